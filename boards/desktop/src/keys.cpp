@@ -122,6 +122,10 @@ namespace otto::board::ui {
     case Key::m: send_key(OKey::master); break;
 
     case Key::n7: send_key(OKey::send); break;
+    case Key::n9: send_key(OKey::looper); break;
+    case Key::n0: send_key(OKey::tuner); break;
+    case Key::o: send_key(OKey::modulation); break;
+    case Key::c: send_key(OKey::clock); break;
 
     case Key::left_shift: [[fallthrough]];
     case Key::right_shift: send_key(OKey::shift); break;
@@ -1,12 +1,17 @@
 #include <csignal>
+#include <cstring>
+#include <optional>
 
 #include "core/audio/midi.hpp"
 
 #include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
+#include "services/session.hpp"
 #include "services/state_manager.hpp"
+#include "services/thread_pool.hpp"
 #include "services/ui_manager.hpp"
 
 #include "board/audio_driver.hpp"
@@ -21,13 +26,21 @@ int handle_exception();
 
 int main(int argc, char* argv[])
 {
+  // `--record FILE` records the input of the session, see services/session.hpp
+  std::optional<fs::path> record_path;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (std::strcmp(argv[i], "--record") == 0) record_path = argv[i + 1];
+  }
+
   try {
     Application app {
       [&] { return std::make_unique<LogManager>(argc, argv); },
+      ThreadPool::create_default,
       StateManager::create_default,
       std::make_unique<PresetManager>,
       std::make_unique<RTAudioAudioManager>,
       std::make_unique<GLFWUIManager>,
+      std::make_unique<ClockManager>,
       EngineManager::create_default
     };
 
@@ -38,7 +51,9 @@ int main(int argc, char* argv[])
 
     app.engine_manager->start();
     app.audio_manager->start();
+    if (record_path) session::start_recording(*record_path);
     app.ui_manager->main_ui_loop();
+    session::stop_recording();
 
   } catch (const char* e) {
     return handle_exception(e);
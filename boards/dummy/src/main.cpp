@@ -3,10 +3,12 @@
 #include "core/audio/midi.hpp"
 
 #include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
 #include "services/state_manager.hpp"
+#include "services/thread_pool.hpp"
 #include "services/ui_manager.hpp"
 
 using namespace otto;
@@ -26,10 +28,12 @@ int main(int argc, char* argv[])
 {
   try {
     Application app{[&] { return std::make_unique<LogManager>(argc, argv); },
+                    ThreadPool::create_default,
                     StateManager::create_default,
                     std::make_unique<PresetManager>,
                     std::make_unique<AudioManager>,
                     std::make_unique<DummyUIManager>,
+                    std::make_unique<ClockManager>,
                     EngineManager::create_default};
 
     // Overwrite the logger signal handlers
@@ -16,6 +16,7 @@
 #include "services/audio.hpp"
 #include "services/engines.hpp"
 #include "services/logger.hpp"
+#include "services/session.hpp"
 
 namespace otto::service::audio {
   namespace {
@@ -111,6 +112,7 @@ namespace otto::service::audio {
 
   void JackAudioDriver::send_midi_event(core::midi::AnyMidiEvent evt) noexcept
   {
+    services::session::record_midi(evt);
     midi_bufs.outer().emplace_back(std::move(evt));
   }
 
@@ -295,7 +297,7 @@ namespace otto::service::audio {
     TIME_SCOPE("JackAudio::Process");
 
     if ((size_t) nframes > bufferSize) {
-      LOGE("Jack requested more frames than expected");
+      RT_LOGE("Jack requested more frames than expected");
       return;
     }
 
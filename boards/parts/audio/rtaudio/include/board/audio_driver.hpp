@@ -36,6 +36,8 @@ namespace otto::services {
     std::optional<RtMidiOut> midi_out = std::nullopt;
 
     unsigned buffer_size = 256;
+    /// Frames from the callback to the output, as reported by RtAudio
+    long output_latency = 0;
   };
 
 } // namespace otto::service::audio
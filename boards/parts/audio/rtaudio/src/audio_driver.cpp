@@ -12,7 +12,9 @@
 
 #include "services/audio_manager.hpp"
 #include "services/engine_manager.hpp"
+#include "services/latency.hpp"
 #include "services/log_manager.hpp"
+#include "services/metrics.hpp"
 
 namespace otto::services {
 
@@ -61,6 +63,8 @@ namespace otto::services {
                         this,
 			&options);
       buffer_pool().set_buffer_size(buffer_size);
+      output_latency = client.getStreamLatency();
+      DLOGI("Stream latency: {} frames", output_latency);
       client.startStream();
     } catch (RtAudioError& e) {
       e.printMessage();
@@ -91,9 +95,14 @@ namespace otto::services {
       }
     }
 
+    // Keep sysex and active sensing ignored, but let clock and transport
+    // messages through
+    midi_in->ignoreTypes(true, false, true);
     midi_in->setCallback(
       [](double timeStamp, std::vector<unsigned char>* message, void* userData) {
         auto& self = *static_cast<RTAudioAudioManager*>(userData);
+        // `timeStamp` is the time since the previous message, so the event
+        // is stamped with the time of the callback instead
         try {
         self.send_midi_event(core::midi::from_bytes(*message));
         } catch (util::exception& e) {
@@ -117,11 +126,17 @@ namespace otto::services {
     }
 
     if ((unsigned) nframes > buffer_size) {
-      LOGE("RTAudio requested more frames than expected");
+      RT_LOGE("RTAudio requested more frames than expected");
       return 0;
     }
 
+    if (stream_status & (RTAUDIO_INPUT_OVERFLOW | RTAUDIO_OUTPUT_UNDERFLOW)) {
+      metrics::xrun();
+    }
+
     clock::time_point t0 = clock::now();
+    // When the first frame of this block is played
+    const auto output_ns = latency::now() + output_latency * 1'000'000'000 / _samplerate;
 
     midi_bufs.swap();
 
@@ -149,12 +164,15 @@ namespace otto::services {
       }
     }
 
+    latency::block(out.audio[0].data(), out.audio[1].data(), nframes, output_ns, _samplerate);
+
     // return the midi buffer
     midi_bufs.inner() = out.midi.move_vector_out();
 
     clock::time_point t1 = clock::now();
 
     _cpu_time.add(std::chrono::nanoseconds(t1 - t0).count() / (1e9 / float(_samplerate) * nframes) );
+    metrics::audio_callback(t1 - t0, nframes, _samplerate);
 
     return 0;
   }
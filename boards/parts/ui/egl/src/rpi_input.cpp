@@ -1,10 +1,13 @@
 #include <fcntl.h>
 #include <linux/input.h>
+#include <time.h>
 #include <unistd.h>
+#include <optional>
 #include <string>
 #include <thread>
 #include <vector>
 
+#include "services/latency.hpp"
 #include "services/log_manager.hpp"
 #include "services/ui_manager.hpp"
 #include "util/filesystem.hpp"
@@ -59,6 +62,13 @@ namespace otto::services {
     return -1;
   }
 
+  /// The time of `event` in nanoseconds, on the clock set with EVIOCSCLOCKID
+  static std::int64_t event_ns(const input_event& event)
+  {
+    return std::int64_t(event.time.tv_sec) * 1'000'000'000 +
+           std::int64_t(event.time.tv_usec) * 1000;
+  }
+
   std::vector<input_event> read_events(int device)
   {
     struct input_event events[event_buffer_size];
@@ -158,6 +168,13 @@ namespace otto::services {
       throw Application::exception(Application::ErrorCode::input_error, "Could not find a keyboard!");
     }
 
+    // Event times are on the realtime clock by default, and latency stamps are
+    // on the monotonic clock
+    int clock_id = CLOCK_MONOTONIC;
+    const bool monotonic = ioctl(keyboard, EVIOCSCLOCKID, &clock_id) == 0;
+    LOGW_IF(!monotonic, "Could not set the clock of the keyboard, key latency is measured from "
+                        "when the key is read");
+
     while (Application::current().running()) {
       auto events = read_events(keyboard);
       for (const auto& event : events) {
@@ -185,6 +202,9 @@ namespace otto::services {
             }
           }();
 
+          // Notes played by the key are stamped with when the kernel got it
+          std::optional<latency::Arrival> arrival;
+          if (monotonic) arrival.emplace(event_ns(event));
           board::ui::handle_keyevent(action, left | right, board::ui::Key(event.code));
         }
       }
@@ -0,0 +1,27 @@
+#include "midi.hpp"
+
+#include "util/dsp/lookup_tables.hpp"
+
+namespace otto::core::midi {
+
+  util::memory_pool& shared_vector_pool()
+  {
+    // Room for the control block and the vector. A shared_vector lives for
+    // about one buffer, so only a few are in use at once.
+    static util::memory_pool pool(128, 64);
+    return pool;
+  }
+
+  // Defined here, so the tables are only compiled where they are used
+
+  float note_freq(int key) noexcept
+  {
+    return util::dsp::tables::midi_note_freq[key] * detail::tuning_ratio;
+  }
+
+  float note_freq(float note) noexcept
+  {
+    return util::dsp::tables::midi_to_freq(note) * detail::tuning_ratio;
+  }
+
+} // namespace otto::core::midi
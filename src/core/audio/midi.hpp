@@ -2,11 +2,13 @@
 
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <gsl/gsl>
 #include <variant.hpp>
 
 #include "util/algorithm.hpp"
 #include "util/exception.hpp"
+#include "util/pool_allocator.hpp"
 
 #include "services/log_manager.hpp"
 #include "util/utility.hpp"
@@ -15,7 +17,8 @@ namespace otto::core::midi {
 
   namespace detail {
 
-    inline double freq_table[128];
+    /// Ratio of the current tuning to A4 = 440Hz
+    inline float tuning_ratio = 1.f;
 
     constexpr std::array<const char*, 128> note_names = {
       {"C-2", "C#-2", "D-2", "D#-2", "E-2", "F-2", "F#-2", "G-2", "G#-2", "A-2", "A#-2", "B-2",
@@ -70,6 +73,9 @@ namespace otto::core::midi {
 
     int channel;
     int time;
+    /// When the event reached OTTO, in nanoseconds on `services::latency::clock`,
+    /// or 0 if unknown. Not part of the MIDI bytes.
+    std::int64_t timestamp = 0;
   };
 
   struct NoteEvent : MidiEvent {
@@ -160,10 +166,42 @@ namespace otto::core::midi {
     }
   };
 
-  using AnyMidiEvent = mpark::variant<MidiEvent, NoteOnEvent, NoteOffEvent, ControlChangeEvent>;
+  /// A system realtime message, for MIDI clock and transport
+  struct RealtimeEvent {
+    using byte = unsigned char;
+
+    enum class Type : byte {
+      /// 24 per beat
+      Clock = 0xF8,
+      Start = 0xFA,
+      Continue = 0xFB,
+      Stop = 0xFC,
+    };
+
+    Type type;
+    int time = 0;
+
+    std::array<byte, 1> to_bytes()
+    {
+      return {byte(type)};
+    }
+
+    /// Whether `status` is a realtime message that has a @ref Type
+    static constexpr bool is_realtime(byte status) noexcept
+    {
+      return status == 0xF8 || status == 0xFA || status == 0xFB || status == 0xFC;
+    }
+  };
+
+  using AnyMidiEvent =
+    mpark::variant<MidiEvent, NoteOnEvent, NoteOffEvent, ControlChangeEvent, RealtimeEvent>;
 
   inline AnyMidiEvent from_bytes(gsl::span<unsigned char> bytes, int time = 0)
   {
+    // Realtime messages are a single byte
+    if (bytes.size() > 0 && RealtimeEvent::is_realtime(bytes[0])) {
+      return RealtimeEvent{RealtimeEvent::Type{bytes[0]}, time};
+    }
     if (bytes.size() < 3) throw util::exception("Midi event size must be >= 3 bytes");
     auto type = MidiEvent::Type(bytes[0] >> 4);
     auto velocity = bytes[2];
@@ -181,11 +219,13 @@ namespace otto::core::midi {
     }
   }
 
+  /// Set the frequency of A4
+  ///
+  /// The note frequencies themselves are in the compile time table
+  /// @ref util::dsp::tables::midi_note_freq, and scaled by the tuning.
   inline void generateFreqTable(double tuning = 440)
   {
-    for (int i = 0; i < 128; i++) {
-      detail::freq_table[i] = tuning * std::pow(2.0, double(i - 69) / double(12));
-    }
+    detail::tuning_ratio = tuning / 440.0;
   }
 
   constexpr const char* note_name(int key) noexcept
@@ -193,10 +233,17 @@ namespace otto::core::midi {
     return detail::note_names[key];
   }
 
-  inline float note_freq(int key) noexcept
-  {
-    return detail::freq_table[key];
-  }
+  float note_freq(int key) noexcept;
+
+  /// Frequency of a fractional note, with cent resolution
+  float note_freq(float note) noexcept;
+
+  /// The pool the lists of every @ref shared_vector are allocated from
+  ///
+  /// The audio thread makes a new @ref shared_vector for the events of every
+  /// buffer, so they are taken from this pool instead of the heap. It is
+  /// sized the first time it is used, which the AudioManager does at startup.
+  util::memory_pool& shared_vector_pool();
 
   template<typename T, typename Allocator = std::allocator<T>>
   struct shared_vector {
@@ -207,11 +254,11 @@ namespace otto::core::midi {
 
     shared_vector() = default;
 
-    shared_vector(vector_type&& other) : _data(std::make_shared<vector_type>(std::move(other))) {}
+    shared_vector(vector_type&& other) : _data(make_data(std::move(other))) {}
 
-    shared_vector(const vector_type& other) : _data(std::make_shared<vector_type>(other)) {}
+    shared_vector(const vector_type& other) : _data(make_data(other)) {}
 
-    shared_vector(const allocator_type& alloc) : _data(std::make_shared<vector_type>(alloc)) {}
+    shared_vector(const allocator_type& alloc) : _data(make_data(alloc)) {}
 
     auto begin()
     {
@@ -300,7 +347,20 @@ namespace otto::core::midi {
     }
 
   private:
-    std::shared_ptr<vector_type> _data = std::make_shared<vector_type>();
+    /// Allocate the list from @ref shared_vector_pool, or from the heap if
+    /// the pool is exhausted
+    template<typename... Args>
+    static std::shared_ptr<vector_type> make_data(Args&&... args)
+    {
+      try {
+        return std::allocate_shared<vector_type>(
+          util::pool_allocator<vector_type>(shared_vector_pool()), std::forward<Args>(args)...);
+      } catch (std::bad_alloc&) {
+        return std::make_shared<vector_type>(std::forward<Args>(args)...);
+      }
+    }
+
+    std::shared_ptr<vector_type> _data = make_data();
   };
 
 
@@ -185,9 +185,9 @@ namespace otto::core::audio {
     {
       for (std::size_t i = 0; i < reference_counts.size(); i++) {
         if (reference_counts[i] < 1) {
-          if (i > _max_val) {
-            LOGI("Using {} buffers", i + 1);
-            _max_val = i;
+          if (i >= _high_water) {
+            _high_water = i + 1;
+            RT_LOGI("Using {} buffers", _high_water);
           }
           reference_counts[i] = 0;
           int index = i * buffer_size;
@@ -224,6 +224,24 @@ namespace otto::core::audio {
       reserve(number_of_buffers);
     }
 
+    /// The number of frames in each buffer
+    std::size_t buffer_frames() const noexcept
+    {
+      return buffer_size;
+    }
+
+    /// The most buffers that have been in use at once
+    std::size_t high_water() const noexcept
+    {
+      return _high_water;
+    }
+
+    /// The bytes used by the buffers and their reference counts
+    std::size_t bytes() const noexcept
+    {
+      return _avaliable_buffers * (buffer_size * sizeof(float) + sizeof(int));
+    }
+
   private:
     void reserve(std::size_t n) noexcept
     {
@@ -236,7 +254,7 @@ namespace otto::core::audio {
     std::vector<int> reference_counts;
     std::size_t _avaliable_buffers = 0;
     std::unique_ptr<float[]> data;
-    std::size_t _max_val = -1;
+    std::size_t _high_water = 0;
   };
 
   /// Non-owning package of data passed to audio processors
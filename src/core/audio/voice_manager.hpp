@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <gsl/gsl_util>
 #include <queue>
@@ -14,6 +15,8 @@
 #include "core/props/props.hpp"
 #include "core/ui/screen.hpp"
 
+#include "services/metrics.hpp"
+
 namespace otto::core::audio {
 
   using Voice = int;
@@ -236,6 +239,8 @@ namespace otto::core::audio {
                   [this](midi::NoteOffEvent& ev) { stop_voice(gsl::narrow_cast<char>(ev.key)); },
                   [](auto&&) {});
     }
+    services::metrics::voices(std::count_if(voices.begin(), voices.end(),
+                                            [](VoiceProps& vp) { return vp.midi.trigger.get(); }));
   }
 
   template<int N>
@@ -2,6 +2,8 @@
 
 #include "engine_selector_screen.hpp"
 #include "services/engine_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/memory.hpp"
 #include "services/preset_manager.hpp"
 
 #include <thread>
@@ -47,10 +49,19 @@ namespace otto::core::engine {
   template<EngineType ET>
   Engine<ET>& EngineDispatcher<ET>::select(const EngineFactory& fact)
   {
+    namespace memory = services::memory;
     auto save_it = _current;
-    _current = fact.construct();
-    _current_factory = &fact;
-    _current->from_json(fact.data);
+    {
+      memory::Measure measure;
+      _current = fact.construct();
+      _current_factory = &fact;
+      _current->from_json(fact.data);
+      _memory_charge = memory::Charge(fact.name, memory::Kind::heap, measure.bytes());
+    }
+    if constexpr (memory::enabled) {
+      auto& account = memory::account(fact.name);
+      LOGI("Selected {}, using {}", fact.name, memory::format_bytes(account.total()));
+    }
     // TODO:
     // So sorry about this hack, its awful.
     // If we dont wait to destruct the old engine, the audio thread might still be using it.
@@ -78,6 +89,12 @@ namespace otto::core::engine {
     return *_current;
   }
 
+  template<EngineType ET>
+  std::size_t EngineDispatcher<ET>::engine_count() const noexcept
+  {
+    return _factories.size();
+  }
+
   template<EngineType ET>
   Engine<ET>& EngineDispatcher<ET>::select(std::size_t idx)
   {
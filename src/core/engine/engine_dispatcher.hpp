@@ -1,6 +1,7 @@
 #pragma once
 
 #include "core/engine/engine.hpp"
+#include "services/memory.hpp"
 
 namespace otto::core::engine {
 
@@ -12,6 +13,11 @@ namespace otto::core::engine {
       virtual AnyEngine* current() = 0;
       virtual const AnyEngine* current() const = 0;
 
+      /// The number of engines that can be selected
+      virtual std::size_t engine_count() const noexcept = 0;
+      /// Select engine by index
+      virtual AnyEngine& select(std::size_t idx) = 0;
+
       virtual ~IEngineDispatcher() = default;
   };
 
@@ -57,8 +63,10 @@ namespace otto::core::engine {
     /// If the name is the same as the already selected engine, that engine is returned instead.
     Engine<ET>& select(const EngineFactory&);
 
+    std::size_t engine_count() const noexcept override;
+
     /// Select engine by index
-    Engine<ET>& select(std::size_t idx);
+    Engine<ET>& select(std::size_t idx) override;
 
     /// Select engine by name
     ///
@@ -87,6 +95,8 @@ namespace otto::core::engine {
     std::vector<EngineFactory> _factories;
     const EngineFactory* _current_factory = nullptr;
     std::shared_ptr<Engine<ET>> _current = nullptr;
+    /// What the current engine allocated while it was constructed
+    services::memory::Charge _memory_charge;
     std::unique_ptr<ui::Screen> _selector_screen = nullptr;
   };
 
@@ -2,13 +2,18 @@
 
 #include "core/ui/vector_graphics.hpp"
 
-#include "util/cache.hpp"
+#include "engines/synths/sampler/sampler.hpp"
+
+#include "util/dsp/resampler.hpp"
 #include "util/iterator.hpp"
+#include "util/library_index.hpp"
+#include "util/math.hpp"
+#include "util/soundfile.hpp"
 #include "util/utility.hpp"
 
-#include "core/audio/voice_manager.hpp"
+#include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
 #include "services/log_manager.hpp"
-#include "services/state_manager.hpp"
 
 namespace otto::engines {
 
@@ -21,16 +26,116 @@ namespace otto::engines {
     using EngineScreen<Sequencer>::EngineScreen;
 
     void draw(Canvas& ctx) override;
-    bool keypress(Key key) override;
     void rotary(RotaryEvent e) override;
+    void on_show() override;
+    void on_hide() override;
   };
 
-  Sequencer::Sequencer() : MiscEngine("Sequencer", props, std::make_unique<SequencerScreen>(this))
-  {}
+  Sequencer::Sequencer() : MiscEngine("Drums", props, std::make_unique<SequencerScreen>(this))
+  {
+    for (auto& s : _samples) s = nullptr;
+    for (int i = 0; i < number_of_channels; i++) {
+      props.channels[i].file.on_change().connect(
+        [this, i](const std::string& file) { load_file(i, file); });
+    }
+  }
+
+  Sequencer::~Sequencer()
+  {
+    for (auto& task : _loading) {
+      if (!task.valid()) continue;
+      task.cancel();
+      task.wait();
+    }
+  }
+
+  void Sequencer::load_file(int channel, const std::string& file)
+  {
+    auto& loading = _loading[channel];
+    if (loading.valid()) loading.cancel();
+    {
+      std::unique_lock lock(_mutex);
+      if (file.empty()) {
+        _samples[channel] = nullptr;
+        sweep_store();
+        return;
+      }
+      if (auto found = _store.find(file); found != _store.end()) {
+        _samples[channel] = found->second.get();
+        sweep_store();
+        return;
+      }
+    }
+    loading = Application::current().thread_pool->submit([this, channel, file] {
+      auto path = sample_library().root() / file;
+      auto sample = std::make_unique<Sample>();
+      try {
+        util::SoundFile sf;
+        sf.open(path);
+        // Only the first channel
+        std::vector<float> interleaved;
+        interleaved.reserve(sf.length());
+        sf.read_samples(std::back_inserter(interleaved), sf.length());
+        for (std::size_t i = 0; i < interleaved.size(); i += sf.info.channels) {
+          sample->audio.push_back(interleaved[i]);
+        }
+        if (int rate = Application::current().audio_manager->samplerate(); sf.info.samplerate != rate) {
+          sample->audio = util::dsp::resample(sample->audio, sf.info.samplerate, rate);
+        }
+      } catch (util::exception& e) {
+        LOGE("Could not load sample {}: {}", path.string(), e.what());
+        return;
+      }
+      if (services::ThreadPool::cancelled()) return;
+      sample->audio.shrink_to_fit();
+      sample->memory = services::memory::Charge(name(), services::memory::Kind::assets,
+                                                services::memory::bytes_of(sample->audio));
+
+      std::unique_lock lock(_mutex);
+      // Another channel may have loaded it in the meantime
+      auto& stored = _store[file];
+      if (!stored) stored = std::move(sample);
+      _samples[channel] = stored.get();
+      sweep_store();
+    });
+  }
+
+  void Sequencer::sweep_store()
+  {
+    for (auto it = _store.begin(); it != _store.end();) {
+      auto used = util::any_of(_samples, [&](auto& s) { return s.load() == it->second.get(); });
+      if (used) {
+        it++;
+        continue;
+      }
+      _unused.push_back(std::move(it->second));
+      it = _store.erase(it);
+    }
+    if (auto* unplayed = _unplayed.exchange(nullptr)) {
+      util::erase_if(_unused, [&](auto& s) { return s.get() == unplayed; });
+    }
+    // The audio thread checks one sample at a time
+    if (_checking.load() == nullptr && !_unused.empty()) _checking = _unused.back().get();
+  }
+
+  void Sequencer::select_file(int offset)
+  {
+    auto& file = props.channels[props.channel].file;
+    auto entries = sample_library().entries();
+    std::vector<const util::LibraryIndex::Entry*> files;
+    for (auto& e : *entries) {
+      if (e.is_audio()) files.push_back(&e);
+    }
+    if (files.empty()) return;
+    auto current = util::find_if(files, [&](auto* e) { return e->path.string() == file.get(); });
+    int idx = current == files.end() ? 0 : (current - files.begin()) + offset;
+    idx = std::clamp(idx, 0, int(files.size()) - 1);
+    file = files[idx]->path.string();
+  }
 
+  /// The step of a white key, or the channel of a black key
   std::pair<bool, int> get_sequencer_number(int key)
   {
-    DLOGI("Raw key: {}", key);
     int octave_pos = (key + 7) % 12;
     std::array<std::pair<bool, int>, 12> octave = {{{true, 0},
                                                     {false, 0},
@@ -53,70 +158,69 @@ namespace otto::engines {
 
   audio::ProcessData<1> Sequencer::process(audio::ProcessData<0> data)
   {
-    for (auto& event : data.midi) {
-      util::match(event,
-                  [&](midi::NoteOnEvent& ev) {
-                    auto key = get_sequencer_number((int) ev.key);
-                    if (key.first) {
-                      int step = (key.second - 21) % 16;
-                      DLOGI("White key: step {}", step);
-                      channels[current_channel].triggers[step] =
-                        !channels[current_channel].triggers[step];
-                    } else {
-                      current_channel = (key.second - 16) % 16;
-                      DLOGI("Changing channel: {}", current_channel);
-                    }
-                  },
-                  [](auto&&) {});
-    }
-
-    if (_running) _next_beat = _samples_per_beat - _counter;
-
-
-    if (_next_beat <= data.nframes) {
-      _beat++;
-      for (auto& chan : channels) {
-        if (chan.triggers[_beat]) {
-          // Reset and trigger appropriate samples
-          chan.sampler.restart();
-        }
+    if (_editing) {
+      for (auto& event : data.midi) {
+        util::match(event,
+                    [&](midi::NoteOnEvent& ev) {
+                      auto [white, number] = get_sequencer_number((int) ev.key);
+                      if (white) {
+                        props.channels[props.channel].toggle(util::math::modulo(number - 21, number_of_steps));
+                      } else {
+                        props.channel = util::math::modulo(number - 16, number_of_channels);
+                      }
+                    },
+                    [](auto&&) {});
       }
     }
 
-    auto buf = Application::current().audio_manager->buffer_pool().allocate();
-    for (auto&& frm : buf) {
-      for (auto& chan : channels) {
-        frm += chan.sampler();
+    // Start the voices of every step in this block at its offset
+    const int nframes = data.nframes;
+    auto& clock = Application::current().clock_manager->block();
+    clock.for_each(0.25, [&](int frame, std::int64_t idx) {
+      const int step = idx % number_of_steps;
+      for (int i = 0; i < number_of_channels; i++) {
+        auto& chan = props.channels[i];
+        const Sample* sample = _samples[i].load(std::memory_order_acquire);
+        if (sample == nullptr || !chan.step(step)) continue;
+        _voices.trigger(sample->audio, chan.volume, frame);
       }
-    }
+      _shown_step = step;
+    });
+    if (!clock.running()) _shown_step = -1;
 
-    _counter += data.nframes;
-    _counter %= _samples_per_beat;
+    auto buf = Application::current().audio_manager->buffer_pool().allocate_clear();
+    _voices.process({buf.data(), nframes});
 
+    // No channel uses the sample being checked any more, so no new voices
+    // play it, and it can be freed when the last one has finished
+    auto* checking = _checking.load(std::memory_order_acquire);
+    if (checking && !_unplayed.load(std::memory_order_relaxed) &&
+        !_voices.playing(checking->audio)) {
+      _unplayed.store(checking, std::memory_order_release);
+      _checking.store(nullptr, std::memory_order_release);
+    }
     return data.redirect(buf);
   }
 
-  bool SequencerScreen::keypress(ui::Key key)
+  // SCREEN //
+
+  void SequencerScreen::on_show()
   {
-    switch (key) {
-    case ui::Key::play: {
-      engine._running = !engine._running;
-      engine._beat = 0;
-      engine._next_beat = engine._samples_per_beat;
-      engine._counter = engine._samples_per_beat;
-      break;
-    }
-    default: return false; ;
-    }
-    return true;
+    engine._editing = true;
+  }
+
+  void SequencerScreen::on_hide()
+  {
+    engine._editing = false;
   }
 
   void SequencerScreen::rotary(ui::RotaryEvent ev)
   {
+    auto& props = engine.props;
     switch (ev.rotary) {
-    case Rotary::blue: [[fallthrough]];
-    case Rotary::green: [[fallthrough]];
-    case Rotary::yellow: [[fallthrough]];
+    case Rotary::blue: props.channel.step(ev.clicks); break;
+    case Rotary::green: engine.select_file(ev.clicks); break;
+    case Rotary::yellow: props.channels[props.channel].volume.step(ev.clicks); break;
     case Rotary::red: break;
     }
   }
@@ -125,26 +229,47 @@ namespace otto::engines {
   {
     using namespace ui::vg;
 
-    int pad = 10;
+    auto& props = engine.props;
+    const int current = props.channel;
+    const int playing = engine._shown_step;
+
+    {
+      std::unique_lock lock(engine._mutex);
+      engine.sweep_store();
+    }
+
+    constexpr float pad = 10;
+    constexpr float top = 40;
+    constexpr float x_sp = (width - 2 * pad) / Sequencer::number_of_steps;
+    constexpr float y_sp = (height - top - pad) / Sequencer::number_of_channels;
 
-    int x_sp = (width - 2 * pad) / 16;
-    int y_sp = (height - 2 * pad) / engine.number_of_channels;
+    auto& chan = props.channels[current];
+    ctx.font(Fonts::Norm, 18);
+    ctx.beginPath();
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillStyle(Colours::Blue);
+    ctx.fillText(fmt::format("{}", current + 1), {pad, 20});
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(chan.file.get().empty() ? std::string("NO SAMPLE") : chan.file.get(), {pad + 30, 20});
+    ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+    ctx.fillStyle(Colours::Yellow);
+    ctx.fillText(fmt::format("{:.0f}", chan.volume * 100), {width - pad, 20});
 
-    for (int i = 0; i < engine.number_of_channels; i++) {
-      for (int j = 0; j < 16; j++) {
-        int x = pad + j * x_sp;
-        int y = pad + i * y_sp;
+    for (int i = 0; i < Sequencer::number_of_channels; i++) {
+      for (int j = 0; j < Sequencer::number_of_steps; j++) {
+        Point p = {pad + (j + 0.5f) * x_sp, top + (i + 0.5f) * y_sp};
+        bool on = props.channels[i].step(j);
         ctx.beginPath();
-        ctx.circle(x, y, 5);
-        if (engine.channels[i].triggers[j] && engine.current_channel != i)
+        ctx.circle(p, j == playing ? 6 : 5);
+        if (on && current != i)
           ctx.fill(Colours::Pink);
-        else if (engine.channels[i].triggers[j] && engine.current_channel == i)
+        else if (on && current == i)
           ctx.fill(Colours::Blue);
-        else if (!engine.channels[i].triggers[j] && engine.current_channel == i)
+        else if (current == i)
           ctx.fill(Colours::Gray70);
         else
           ctx.fill(Colours::Gray50);
       }
     }
   }
-}; // namespace otto::engines
+} // namespace otto::engines
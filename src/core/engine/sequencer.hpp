@@ -1,48 +1,114 @@
 #pragma once
 
-#include <core/props/props.hpp>
-#include "util/filesystem.hpp"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "core/props/props.hpp"
 #include "engine.hpp"
-#include "engines/synths/sampler/sampler.hpp"
-
-
-namespace otto::engines {
 
-    using namespace otto::core;
-    using namespace otto::core::props;
+#include "services/memory.hpp"
+#include "services/thread_pool.hpp"
 
-    struct Sequencer : engine::MiscEngine {
-
-        static constexpr int number_of_channels = 10;
-        int current_channel = 0;
+#include "util/dsp/sample_voices.hpp"
+#include "util/filesystem.hpp"
 
-        struct Props : Properties<> {
+namespace otto::engines {
 
-        } props;
+  using namespace otto::core;
+  using namespace otto::core::props;
+
+  /// Step sequencer for drum samples
+  ///
+  /// Each channel plays one sample from the sample library on its steps. The
+  /// samples are loaded once into a store shared by all channels, and played
+  /// by one pool of voices, so a channel costs no more than its active
+  /// voices. Samples no channel uses are freed once no voice plays them. Steps are the sixteenth notes of the transport, and start their
+  /// voices at the exact sample they fall on.
+  struct Sequencer : engine::MiscEngine {
+    static constexpr int number_of_channels = 10;
+    static constexpr int number_of_steps = 16;
+
+    struct Channel : Properties<> {
+      Property<std::string> file = {this, "FILENAME", ""};
+      Property<float> volume = {this, "VOLUME", 1, has_limits::init(0, 1), steppable::init(0.01)};
+      /// One bit per step
+      Property<int> steps = {this, "STEPS", 0};
+
+      bool step(int idx) const noexcept
+      {
+        return (steps.get() >> idx) & 1;
+      }
+
+      void toggle(int idx)
+      {
+        steps = steps.get() ^ (1 << idx);
+      }
+
+      Channel(int n) : branch_base(nullptr, fmt::format("Channel {}", n)){};
+    };
 
-        struct Channel {
-            Sampler sampler;
-            std::array<bool, 16> triggers = {false};
+    struct Props : Properties<> {
+      Property<int, wrap> channel = {this, "Channel", 0, has_limits::init(0, number_of_channels - 1)};
+      std::array<Channel, number_of_channels> channels =
+        util::generate_array<number_of_channels>([](int n) { return Channel(n); });
 
-        };
+      Props()
+      {
+        for (auto& c : channels) channels_props.push_back(c);
+      }
 
-        std::array<Channel, number_of_channels> channels;
+      Properties<> channels_props = {this, "Channels"};
+    } props;
 
-        Sequencer();
+    Sequencer();
+    ~Sequencer();
 
-        audio::ProcessData<1> process(audio::ProcessData<0>);
+    audio::ProcessData<1> process(audio::ProcessData<0>);
 
-    private:
-        friend struct SequencerScreen;
-        int _beat = 0;
-        int _samples_per_beat = 22050 / 4;
-        int _next_beat = _samples_per_beat;
-        int _counter = _samples_per_beat;
-        bool _should_run = false;
-        bool _running = false;
+  private:
+    friend struct SequencerScreen;
 
+    /// A loaded sample, resampled to the engine samplerate
+    struct Sample {
+      std::vector<float> audio;
+      services::memory::Charge memory;
     };
-};
-
 
+    /// Load the sample for `channel`, or take it from the store
+    void load_file(int channel, const std::string& file);
+    /// Select the sound file `offset` entries away from the one of the
+    /// current channel in the sample library
+    void select_file(int offset);
+    /// Move samples no channel uses out of the store, and free those the
+    /// audio thread no longer plays
+    ///
+    /// Called with @ref _mutex held, by the screen and the loading tasks.
+    void sweep_store();
+
+    /// Guards @ref _store and @ref _unused, which are only used by the screen
+    /// and the loading tasks
+    std::mutex _mutex;
+    /// The samples used by a channel, by file name
+    std::map<std::string, std::unique_ptr<Sample>> _store;
+    /// Samples no channel uses, which voices may still be playing
+    std::vector<std::unique_ptr<Sample>> _unused;
+    /// The sample of each channel, read by the audio thread
+    std::array<std::atomic<const Sample*>, number_of_channels> _samples = {};
+    std::array<services::ThreadPool::Task, number_of_channels> _loading;
+
+    /// One of @ref _unused, for the audio thread to check
+    std::atomic<const Sample*> _checking = nullptr;
+    /// Set by the audio thread when @ref _checking is not playing any more
+    std::atomic<const Sample*> _unplayed = nullptr;
+
+    util::dsp::SampleVoices _voices;
+
+    /// The step playing, for the screen, or `-1` when stopped
+    std::atomic<int> _shown_step = -1;
+    /// Whether notes edit the steps, while the screen is shown
+    std::atomic<bool> _editing = false;
+  };
+} // namespace otto::engines
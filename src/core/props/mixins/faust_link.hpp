@@ -1,11 +1,14 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "util/utility.hpp"
 
 #include "../internal/mixin_macros.hpp"
 #include "../internal/property.hpp"
+#include "has_limits.hpp"
 
 #include "services/log_manager.hpp"
 #include "util/algorithm.hpp"
@@ -25,6 +28,13 @@ namespace otto::core::props {
                                std::vector<std::string>::const_iterator last,
                                FaustLink) = 0;
     virtual void clear() = 0;
+    /// Whether the value is sent to faust, so @ref modulate has an effect
+    virtual bool linked() const = 0;
+    /// Offset the value sent to faust, without changing the property
+    ///
+    /// `amount` is a fraction of the range of the property if it has
+    /// limits, and is added as it is otherwise. `0` sends the value itself.
+    virtual void modulate(float amount) = 0;
   };
 
   OTTO_PROPS_MIXIN_BRANCH (faust_link) {
@@ -56,6 +66,16 @@ namespace otto::core::props {
         if (itf.is<faust_link>()) itf.as<faust_link>().clear();
       }
     }
+
+    bool linked() const override
+    {
+      return util::any_of(children(), [](const property_base& p) {
+        return p.is<faust_link>() && p.as<faust_link>().linked();
+      });
+    }
+
+    /// Branches have no value to modulate
+    void modulate(float) override {}
   };
 
   OTTO_PROPS_MIXIN_LEAF (faust_link) {
@@ -97,6 +117,40 @@ namespace otto::core::props {
       faust_links_.clear();
     }
 
+    bool linked() const override
+    {
+      return type_ == FaustLink::Type::ToFaust && !faust_links_.empty();
+    }
+
+    void modulate(float amount) override
+    {
+      if constexpr (std::is_arithmetic_v<value_type>) {
+        if (type_ != FaustLink::Type::ToFaust) return;
+        auto& prop = dynamic_cast<property_type&>(*this);
+        double value = prop.get();
+        if constexpr (property_type::template is<has_limits>) {
+          auto& limits = prop.template as<has_limits>();
+          double range = double(limits.max) - double(limits.min);
+          // Limits that were never set are the whole range of the type
+          if (range < 1e9) {
+            value = std::clamp(value + amount * range, double(limits.min), double(limits.max));
+          } else {
+            value += amount;
+          }
+        } else {
+          value += amount;
+        }
+        if constexpr (std::is_same_v<value_type, bool>) {
+          value = value >= 0.5;
+        } else if constexpr (std::is_integral_v<value_type>) {
+          value = std::round(value);
+        }
+        for (auto&& fl : faust_links_) {
+          *fl = value;
+        }
+      }
+    }
+
     void on_hook(hook<common::hooks::on_set, HookOrder::After> & hook)
     {
       if (type_ == FaustLink::Type::ToFaust) {
@@ -33,6 +33,10 @@ namespace otto::core::ui {
     master,
 
     send,
+    looper,
+    tuner,
+    modulation,
+    clock,
 
     /// Number of keys
     n_keys,
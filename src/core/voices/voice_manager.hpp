@@ -220,6 +220,10 @@ namespace otto::core::voices {
     Voice* handle_midi_off(const midi::NoteOffEvent&) noexcept;
 
     /// Process audio, applying Preprocessing, each voice and then postprocessing
+    ///
+    /// Note events take effect at the frame of their `time`. They are
+    /// expected in order of time, and an event out of order waits for the
+    /// one before it.
     audio::ProcessData<1> process(audio::ProcessData<1> data) noexcept;
 
   private:
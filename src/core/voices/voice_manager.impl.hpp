@@ -1,6 +1,7 @@
 #pragma once
 
 #include "services/audio_manager.hpp"
+#include "services/metrics.hpp"
 #include "voice_manager.hpp"
 
 namespace otto::core::voices {
@@ -157,14 +158,23 @@ namespace otto::core::voices {
   template<typename V, int N>
   audio::ProcessData<1> VoiceManager<V, N>::process(audio::ProcessData<1> data) noexcept
   {
-    for (auto& evt : data.midi) {
+    auto handle = [&](midi::AnyMidiEvent& evt) {
       util::match(evt, [&](midi::NoteOnEvent& evt) { handle_midi_on(evt); },
                   [&](midi::NoteOffEvent& evt) { handle_midi_off(evt); }, [](auto&) {});
-    }
+    };
+    auto time = [](midi::AnyMidiEvent& evt) { return util::match(evt, [](auto& e) { return e.time; }); };
+
+    auto evt = data.midi.begin();
+    const auto last = data.midi.end();
     auto buf = Application::current().audio_manager->buffer_pool().allocate();
-    for (auto& frm : buf) {
-      frm = (*this)();
+    for (int i = 0; i < int(buf.size()); i++) {
+      for (; evt != last && time(*evt) <= i; ++evt) handle(*evt);
+      buf[i] = (*this)();
     }
+    // Events timed after this block
+    for (; evt != last; ++evt) handle(*evt);
+    services::metrics::voices(
+      std::count_if(voices_.begin(), voices_.end(), [](Voice& v) { return v.is_triggered(); }));
     return data.redirect(buf);
   }
 
@@ -180,13 +190,13 @@ namespace otto::core::voices {
     } else {
       auto found = util::find_if(note_stack, [](NoteVoicePair& nvp) { return nvp.has_voice(); });
       if (found != note_stack.end()) {
-        DLOGI("Stealing voice {} from key {}", (found->voice - voices_.data()), found->note);
+        RT_DLOGI("Stealing voice {} from key {}", (found->voice - voices_.data()), found->note);
         Voice& v = *found->voice;
         v.release();
         found->voice = nullptr;
         return v;
       } else {
-        DLOGE("No voice found. Using voice 0");
+        RT_DLOGE("No voice found. Using voice 0");
         return voices_[0];
       }
     }
@@ -0,0 +1,285 @@
+#include "convolution.hpp"
+
+#include <cmath>
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "services/audio_manager.hpp"
+
+#include "util/dsp/resampler.hpp"
+#include "util/iterator.hpp"
+#include "util/library_index.hpp"
+#include "util/soundfile.hpp"
+#include "util/utility.hpp"
+
+namespace otto::engines {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  struct ConvolutionScreen : EngineScreen<Convolution> {
+    void draw(Canvas& ctx) override;
+    void rotary(RotaryEvent e) override;
+
+    using EngineScreen<Convolution>::EngineScreen;
+  };
+
+  /// The impulse response library, shared by all instances
+  static util::LibraryIndex& impulse_library()
+  {
+    static util::LibraryIndex library{Application::current().data_dir / "impulses",
+                                      {".wav"},
+                                      Application::current().data_dir / ".impulse-library.json"};
+    return library;
+  }
+
+  /// Number of points in the overview drawn on the screen
+  constexpr std::size_t overview_size = 150;
+
+  std::size_t Convolution::ImpulseResponse::size() const noexcept
+  {
+    return channels.empty() ? 0 : channels.front().size();
+  }
+
+  Convolution::Convolution()
+    : EffectEngine("Convolution", props, std::make_unique<ConvolutionScreen>(this))
+  {
+    props.file.on_change().connect(
+      [this](const std::string& file) { load_file(impulse_library().root() / file); });
+    props.length.on_change().connect([this](float) { rebuild(); });
+    props.predelay.on_change().connect([this](float) { rebuild(); });
+  }
+
+  Convolution::~Convolution()
+  {
+    if (_loading.valid()) {
+      _loading.cancel();
+      _loading.wait();
+    }
+    delete _pending.exchange(nullptr);
+    delete _retired.exchange(nullptr);
+    delete _current;
+  }
+
+  void Convolution::load_file(fs::path path)
+  {
+    if (_loading.valid()) _loading.cancel();
+    _loading_file = true;
+    _loading = Application::current().thread_pool->submit([this, path = std::move(path)] {
+      auto ir = std::make_shared<ImpulseResponse>();
+      try {
+        util::SoundFile sf;
+        sf.open(path);
+        int channels = std::clamp(sf.info.channels, 1, 2);
+        std::vector<float> interleaved;
+        interleaved.reserve(sf.length());
+        sf.read_samples(std::back_inserter(interleaved), sf.length());
+        ir->channels.resize(channels);
+        for (int c = 0; c < channels; c++) {
+          auto& ch = ir->channels[c];
+          for (std::size_t i = c; i < interleaved.size(); i += sf.info.channels) {
+            ch.push_back(interleaved[i]);
+          }
+          if (int rate = Application::current().audio_manager->samplerate();
+              sf.info.samplerate != rate) {
+            ch = util::dsp::resample(ch, sf.info.samplerate, rate);
+          }
+        }
+      } catch (util::exception& e) {
+        LOGE("Could not load impulse response {}: {}", path.string(), e.what());
+        ir->channels.clear();
+      }
+      if (services::ThreadPool::cancelled()) return;
+
+      // Normalize the loudest channel to unit energy
+      double energy = 0;
+      for (auto& ch : ir->channels) {
+        double sum = 0;
+        for (float s : ch) sum += double(s) * s;
+        energy = std::max(energy, sum);
+      }
+      if (energy > 0) {
+        float gain = 1 / std::sqrt(energy);
+        for (auto& ch : ir->channels) {
+          for (auto& s : ch) s *= gain;
+        }
+      }
+      std::size_t bytes = 0;
+      for (auto& ch : ir->channels) bytes += services::memory::bytes_of(ch);
+      ir->memory = services::memory::Charge(name(), services::memory::Kind::assets, bytes);
+
+      {
+        std::unique_lock lock(_mutex);
+        _ir = ir;
+      }
+      build_kernel(*ir);
+    });
+  }
+
+  void Convolution::rebuild()
+  {
+    std::shared_ptr<const ImpulseResponse> ir;
+    {
+      std::unique_lock lock(_mutex);
+      ir = _ir;
+    }
+    if (!ir) return;
+    // A file being loaded is built with the new settings anyway
+    if (_loading_file && _loading.valid() &&
+        (_loading.state() == services::ThreadPool::Task::State::queued ||
+         _loading.state() == services::ThreadPool::Task::State::running)) {
+      return;
+    }
+    if (_loading.valid()) _loading.cancel();
+    _loading_file = false;
+    _loading = Application::current().thread_pool->submit([this, ir] { build_kernel(*ir); });
+  }
+
+  void Convolution::build_kernel(const ImpulseResponse& ir)
+  {
+    const float samplerate = Application::current().audio_manager->samplerate();
+    const std::size_t predelay = std::lround(props.predelay * samplerate);
+    const std::size_t length = std::lround(props.length * ir.size());
+    // Fade out the cut, to avoid a click when the reverb stops
+    const std::size_t fade = length == ir.size() ? 0 : std::min<std::size_t>(length, 0.05f * samplerate);
+
+    auto kernel = std::make_unique<Kernel>();
+    std::vector<float> overview(overview_size, 0.f);
+    std::vector<float> cut;
+    std::size_t bytes = 0;
+    for (auto& ch : ir.channels) {
+      if (services::ThreadPool::cancelled()) return;
+      cut.assign(predelay, 0.f);
+      cut.insert(cut.end(), ch.begin(), ch.begin() + length);
+      for (std::size_t i = 0; i < fade; i++) {
+        cut[cut.size() - 1 - i] *= float(i) / fade;
+      }
+      for (std::size_t i = 0; i < cut.size(); i++) {
+        auto& peak = overview[i * overview_size / cut.size()];
+        peak = std::max(peak, std::abs(cut[i]));
+      }
+      services::memory::Measure measure;
+      kernel->channels.push_back(std::make_unique<util::dsp::Convolver>(cut));
+      bytes += measure.bytes();
+    }
+    if (services::ThreadPool::cancelled()) return;
+    kernel->memory = services::memory::Charge(name(), services::memory::Kind::assets, bytes);
+
+    if (float max = *std::max_element(overview.begin(), overview.end()); max > 0) {
+      for (auto& peak : overview) peak /= max;
+    }
+    {
+      std::unique_lock lock(_mutex);
+      _overview = std::move(overview);
+      _seconds = (predelay + length) / samplerate;
+    }
+
+    // The audio thread only retires a kernel when the last one has been
+    // freed, so there is at most one of each
+    delete _retired.exchange(nullptr);
+    delete _pending.exchange(kernel.release());
+  }
+
+  void Convolution::select_file(int offset)
+  {
+    auto entries = impulse_library().entries();
+    std::vector<const util::LibraryIndex::Entry*> files;
+    for (auto& e : *entries) {
+      if (e.is_audio()) files.push_back(&e);
+    }
+    if (files.empty()) return;
+    auto current = util::find_if(files, [&](auto* e) { return e->path.string() == props.file.get(); });
+    int idx = current == files.end() ? 0 : (current - files.begin()) + offset;
+    idx = std::clamp(idx, 0, int(files.size()) - 1);
+    props.file = files[idx]->path.string();
+  }
+
+  audio::ProcessData<2> Convolution::process(audio::ProcessData<1> data)
+  {
+    if (_retired.load(std::memory_order_acquire) == nullptr) {
+      if (auto* kernel = _pending.exchange(nullptr, std::memory_order_acq_rel)) {
+        _retired.store(_current, std::memory_order_release);
+        _current = kernel;
+      }
+    }
+
+    auto out = Application::current().audio_manager->buffer_pool().allocate_multi_clear<2>();
+    if (!_current || _current->channels.empty()) return data.redirect(out);
+
+    const std::ptrdiff_t n = data.nframes;
+    gsl::span<const float> in = {data.audio.data(), n};
+    _current->channels[0]->process(in, {out[0].data(), n});
+    if (_current->channels.size() > 1) {
+      _current->channels[1]->process(in, {out[1].data(), n});
+    } else {
+      std::copy_n(out[0].data(), n, out[1].data());
+    }
+
+    // One pole lowpass, from 200 Hz to 20 kHz
+    const float samplerate = Application::current().audio_manager->samplerate();
+    const float cutoff = 200.f * std::pow(100.f, props.tone.get());
+    const float a = 1 - std::exp(-2 * float(M_PI) * cutoff / samplerate);
+    for (int c = 0; c < 2; c++) {
+      float state = _tone_state[c];
+      for (auto& s : out[c]) {
+        state += a * (s - state);
+        s = state;
+      }
+      _tone_state[c] = state;
+    }
+    return data.redirect(out);
+  }
+
+  // SCREEN //
+
+  void ConvolutionScreen::rotary(ui::RotaryEvent ev)
+  {
+    auto& props = engine.props;
+    switch (ev.rotary) {
+    case Rotary::blue: engine.select_file(ev.clicks); break;
+    case Rotary::green: props.length.step(ev.clicks); break;
+    case Rotary::yellow: props.predelay.step(ev.clicks); break;
+    case Rotary::red: props.tone.step(ev.clicks); break;
+    }
+  }
+
+  void ConvolutionScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    auto& props = engine.props;
+    std::vector<float> overview;
+    float seconds;
+    {
+      std::unique_lock lock(engine._mutex);
+      overview = engine._overview;
+      seconds = engine._seconds;
+    }
+
+    ctx.font(Fonts::Norm, 20);
+    ctx.fillStyle(Colours::Blue);
+    ctx.beginPath();
+    ctx.fillText(props.file.get().empty() ? "NO IMPULSE RESPONSE" : props.file.get(), {10, 25});
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(fmt::format("LENGTH {:.2f}s", seconds), {10, 215});
+    ctx.fillStyle(Colours::Yellow);
+    ctx.fillText(fmt::format("PRE {:.0f}ms", props.predelay * 1000), {130, 215});
+    ctx.fillStyle(Colours::Red);
+    ctx.fillText(fmt::format("TONE {:.0f}", props.tone * 100), {230, 215});
+
+    if (overview.empty()) return;
+
+    // The decay, mirrored around the middle, darker as the tone closes
+    ctx.beginPath();
+    ctx.moveTo(10, 120);
+    for (std::size_t i = 0; i < overview.size(); i++) {
+      ctx.lineTo(10 + i * 2, 120 - overview[i] * 70);
+    }
+    for (std::size_t i = overview.size(); i-- > 0;) {
+      ctx.lineTo(10 + i * 2, 120 + overview[i] * 70);
+    }
+    ctx.closePath();
+    ctx.fill(Colours::White.dim(0.6 * (1 - props.tone)));
+  }
+
+} // namespace otto::engines
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "core/engine/engine.hpp"
+
+#include "services/memory.hpp"
+#include "services/thread_pool.hpp"
+
+#include "util/dsp/convolver.hpp"
+#include "util/filesystem.hpp"
+
+namespace otto::engines {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  /// Convolution reverb, with impulse responses from `data/impulses`
+  ///
+  /// Impulse responses are 32 bit float wav files, mono or stereo, at any
+  /// sample rate. They are converted to the engine rate and normalized to the
+  /// same energy when loaded, so switching between them keeps the level.
+  ///
+  /// The output is only the reverb, the dry signal is mixed in by the engine
+  /// manager, as for the other effects.
+  struct Convolution : EffectEngine {
+    struct Props : Properties<> {
+      Property<std::string> file = {this, "FILENAME", ""};
+      /// Fraction of the impulse response to use
+      Property<float> length = {this, "LENGTH", 1, has_limits::init(0.05, 1), steppable::init(0.05)};
+      /// Seconds of silence before the impulse response
+      Property<float> predelay = {this, "PREDELAY", 0, has_limits::init(0, 0.25), steppable::init(0.005)};
+      /// Lowpass on the reverb, from dark to fully open
+      Property<float> tone = {this, "TONE", 1, has_limits::init(0, 1), steppable::init(0.02)};
+    } props;
+
+    Convolution();
+    ~Convolution();
+
+    audio::ProcessData<2> process(audio::ProcessData<1>) override;
+
+  private:
+    friend struct ConvolutionScreen;
+
+    /// The impulse response, as loaded from the file
+    struct ImpulseResponse {
+      std::vector<std::vector<float>> channels;
+      services::memory::Charge memory;
+      std::size_t size() const noexcept;
+    };
+
+    /// What the audio thread convolves with
+    struct Kernel {
+      std::vector<std::unique_ptr<util::dsp::Convolver>> channels;
+      services::memory::Charge memory;
+    };
+
+    /// Read `path` and build a new kernel from it, on the thread pool
+    void load_file(fs::path path);
+    /// Build a new kernel from the current impulse response, on the thread
+    /// pool, after @ref Props::length or @ref Props::predelay has changed
+    void rebuild();
+    /// Cut, delay and partition `ir`, and hand the result to the audio thread
+    ///
+    /// Runs on the thread pool
+    void build_kernel(const ImpulseResponse& ir);
+    /// Select the impulse response `offset` entries away from the current
+    /// one in the library
+    void select_file(int offset);
+
+    services::ThreadPool::Task _loading;
+    /// Whether @ref _loading is a @ref load_file task
+    bool _loading_file = false;
+
+    /// Guards @ref _ir and @ref _overview, which are shared with the loading
+    /// task and the screen
+    std::mutex _mutex;
+    std::shared_ptr<const ImpulseResponse> _ir;
+    /// Peak levels of the cut impulse response, for the screen
+    std::vector<float> _overview;
+    /// Length of the cut impulse response, in seconds
+    float _seconds = 0;
+
+    /// The kernel in use. Only touched by the audio thread.
+    Kernel* _current = nullptr;
+    /// A new kernel, to be picked up by the audio thread
+    std::atomic<Kernel*> _pending = nullptr;
+    /// The kernel replaced by the audio thread, to be freed by the next
+    /// loading task
+    std::atomic<Kernel*> _retired = nullptr;
+
+    /// State of the tone filter, per channel
+    float _tone_state[2] = {0, 0};
+  };
+
+} // namespace otto::engines
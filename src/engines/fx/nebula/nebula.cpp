@@ -0,0 +1,100 @@
+#include "nebula.hpp"
+
+#include <cmath>
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "services/audio_manager.hpp"
+
+namespace otto::engines {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  struct NebulaScreen : EngineScreen<Nebula> {
+    void draw(Canvas& ctx) override;
+    void rotary(RotaryEvent e) override;
+
+    using EngineScreen<Nebula>::EngineScreen;
+  };
+
+  Nebula::Nebula()
+    : EffectEngine("Nebula", props, std::make_unique<NebulaScreen>(this)),
+      _reverb(Application::current().audio_manager->samplerate())
+  {
+    props.spread.on_change().connect([this](float s) { _reverb.spread(s); }).call_now(props.spread);
+    props.shimmer.on_change().connect([this](float s) { _reverb.shimmer(s); }).call_now(props.shimmer);
+    // From 0.3 to 12 seconds
+    props.length.on_change()
+      .connect([this](float l) { _reverb.decay(0.3f * std::pow(40.f, l)); })
+      .call_now(props.length);
+    props.shape.on_change()
+      .connect([this](float s) {
+        // Below 1, close the damping from 10 kHz down to 1 kHz
+        _reverb.damping(1000.f * std::pow(10.f, std::min(s, 1.f)));
+        // Above 1, raise the gate threshold from -60 dB to 0 dB
+        _reverb.gate(s > 1 ? std::pow(10.f, ((s - 1) * 60 - 60) / 20) : 0.f);
+      })
+      .call_now(props.shape);
+  }
+
+  audio::ProcessData<2> Nebula::process(audio::ProcessData<1> data)
+  {
+    auto out = Application::current().audio_manager->buffer_pool().allocate_multi_clear<2>();
+    const std::ptrdiff_t n = data.nframes;
+    _reverb.process({data.audio.data(), n}, {out[0].data(), n}, {out[1].data(), n});
+    return data.redirect(out);
+  }
+
+  // SCREEN //
+
+  void NebulaScreen::rotary(ui::RotaryEvent ev)
+  {
+    auto& props = engine.props;
+    switch (ev.rotary) {
+    case Rotary::blue: props.spread.step(ev.clicks); break;
+    case Rotary::green: props.length.step(ev.clicks); break;
+    case Rotary::yellow: props.shimmer.step(ev.clicks); break;
+    case Rotary::red: props.shape.step(ev.clicks); break;
+    }
+  }
+
+  void NebulaScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    auto& props = engine.props;
+
+    // Rings spreading out from the middle, further apart with the length,
+    // and pulled apart sideways with the spread
+    float spacing = 8 + props.length.normalize() * 12;
+    float offset = props.spread.normalize() * 30;
+    ctx.lineWidth(2);
+    for (int i = 1; i <= 6; i++) {
+      for (float x : {160 - offset, 160 + offset}) {
+        ctx.beginPath();
+        ctx.circle({x, 110}, i * spacing);
+        ctx.stroke(Colours::Green.dim(i / 7.f));
+      }
+    }
+
+    // The shimmer, as a bright core
+    ctx.beginPath();
+    ctx.circle({160, 110}, 4 + props.shimmer.normalize() * 10);
+    ctx.fill(Colours::Yellow.dim(1 - props.shimmer.normalize()));
+
+    ctx.font(Fonts::Norm, 20);
+    ctx.beginPath();
+    ctx.fillStyle(Colours::Blue);
+    ctx.fillText(fmt::format("SPREAD {:.0f}", props.spread * 100), {10, 25});
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(fmt::format("LENGTH {:.0f}", props.length * 100), {10, 215});
+    ctx.fillStyle(Colours::Yellow);
+    ctx.fillText(fmt::format("SHIMMER {:.0f}", props.shimmer * 100), {190, 25});
+    ctx.fillStyle(Colours::Red);
+    ctx.fillText(props.shape < 1 ? fmt::format("DARK {:.0f}", (1 - props.shape) * 100)
+                                 : fmt::format("GATE {:.0f}", (props.shape - 1) * 100),
+                 {210, 215});
+  }
+
+} // namespace otto::engines
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "core/engine/engine.hpp"
+
+#include "util/dsp/fdn_reverb.hpp"
+
+namespace otto::engines {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  /// Feedback delay network reverb, a lighter alternative to @ref Wormhole
+  ///
+  /// The properties are the same as Wormhole's, so a patch sounds roughly
+  /// the same on either. `shape` darkens the tail below the middle, and
+  /// gates it above.
+  struct Nebula : EffectEngine {
+    struct Props : Properties<> {
+      Property<float> spread = {this, "SPREAD", 0, has_limits::init(0, 1), steppable::init(0.01)};
+      Property<float> shimmer = {this, "SHIMMER", 0, has_limits::init(0, 0.8), steppable::init(0.01)};
+      Property<float> length = {this, "LENGTH", 0.5, has_limits::init(0, 1), steppable::init(0.01)};
+      Property<float> shape = {this, "SHAPE", 1, has_limits::init(0, 2), steppable::init(0.01)};
+    } props;
+
+    Nebula();
+
+    audio::ProcessData<2> process(audio::ProcessData<1>) override;
+
+  private:
+    util::dsp::FdnReverb _reverb;
+  };
+
+} // namespace otto::engines
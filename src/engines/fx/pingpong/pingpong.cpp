@@ -5,6 +5,8 @@
 #include "util/iterator.hpp"
 #include "util/utility.hpp"
 
+#include "services/clock_manager.hpp"
+
 #include "pingpong.faust.hpp"
 
 namespace otto::engines {
@@ -28,6 +30,7 @@ namespace otto::engines {
 
   audio::ProcessData<2> Pingpong::process(audio::ProcessData<1> data)
   {
+    if (float bpm = Application::current().clock_manager->bpm(); bpm != props.bpm) props.bpm = bpm;
     return faust_.process(data);
   }
 
@@ -17,8 +17,7 @@ TO-DO:
 
 
 //Controls
-//BPM = hbargraph("/bpm",1,400); // NOTE: Should be removed and replaced by some variable so Faust knows what the BPM is...
-BPM = 120;
+BPM = hslider("/bpm", 120, 30, 300, 0.1); // The tempo of the transport
 delaySlider = hslider("/delaytime", 0.5, 0.01, 0.999, 0.001):min(1):max(0.01);
 bpmFollow = checkbox("/bpm_follow");
 feedback = hslider("/feedback", 0.5, 0, 1, 1);
@@ -49,7 +48,7 @@ proc = _,_ : *(feedback),*(feedback) : ef.transpose(250,50,tpAmount),ef.transpos
 									 
 //DelayTime
 echoDelay = delaySlider*(ma.SR):int;
-tempo = 60*ma.SR/BPM*subdivision; //This should instead access a BPM variable from the metronome...
+tempo = 60*ma.SR/BPM*subdivision;
 delayTime = (bpmFollow, echoDelay, tempo) : select2;
 									 
 //Subdivision
@@ -197,6 +197,7 @@ class faust_pingpong : public dsp {
 	FAUSTFLOAT fCheckbox0;
 	FAUSTFLOAT fHslider1;
 	float fConst2;
+	FAUSTFLOAT fHslider4;
 	float fVec0[262144];
 	int fVec0_idx;
 	int fVec0_idx_save;
@@ -345,7 +346,7 @@ class faust_pingpong : public dsp {
 		fSamplingFreq = samplingFreq;
 		fConst0 = std::min<float>(192000.0f, std::max<float>(1.0f, float(fSamplingFreq)));
 		fConst1 = (7.0f / fConst0);
-		fConst2 = (0.125f * fConst0);
+		fConst2 = (15.0f * fConst0);
 		fConst3 = (3.14159274f / fConst0);
 		fConst4 = std::exp((0.0f - (5.0f / fConst0)));
 		fConst5 = (1.0f - fConst4);
@@ -358,6 +359,7 @@ class faust_pingpong : public dsp {
 		fHslider0 = FAUSTFLOAT(0.0f);
 		fCheckbox0 = FAUSTFLOAT(0.0f);
 		fHslider1 = FAUSTFLOAT(0.5f);
+		fHslider4 = FAUSTFLOAT(120.0f);
 		fHslider2 = FAUSTFLOAT(0.5f);
 		fHslider3 = FAUSTFLOAT(0.5f);
 		
@@ -467,6 +469,7 @@ class faust_pingpong : public dsp {
 	
 	virtual void buildUserInterface(UI* ui_interface) {
 		ui_interface->openVerticalBox("pingpong");
+		ui_interface->addHorizontalSlider("bpm", &fHslider4, 120.0f, 30.0f, 300.0f, 0.100000001f);
 		ui_interface->addCheckButton("bpm_follow", &fCheckbox0);
 		ui_interface->openVerticalBox("delayline0");
 		ui_interface->addHorizontalBargraph("level", &fHbargraph0, 0.0f, 5.0f);
@@ -547,7 +550,7 @@ class faust_pingpong : public dsp {
 		float fRec2_tmp[36];
 		float* fRec2 = &fRec2_tmp[4];
 		float fSlow3 = std::max<float>(0.00999999978f, std::min<float>(1.0f, float(fHslider1)));
-		float fSlow4 = (int(float(fCheckbox0))?(fConst2 * std::ceil((4.0f * fSlow3))):float(int((fConst0 * fSlow3))));
+		float fSlow4 = (int(float(fCheckbox0))?((fConst2 * std::ceil((4.0f * fSlow3))) / float(fHslider4)):float(int((fConst0 * fSlow3))));
 		int iSlow5 = int(fSlow4);
 		float fRec5_tmp[36];
 		float* fRec5 = &fRec5_tmp[4];
@@ -21,6 +21,8 @@ namespace otto::engines {
 
       Property<float> delaytime   = {this, "delaytime",     0.5,  has_limits::init(0.01, 0.99),    steppable::init(0.01)};
       Property<bool> bpm_follow   = {this, "bpm_follow", false};
+      /// The tempo of the transport, which the delay follows with @ref bpm_follow
+      Property<float, no_serialize> bpm = {this, "bpm", 120, has_limits::init(30, 300)};
       Property<float> feedback    = {this, "feedback",  0.5,  has_limits::init(0, 1),    steppable::init(0.01)};
       Property<float> tone        = {this, "tone",  0.5, has_limits::init(0, 1),   steppable::init(0.01)};
       Property<float> spread      = {this, "spread",  0, has_limits::init(0, 1),   steppable::init(0.01)};
@@ -0,0 +1,214 @@
+#include "looper.hpp"
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "services/audio_manager.hpp"
+#include "services/ui_manager.hpp"
+
+#include "util/dsp/kernels.hpp"
+
+namespace otto::engines {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  using State = util::dsp::Looper::State;
+
+  struct LooperScreen : EngineScreen<Looper> {
+    void draw(Canvas& ctx) override;
+    bool keypress(Key key) override;
+    void rotary(RotaryEvent e) override;
+
+    using EngineScreen<Looper>::EngineScreen;
+  };
+
+  Looper::Looper()
+    : Engine("Looper", props, std::make_unique<LooperScreen>(this)),
+      _looper(max_seconds * Application::current().audio_manager->samplerate(), layers)
+  {}
+
+  void Looper::command(Command c) noexcept
+  {
+    _command = c;
+  }
+
+  void Looper::process(audio::ProcessData<1>& synth,
+                       audio::AudioBufferHandle& line_in,
+                       int samples_per_beat,
+                       int next_beat)
+  {
+    const int nframes = synth.nframes;
+    const std::size_t beats_length = std::size_t(props.beats) * samples_per_beat;
+
+    switch (_command.exchange(Command::none)) {
+    case Command::none: break;
+    case Command::record:
+      if (props.beats > 0) {
+        _armed = true;
+      } else {
+        _looper.record();
+      }
+      break;
+    case Command::play:
+      _armed = false;
+      _looper.play();
+      break;
+    case Command::overdub: _looper.overdub(); break;
+    case Command::stop:
+      _armed = false;
+      _looper.stop();
+      break;
+    case Command::undo: _looper.undo(); break;
+    case Command::redo: _looper.redo(); break;
+    case Command::clear:
+      _armed = false;
+      _looper.clear();
+      break;
+    }
+
+    auto in = Application::current().audio_manager->buffer_pool().allocate();
+    auto out = Application::current().audio_manager->buffer_pool().allocate();
+    switch (Source(props.source.get())) {
+    case Source::synth: std::copy_n(synth.audio.data(), nframes, in.data()); break;
+    case Source::line_in: std::copy_n(line_in.data(), nframes, in.data()); break;
+    case Source::both:
+      for (int i = 0; i < nframes; i++) in[i] = synth.audio[i] + line_in[i];
+      break;
+    }
+
+    // An armed take starts on the next beat, or right away if the
+    // transport is stopped
+    int start = -1;
+    if (_armed) start = next_beat < 0 ? 0 : next_beat < nframes ? next_beat : -1;
+    if (start > 0) _looper.process({in.data(), start}, {out.data(), start});
+    if (start >= 0) {
+      _looper.record(beats_length);
+      _armed = false;
+    }
+    const int from = std::max(start, 0);
+    _looper.process({in.data() + from, nframes - from}, {out.data() + from, nframes - from});
+
+    util::dsp::kernels::mix(out.data(), synth.audio.data(), nframes, props.level);
+
+    in.release();
+    out.release();
+
+    _state = _looper.state();
+    _armed_shown = _armed;
+    _length = _looper.length();
+    _position = _looper.position();
+    _undo_depth = _looper.undo_depth();
+  }
+
+  // SCREEN //
+
+  bool LooperScreen::keypress(ui::Key key)
+  {
+    switch (key) {
+    case Key::blue_click:
+      // Record, then overdub and play in turn
+      switch (engine._state.load()) {
+      case State::empty: engine.command(Looper::Command::record); break;
+      case State::recording: engine.command(Looper::Command::play); break;
+      case State::playing: engine.command(Looper::Command::overdub); break;
+      case State::overdubbing: engine.command(Looper::Command::play); break;
+      case State::stopped: engine.command(Looper::Command::play); break;
+      }
+      return true;
+    case Key::green_click: engine.command(Looper::Command::undo); return true;
+    case Key::yellow_click: engine.command(Looper::Command::redo); return true;
+    case Key::red_click:
+      if (Application::current().ui_manager->is_pressed(Key::shift)) {
+        engine.command(Looper::Command::clear);
+      } else if (engine._state == State::stopped) {
+        engine.command(Looper::Command::play);
+      } else {
+        engine.command(Looper::Command::stop);
+      }
+      return true;
+    default: return false;
+    }
+  }
+
+  void LooperScreen::rotary(ui::RotaryEvent ev)
+  {
+    auto& props = engine.props;
+    switch (ev.rotary) {
+    case Rotary::blue: props.source.step(ev.clicks); break;
+    case Rotary::green: props.beats.step(ev.clicks); break;
+    case Rotary::yellow: props.level.step(ev.clicks); break;
+    case Rotary::red: break;
+    }
+  }
+
+  void LooperScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    auto& props = engine.props;
+    const State state = engine._state;
+    const std::size_t length = engine._length;
+    const std::size_t position = engine._position;
+
+    constexpr const char* sources[] = {"SYNTH", "LINE IN", "BOTH"};
+    ctx.font(Fonts::Norm, 20);
+    ctx.beginPath();
+    ctx.fillStyle(Colours::Blue);
+    ctx.fillText(sources[props.source], {10, 25});
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(props.beats == 0 ? std::string("FREE") : fmt::format("{} BEATS", props.beats.get()), {10, 215});
+    ctx.fillStyle(Colours::Yellow);
+    ctx.fillText(fmt::format("LEVEL {:.0f}", props.level * 100), {200, 215});
+    ctx.fillStyle(Colours::White);
+    ctx.fillText(fmt::format("UNDO {}", engine._undo_depth.load()), {220, 25});
+
+    // The loop as a ring, filled up to the playback position
+    Colour colour = Colours::Gray50;
+    const char* label = "EMPTY";
+    switch (state) {
+    case State::empty:
+      if (engine._armed_shown) {
+        colour = Colours::Red.dim(0.5);
+        label = "ARMED";
+      }
+      break;
+    case State::recording:
+      colour = Colours::Red;
+      label = "REC";
+      break;
+    case State::playing:
+      colour = Colours::Green;
+      label = "PLAY";
+      break;
+    case State::overdubbing:
+      colour = Colours::Yellow;
+      label = "DUB";
+      break;
+    case State::stopped: label = "STOP"; break;
+    }
+
+    const Point center = {160, 115};
+    ctx.lineWidth(6);
+    ctx.beginPath();
+    ctx.circle(center, 60);
+    ctx.stroke(Colours::Gray50);
+    if (length > 0 && state != State::recording) {
+      float angle = 2 * float(M_PI) * position / length;
+      ctx.beginPath();
+      ctx.arc(center, 60, -M_PI / 2, -M_PI / 2 + angle);
+      ctx.stroke(colour);
+    }
+
+    ctx.beginPath();
+    ctx.fillStyle(colour);
+    ctx.textAlign(HorizontalAlign::Center, VerticalAlign::Middle);
+    ctx.fillText(label, center);
+    if (length > 0) {
+      ctx.font(Fonts::Norm, 16);
+      ctx.fillText(
+        fmt::format("{:.1f}s", length / float(Application::current().audio_manager->samplerate())),
+        {center.x, center.y + 22});
+    }
+  }
+
+} // namespace otto::engines
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+
+#include "core/engine/engine.hpp"
+
+#include "util/dsp/looper.hpp"
+
+namespace otto::engines {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  /// Live looper, recording the synth and/or the line input
+  ///
+  /// The loop is added to the synth output, so it goes through the effect
+  /// sends like the synth does. With a length in beats set, recording starts
+  /// on the next beat of the transport and stops by itself.
+  ///
+  /// All loop memory is allocated when the engine is constructed.
+  struct Looper : Engine<EngineType::misc> {
+    /// Longest loop, in seconds
+    static constexpr float max_seconds = 30;
+    /// Steps of undo, plus one
+    static constexpr std::size_t layers = 6;
+
+    enum struct Source { synth, line_in, both };
+
+    struct Props : Properties<> {
+      /// A @ref Source
+      Property<int> source = {this, "SOURCE", 0, has_limits::init(0, 2), steppable::init(1)};
+      /// Length of the loop in beats, or `0` to set it by hand
+      Property<int> beats = {this, "BEATS", 16, has_limits::init(0, 64), steppable::init(1)};
+      Property<float> level = {this, "LEVEL", 1, has_limits::init(0, 1), steppable::init(0.01)};
+    } props;
+
+    /// Commands from the screen, carried out at the start of the next block
+    enum struct Command { none, record, play, overdub, stop, undo, redo, clear };
+
+    Looper();
+
+    /// Record from `synth` and/or `line_in`, and add the loop to `synth`
+    ///
+    /// `samples_per_beat` and `next_beat` are the tempo of the transport,
+    /// and the offset of its next beat from the start of this block, or `-1`
+    /// if it is stopped. If `samples_per_beat` is `0`, takes are always
+    /// closed by hand.
+    void process(audio::ProcessData<1>& synth,
+                 audio::AudioBufferHandle& line_in,
+                 int samples_per_beat,
+                 int next_beat);
+
+  private:
+    friend struct LooperScreen;
+
+    void command(Command c) noexcept;
+
+    util::dsp::Looper _looper;
+    std::atomic<Command> _command = Command::none;
+    /// Waiting for the next beat to start recording
+    bool _armed = false;
+
+    /// What the screen shows, published by the audio thread
+    std::atomic<util::dsp::Looper::State> _state = util::dsp::Looper::State::empty;
+    std::atomic<bool> _armed_shown = false;
+    std::atomic<std::size_t> _length = 0;
+    std::atomic<std::size_t> _position = 0;
+    std::atomic<std::size_t> _undo_depth = 0;
+  };
+
+} // namespace otto::engines
@@ -1,12 +1,15 @@
 #include "master.hpp"
 
+#include <algorithm>
+#include <cmath>
+
 #include "core/ui/vector_graphics.hpp"
 
+#include "services/audio_manager.hpp"
+
 #include "util/iterator.hpp"
 #include "util/utility.hpp"
 
-#include "master.faust.hpp"
-
 namespace otto::engines {
 
   using namespace ui;
@@ -21,19 +24,17 @@ namespace otto::engines {
 
   Master::Master()
     : Engine("Master", props, std::make_unique<MasterScreen>(this)),
-      faust_(std::make_unique<faust_master>(), props)
+      _bus(Application::current().audio_manager->samplerate())
   {}
 
-
   audio::ProcessData<2> Master::process(audio::ProcessData<2> data)
   {
-    for (auto&& l : data.audio[0]) {
-      l *= props.volume * props.volume * 0.80;
-    }
-    for (auto&& r : data.audio[1]) {
-      r *= props.volume * props.volume * 0.80;
-    }
-    return faust_.process(data);
+    _bus.gain(props.volume * props.volume * 0.80);
+    const std::ptrdiff_t n = data.nframes;
+    _bus.process({data.audio[0].data(), n}, {data.audio[1].data(), n});
+    auto levels = _bus.take_levels();
+    for (int c = 0; c < 2; c++) peak[c] = levels.peak[c];
+    return data;
   }
 
   // SCREEN //
@@ -91,7 +92,19 @@ namespace otto::engines {
     ctx.stroke();
     ctx.restore();
 
-
+    // Peak meters, from -48 dB to 0 dB, red at the ceiling
+    for (int c = 0; c < 2; c++) {
+      float peak = engine.peak[c];
+      float db = peak > 0 ? 20 * std::log10(peak) : -48;
+      float x = 86.6 + c * 80;
+      float width = 67 * std::clamp((db + 48) / 48, 0.f, 1.f);
+      ctx.beginPath();
+      ctx.rect({x, 205}, {67, 6});
+      ctx.fill(Colours::Gray50);
+      ctx.beginPath();
+      ctx.rect({x, 205}, {width, 6});
+      ctx.fill(db > -0.5 ? Colours::Red : Colours::Green);
+    }
   }
 
 } // namespace otto::engines
@@ -1,3 +0,0 @@
-import("stdfaust.lib");
-
-process = co.compressor_stereo(4,-6,0.0008,0.5);
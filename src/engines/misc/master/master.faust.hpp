@@ -1,145 +0,0 @@
-//----------------------------------------------------------
-// name: "master"
-//
-// Code generated with Faust 2.11.10 (https://faust.grame.fr)
-//----------------------------------------------------------
-
-/* link with  */
-#include <math.h>
-#include <math.h>
-#include <algorithm>
-
-#include <faust/gui/UI.h>
-#include <faust/gui/meta.h>
-#include <faust/dsp/dsp.h>
-
-using std::max;
-using std::min;
-
-/********************************
-	VECTOR INTRINSICS
-*********************************/
-
-
-/********************************
-	ABSTRACT USER INTERFACE
-*********************************/
-
-#ifndef FAUSTFLOAT
-#define FAUSTFLOAT float
-#endif 
-
-
-#ifndef FAUSTCLASS 
-#define FAUSTCLASS faust_master
-#endif
-
-class faust_master : public dsp {
-  private:
-	float 	fTempPerm0;
-	float 	fConst0;
-	float 	fConst1;
-	float 	fConst2;
-	float 	fTempPerm1;
-	float 	fTempPerm2;
-	float 	fTempPerm3;
-	float 	fRec2[2];
-	float 	fRec1[2];
-	float 	fConst3;
-	float 	fConst4;
-	float 	fRec0[2];
-	float 	fTempPerm4;
-	int fSamplingFreq;
-
-  public:
-	virtual void metadata(Meta* m) { 
-		m->declare("analyzers.lib/name", "Faust Analyzer Library");
-		m->declare("analyzers.lib/version", "0.0");
-		m->declare("basics.lib/name", "Faust Basic Element Library");
-		m->declare("basics.lib/version", "0.0");
-		m->declare("compressors.lib/name", "Faust Compressor Effect Library");
-		m->declare("compressors.lib/version", "0.0");
-		m->declare("filename", "master");
-		m->declare("maths.lib/author", "GRAME");
-		m->declare("maths.lib/copyright", "GRAME");
-		m->declare("maths.lib/license", "LGPL with exception");
-		m->declare("maths.lib/name", "Faust Math Library");
-		m->declare("maths.lib/version", "2.1");
-		m->declare("name", "master");
-		m->declare("signals.lib/name", "Faust Signal Routing Library");
-		m->declare("signals.lib/version", "0.0");
-	}
-
-	virtual int getNumInputs() { return 2; }
-	virtual int getNumOutputs() { return 2; }
-	static void classInit(int samplingFreq) {
-	}
-	virtual void instanceConstants(int samplingFreq) {
-		fSamplingFreq = samplingFreq;
-		fTempPerm0 = 0;
-		fConst0 = min(192000.0f, max(1.0f, (float)fSamplingFreq));
-		fConst1 = expf((0 - (1250.0f / fConst0)));
-		fConst2 = expf((0 - (2.0f / fConst0)));
-		fTempPerm1 = 0;
-		fTempPerm2 = 0;
-		fTempPerm3 = 0;
-		fConst3 = expf((0 - (2500.0f / fConst0)));
-		fConst4 = (1.0f - fConst3);
-		fTempPerm4 = 0;
-	}
-	virtual void instanceResetUserInterface() {
-	}
-	virtual void instanceClear() {
-		for (int i=0; i<2; i++) fRec2[i] = 0;
-		for (int i=0; i<2; i++) fRec1[i] = 0;
-		for (int i=0; i<2; i++) fRec0[i] = 0;
-	}
-	virtual void init(int samplingFreq) {
-		classInit(samplingFreq);
-		instanceInit(samplingFreq);
-	}
-	virtual void instanceInit(int samplingFreq) {
-		instanceConstants(samplingFreq);
-		instanceResetUserInterface();
-		instanceClear();
-	}
-	virtual faust_master* clone() {
-		return new faust_master();
-	}
-	virtual int getSampleRate() {
-		return fSamplingFreq;
-	}
-	virtual void buildUserInterface(UI* ui_interface) {
-		ui_interface->openVerticalBox("master");
-		ui_interface->closeBox();
-	}
-	virtual void compute (int count, FAUSTFLOAT** input, FAUSTFLOAT** output) {
-		//zone1
-		//zone2
-		//zone2b
-		//zone3
-		FAUSTFLOAT* input0 = input[0];
-		FAUSTFLOAT* input1 = input[1];
-		FAUSTFLOAT* output0 = output[0];
-		FAUSTFLOAT* output1 = output[1];
-		//LoopGraphScalar
-		for (int i=0; i<count; i++) {
-			fTempPerm0 = (float)input0[i];
-			fTempPerm1 = (float)input1[i];
-			fTempPerm2 = fabsf((fabsf(fTempPerm1) + fabsf(fTempPerm0)));
-			fTempPerm3 = ((int((fRec1[1] > fTempPerm2)))?fConst2:fConst1);
-			fRec2[0] = ((fRec2[1] * fTempPerm3) + (fTempPerm2 * (1.0f - fTempPerm3)));
-			fRec1[0] = fRec2[0];
-			fRec0[0] = ((fConst3 * fRec0[1]) + (fConst4 * (0 - (0.75f * max(((20.0f * log10f(fRec1[0])) + 6.0f), 0.0f)))));
-			fTempPerm4 = powf(10,(0.050000000000000003f * fRec0[0]));
-			output0[i] = (FAUSTFLOAT)(fTempPerm4 * fTempPerm0);
-			output1[i] = (FAUSTFLOAT)(fTempPerm4 * fTempPerm1);
-			// post processing
-			fRec0[1] = fRec0[0];
-			fRec1[1] = fRec1[0];
-			fRec2[1] = fRec2[0];
-		}
-	}
-};
-
-
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+
 #include "core/engine/engine.hpp"
 
-#include "core/audio/faust.hpp"
+#include "util/dsp/master_bus.hpp"
 
 namespace otto::engines {
 
@@ -17,10 +20,16 @@ namespace otto::engines {
 
     Master();
 
+    /// Scale, limit and meter the output, in place
+    ///
+    /// Delays the output by @ref util::dsp::MasterBus::latency frames.
     audio::ProcessData<2> process(audio::ProcessData<2>);
 
+    /// The peak level of each channel in the last block, for the UI
+    std::array<std::atomic<float>, 2> peak = {};
+
   private:
-    audio::FaustWrapper<2, 2> faust_;
+    util::dsp::MasterBus _bus;
   };
 
 } // namespace otto::engines
@@ -0,0 +1,312 @@
+#include "modulation.hpp"
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "services/audio_manager.hpp"
+#include "services/engine_manager.hpp"
+
+#include "util/iterator.hpp"
+#include "util/utility.hpp"
+
+namespace otto::engines {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  using Shape = util::dsp::ModMatrix::Shape;
+
+  /// Edits the routes, or the LFOs
+  struct ModulationScreen : EngineScreen<Modulation> {
+    void draw(Canvas& ctx) override;
+    bool keypress(Key key) override;
+    void rotary(RotaryEvent e) override;
+
+    using EngineScreen<Modulation>::EngineScreen;
+
+    bool lfo_page = false;
+  };
+
+  namespace {
+    /// The engine slots with properties worth modulating
+    constexpr const char* target_slots[] = {"Synth", "Effect1", "Effect2"};
+
+    constexpr const char* shape_names[] = {"SINE", "TRIANGLE", "SAW", "SQUARE", "RANDOM"};
+
+    std::string source_name(int source)
+    {
+      switch (source) {
+      case Modulation::synth_level: return "SYNTH LEVEL";
+      case Modulation::line_level: return "LINE LEVEL";
+      case Modulation::mod_wheel: return "MOD WHEEL";
+      case Modulation::velocity: return "VELOCITY";
+      case Modulation::key: return "KEY";
+      default: return fmt::format("LFO {}", source + 1);
+      }
+    }
+
+    /// The parts of a property ID
+    std::vector<std::string> split_id(const std::string& id)
+    {
+      std::vector<std::string> res;
+      std::size_t start = 0;
+      for (std::size_t slash; (slash = id.find('/', start)) != std::string::npos; start = slash + 1) {
+        res.push_back(id.substr(start, slash - start));
+      }
+      res.push_back(id.substr(start));
+      return res;
+    }
+
+    /// Add the IDs of the modulatable leaves under `branch` to `out`
+    void find_targets(const props::branch_base& branch, const std::string& prefix, std::vector<std::string>& out)
+    {
+      for (const props::property_base& child : branch.children()) {
+        auto id = prefix + "/" + child.name();
+        if (auto* sub = dynamic_cast<const props::branch_base*>(&child)) {
+          find_targets(*sub, id, out);
+        } else if (child.is<props::faust_link>() && child.is<props::serializable>() &&
+                   child.as<props::faust_link>().linked()) {
+          // Values read back from faust, like meters, are not serialized
+          out.push_back(std::move(id));
+        }
+      }
+    }
+  } // namespace
+
+  Modulation::Modulation()
+    : Engine("Modulation", props, std::make_unique<ModulationScreen>(this)),
+      _matrix(Application::current().audio_manager->samplerate()),
+      _synth_follower(Application::current().audio_manager->samplerate()),
+      _line_follower(Application::current().audio_manager->samplerate())
+  {
+    for (auto& s : _shown) s = 0;
+    for (auto& route : props.routes) {
+      route.source.on_change().connect([this](int) { update_plan(); });
+      route.target.on_change().connect([this](const std::string&) { update_plan(); });
+      route.depth.on_change().connect([this](float) { update_plan(); });
+    }
+  }
+
+  Modulation::~Modulation()
+  {
+    delete _pending.exchange(nullptr);
+    delete _retired.exchange(nullptr);
+    delete _plan;
+  }
+
+  void Modulation::update_plan()
+  {
+    auto plan = std::make_unique<Plan>();
+    // The ID of each target in the plan
+    std::vector<std::string> ids;
+    for (std::size_t r = 0; r < ModMatrix::max_routes; r++) {
+      auto& route = props.routes[r];
+      const std::string& id = route.target.get();
+      if (id.empty() || route.depth == 0) continue;
+      auto found = util::find(ids, id);
+      if (found == ids.end()) {
+        auto parts = split_id(id);
+        if (parts.size() < 2) continue;
+        Plan::Target target;
+        target.slot = parts.front();
+        target.path.assign(parts.begin() + 1, parts.end());
+        // Looked up here, so the audio thread does not have to
+        auto& engines = *Application::current().engine_manager;
+        target.dispatcher = engines.dispatcher(target.slot);
+        if (target.dispatcher == nullptr) target.engine = engines.by_name(target.slot);
+        plan->targets.push_back(std::move(target));
+        ids.push_back(id);
+        found = ids.end() - 1;
+      }
+      plan->routes[r] = {route.source.get(), int(found - ids.begin()), route.depth.get()};
+    }
+    // The audio thread only retires a plan when the last one has been
+    // freed, so there is at most one of each
+    delete _retired.exchange(nullptr);
+    delete _pending.exchange(plan.release());
+  }
+
+  void Modulation::resolve(const Plan::Target& target, Resolved& res) noexcept
+  {
+    auto* engine = target.current();
+    if (engine == res.engine) return;
+    res.engine = engine;
+    res.prop = nullptr;
+    if (engine == nullptr) return;
+    props::branch_base* branch = &engine->props();
+    for (std::size_t i = 0; i < target.path.size(); i++) {
+      auto found = util::find_if(branch->children(),
+                                 [&](props::property_base& p) { return p.name() == target.path[i]; });
+      if (found == branch->children().end()) return;
+      props::property_base& prop = *found;
+      if (i + 1 < target.path.size()) {
+        branch = dynamic_cast<props::branch_base*>(&prop);
+        if (branch == nullptr) return;
+      } else if (!prop.is_branch() && prop.is<props::faust_link>() &&
+                 prop.as<props::faust_link>().linked()) {
+        res.prop = &prop.as<props::faust_link>();
+      }
+    }
+  }
+
+  void Modulation::apply_plan(Plan* plan) noexcept
+  {
+    // Send the plain values to the old targets, if their engines are still
+    // there
+    if (_plan != nullptr) {
+      for (std::size_t t = 0; t < _plan->targets.size(); t++) {
+        auto& res = _resolved[t];
+        if (res.prop == nullptr) continue;
+        if (_plan->targets[t].current() == res.engine) res.prop->modulate(0);
+      }
+    }
+    _resolved.fill({});
+    for (std::size_t r = 0; r < ModMatrix::max_routes; r++) {
+      auto& entry = plan->routes[r];
+      if (entry.target < 0) {
+        _matrix.unroute(r);
+      } else {
+        _matrix.route(r, entry.source, entry.target, entry.depth);
+      }
+    }
+  }
+
+  void Modulation::process(audio::ProcessData<0> midi, audio::AudioBufferHandle& line_in)
+  {
+    if (_retired.load(std::memory_order_acquire) == nullptr) {
+      if (auto* plan = _pending.exchange(nullptr, std::memory_order_acq_rel)) {
+        apply_plan(plan);
+        _retired.store(_plan, std::memory_order_release);
+        _plan = plan;
+      }
+    }
+
+    for (std::size_t i = 0; i < ModMatrix::num_lfos; i++) {
+      _matrix.lfo(i, props.lfos[i].rate, Shape(props.lfos[i].shape.get()));
+    }
+    for (auto& event : midi.midi) {
+      util::match(event,
+                  [&](midi::NoteOnEvent& ev) {
+                    _matrix.set(velocity, ev.velocity / 127.f);
+                    _matrix.set(key, ev.key / 127.f);
+                  },
+                  [&](midi::ControlChangeEvent& ev) {
+                    if (ev.controler == 1) _matrix.set(mod_wheel, ev.value / 127.f);
+                  },
+                  [](auto&&) {});
+    }
+    _matrix.set(line_level, _line_follower.process({line_in.data(), midi.nframes}));
+    _matrix.process(midi.nframes);
+
+    if (_plan != nullptr) {
+      for (std::size_t t = 0; t < _plan->targets.size(); t++) {
+        auto& res = _resolved[t];
+        resolve(_plan->targets[t], res);
+        if (res.prop != nullptr) res.prop->modulate(_matrix.offset(t));
+      }
+    }
+
+    for (int s = 0; s < n_sources; s++) _shown[s] = _matrix.source(s);
+  }
+
+  void Modulation::follow_synth(audio::ProcessData<1>& synth)
+  {
+    _matrix.set(synth_level, _synth_follower.process({synth.audio.data(), synth.nframes}));
+  }
+
+  std::vector<std::string> Modulation::targets() const
+  {
+    std::vector<std::string> res;
+    for (const char* slot : target_slots) {
+      if (auto* engine = Application::current().engine_manager->by_name(slot)) {
+        find_targets(engine->props(), slot, res);
+      }
+    }
+    return res;
+  }
+
+  // SCREEN //
+
+  bool ModulationScreen::keypress(ui::Key key)
+  {
+    switch (key) {
+    case Key::blue_click: lfo_page = !lfo_page; return true;
+    case Key::red_click:
+      if (!lfo_page) engine.props.routes[engine.props.route].target = "";
+      return true;
+    default: return false;
+    }
+  }
+
+  void ModulationScreen::rotary(ui::RotaryEvent ev)
+  {
+    auto& props = engine.props;
+    if (lfo_page) {
+      auto& lfo = props.lfos[props.lfo];
+      switch (ev.rotary) {
+      case Rotary::blue: props.lfo.step(ev.clicks); break;
+      case Rotary::green: lfo.rate.step(ev.clicks); break;
+      case Rotary::yellow: lfo.shape.step(ev.clicks); break;
+      case Rotary::red: break;
+      }
+      return;
+    }
+    auto& route = props.routes[props.route];
+    switch (ev.rotary) {
+    case Rotary::blue: props.route.step(ev.clicks); break;
+    case Rotary::green: route.source.step(ev.clicks); break;
+    case Rotary::yellow: {
+      auto targets = engine.targets();
+      if (targets.empty()) break;
+      auto current = util::find(targets, route.target.get());
+      int idx = current == targets.end() ? 0 : (current - targets.begin()) + ev.clicks;
+      route.target = targets[std::clamp(idx, 0, int(targets.size()) - 1)];
+      break;
+    }
+    case Rotary::red: route.depth.step(ev.clicks); break;
+    }
+  }
+
+  void ModulationScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    auto& props = engine.props;
+    constexpr float x_pad = 20;
+    constexpr float y_pad = 40;
+    constexpr float space = (height - 2.f * y_pad) / 4.f;
+
+    auto row = [&](int i, Colour colour, const std::string& label, const std::string& value) {
+      ctx.beginPath();
+      ctx.fillStyle(colour);
+      ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+      ctx.fillText(label, {x_pad, y_pad + i * space});
+      ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+      ctx.fillText(value, {width - x_pad, y_pad + i * space});
+    };
+
+    ctx.font(Fonts::Norm, 22);
+    if (lfo_page) {
+      auto& lfo = props.lfos[props.lfo];
+      row(0, Colours::Blue, "LFO", fmt::format("{}", props.lfo + 1));
+      row(1, Colours::Green, "Rate", fmt::format("{:.2f} Hz", lfo.rate.get()));
+      row(2, Colours::Yellow, "Shape", shape_names[lfo.shape]);
+    } else {
+      auto& route = props.routes[props.route];
+      row(0, Colours::Blue, "Route", fmt::format("{}", props.route + 1));
+      row(1, Colours::Green, "Source", source_name(route.source));
+      row(2, Colours::Yellow, "Target", route.target.get().empty() ? std::string("-") : route.target.get());
+      row(3, Colours::Red, "Depth", fmt::format("{:+.0f}%", route.depth * 100));
+    }
+
+    // The sources, as bars from the middle
+    const float bar_width = (width - 2 * x_pad) / Modulation::n_sources;
+    for (int s = 0; s < Modulation::n_sources; s++) {
+      float v = std::clamp(engine._shown[s].load(), -1.f, 1.f);
+      float x = x_pad + s * bar_width;
+      ctx.beginPath();
+      ctx.rect({x + 2, height - 20 - std::max(v, 0.f) * 15}, {bar_width - 4, std::abs(v) * 15 + 1});
+      ctx.fill(s == props.lfo && lfo_page ? Colours::Blue : Colours::Gray70);
+    }
+  }
+
+} // namespace otto::engines
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "core/engine/engine.hpp"
+#include "core/engine/engine_dispatcher.hpp"
+
+#include "util/dsp/mod_matrix.hpp"
+
+namespace otto::engines {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  /// Routes LFOs, envelope followers and MIDI to the properties of the
+  /// other engines
+  ///
+  /// A route targets a property by its ID, the name of the engine slot it is
+  /// in, as given to @ref services::EngineManager::by_name, followed by the
+  /// path to the property, like `"Synth/DRAWBAR1"`. It follows the engine
+  /// selected in that slot. Only properties linked to faust can be
+  /// modulated, since the offset is applied to the value sent to faust, and
+  /// the property itself keeps its value. Engines without a faust DSP have
+  /// no such properties, so @ref targets leaves them out.
+  struct Modulation : Engine<EngineType::misc> {
+    using ModMatrix = util::dsp::ModMatrix;
+
+    /// The sources after the LFOs
+    enum Source {
+      synth_level = ModMatrix::num_lfos,
+      line_level,
+      mod_wheel,
+      velocity,
+      key,
+      /// Number of sources
+      n_sources,
+    };
+
+    struct Lfo : Properties<> {
+      Property<float> rate = {this, "RATE", 1, has_limits::init(0.01, 20), steppable::init(0.05)};
+      /// A @ref util::dsp::ModMatrix::Shape
+      Property<int> shape = {this, "SHAPE", 0, has_limits::init(0, 4), steppable::init(1)};
+
+      Lfo(int n) : branch_base(nullptr, fmt::format("LFO {}", n)){};
+    };
+
+    struct Route : Properties<> {
+      /// A @ref Source, or an LFO
+      Property<int> source = {this, "SOURCE", 0, has_limits::init(0, n_sources - 1), steppable::init(1)};
+      /// The property ID, or empty if the route is not used
+      Property<std::string> target = {this, "TARGET", ""};
+      /// Fraction of the range of the target
+      Property<float> depth = {this, "DEPTH", 0, has_limits::init(-1, 1), steppable::init(0.01)};
+
+      Route(int n) : branch_base(nullptr, fmt::format("Route {}", n)){};
+    };
+
+    struct Props : Properties<> {
+      Property<int, wrap> route = {this, "Route", 0, has_limits::init(0, ModMatrix::max_routes - 1)};
+      Property<int, wrap> lfo = {this, "Lfo", 0, has_limits::init(0, ModMatrix::num_lfos - 1)};
+      std::array<Lfo, ModMatrix::num_lfos> lfos =
+        util::generate_array<ModMatrix::num_lfos>([](int n) { return Lfo(n); });
+      std::array<Route, ModMatrix::max_routes> routes =
+        util::generate_array<ModMatrix::max_routes>([](int n) { return Route(n); });
+
+      Props()
+      {
+        for (auto& l : lfos) lfos_props.push_back(l);
+        for (auto& r : routes) routes_props.push_back(r);
+      }
+
+      Properties<> lfos_props = {this, "LFOs"};
+      Properties<> routes_props = {this, "Routes"};
+    } props;
+
+    Modulation();
+    ~Modulation();
+
+    /// Compute the modulation for the next block, and apply it to the
+    /// targets
+    ///
+    /// The level of the synth is from the last block, see @ref follow_synth
+    void process(audio::ProcessData<0> midi, audio::AudioBufferHandle& line_in);
+
+    /// Follow the level of the synth output
+    void follow_synth(audio::ProcessData<1>& synth);
+
+    /// IDs of the properties in the selected engines that are linked to
+    /// faust, and can be modulated
+    std::vector<std::string> targets() const;
+
+  private:
+    friend struct ModulationScreen;
+
+    /// The routes, as the audio thread uses them
+    struct Plan {
+      struct Target {
+        /// The engine slot
+        std::string slot;
+        /// Names of the branches and the leaf in the engine properties
+        std::vector<std::string> path;
+        /// The dispatcher of the slot, if its engine can be selected
+        IEngineDispatcher* dispatcher = nullptr;
+        /// The engine of the slot, if it is fixed
+        AnyEngine* engine = nullptr;
+
+        /// The engine currently in the slot
+        AnyEngine* current() const noexcept
+        {
+          return dispatcher != nullptr ? dispatcher->current() : engine;
+        }
+      };
+      /// Each distinct target, by its index in the @ref ModMatrix
+      std::vector<Target> targets;
+      struct Entry {
+        int source = 0;
+        /// Index in @ref targets, or -1 for an unused route
+        int target = -1;
+        float depth = 0;
+      };
+      std::array<Entry, ModMatrix::max_routes> routes;
+    };
+
+    /// A target as it was last found
+    struct Resolved {
+      AnyEngine* engine = nullptr;
+      props::mixin::interface<props::faust_link>* prop = nullptr;
+    };
+
+    /// Build a new @ref Plan from the route properties, and hand it to the
+    /// audio thread
+    void update_plan();
+    /// Switch to `plan`, on the audio thread
+    void apply_plan(Plan* plan) noexcept;
+    /// Find the property of `target`, if its engine has changed
+    ///
+    /// Only walks the properties when another engine has been selected in
+    /// the slot, since the plan was applied.
+    void resolve(const Plan::Target& target, Resolved& res) noexcept;
+
+    ModMatrix _matrix;
+    util::dsp::EnvelopeFollower _synth_follower;
+    util::dsp::EnvelopeFollower _line_follower;
+
+    /// The plan in use. Only touched by the audio thread.
+    Plan* _plan = nullptr;
+    /// A new plan, to be picked up by the audio thread
+    std::atomic<Plan*> _pending = nullptr;
+    /// The plan replaced by the audio thread, freed by the next update
+    std::atomic<Plan*> _retired = nullptr;
+    std::array<Resolved, ModMatrix::max_targets> _resolved;
+
+    /// The sources, for the screen
+    std::array<std::atomic<float>, n_sources> _shown = {};
+  };
+
+} // namespace otto::engines
@@ -0,0 +1,114 @@
+#include "tuner.hpp"
+
+#include <cmath>
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "services/audio_manager.hpp"
+
+#include "util/math.hpp"
+
+namespace otto::engines {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  struct TunerScreen : EngineScreen<Tuner> {
+    void draw(Canvas& ctx) override;
+    void rotary(RotaryEvent e) override;
+    void on_show() override;
+    void on_hide() override;
+
+    using EngineScreen<Tuner>::EngineScreen;
+  };
+
+  Tuner::Tuner()
+    : Engine("Tuner", props, std::make_unique<TunerScreen>(this)),
+      _detector(Application::current().audio_manager->samplerate())
+  {}
+
+  void Tuner::process(audio::AudioBufferHandle& line_in, int nframes)
+  {
+    if (!_active) return;
+    if (_detector.process({line_in.data(), nframes})) {
+      _frequency = _detector.frequency();
+      _clarity = _detector.clarity();
+    }
+  }
+
+  // SCREEN //
+
+  void TunerScreen::on_show()
+  {
+    engine._active = true;
+  }
+
+  void TunerScreen::on_hide()
+  {
+    engine._active = false;
+    engine._frequency = 0;
+    engine._clarity = 0;
+  }
+
+  void TunerScreen::rotary(ui::RotaryEvent ev)
+  {
+    switch (ev.rotary) {
+    case Rotary::blue: engine.props.reference.step(ev.clicks); break;
+    default: break;
+    }
+  }
+
+  void TunerScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    constexpr const char* names[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+
+    const float freq = engine._frequency;
+    const float clarity = engine._clarity;
+
+    ctx.font(Fonts::Norm, 20);
+    ctx.beginPath();
+    ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+    ctx.fillStyle(Colours::Blue);
+    ctx.fillText(fmt::format("A4 = {:.0f} Hz", engine.props.reference.get()), {10, 25});
+
+    // The scale, from -50 to 50 cents
+    const Point center = {160, 190};
+    constexpr float radius = 120;
+    ctx.lineWidth(4);
+    ctx.beginPath();
+    ctx.arc(center, radius, -M_PI * 0.75, -M_PI * 0.25);
+    ctx.stroke(Colours::Gray50);
+
+    ctx.textAlign(HorizontalAlign::Center, VerticalAlign::Middle);
+    if (freq <= 0) {
+      ctx.beginPath();
+      ctx.font(Fonts::Norm, 40);
+      ctx.fillStyle(Colours::Gray50);
+      ctx.fillText("-", {center.x, center.y - 60});
+      return;
+    }
+
+    const float note = 69 + 12 * std::log2(freq / engine.props.reference);
+    const int nearest = std::lround(note);
+    const float cents = (note - nearest) * 100;
+    const Colour colour = std::abs(cents) < 5 ? Colours::Green : Colours::Red;
+
+    ctx.beginPath();
+    ctx.font(Fonts::Norm, 60);
+    ctx.fillStyle(colour.dim(1 - clarity));
+    ctx.fillText(fmt::format("{}{}", names[util::math::modulo(nearest, 12)], nearest / 12 - 1),
+                 {center.x, center.y - 60});
+    ctx.font(Fonts::Norm, 18);
+    ctx.fillStyle(Colours::White);
+    ctx.fillText(fmt::format("{:.1f} Hz  {:+.0f}c", freq, cents), {center.x, center.y - 15});
+
+    const float angle = -M_PI / 2 + cents / 50 * M_PI / 4;
+    ctx.beginPath();
+    ctx.moveTo(center);
+    ctx.lineTo({center.x + radius * std::cos(angle), center.y + radius * std::sin(angle)});
+    ctx.stroke(colour);
+  }
+
+} // namespace otto::engines
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+
+#include "core/engine/engine.hpp"
+
+#include "util/dsp/pitch_detector.hpp"
+
+namespace otto::engines {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  /// Tuner for the line input
+  ///
+  /// Only listens while its screen is shown. The audio thread publishes the
+  /// estimates through atomics, so the screen never waits for it.
+  struct Tuner : Engine<EngineType::misc> {
+    struct Props : Properties<> {
+      /// Frequency of A4
+      Property<float> reference = {this, "REFERENCE", 440, has_limits::init(415, 466), steppable::init(1)};
+    } props;
+
+    Tuner();
+
+    /// Analyse `nframes` of the line input
+    void process(audio::AudioBufferHandle& line_in, int nframes);
+
+  private:
+    friend struct TunerScreen;
+
+    util::dsp::PitchDetector _detector;
+    /// Whether the screen is shown
+    std::atomic<bool> _active = false;
+
+    /// The last estimate, published by the audio thread
+    std::atomic<float> _frequency = 0;
+    std::atomic<float> _clarity = 0;
+  };
+
+} // namespace otto::engines
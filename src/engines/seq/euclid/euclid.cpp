@@ -6,6 +6,7 @@
 #include "util/iterator.hpp"
 #include "util/utility.hpp"
 
+#include "services/clock_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/state_manager.hpp"
 
@@ -63,6 +64,12 @@ namespace otto::engines {
   }
 
   audio::ProcessData<0> Euclid::process(audio::ProcessData<0> data)
+  {
+    return process(std::move(data), Application::current().clock_manager->block());
+  }
+
+  audio::ProcessData<0> Euclid::process(audio::ProcessData<0> data,
+                                        const util::dsp::Transport::Block& clock)
   {
     auto& current = current_channel();
     // Copy for thread safety
@@ -98,43 +105,39 @@ namespace otto::engines {
         ;
       }
     }
-    if (_should_run) running = true;
-    if (!running) return data;
-
-    if (!_should_run && running) {
+    // Steps are the sixteenth notes of the transport, played at the frame
+    // they fall on. Their position in the song sets the beat of each
+    // channel, so the channels stay in phase with each other and the
+    // transport.
+    clock.for_each(0.25, [&](int frame, std::int64_t step) {
+      running = true;
       for (auto& channel : props.channels) {
-        for (auto&& note : channel.notes.get()) {
-          if (note >= 0) data.midi.push_back(midi::NoteOffEvent(note));
+        if (channel.length <= 0) continue;
+        channel._beat_counter = step % channel.length;
+        for (auto& note : channel.notes.get()) {
+          if (note >= 0) data.midi.push_back(midi::NoteOffEvent(note, 1, 0, frame));
+        }
+        if (channel._hits_enabled.at(channel._beat_counter)) {
+          for (auto note : channel.notes.get()) {
+            if (note >= 0) data.midi.push_back(midi::NoteOnEvent(note, 1, 0, frame));
+          }
         }
       }
-      _counter = _samples_per_beat;
-      running = false;
-      return data;
-    }
-
-    auto next_beat = _samples_per_beat - _counter;
+    });
 
-    if (next_beat <= data.nframes) {
+    // Stopped during or before this block
+    const bool still_running = clock.running() && clock.to == clock.nframes;
+    if (running && !still_running) {
+      const int frame = clock.running() ? clock.to : 0;
       for (auto& channel : props.channels) {
-        if (channel.length > 0) {
-          channel._beat_counter++;
-          channel._beat_counter %= channel.length;
-          for (auto& note : channel.notes.get()) {
-            if (note >= 0) data.midi.push_back(midi::NoteOffEvent(note));
-          }
-          if (running && channel._hits_enabled.at(channel._beat_counter)) {
-            for (auto note : channel.notes.get()) {
-              if (note >= 0) {
-                data.midi.push_back(midi::NoteOnEvent(note));
-              }
-            }
-          }
+        for (auto&& note : channel.notes.get()) {
+          if (note >= 0) data.midi.push_back(midi::NoteOffEvent(note, 1, 0, frame));
         }
+        // Starting again plays the first step next
+        channel._beat_counter = 0;
       }
+      running = false;
     }
-
-    _counter += data.nframes;
-    _counter %= _samples_per_beat;
     return data;
   }
 
@@ -181,7 +184,6 @@ namespace otto::engines {
         engine.recording = engine.current_channel().notes;
       }
       break;
-    case ui::Key::play: engine._should_run = !engine._should_run; break;
     default: return false; ;
     }
     return true;
@@ -295,14 +297,15 @@ namespace otto::engines {
     }
 
 
-    auto& hit =
-      chan.hits.at((chan.channel->_beat_counter + (engine.running ? 0 : 1)) % chan.length);
+    auto& hit = chan.hits.at(chan.channel->_beat_counter % chan.length);
 
     ctx.group([&] {
       ctx.beginPath();
       float r = 3;
       if (engine.running) {
-        float x = engine._counter / float(engine._samples_per_beat);
+        // How far the transport is into the step
+        double step = Application::current().clock_manager->position() * 4;
+        float x = step - std::floor(step);
         ctx.rotateAround(x * M_PI * 2 / float(state.max_length), state.center);
       }
       ctx.circle(hit.point, r);
@@ -5,6 +5,8 @@
 #include "core/audio/faust.hpp"
 #include "core/audio/voice_manager.hpp"
 
+#include "util/dsp/transport.hpp"
+
 #include <array>
 #include <optional>
 
@@ -53,7 +55,13 @@ namespace otto::engines {
 
     void on_enable() override;
 
+    /// Play the steps of the transport in this block
     audio::ProcessData<0> process(audio::ProcessData<0>) override;
+    /// Play the steps of `clock`, which is where the transport is in this
+    /// block
+    ///
+    /// Every event is timed to the frame its step falls on.
+    audio::ProcessData<0> process(audio::ProcessData<0>, const util::dsp::Transport::Block& clock);
 
     Channel& current_channel()
     {
@@ -62,16 +70,13 @@ namespace otto::engines {
 
     std::optional<std::array<int, 6>> recording = std::nullopt;
 
+    /// Whether a step has played since the transport started. Used to
+    /// make sure NoteOff events are sent when stopped.
     bool running = false;
 
   private:
     friend struct EuclidScreen;
 
-    int _samples_per_beat = 22050 / 4;
-    int _counter = _samples_per_beat;
-    //Used to make sure NoteOff events are sent when stopped
-    bool _should_run = false;
-
     // Used in recording to clear the current value when the first keyonevent is sent
     bool _has_pressed_keys = false;
   };
@@ -5,6 +5,7 @@
 
 #include "core/audio/voice_manager.hpp"
 #include "services/ui_manager.hpp"
+#include "util/dsp/lookup_tables.hpp"
 
 namespace otto::engines {
 
@@ -145,7 +146,8 @@ namespace otto::engines {
 
   float OTTOFMSynth::FMOperator::FMSine::operator()(float phsOffset = 0) noexcept
   {
-    return gam::scl::sinP9(gam::scl::wrap(this->nextPhase() + phsOffset, 1.f, -1.f));
+    // The phase is in [-1, 1) for a full cycle. The table wraps it.
+    return util::dsp::tables::sine(0.5f * (this->nextPhase() + phsOffset));
   }
 
   float OTTOFMSynth::FMOperator::operator()(float phaseMod = 0)
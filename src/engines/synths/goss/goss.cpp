@@ -1,6 +1,8 @@
 #include "goss.hpp"
 
 #include "core/ui/vector_graphics.hpp"
+#include "services/audio_manager.hpp"
+#include "util/dsp/lookup_tables.hpp"
 
 namespace otto::engines {
 
@@ -27,35 +29,18 @@ namespace otto::engines {
 
   float GossSynth::Voice::operator()() noexcept
   {
+    using namespace util::dsp::tables;
     float fundamental = frequency() * (1 + 0.015 * props.leslie * pre.pitch_modulation_hi.cos()) * 0.5;
-    pipes[0].freq(fundamental);
-    pipes[1].freq(fundamental);
-    pipes[2].freq(fundamental);
-    percussion.freq(frequency());
-    return pipes[0]() + pipes[1]() * props.drawbar1 + pipes[2]() * props.drawbar2 + percussion() * perc_env();
+    float res = goss::pipe1(pipe_phase) + goss::pipe2(pipe_phase) * props.drawbar1 +
+                goss::pipe3(pipe_phase) * props.drawbar2 + goss::percussion(perc_phase) * perc_env();
+    pipe_phase += fundamental * pre.inv_samplerate;
+    pipe_phase -= int(pipe_phase);
+    perc_phase += frequency() * pre.inv_samplerate;
+    perc_phase -= int(perc_phase);
+    return res;
   }
 
   GossSynth::Voice::Voice(Pre& pre) noexcept : VoiceBase(pre) {
-    pipes[0].resize(1024);
-    pipes[0].addSine(1, 1, 0);
-    pipes[0].addSine(3, 1, 0);
-    pipes[0].addSine(2, 1, 0);
-
-    pipes[1].resize(1024);
-    pipes[1].addSine(4, 1, 0);
-    pipes[1].addSine(16, 0.5, 0);
-
-    pipes[2].resize(1024);
-    pipes[2].addSine(6, 0.5, 0);
-    pipes[2].addSine(8, 1, 0);
-    pipes[2].addSine(10, 0.5, 0);
-    pipes[2].addSine(12, 1, 0);
-    pipes[2].addSine(16, 0.5, 0);
-
-    percussion.resize(1024);
-    percussion.addSine(4, 0.5, 0);
-    percussion.addSine(6, 1.0, 0);
-
     perc_env.decay(0.5);
     perc_env.finish();
   }
@@ -64,7 +49,8 @@ namespace otto::engines {
     perc_env.reset(props.drawbar3 * 5);
   }
 
-  GossSynth::Pre::Pre(Props& props) noexcept : PreBase(props)
+  GossSynth::Pre::Pre(Props& props) noexcept
+    : PreBase(props), inv_samplerate(1.f / Application::current().audio_manager->samplerate())
   {
     leslie_filter_hi.phase(0.5);
     leslie_filter_lo.phase(0.5);
@@ -57,14 +57,19 @@ namespace otto::engines {
 
       gam::AccumPhase<> rotation;
 
+      /// Reciprocal of the samplerate, to convert frequencies to phase increments
+      float inv_samplerate;
+
       Pre(Props&) noexcept;
 
       void operator()() noexcept;
     };
 
     struct Voice : voices::VoiceBase<Voice, Pre> {
-      std::array<gam::Osc<>, 4> pipes;
-      gam::Osc<> percussion;
+      /// Phase of the pipes, in cycles. The pipes all share the same fundamental.
+      float pipe_phase = 0;
+      /// Phase of the percussion, in cycles
+      float perc_phase = 0;
       gam::Decay<> perc_env;
 
       Voice(Pre&) noexcept;
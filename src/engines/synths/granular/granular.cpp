@@ -0,0 +1,281 @@
+#include "granular.hpp"
+
+#include <cmath>
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "engines/synths/sampler/sampler.hpp"
+
+#include "services/audio_manager.hpp"
+
+#include "util/dsp/resampler.hpp"
+#include "util/iterator.hpp"
+#include "util/library_index.hpp"
+#include "util/soundfile.hpp"
+#include "util/utility.hpp"
+
+namespace otto::engines {
+
+  using namespace ui;
+  using namespace ui::vg;
+
+  struct GranularScreen : EngineScreen<Granular> {
+    void draw(Canvas& ctx) override;
+    void rotary(RotaryEvent e) override;
+
+    using EngineScreen<Granular>::EngineScreen;
+  };
+
+  /// The sample, pitch and window
+  struct GranularGrainScreen : EngineScreen<Granular> {
+    void draw(Canvas& ctx) override;
+    void rotary(RotaryEvent e) override;
+
+    using EngineScreen<Granular>::EngineScreen;
+  };
+
+  /// Number of points in the overview drawn on the screen
+  constexpr std::size_t overview_size = 150;
+
+  Granular::Granular()
+    : SynthEngine("Granular", props, std::make_unique<GranularScreen>(this)),
+      _granulator(Application::current().audio_manager->samplerate()),
+      _grain_screen(std::make_unique<GranularGrainScreen>(this))
+  {
+    props.file.on_change().connect(
+      [this](const std::string& file) { load_file(sample_library().root() / file); });
+    props.position.on_change().connect([this](float p) { _granulator.position(p); }).call_now(props.position);
+    props.spray.on_change().connect([this](float s) { _granulator.spray(s); }).call_now(props.spray);
+    props.density.on_change().connect([this](float d) { _granulator.density(d); }).call_now(props.density);
+    props.size.on_change().connect([this](float s) { _granulator.size(s); }).call_now(props.size);
+    props.pitch.on_change().connect([this](float) { update_pitch(); }).call_now(props.pitch);
+    props.window.on_change()
+      .connect([this](int w) { _granulator.window(util::dsp::Window::WindowType(w)); })
+      .call_now(props.window);
+  }
+
+  Granular::~Granular()
+  {
+    if (_loading.valid()) {
+      _loading.cancel();
+      _loading.wait();
+    }
+    delete _pending.exchange(nullptr);
+    delete _retired.exchange(nullptr);
+    delete _current;
+  }
+
+  void Granular::load_file(fs::path path)
+  {
+    if (_loading.valid()) _loading.cancel();
+    _loading = Application::current().thread_pool->submit([this, path = std::move(path)] {
+      auto source = std::make_unique<Source>();
+      try {
+        util::SoundFile sf;
+        sf.open(path);
+        // Only the first channel
+        std::vector<float> interleaved;
+        interleaved.reserve(sf.length());
+        sf.read_samples(std::back_inserter(interleaved), sf.length());
+        for (std::size_t i = 0; i < interleaved.size(); i += sf.info.channels) {
+          source->audio.push_back(interleaved[i]);
+        }
+        if (int rate = Application::current().audio_manager->samplerate(); sf.info.samplerate != rate) {
+          source->audio = util::dsp::resample(source->audio, sf.info.samplerate, rate);
+        }
+      } catch (util::exception& e) {
+        LOGE("Could not load sample {}: {}", path.string(), e.what());
+        source->audio.clear();
+      }
+      if (services::ThreadPool::cancelled()) return;
+
+      source->overview.assign(overview_size, 0.f);
+      for (std::size_t i = 0; i < source->audio.size(); i++) {
+        auto& peak = source->overview[i * overview_size / source->audio.size()];
+        peak = std::max(peak, std::abs(source->audio[i]));
+      }
+      source->memory = services::memory::Charge(
+        name(), services::memory::Kind::assets,
+        services::memory::bytes_of(source->audio) + services::memory::bytes_of(source->overview));
+      {
+        std::unique_lock lock(_mutex);
+        _overview = source->overview;
+        _seconds = source->audio.size() / float(Application::current().audio_manager->samplerate());
+      }
+
+      // The audio thread only retires a source when the last one has been
+      // freed, so there is at most one of each
+      delete _retired.exchange(nullptr);
+      delete _pending.exchange(source.release());
+    });
+  }
+
+  void Granular::select_file(int offset)
+  {
+    auto entries = sample_library().entries();
+    std::vector<const util::LibraryIndex::Entry*> files;
+    for (auto& e : *entries) {
+      if (e.is_audio()) files.push_back(&e);
+    }
+    if (files.empty()) return;
+    auto current = util::find_if(files, [&](auto* e) { return e->path.string() == props.file.get(); });
+    int idx = current == files.end() ? 0 : (current - files.begin()) + offset;
+    idx = std::clamp(idx, 0, int(files.size()) - 1);
+    props.file = files[idx]->path.string();
+  }
+
+  void Granular::update_pitch() noexcept
+  {
+    float semitones = props.pitch + (_key < 0 ? 0 : _key - 60);
+    _granulator.pitch(std::pow(2.f, semitones / 12.f));
+  }
+
+  audio::ProcessData<1> Granular::process(audio::ProcessData<1> data)
+  {
+    if (_retired.load(std::memory_order_acquire) == nullptr) {
+      if (auto* source = _pending.exchange(nullptr, std::memory_order_acq_rel)) {
+        _granulator.source(source->audio);
+        _retired.store(_current, std::memory_order_release);
+        _current = source;
+      }
+    }
+
+    for (auto& ev : data.midi) {
+      util::match(ev,
+                  [this](midi::NoteOnEvent& ev) {
+                    _key = ev.key;
+                    update_pitch();
+                    _granulator.gate(true);
+                  },
+                  [this](midi::NoteOffEvent& ev) {
+                    if (ev.key != _key) return;
+                    _key = -1;
+                    _granulator.gate(false);
+                  },
+                  [](auto&&) {});
+    }
+
+    // The synth bus is mono, so the grains are not panned
+    _granulator.process({data.audio.data(), std::ptrdiff_t(data.nframes)});
+    return data;
+  }
+
+  ui::Screen& Granular::envelope_screen()
+  {
+    return *_grain_screen;
+  }
+
+  ui::Screen& Granular::voices_screen()
+  {
+    return *_grain_screen;
+  }
+
+  // MAIN SCREEN //
+
+  void GranularScreen::rotary(ui::RotaryEvent ev)
+  {
+    auto& props = engine.props;
+    switch (ev.rotary) {
+    case Rotary::blue: props.position.step(ev.clicks); break;
+    case Rotary::green: props.spray.step(ev.clicks); break;
+    case Rotary::yellow: props.density.step(ev.clicks); break;
+    case Rotary::red: props.size.step(ev.clicks); break;
+    }
+  }
+
+  void GranularScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    auto& props = engine.props;
+    std::vector<float> overview;
+    float seconds;
+    {
+      std::unique_lock lock(engine._mutex);
+      overview = engine._overview;
+      seconds = engine._seconds;
+    }
+
+    ctx.font(Fonts::Norm, 20);
+    ctx.beginPath();
+    ctx.fillStyle(Colours::Blue);
+    ctx.fillText(fmt::format("POS {:.0f}", props.position * 100), {10, 25});
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(fmt::format("SPRAY {:.0f}ms", props.spray * 1000), {160, 25});
+    ctx.fillStyle(Colours::Yellow);
+    ctx.fillText(fmt::format("DENSITY {:.0f}", props.density.get()), {10, 215});
+    ctx.fillStyle(Colours::Red);
+    ctx.fillText(fmt::format("SIZE {:.0f}ms", props.size * 1000), {180, 215});
+
+    if (overview.empty()) return;
+
+    // The sample, mirrored around the middle
+    ctx.beginPath();
+    ctx.moveTo(10, 120);
+    for (std::size_t i = 0; i < overview.size(); i++) {
+      ctx.lineTo(10 + i * 2, 120 - overview[i] * 60);
+    }
+    for (std::size_t i = overview.size(); i-- > 0;) {
+      ctx.lineTo(10 + i * 2, 120 + overview[i] * 60);
+    }
+    ctx.closePath();
+    ctx.fill(Colours::White.dim(0.5));
+
+    // The range grains start in
+    float width = overview.size() * 2;
+    float spray = seconds > 0 ? props.spray / seconds : 0;
+    float from = std::max(0.f, props.position - spray);
+    float to = std::min(1.f, props.position + spray);
+    ctx.beginPath();
+    ctx.rect({10 + from * width, 55}, {std::max(2.f, (to - from) * width), 130});
+    ctx.fill(Colours::Green.dim(0.7));
+    ctx.beginPath();
+    ctx.moveTo(10 + props.position * width, 55);
+    ctx.lineTo(10 + props.position * width, 185);
+    ctx.lineWidth(2);
+    ctx.stroke(Colours::Blue);
+  }
+
+  // GRAIN SCREEN //
+
+  void GranularGrainScreen::rotary(ui::RotaryEvent ev)
+  {
+    auto& props = engine.props;
+    switch (ev.rotary) {
+    case Rotary::blue: engine.select_file(ev.clicks); break;
+    case Rotary::green: props.pitch.step(ev.clicks); break;
+    case Rotary::yellow: props.window.step(ev.clicks); break;
+    case Rotary::red: break;
+    }
+  }
+
+  void GranularGrainScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    auto& props = engine.props;
+    auto type = util::dsp::Window::WindowType(props.window.get());
+
+    ctx.font(Fonts::Norm, 20);
+    ctx.beginPath();
+    ctx.fillStyle(Colours::Blue);
+    ctx.fillText(props.file.get().empty() ? "NO SAMPLE" : props.file.get(), {10, 25});
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(fmt::format("PITCH {:+.0f}", props.pitch.get()), {10, 215});
+    ctx.fillStyle(Colours::Yellow);
+    ctx.fillText(util::dsp::Window::get_window_type_name(type), {160, 215});
+
+    // The window shape
+    std::vector<double> points(100);
+    util::dsp::Window::compute(points, type, false);
+    ctx.beginPath();
+    ctx.moveTo(60, 180);
+    for (std::size_t i = 0; i < points.size(); i++) {
+      ctx.lineTo(60 + i * 2, 180 - points[i] * 120);
+    }
+    ctx.lineTo(258, 180);
+    ctx.lineWidth(3);
+    ctx.stroke(Colours::Yellow);
+  }
+
+} // namespace otto::engines
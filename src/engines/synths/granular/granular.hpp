@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include "core/engine/engine.hpp"
+
+#include "services/memory.hpp"
+#include "services/thread_pool.hpp"
+
+#include "util/dsp/granulator.hpp"
+#include "util/filesystem.hpp"
+
+namespace otto::engines {
+
+  using namespace core;
+  using namespace core::engine;
+  using namespace props;
+
+  /// Granular synth, playing clouds of short grains from a sample
+  ///
+  /// Grains are started while a key is held, at the pitch of the key relative
+  /// to middle C. The samples are the same as the @ref Sampler uses.
+  struct Granular : SynthEngine, EngineWithEnvelope {
+    struct Props : Properties<> {
+      Property<std::string> file = {this, "FILENAME", ""};
+      /// Where grains start, as a fraction of the sample
+      Property<float> position = {this, "POSITION", 0, has_limits::init(0, 1), steppable::init(0.005)};
+      /// Random offset of the start of each grain, in seconds
+      Property<float> spray = {this, "SPRAY", 0.05, has_limits::init(0, 2), steppable::init(0.01)};
+      /// Grains per second
+      Property<float> density = {this, "DENSITY", 20, has_limits::init(1, 500), steppable::init(1)};
+      /// Grain length in seconds
+      Property<float> size = {this, "SIZE", 0.1, has_limits::init(0.005, 0.5), steppable::init(0.005)};
+      /// Transposition in semitones
+      Property<float> pitch = {this, "PITCH", 0, has_limits::init(-24, 24), steppable::init(1)};
+      /// A @ref util::dsp::Window::WindowType
+      Property<int> window = {this, "WINDOW", util::dsp::Window::hann,
+                              has_limits::init(0, util::dsp::Window::blackman_harris), steppable::init(1)};
+    } props;
+
+    Granular();
+    ~Granular();
+
+    audio::ProcessData<1> process(audio::ProcessData<1>) override;
+
+    ui::Screen& envelope_screen() override;
+    ui::Screen& voices_screen() override;
+
+  private:
+    friend struct GranularScreen;
+    friend struct GranularGrainScreen;
+
+    /// A loaded sample
+    struct Source {
+      std::vector<float> audio;
+      /// Peak levels, for the screen
+      std::vector<float> overview;
+      services::memory::Charge memory;
+    };
+
+    /// Read `path` on the thread pool, and hand it to the audio thread
+    void load_file(fs::path path);
+    /// Select the sound file `offset` entries away from the current one in
+    /// the sample library
+    void select_file(int offset);
+    /// Semitones of the held key, relative to middle C
+    void update_pitch() noexcept;
+
+    util::dsp::Granulator _granulator;
+    /// The held key, or -1
+    int _key = -1;
+
+    services::ThreadPool::Task _loading;
+
+    /// The source in use. Only touched by the audio thread.
+    Source* _current = nullptr;
+    /// A new source, to be picked up by the audio thread
+    std::atomic<Source*> _pending = nullptr;
+    /// The source replaced by the audio thread, to be freed by the next
+    /// loading task
+    std::atomic<Source*> _retired = nullptr;
+
+    /// Guards @ref _overview and @ref _seconds, which are shared with the
+    /// loading task and the screen
+    std::mutex _mutex;
+    std::vector<float> _overview;
+    /// Length of the sample
+    float _seconds = 0;
+
+    std::unique_ptr<ui::Screen> _grain_screen;
+  };
+
+} // namespace otto::engines
@@ -40,9 +40,10 @@ namespace otto::engines {
 
     PotionSynth::Pre::Pre(Props& props) noexcept : PreBase(props)
     {
-      ///Load waveforms into vectors.
-      for (int i=0; i<4; i++) {
-        wavetables[i].load(Application::current().data_dir / "wavetables/wt1.wav");
+      ///Load waveforms into vectors. They are all the same for now, so parse the file once
+      wavetables[0].load(Application::current().data_dir / "wavetables/wt1.wav");
+      for (int i=1; i<4; i++) {
+        wavetables[i] = wavetables[0];
       }
       //wavetables[1].load(Application::current().data_dir / "wavetables/wt2.wav");
       //wavetables[2].load(Application::current().data_dir / "wavetables/wt3.wav");
@@ -57,6 +58,12 @@ namespace otto::engines {
         remap_table[i] = (2.f*(float)i/(float)remap_table.size()) / 2.f;
       }
 
+      std::size_t bytes = remap_table.size() * sizeof(float);
+      for (auto& wt : wavetables) {
+        for (auto& channel : wt.samples) bytes += services::memory::bytes_of(channel);
+      }
+      memory = services::memory::Charge("Potion", services::memory::Kind::assets, bytes);
+
     }
 
     void PotionSynth::Pre::operator()() noexcept {}
@@ -11,6 +11,9 @@
 #include <Gamma/Effects.h>
 #include <AudioFile.h>
 
+#include "services/memory.hpp"
+#include "util/dsp/lookup_tables.hpp"
+
 
 namespace otto::engines {
 
@@ -70,18 +73,12 @@ namespace otto::engines {
         /// Set position (constant power law)
 
         /// This is a constant power pan where the sum of the squares of the two
-        /// channel gains is always 1. A quadratic approximation is used to avoid
-        /// expensive trig function calls. The approximation is good enough for most
-        /// purposes and gives the exact result at positions of -1, 0, 1.
+        /// channel gains is always 1. The gains are read from a table that is
+        /// generated at compile time, to avoid expensive trig function calls.
         ///
         /// \param[in] v	Position, in [-1, 1]
         void pos(float v){
-          static const float c0 = 1./sqrt(2);
-          static const float c1 = 0.5 - c0;
-          static const float c2 =-0.5/c1;
-          v = gam::scl::clip(v, 1.f, -1.f);
-          w1 = c1 * v * (v + c2) + c0;
-          w2 = w1 + v;
+          std::tie(w1, w2) = util::dsp::tables::equal_power_pan(v);
         }
 
     protected:
@@ -104,6 +101,7 @@ namespace otto::engines {
     struct Pre : voices::PreBase<Pre, Props> {
       std::array<AudioFile<float>,4> wavetables;
       gam::Osc<> remap_table;
+      services::memory::Charge memory;
 
       Pre(Props&) noexcept;
       void operator()() noexcept;
@@ -1,6 +1,8 @@
 #include "rhodes.hpp"
 
 #include "core/ui/vector_graphics.hpp"
+#include "util/dsp/lookup_tables.hpp"
+#include "util/fast_math.hpp"
 
 namespace otto::engines {
 
@@ -32,8 +34,8 @@ namespace otto::engines {
     float excitation = lpf(exciter() * (1 + noise()));
     float harmonics = env() * overtones();
     float orig_note = reson(excitation*hammer_strength);
-    float aux = tanh(0.3*orig_note + props.asymmetry);
-    return pickup_hpf(pow(2, 10*aux)) + harmonics;
+    float aux = util::dsp::tables::tanh(0.3*orig_note + props.asymmetry);
+    return pickup_hpf(util::math::fast_exp2(10.f*aux)) + harmonics;
   }
 
   RhodesSynth::Voice::Voice(Pre& pre) noexcept : VoiceBase(pre) {
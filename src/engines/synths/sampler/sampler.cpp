@@ -3,6 +3,7 @@
 #include "core/ui/vector_graphics.hpp"
 
 #include "util/iterator.hpp"
+#include "util/library_index.hpp"
 #include "util/utility.hpp"
 
 #include "services/audio_manager.hpp"
@@ -18,10 +19,14 @@ namespace otto::engines {
       _audio_data.reserve(_size);
       _waveform.reserve(_size);
       sf.read_samples(std::back_inserter(_audio_data), _size);
+      // Convert to the engine rate once, so playback at speed 1 is exact
+      if (int rate = Application::current().audio_manager->samplerate();
+          sf.info.samplerate != rate) {
+        _audio_data = util::dsp::resample(_audio_data, sf.info.samplerate, rate);
+        _size = _audio_data.size();
+      }
       util::audio::EnvelopeFollower env_fol;
       util::transform(_audio_data, std::back_inserter(_waveform), env_fol);
-      speed_modifier =
-        sf.info.samplerate / float(Application::current().audio_manager->samplerate());
       _start_point = 0;
       _end_point = _size;
     } catch (util::exception& e) {
@@ -40,17 +45,17 @@ namespace otto::engines {
   Sample::iterator Sample::begin(float stride) const
   {
     if (stride < 0) {
-      return {*this, end_point(), stride * speed_modifier};
+      return {*this, end_point(), stride};
     }
-    return {*this, start_point(), stride * speed_modifier};
+    return {*this, start_point(), stride};
   }
 
   Sample::iterator Sample::end(float stride) const
   {
     if (stride < 0) {
-      return {*this, start_point(), stride * speed_modifier};
+      return {*this, start_point(), stride};
     }
-    return {*this, end_point(), stride * speed_modifier};
+    return {*this, end_point(), stride};
   }
 
   util::sequence<std::vector<float>::const_iterator, std::vector<float>::const_iterator>
@@ -65,6 +70,11 @@ namespace otto::engines {
     return 1;
   }
 
+  std::size_t Sample::bytes() const noexcept
+  {
+    return services::memory::bytes_of(_audio_data) + services::memory::bytes_of(_waveform);
+  }
+
   std::size_t Sample::start_point() const
   {
     if (_start_point < 0) return 0;
@@ -120,21 +130,9 @@ namespace otto::engines {
   }
 
   Sample::iterator::iterator(const Sample& sample, std::size_t index, float stride)
-    : sample(sample), _index(index), _playback_speed(stride)
+    : _sample(&sample), _index(index), _playback_speed(stride)
   {}
 
-  Sample::iterator::iterator(const iterator& rhs) = default;
-
-  Sample::iterator& Sample::iterator::operator=(const iterator& rhs)
-  {
-    assert(&this->sample == &rhs.sample);
-    do_loop = rhs.do_loop;
-    _index = rhs._index;
-    _playback_speed = rhs._playback_speed;
-    _error = rhs._error;
-    return *this;
-  }
-
   void Sample::iterator::advance(std::ptrdiff_t d)
   {
     float int_part;
@@ -156,7 +154,10 @@ namespace otto::engines {
     if (start_point() == end_point() || signed_index() < start_point() ||
         signed_index() >= end_point())
       return 0.f;
-    return sample._audio_data[_index];
+    // _error is always the fraction of the way to the next sample, also when
+    // playing backwards
+    if (_error == 0.f && std::abs(_playback_speed) <= 1) return _sample->_audio_data[_index];
+    return _sample->_interpolator(_sample->_audio_data, _index + double(_error), _playback_speed);
   }
 
   bool Sample::iterator::equal(const Sample::iterator& rhs) const
@@ -171,26 +172,26 @@ namespace otto::engines {
 
   int Sample::iterator::start_point() const
   {
-    if (_playback_speed < 0) return -sample.end_point();
-    return sample.start_point();
+    if (_playback_speed < 0) return -_sample->end_point();
+    return _sample->start_point();
   }
 
   int Sample::iterator::end_point() const
   {
-    if (_playback_speed < 0) return -sample.start_point();
-    return sample.end_point();
+    if (_playback_speed < 0) return -_sample->start_point();
+    return _sample->end_point();
   }
 
   int Sample::iterator::loop_start() const
   {
-    if (_playback_speed < 0) return -sample.loop_end();
-    return sample.loop_start();
+    if (_playback_speed < 0) return -_sample->loop_end();
+    return _sample->loop_start();
   }
 
   int Sample::iterator::loop_end() const
   {
-    if (_playback_speed < 0) return -sample.loop_start();
-    return sample.loop_end();
+    if (_playback_speed < 0) return -_sample->loop_start();
+    return _sample->loop_end();
   }
 
   int Sample::iterator::signed_index() const
@@ -202,6 +203,13 @@ namespace otto::engines {
 
   // Sampler ----------------------------------------------------
 
+  util::LibraryIndex& sample_library()
+  {
+    static util::LibraryIndex library{Application::current().data_dir / "samples",
+                                      {".wav"},
+                                      Application::current().data_dir / ".sample-library.json"};
+    return library;
+  }
 
   using namespace ui;
   using namespace ui::vg;
@@ -224,12 +232,14 @@ namespace otto::engines {
     : Engine("Sampler", props, std::make_unique<SamplerScreen>(this)),
       _envelope_screen(std::make_unique<SamplerEnvelopeScreen>(this))
   {
-    load_file(Application::current().data_dir / "samples" / "sample.wav");
+    props.file.on_change().connect(
+      [this](const std::string& file) { load_file(sample_library().root() / file); });
+    props.file = "sample.wav";
   }
 
   void Sampler::restart()
   {
-    sample.begin(props.speed);
+    _playing->begin(props.speed);
   }
 
   float Sampler::operator()() noexcept
@@ -239,21 +249,81 @@ namespace otto::engines {
     return frm;
   }
 
+  Sampler::~Sampler()
+  {
+    if (_loading.valid()) {
+      _loading.cancel();
+      _loading.wait();
+    }
+    // _shown is either _playing or _retired
+    delete _pending.exchange(nullptr);
+    delete _retired.exchange(nullptr);
+    delete _playing;
+  }
+
   void Sampler::load_file(fs::path path)
   {
-    sample = Sample(std::move(path));
-    play_position = sample.end();
+    update_loaded_sample();
+    if (_loading.valid()) _loading.cancel();
+    _loading = Application::current().thread_pool->submit([this, path = std::move(path)] {
+      auto loaded = std::make_unique<Sample>(path);
+      if (services::ThreadPool::cancelled()) return;
+      loaded->memory =
+        services::memory::Charge(name(), services::memory::Kind::assets, loaded->bytes());
+      DLOGI("Loaded sample {}", path);
+      // A sample that was never picked up was not seen by the audio thread
+      // or the screens
+      delete _pending.exchange(loaded.release(), std::memory_order_acq_rel);
+    });
+  }
+
+  void Sampler::update_loaded_sample()
+  {
+    Sample* old = _retired.load(std::memory_order_acquire);
+    if (old == nullptr) return;
+    // The audio thread set _playing before it published _retired, and does
+    // not swap again until _retired is cleared below, so it can be read here
+    _shown = _playing;
+    _retired.store(nullptr, std::memory_order_release);
+    Application::current().thread_pool->submit([old] { delete old; },
+                                              services::ThreadPool::Priority::low);
+  }
+
+  void Sampler::select_file(int offset)
+  {
+    auto entries = sample_library().entries();
+    std::vector<const util::LibraryIndex::Entry*> files;
+    for (auto& e : *entries) {
+      if (e.is_audio()) files.push_back(&e);
+    }
+    if (files.empty()) return;
+    auto current = util::find_if(files, [&](auto* e) { return e->path.string() == props.file.get(); });
+    int idx = current == files.end() ? 0 : (current - files.begin()) + offset;
+    idx = std::clamp(idx, 0, int(files.size()) - 1);
+    props.file = files[idx]->path.string();
   }
 
   audio::ProcessData<1> Sampler::process(audio::ProcessData<1> data)
   {
+    // Swap in a loaded sample. The old one is freed once the screens have
+    // let go of it, so only one can be retired at a time.
+    if (_retired.load(std::memory_order_acquire) == nullptr) {
+      if (auto* loaded = _pending.exchange(nullptr, std::memory_order_acq_rel)) {
+        Sample* old = _playing;
+        _playing = loaded;
+        play_position = _playing->end();
+        _retired.store(old, std::memory_order_release);
+      }
+    }
+
+    auto& sample = *_playing;
     for (auto& ev : data.midi) {
       util::match(ev,
-                  [this](midi::NoteOnEvent& ev) {
+                  [&](midi::NoteOnEvent& ev) {
                     play_position = sample.begin(props.speed);
                     play_position.do_loop = sample.loop;
                   },
-                  [this](midi::NoteOffEvent& ev) {
+                  [&](midi::NoteOffEvent& ev) {
                     if (sample.cut) play_position = sample.end();
                     play_position.do_loop = false;
                   },
@@ -280,10 +350,11 @@ namespace otto::engines {
 
   void SamplerScreen::rotary(ui::RotaryEvent ev)
   {
+    engine.update_loaded_sample();
     auto& props = engine.props;
-    auto& sample = engine.sample;
+    auto& sample = *engine._shown;
     switch (ev.rotary) {
-    case ui::Rotary::blue: break;
+    case ui::Rotary::blue: engine.select_file(ev.clicks); break;
     case ui::Rotary::green: props.filter.step(ev.clicks); break;
     case ui::Rotary::yellow: props.speed.step(ev.clicks); break;
     case ui::Rotary::red:
@@ -303,12 +374,15 @@ namespace otto::engines {
   {
     using namespace ui::vg;
 
+    engine.update_loaded_sample();
+
     auto& props = engine.props;
-    auto& sample = engine.sample;
+    auto& sample = *engine._shown;
 
     ctx.font(Fonts::Norm, 20);
 
     ctx.beginPath();
+    ctx.fillText(props.file.get(), {10, 15});
     if (sample.cut) ctx.fillText("CUT", {10, 40});
     if (sample.loop) ctx.fillText("LOOP", {10, 65});
     ctx.fillText(fmt::format("LS: {}", sample.loop_start()), {10, 80});
@@ -320,7 +394,8 @@ namespace otto::engines {
 
   void SamplerEnvelopeScreen::rotary(ui::RotaryEvent ev)
   {
-    auto& sample = engine.sample;
+    engine.update_loaded_sample();
+    auto& sample = *engine._shown;
     switch (ev.rotary) {
     case ui::Rotary::blue: sample.start_point(sample.start_point() + ev.clicks * 100); break;
     case ui::Rotary::green: sample.end_point(sample.end_point() + ev.clicks * 100); break;
@@ -333,15 +408,17 @@ namespace otto::engines {
   {
     using namespace ui::vg;
 
+    engine.update_loaded_sample();
+
     // auto& props = engine.props;
-    auto& sample = engine.sample;
+    auto& sample = *engine._shown;
 
-    if (engine.sample.size() <= 0) return;
+    if (sample.size() <= 0) return;
 
     ctx.beginPath();
 
     ctx.moveTo(10, 120);
-    auto waveform = engine.sample.waveform();
+    auto waveform = sample.waveform();
     float size = waveform.end() - waveform.begin();
 
     for (float i = 0; i < 300; i += 2) {
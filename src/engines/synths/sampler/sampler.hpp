@@ -1,10 +1,17 @@
 #pragma once
 
+#include <atomic>
+
 #include "core/engine/engine.hpp"
 
+#include "services/memory.hpp"
+#include "services/thread_pool.hpp"
+
+#include "util/dsp/resampler.hpp"
 #include "util/soundfile.hpp"
 
 #include "util/iterator.hpp"
+#include "util/library_index.hpp"
 
 #include "list"
 
@@ -14,6 +21,10 @@ namespace otto::engines {
   using namespace core::engine;
   using namespace props;
 
+  /// The sample library, `data/samples`, shared by all engines playing
+  /// samples
+  util::LibraryIndex& sample_library();
+
   struct Sample {
     struct iterator;
 
@@ -32,6 +43,9 @@ namespace otto::engines {
     /// Audio samples per entry in @ref waveform()
     int waveform_scale() const;
 
+    /// The bytes used by the audio and the waveform
+    std::size_t bytes() const noexcept;
+
     std::size_t start_point() const;
     std::size_t end_point() const;
     int loop_start() const;
@@ -46,8 +60,6 @@ namespace otto::engines {
       using vector_iterator = std::vector<float>::const_iterator;
 
       iterator(const Sample& sample, std::size_t index, float stride = 1.f);
-      iterator(const iterator&);
-      iterator& operator=(const iterator&);
 
       void advance(std::ptrdiff_t d);
       float dereference() const;
@@ -55,7 +67,6 @@ namespace otto::engines {
 
       std::size_t index() const;
 
-      const Sample& sample;
       bool do_loop = false;
 
     private:
@@ -65,6 +76,7 @@ namespace otto::engines {
       int loop_end() const;
       int signed_index() const;
 
+      const Sample* _sample;
       std::size_t _index = 0;
       float _playback_speed = 1.f;
       float _error = 0.f;
@@ -73,6 +85,8 @@ namespace otto::engines {
     bool cut = false;
     bool loop = false;
 
+    services::memory::Charge memory;
+
   private:
     std::vector<float> _audio_data;
     std::vector<float> _waveform;
@@ -85,9 +99,8 @@ namespace otto::engines {
     int _loop_start = -1;
     int _loop_end = -1;
 
-    /// The normal speed. When reading a sample from a file, this is the AudioManager's
-    /// samplerate divided by the sample's
-    float speed_modifier = 1.f;
+    /// Reads between the samples when playing at other speeds than 1
+    util::dsp::Interpolator _interpolator = {util::dsp::ResamplerQuality::low};
   };
 
   struct Sampler : SynthEngine, EngineWithEnvelope {
@@ -98,6 +111,7 @@ namespace otto::engines {
     } props;
 
     Sampler();
+    ~Sampler();
 
     void restart();
 
@@ -111,11 +125,35 @@ namespace otto::engines {
     friend struct SamplerScreen;
     friend struct SamplerEnvelopeScreen;
 
+    /// Load `file` on the thread pool. Cancels any load still in progress.
+    ///
+    /// The audio thread swaps in the loaded sample at the start of the next
+    /// @ref process, and the screens follow in @ref update_loaded_sample
     void load_file(fs::path file);
-    Sample sample;
-    Sample::iterator play_position = sample.end();
+    /// Show the sample the audio thread has swapped in, and free the one it
+    /// replaced on the thread pool. UI thread.
+    void update_loaded_sample();
+    /// Select the sound file `offset` entries away from the current one in
+    /// the sample library, and load it.
+    void select_file(int offset);
+
+    /// The sample being played. Only touched by the audio thread, except in
+    /// @ref update_loaded_sample, see there.
+    Sample* _playing = new Sample();
+    /// The sample the screens show and edit. Only touched by the UI thread.
+    ///
+    /// Either @ref _playing, or the sample in @ref _retired.
+    Sample* _shown = _playing;
+    Sample::iterator play_position = _playing->end();
     bool note_on = false;
 
+    services::ThreadPool::Task _loading;
+    /// A loaded sample, to be picked up by the audio thread
+    std::atomic<Sample*> _pending = nullptr;
+    /// The sample replaced by the audio thread. Freed once the screens have
+    /// moved on, by @ref update_loaded_sample
+    std::atomic<Sample*> _retired = nullptr;
+
     std::unique_ptr<ui::Screen> _envelope_screen;
   };
 
@@ -3,28 +3,35 @@
 #include "application.hpp"
 
 #include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
 #include "services/engine_manager.hpp"
 #include "services/log_manager.hpp"
 #include "services/preset_manager.hpp"
 #include "services/state_manager.hpp"
+#include "services/thread_pool.hpp"
 #include "services/ui_manager.hpp"
 
 namespace otto::services {
 
   Application::Application(ServiceStorage<LogManager>::Factory log_fact,
+                           ServiceStorage<ThreadPool>::Factory thread_pool_fact,
                            ServiceStorage<StateManager>::Factory state_fact,
                            ServiceStorage<PresetManager>::Factory preset_fact,
                            ServiceStorage<AudioManager>::Factory audio_fact,
                            ServiceStorage<UIManager>::Factory ui_fact,
+                           ServiceStorage<ClockManager>::Factory clock_fact,
                            ServiceStorage<EngineManager>::Factory engine_fact)
-    : log_manager(std::move(log_fact)),
-      state_manager(std::move(state_fact)),
-      preset_manager(std::move(preset_fact)),
-      audio_manager(std::move(audio_fact)),
-      ui_manager(std::move(ui_fact)),
-      engine_manager(std::move(engine_fact))
+    : log_manager(std::move(log_fact), "Log"),
+      thread_pool(std::move(thread_pool_fact), "Thread pool"),
+      state_manager(std::move(state_fact), "State"),
+      preset_manager(std::move(preset_fact), "Presets"),
+      audio_manager(std::move(audio_fact), "Audio"),
+      ui_manager(std::move(ui_fact), "UI"),
+      clock_manager(std::move(clock_fact), "Clock"),
+      engine_manager(std::move(engine_fact), "Engines")
   {
     _current = this;
+    memory::log_report();
     events.post_init.fire();
   }
 
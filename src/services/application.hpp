@@ -4,6 +4,7 @@
 #include <functional>
 #include <memory>
 
+#include "services/memory.hpp"
 #include "util/event.hpp"
 #include "util/exception.hpp"
 #include "util/filesystem.hpp"
@@ -11,18 +12,23 @@
 namespace otto::services {
 
   struct AudioManager;
+  struct ClockManager;
   struct EngineManager;
   struct LogManager;
   struct PresetManager;
   struct UIManager;
   struct StateManager;
+  struct ThreadPool;
   struct Application;
 
   template<typename Service>
   struct ServiceStorage {
     using Factory = std::function<std::unique_ptr<Service>()>;
 
-    ServiceStorage(Factory f) : _storage(f()) {}
+    /// Construct the service with `f`, and charge what it allocates to `account`
+    ServiceStorage(Factory f, std::string_view account)
+      : _storage(f()), _memory_charge(account, memory::Kind::heap, _measure.bytes())
+    {}
 
     Service* operator->() noexcept
     {
@@ -39,7 +45,15 @@ namespace otto::services {
       return *_storage;
     }
 
+  private:
+    // Declared first, to start measuring before the service is constructed
+    memory::Measure _measure;
+
+  public:
     const std::unique_ptr<Service> _storage;
+
+  private:
+    memory::Charge _memory_charge;
   };
 
   struct ApplicationHandler {
@@ -77,10 +91,12 @@ namespace otto::services {
     static Application& current() noexcept;
 
     Application(ServiceStorage<LogManager>::Factory log_factory,
+                ServiceStorage<ThreadPool>::Factory thread_pool_factory,
                 ServiceStorage<StateManager>::Factory state_factory,
                 ServiceStorage<PresetManager>::Factory preset_factory,
                 ServiceStorage<AudioManager>::Factory audio_factory,
                 ServiceStorage<UIManager>::Factory ui_factory,
+                ServiceStorage<ClockManager>::Factory clock_factory,
                 ServiceStorage<EngineManager>::Factory engine_factory);
 
     virtual ~Application();
@@ -99,10 +115,12 @@ namespace otto::services {
     } events;
 
     ServiceStorage<LogManager> log_manager;
+    ServiceStorage<ThreadPool> thread_pool;
     ServiceStorage<StateManager> state_manager;
     ServiceStorage<PresetManager> preset_manager;
     ServiceStorage<AudioManager> audio_manager;
     ServiceStorage<UIManager> ui_manager;
+    ServiceStorage<ClockManager> clock_manager;
     ServiceStorage<EngineManager> engine_manager;
 
   private:
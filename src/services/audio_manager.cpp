@@ -2,12 +2,19 @@
 
 #include <Gamma/Domain.h>
 
+#include "services/latency.hpp"
+#include "services/log_manager.hpp"
+#include "services/session.hpp"
+#include "util/dsp/kernels.hpp"
+
 namespace otto::services {
 
-  AudioManager::AudioManager()
+  AudioManager::AudioManager() : _memory_account(memory::account("Audio"))
   {
     events.pre_init.fire();
     core::midi::generateFreqTable(440);
+    core::midi::shared_vector_pool();
+    LOGI("Using {} DSP kernels", util::dsp::kernels::name(util::dsp::kernels::table().isa));
   }
 
   core::audio::AudioBufferPool& AudioManager::buffer_pool() noexcept
@@ -17,6 +24,7 @@ namespace otto::services {
 
   void AudioManager::start() noexcept
   {
+    _buffers_charge = memory::Charge(_memory_account, memory::Kind::buffers, _buffer_pool.bytes());
     _running = true;
   }
 
@@ -28,6 +36,12 @@ namespace otto::services {
 
   void AudioManager::send_midi_event(core::midi::AnyMidiEvent evt) noexcept
   {
+    session::record_midi(evt);
+    util::match(evt, [](auto& e) {
+      if constexpr (std::is_base_of_v<core::midi::MidiEvent, std::decay_t<decltype(e)>>) {
+        if (e.timestamp == 0) e.timestamp = latency::stamp();
+      }
+    });
     midi_bufs.outer().emplace_back(std::move(evt));
   }
 
@@ -28,6 +28,7 @@ namespace otto::services {
     /// Send a midi event into the system.
     ///
     /// The `core::midi` namespace has some nice utils for constructing events.
+    /// Events without a timestamp are stamped with `latency::stamp()`.
     void send_midi_event(core::midi::AnyMidiEvent) noexcept;
 
     /// Get the current samplerate
@@ -40,6 +41,9 @@ namespace otto::services {
 
     /// Start audio processing
     ///
+    /// Charges the buffers of @ref buffer_pool to the "Audio" memory account,
+    /// so the buffer size has to be set before this is called.
+    ///
     /// \postconditions `running() == true`
     void start() noexcept;
 
@@ -62,6 +66,8 @@ namespace otto::services {
   private:
     core::audio::AudioBufferPool _buffer_pool{1};
     std::atomic_bool _running{false};
+    memory::Account& _memory_account;
+    memory::Charge _buffers_charge;
   };
 
 } // namespace otto::services
@@ -0,0 +1,165 @@
+#include "clock_manager.hpp"
+
+#include <cmath>
+
+#include "core/ui/vector_graphics.hpp"
+
+#include "services/audio_manager.hpp"
+#include "services/state_manager.hpp"
+#include "services/ui_manager.hpp"
+
+#include "util/utility.hpp"
+
+namespace otto::services {
+
+  using namespace core;
+  using Type = midi::RealtimeEvent::Type;
+  using Block = util::dsp::Transport::Block;
+
+  struct ClockScreen : ui::Screen {
+    ClockScreen(ClockManager& clock) : clock(clock) {}
+
+    void draw(ui::vg::Canvas& ctx) override;
+    void rotary(ui::RotaryEvent e) override;
+
+    ClockManager& clock;
+  };
+
+  ClockManager::ClockManager()
+    : _transport(Application::current().audio_manager->samplerate(), props.bpm.get()),
+      _bpm(props.bpm.get()),
+      _screen(std::make_unique<ClockScreen>(*this))
+  {
+    auto& ui_manager = *Application::current().ui_manager;
+    auto& state_manager = *Application::current().state_manager;
+
+    ui_manager.register_key_handler(ui::Key::play, [this](ui::Key) { toggle(); });
+    ui_manager.register_key_handler(ui::Key::clock,
+                                    [this, &ui_manager](ui::Key) { ui_manager.display(screen()); });
+
+    state_manager.attach("Clock", [this](nlohmann::json& data) { props.from_json(data); },
+                         [this] { return props.to_json(); });
+  }
+
+  ClockManager::~ClockManager() = default;
+
+  void ClockManager::start() noexcept
+  {
+    _command = Command::start;
+  }
+
+  void ClockManager::stop() noexcept
+  {
+    _command = Command::stop;
+  }
+
+  void ClockManager::toggle() noexcept
+  {
+    _command = Command::toggle;
+  }
+
+  const Block& ClockManager::process(audio::ProcessData<0>& data) noexcept
+  {
+    const auto sync = Sync(props.sync.get());
+    _transport.follow(sync == Sync::follow);
+    _transport.bpm(props.bpm);
+
+    _out_count = 0;
+    auto out = [this, sync](Type type, int time) {
+      if (sync != Sync::send || _out_count == int(_out.size())) return;
+      _out[_out_count++] = {type, time};
+    };
+
+    auto command = _command.exchange(Command::none);
+    if (command == Command::toggle) command = _transport.running() ? Command::stop : Command::start;
+    switch (command) {
+    case Command::start:
+      _transport.start();
+      out(Type::Start, 0);
+      break;
+    case Command::stop:
+      _transport.stop();
+      out(Type::Stop, 0);
+      break;
+    default: break;
+    }
+
+    if (sync == Sync::follow) {
+      for (auto& event : data.midi) {
+        util::match(event,
+                    [this](midi::RealtimeEvent& ev) {
+                      switch (ev.type) {
+                      case Type::Clock: _transport.tick(ev.time); break;
+                      case Type::Start: _transport.start(ev.time); break;
+                      case Type::Continue: _transport.resume(ev.time); break;
+                      case Type::Stop: _transport.stop(ev.time); break;
+                      }
+                    },
+                    [](auto&&) {});
+      }
+    }
+
+    auto& block = _transport.process(data.nframes);
+    block.for_each(1.0 / util::dsp::Transport::ppqn,
+                   [&](int frame, std::int64_t) { out(Type::Clock, frame); });
+
+    _bpm = _transport.bpm();
+    _running = _transport.running();
+    _position = _transport.position();
+    _frames += data.nframes;
+    return block;
+  }
+
+  void ClockManager::send(midi::shared_vector<midi::AnyMidiEvent>& midi)
+  {
+    for (int i = 0; i < _out_count; i++) midi.push_back(_out[i]);
+  }
+
+  // SCREEN //
+
+  void ClockScreen::rotary(ui::RotaryEvent ev)
+  {
+    switch (ev.rotary) {
+    case ui::Rotary::blue: clock.props.bpm.step(ev.clicks); break;
+    case ui::Rotary::green: clock.props.sync.step(ev.clicks); break;
+    default: break;
+    }
+  }
+
+  void ClockScreen::draw(ui::vg::Canvas& ctx)
+  {
+    using namespace ui::vg;
+
+    constexpr const char* sync_names[] = {"INTERNAL", "SEND CLOCK", "FOLLOW CLOCK"};
+    const auto sync = ClockManager::Sync(clock.props.sync.get());
+    const double position = clock.position();
+
+    ctx.beginPath();
+    ctx.font(Fonts::Norm, 80);
+    ctx.textAlign(HorizontalAlign::Center, VerticalAlign::Middle);
+    // A followed tempo can not be changed here
+    ctx.fillStyle(sync == ClockManager::Sync::follow ? Colours::Gray70 : Colours::Blue);
+    ctx.fillText(fmt::format("{:.1f}", clock.bpm()), {160, 100});
+
+    ctx.beginPath();
+    ctx.font(Fonts::Norm, 20);
+    ctx.fillStyle(Colours::Green);
+    ctx.fillText(sync_names[util::underlying(sync)], {160, 160});
+
+    // Bar and beat, counting from one
+    const auto beat = std::int64_t(std::floor(position));
+    ctx.beginPath();
+    ctx.fillStyle(Colours::White);
+    ctx.fillText(fmt::format("{}.{}", beat / 4 + 1, beat % 4 + 1), {160, 200});
+
+    // Lit for the first quarter of every beat
+    ctx.beginPath();
+    ctx.circle({40, 200}, 8);
+    if (clock.running() && position - beat < 0.25) {
+      ctx.fill(beat % 4 == 0 ? Colours::Red : Colours::Yellow);
+    } else {
+      ctx.fill(Colours::Gray50);
+    }
+  }
+
+} // namespace otto::services
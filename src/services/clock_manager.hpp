@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "core/audio/processor.hpp"
+#include "core/props/props.hpp"
+#include "core/service.hpp"
+#include "core/ui/screen.hpp"
+#include "services/application.hpp"
+#include "util/dsp/transport.hpp"
+
+namespace otto::services {
+
+  /// The global tempo and transport
+  ///
+  /// Keeps the tempo, play state and song position of everything that
+  /// plays in time, and syncs them with MIDI clock. The engine manager
+  /// advances it at the start of every block, and engines read the
+  /// @ref block from the audio thread to find the frames their steps fall
+  /// on. Other threads use the accessors, which read atomics.
+  ///
+  /// The play key starts and stops it.
+  struct ClockManager : core::Service {
+    enum struct Sync {
+      /// Run from the tempo that is set
+      internal,
+      /// Run from the tempo that is set, and send MIDI clock
+      send,
+      /// Follow the MIDI clock and transport messages received
+      follow,
+    };
+
+    struct Props : core::props::Properties<> {
+      core::props::Property<float> bpm = {this, "BPM", 120, core::props::has_limits::init(30, 300),
+                                          core::props::steppable::init(1)};
+      /// A @ref Sync
+      core::props::Property<int> sync = {this, "SYNC", 0, core::props::has_limits::init(0, 2),
+                                         core::props::steppable::init(1)};
+    } props;
+
+    /// \effects
+    ///  - register the play and clock key handlers
+    ///  - attach state loader/saver
+    ClockManager();
+    ~ClockManager();
+
+    /// Start from the beginning, at the next block
+    void start() noexcept;
+    /// Stop, at the next block
+    void stop() noexcept;
+    /// Start or stop, at the next block
+    void toggle() noexcept;
+
+    /// Advance the transport by one block
+    ///
+    /// Follows the clock and transport messages in `data` when set to. Call
+    /// from the audio thread, before any engine.
+    const util::dsp::Transport::Block& process(core::audio::ProcessData<0>& data) noexcept;
+
+    /// Add the clock messages for the block to `midi`, when sending
+    void send(core::midi::shared_vector<core::midi::AnyMidiEvent>& midi);
+
+    /// Where the transport is in this block. Only for the audio thread.
+    const util::dsp::Transport::Block& block() const noexcept
+    {
+      return _transport.block();
+    }
+
+    /// The tempo, as set or as followed
+    float bpm() const noexcept
+    {
+      return _bpm;
+    }
+
+    bool running() const noexcept
+    {
+      return _running;
+    }
+
+    /// The song position in beats, as of the last block
+    double position() const noexcept
+    {
+      return _position;
+    }
+
+    /// Frames processed since startup, as of the last block
+    ///
+    /// Runs whether or not the transport does, so it can timestamp input.
+    std::uint64_t frames() const noexcept
+    {
+      return _frames;
+    }
+
+    core::ui::Screen& screen() noexcept
+    {
+      return *_screen;
+    }
+
+  private:
+    enum struct Command { none, start, stop, toggle };
+
+    util::dsp::Transport _transport;
+    std::atomic<Command> _command = Command::none;
+
+    /// Messages to send for this block
+    std::array<core::midi::RealtimeEvent, util::dsp::Transport::max_events> _out;
+    int _out_count = 0;
+
+    std::atomic<float> _bpm;
+    std::atomic<bool> _running = false;
+    std::atomic<double> _position = 0;
+    std::atomic<std::uint64_t> _frames = 0;
+
+    std::unique_ptr<core::ui::Screen> _screen;
+  };
+
+} // namespace otto::services
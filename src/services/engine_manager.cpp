@@ -1,13 +1,21 @@
 #include "engine_manager.hpp"
 
+#include <algorithm>
+
 #include <engines/synths/goss/goss.hpp>
 #include "core/engine/sequencer.hpp"
 #include "engines/fx/chorus/chorus.hpp"
+#include "engines/fx/convolution/convolution.hpp"
+#include "engines/fx/nebula/nebula.hpp"
 #include "engines/fx/pingpong/pingpong.hpp"
 #include "engines/fx/wormhole/wormhole.hpp"
+#include "engines/misc/looper/looper.hpp"
 #include "engines/misc/master/master.hpp"
+#include "engines/misc/modulation/modulation.hpp"
+#include "engines/misc/tuner/tuner.hpp"
 #include "engines/seq/euclid/euclid.hpp"
 #include "engines/synths/OTTOFM/ottofm.hpp"
+#include "engines/synths/granular/granular.hpp"
 #include "engines/synths/hammond/hammond.hpp"
 #include "engines/synths/nuke/nuke.hpp"
 #include "engines/synths/potion/potion.hpp"
@@ -15,6 +23,11 @@
 #include "engines/synths/sampler/sampler.hpp"
 
 #include "services/application.hpp"
+#include "services/clock_manager.hpp"
+#include "services/latency.hpp"
+#include "services/memory.hpp"
+#include "services/metrics.hpp"
+#include "util/dsp/kernels.hpp"
 
 #include "core/ui/vector_graphics.hpp"
 
@@ -34,6 +47,52 @@ namespace otto::services {
     };
   };
 
+  /// The accounts using the most memory. Shown with shift + tuner.
+  struct MemoryScreen : ui::Screen {
+    void draw(ui::vg::Canvas& ctx) override
+    {
+      using namespace ui::vg;
+
+      ctx.font(Fonts::Norm, 20);
+      ctx.beginPath();
+      ctx.fillStyle(Colours::White);
+      ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+      ctx.fillText("Memory", {20, 20});
+
+      if constexpr (!memory::enabled) {
+        ctx.beginPath();
+        ctx.fillStyle(Colours::Red);
+        ctx.textAlign(HorizontalAlign::Center, VerticalAlign::Middle);
+        ctx.fillText("Accounting disabled", {160, 120});
+        return;
+      }
+
+      auto accounts = memory::accounts();
+      std::sort(accounts.begin(), accounts.end(),
+                [](auto* a, auto* b) { return a->total() > b->total(); });
+      constexpr std::size_t rows = 9;
+      if (accounts.size() > rows) accounts.resize(rows);
+
+      ctx.font(Fonts::Norm, 16);
+      float y = 50;
+      for (auto* a : accounts) {
+        ctx.beginPath();
+        ctx.fillStyle(Colours::Blue);
+        ctx.textAlign(HorizontalAlign::Left, VerticalAlign::Middle);
+        ctx.fillText(std::string(a->name()), {20, y});
+        ctx.beginPath();
+        ctx.fillStyle(Colours::Green);
+        ctx.textAlign(HorizontalAlign::Right, VerticalAlign::Middle);
+        auto objects = a->bytes(memory::Kind::heap) + a->bytes(memory::Kind::buffers);
+        ctx.fillText(memory::format_bytes(objects), {220, y});
+        ctx.beginPath();
+        ctx.fillStyle(Colours::Yellow);
+        ctx.fillText(memory::format_bytes(a->bytes(memory::Kind::assets)), {300, y});
+        y += 20;
+      }
+    }
+  };
+
   struct EffectOffEngine : EffectEngine {
     props::Properties<> props;
     EffectOffEngine() : EffectEngine("OFF", props, std::make_unique<OffScreen>()) {}
@@ -59,6 +118,7 @@ namespace otto::services {
     void start() override;
     audio::ProcessData<2> process(audio::ProcessData<1> external_in) override;
     AnyEngine* by_name(const std::string& name) noexcept override;
+    IEngineDispatcher* dispatcher(const std::string& name) noexcept override;
 
   private:
     std::unordered_map<std::string, std::function<AnyEngine*()>> engineGetters;
@@ -68,8 +128,13 @@ namespace otto::services {
     EngineDispatcher<EngineType::effect> effect1;
     EngineDispatcher<EngineType::effect> effect2;
 
-    engines::Master master;
-    // engines::Sequencer sequencer;
+    memory::Accounted<engines::Master> master{"Master"};
+    memory::Accounted<engines::Looper> looper{"Looper"};
+    memory::Accounted<engines::Sequencer> sequencer{"Drums"};
+    memory::Accounted<engines::Tuner> tuner{"Tuner"};
+    memory::Accounted<engines::Modulation> modulation{"Modulation"};
+
+    MemoryScreen memory_screen;
   };
 
   struct EffectSend {
@@ -175,6 +240,7 @@ namespace otto::services {
                               [&]() { return dynamic_cast<AnyEngine*>(effect2.current()); });
     engineGetters.try_emplace("Arpeggiator",
                               [&]() { return dynamic_cast<AnyEngine*>(arpeggiator.current()); });
+    engineGetters.try_emplace("Drums", [&]() { return dynamic_cast<AnyEngine*>(&sequencer); });
 
     arpeggiator.register_engine<ArpOffEngine>("OFF");
     arpeggiator.register_engine<engines::Euclid>("Euclid");
@@ -185,6 +251,7 @@ namespace otto::services {
     synth.register_engine<engines::RhodesSynth>("Rhodes");
     synth.register_engine<engines::OTTOFMSynth>("OTTO.FM");
     synth.register_engine<engines::Sampler>("Sampler");
+    synth.register_engine<engines::Granular>("Granular");
     effect1.register_engine<EffectOffEngine>("OFF");
     effect2.register_engine<EffectOffEngine>("OFF");
     effect1.register_engine<engines::Wormhole>("Wormhole");
@@ -193,6 +260,10 @@ namespace otto::services {
     effect2.register_engine<engines::Pingpong>("PingPong");
     effect1.register_engine<engines::Chorus>("Chorus");
     effect2.register_engine<engines::Chorus>("Chorus");
+    effect1.register_engine<engines::Convolution>("Convolution");
+    effect2.register_engine<engines::Convolution>("Convolution");
+    effect1.register_engine<engines::Nebula>("Nebula");
+    effect2.register_engine<engines::Nebula>("Nebula");
 
     arpeggiator.init();
     synth.init();
@@ -252,9 +323,25 @@ namespace otto::services {
       }
     });
 
-    // ui_manager.register_key_handler(ui::Key::sequencer, [&](ui::Key k) {
-    //     ui_manager.display(sequencer.screen());
-    // });
+    ui_manager.register_key_handler(ui::Key::sequencer, [&](ui::Key k) {
+      ui_manager.display(sequencer.screen());
+    });
+
+    ui_manager.register_key_handler(ui::Key::looper, [&](ui::Key k) {
+      ui_manager.display(looper.screen());
+    });
+
+    ui_manager.register_key_handler(ui::Key::tuner, [&](ui::Key k) {
+      if (ui_manager.is_pressed(ui::Key::shift)) {
+        ui_manager.display(memory_screen);
+      } else {
+        ui_manager.display(tuner.screen());
+      }
+    });
+
+    ui_manager.register_key_handler(ui::Key::modulation, [&](ui::Key k) {
+      ui_manager.display(modulation.screen());
+    });
 
     static ui::Screen* master_last_screen = nullptr;
     static ui::Screen* send_last_screen = nullptr;
@@ -285,6 +372,10 @@ namespace otto::services {
       effect1.from_json(data["Effect1"]);
       effect2.from_json(data["Effect2"]);
       master.from_json(data["Master"]);
+      looper.from_json(data["Looper"]);
+      sequencer.from_json(data["Drums"]);
+      tuner.from_json(data["Tuner"]);
+      modulation.from_json(data["Modulation"]);
       arpeggiator.from_json(data["Sequencer"]);
     };
 
@@ -293,6 +384,10 @@ namespace otto::services {
                              {"Effect1", effect1.to_json()},
                              {"Effect2", effect2.to_json()},
                              {"Master", master.to_json()},
+                             {"Looper", looper.to_json()},
+                             {"Drums", sequencer.to_json()},
+                             {"Tuner", tuner.to_json()},
+                             {"Modulation", modulation.to_json()},
                              {"Arpeggiator", arpeggiator.to_json()}});
     };
 
@@ -309,35 +404,66 @@ namespace otto::services {
   audio::ProcessData<2> DefaultEngineManager::process(audio::ProcessData<1> external_in)
   { // Main processor function
     auto midi_in = external_in.midi_only();
+    // The driver finds the sound of these in the output
+    for (auto& event : midi_in.midi) {
+      util::match(event,
+                  [](midi::NoteOnEvent& e) {
+                    if (e.timestamp != 0) latency::note(e.time, e.timestamp);
+                  },
+                  [](auto&) {});
+    }
+    // Before anything that plays in time
+    auto& clock = *Application::current().clock_manager;
+    auto& beat = clock.process(midi_in);
+    const int samples_per_beat = std::lround(beat.samples_per_beat);
+    const int next_beat = beat.offset(std::ceil(beat.begin));
+    // Synths may write over the input buffer
+    auto line_in = Application::current().audio_manager->buffer_pool().allocate();
+    std::copy_n(external_in.audio.data(), external_in.nframes, line_in.data());
+    tuner.process(line_in, external_in.nframes);
+    // Before the engines it modulates
+    modulation.process(midi_in, line_in);
+    auto t = metrics::clock::now();
     auto arp_out = arpeggiator->process(midi_in);
+    t = metrics::stage_done(metrics::Stage::arpeggiator, t);
     auto synth_out = synth->process({external_in.audio, arp_out.midi, external_in.nframes});
-    // auto seq_out = sequencer.process(midi_in);
+    t = metrics::stage_done(metrics::Stage::synth, t);
+    modulation.follow_synth(synth_out);
+    t = metrics::clock::now();
+    looper.process(synth_out, line_in, samples_per_beat, next_beat);
+    t = metrics::stage_done(metrics::Stage::looper, t);
+    line_in.release();
+    auto seq_out = sequencer.process(midi_in);
+    t = metrics::stage_done(metrics::Stage::drums, t);
     auto fx1_bus = Application::current().audio_manager->buffer_pool().allocate();
     auto fx2_bus = Application::current().audio_manager->buffer_pool().allocate();
-    for (auto&& [snth, fx1, fx2] : util::zip(synth_out.audio, fx1_bus, fx2_bus)) {
-      fx1 = snth * synth_send.props.to_FX1;
-      fx2 = snth * synth_send.props.to_FX2;
-    }
+    util::dsp::kernels::scale(synth_out.audio.data(), fx1_bus.data(), fx1_bus.size(),
+                              synth_send.props.to_FX1);
+    util::dsp::kernels::scale(synth_out.audio.data(), fx2_bus.data(), fx2_bus.size(),
+                              synth_send.props.to_FX2);
+    t = metrics::clock::now();
     auto fx1_out = effect1->process(audio::ProcessData<1>(fx1_bus));
+    t = metrics::stage_done(metrics::Stage::effect1, t);
     auto fx2_out = effect2->process(audio::ProcessData<1>(fx2_bus));
+    t = metrics::stage_done(metrics::Stage::effect2, t);
     for (auto&& [snth, fx1L, fx1R, fx2L, fx2R] : util::zip(synth_out.audio, fx1_out.audio[0], fx1_out.audio[1], fx2_out.audio[0], fx1_out.audio[1])) {
       fx1L += fx2L + snth * synth_send.props.dry * (1 - synth_send.props.dry_pan);
       fx1R += fx2R + snth * synth_send.props.dry * (1 + synth_send.props.dry_pan);
     }
+    // The drums are mono, and only go to the dry mix
+    util::dsp::kernels::mix(seq_out.audio.data(), fx1_out.audio[0].data(), seq_out.nframes, 1);
+    util::dsp::kernels::mix(seq_out.audio.data(), fx1_out.audio[1].data(), seq_out.nframes, 1);
+    seq_out.audio.release();
     synth_out.audio.release();
     fx2_out.audio[0].release();
     fx2_out.audio[1].release();
     fx1_bus.release();
     fx2_bus.release();
-    return master.process(std::move(fx1_out));
-    /*
-    auto temp = Application::current().audio_manager->buffer_pool().allocate_multi_clear<2>();
-    for (auto&& [in, tmp] : util::zip(seq_out, temp)) {
-    std::get<0>(tmp) += std::get<0>(in);
-        std::get<1>(tmp) += std::get<0>(in);
-        }
-    return master.process({std::move(temp),external_in.midi,external_in.nframes});
-    */
+    t = metrics::clock::now();
+    auto out = master.process(std::move(fx1_out));
+    metrics::stage_done(metrics::Stage::master, t);
+    clock.send(out.midi);
+    return out;
   }
 
   AnyEngine* DefaultEngineManager::by_name(const std::string& name) noexcept
@@ -348,4 +474,13 @@ namespace otto::services {
     return getter->second();
   }
 
+  IEngineDispatcher* DefaultEngineManager::dispatcher(const std::string& name) noexcept
+  {
+    if (name == "Synth") return &synth;
+    if (name == "Effect1") return &effect1;
+    if (name == "Effect2") return &effect2;
+    if (name == "Arpeggiator") return &arpeggiator;
+    return nullptr;
+  }
+
 } // namespace otto::services
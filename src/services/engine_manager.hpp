@@ -53,6 +53,12 @@ namespace otto::services {
     /// \returns `nullptr` if no such engine was found
     virtual core::engine::AnyEngine* by_name(const std::string& name) noexcept = 0;
 
+    /// Get the dispatcher of a slot with selectable engines, by the name used
+    /// with @ref by_name
+    ///
+    /// \returns `nullptr` if there is no such slot, or its engine is fixed
+    virtual core::engine::IEngineDispatcher* dispatcher(const std::string& name) noexcept = 0;
+
     /// For now, this is the way to get the default EngineManager implementation
     /// 
     /// This is very likely to be changed in the future
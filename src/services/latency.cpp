@@ -0,0 +1,115 @@
+#include "latency.hpp"
+
+#include <mutex>
+
+namespace otto::services::latency {
+
+  namespace {
+    thread_local std::int64_t arrival = 0;
+
+    /// Only used by the audio thread
+    Detector detector;
+    std::uint64_t detected = 0;
+
+    /// A copy of the stats of the detector, for other threads
+    std::mutex shared_mutex;
+    Stats shared;
+
+    bool sounding(const float* left, const float* right, int i) noexcept
+    {
+      return std::abs(left[i]) > Detector::threshold || std::abs(right[i]) > Detector::threshold;
+    }
+  } // namespace
+
+  std::int64_t stamp() noexcept
+  {
+    return arrival != 0 ? arrival : now();
+  }
+
+  Arrival::Arrival(std::int64_t ns) noexcept : _previous(arrival)
+  {
+    arrival = ns;
+  }
+
+  Arrival::~Arrival() noexcept
+  {
+    arrival = _previous;
+  }
+
+  // DETECTOR //
+
+  void Detector::note(int frame, std::int64_t stamp) noexcept
+  {
+    if (_count == capacity) return;
+    _waiting[_count++] = {std::max(frame, 0), stamp, 0, false};
+  }
+
+  void Detector::block(const float* left,
+                       const float* right,
+                       int nframes,
+                       std::int64_t output_ns,
+                       int samplerate) noexcept
+  {
+    const auto timeout_frames = std::int64_t(timeout * samplerate);
+    int kept = 0;
+    for (int n = 0; n < _count; n++) {
+      auto w = _waiting[n];
+      const int from = std::min(w.frame, nframes);
+      if (!w.checked) {
+        w.checked = true;
+        const bool before = from == 0 ? _sounding : sounding(left, right, from - 1);
+        if (before) {
+          _stats.masked++;
+          continue;
+        }
+      }
+      int i = from;
+      while (i < nframes && !sounding(left, right, i)) i++;
+      if (i < nframes) {
+        const auto heard = output_ns + std::int64_t(i) * 1'000'000'000 / samplerate;
+        _stats.histogram.add((heard - w.stamp) / 1e6);
+        continue;
+      }
+      w.waited += nframes - from;
+      if (w.waited >= timeout_frames) {
+        _stats.unheard++;
+        continue;
+      }
+      w.frame = 0;
+      _waiting[kept++] = w;
+    }
+    _count = kept;
+    if (nframes > 0) _sounding = sounding(left, right, nframes - 1);
+  }
+
+  // MEASURING //
+
+  void note(int frame, std::int64_t stamp) noexcept
+  {
+    detector.note(frame, stamp);
+  }
+
+  void block(const float* left,
+             const float* right,
+             int nframes,
+             std::int64_t output_ns,
+             int samplerate) noexcept
+  {
+    detector.block(left, right, nframes, output_ns, samplerate);
+    const auto& s = detector.stats();
+    const auto total = s.histogram.count + s.masked + s.unheard;
+    if (total == detected) return;
+    // Never wait on a reader, the next block copies it instead
+    std::unique_lock lock(shared_mutex, std::try_to_lock);
+    if (!lock) return;
+    shared = s;
+    detected = total;
+  }
+
+  Stats stats() noexcept
+  {
+    std::unique_lock lock(shared_mutex);
+    return shared;
+  }
+
+} // namespace otto::services::latency
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+/// Note-on to sound latency
+///
+/// Input is stamped where it reaches OTTO: MIDI in the RtMidi callback, keys
+/// with the kernel's evdev time. The stamp rides on the MIDI event, through
+/// `ProcessData` and the engines, as `MidiEvent::timestamp`. After each block,
+/// the @ref Detector finds the first sample that is not silent at or after
+/// each new note on. The latency is the time that sample reaches the output,
+/// less the stamp, so it includes the wait for the next block, the engines,
+/// and the buffering in the driver.
+///
+/// Sound can only be told apart from what is already playing when the output
+/// was silent before the note. Notes that start over sound are counted as
+/// masked instead, so measure with notes that are separated by silence, like
+/// the rests of `otto_soak`.
+///
+/// The results are published with the metrics, and printed by
+/// `otto_metrics` and `otto_soak`.
+///
+/// This header only depends on the standard library, like `metrics.hpp`,
+/// which embeds @ref Stats.
+namespace otto::services::latency {
+
+  /// Stamps are nanoseconds on this clock. On Linux it is `CLOCK_MONOTONIC`,
+  /// which evdev times are switched to.
+  using clock = std::chrono::steady_clock;
+
+  inline std::int64_t to_ns(clock::time_point time) noexcept
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+  }
+
+  inline std::int64_t now() noexcept
+  {
+    return to_ns(clock::now());
+  }
+
+  /// The stamp of input that arrives on this thread now: the one of the
+  /// enclosing @ref Arrival, or the current time
+  std::int64_t stamp() noexcept;
+
+  /// While it exists, input on this thread is stamped with `ns`
+  ///
+  /// For drivers that know when input arrived, and pass it on through code
+  /// that does not take a stamp, like the key handlers.
+  struct Arrival {
+    explicit Arrival(std::int64_t ns) noexcept;
+    ~Arrival() noexcept;
+
+    Arrival(const Arrival&) = delete;
+    Arrival& operator=(const Arrival&) = delete;
+
+  private:
+    std::int64_t _previous;
+  };
+
+  /// Latencies in buckets of 1 ms. The last bucket counts everything longer.
+  struct Histogram {
+    static constexpr int bucket_count = 64;
+    static constexpr double bucket_ms = 1;
+
+    void add(double ms) noexcept
+    {
+      const int bucket = std::clamp(int(ms / bucket_ms), 0, bucket_count - 1);
+      buckets[bucket]++;
+      if (count == 0 || ms < min_ms) min_ms = float(ms);
+      if (count == 0 || ms > max_ms) max_ms = float(ms);
+      sum_ms += ms;
+      count++;
+    }
+
+    double mean_ms() const noexcept
+    {
+      return count == 0 ? 0 : sum_ms / count;
+    }
+
+    /// The upper edge of the bucket the `p` quantile is in
+    double quantile_ms(double p) const noexcept
+    {
+      if (count == 0) return 0;
+      const auto rank = std::uint64_t(std::ceil(p * count));
+      std::uint64_t seen = 0;
+      for (int i = 0; i < bucket_count; i++) {
+        seen += buckets[i];
+        if (seen < rank || seen == 0) continue;
+        if (i == bucket_count - 1) break;
+        return std::min((i + 1) * bucket_ms, double(max_ms));
+      }
+      return max_ms;
+    }
+
+    std::uint32_t buckets[bucket_count] = {};
+    std::uint64_t count = 0;
+    double sum_ms = 0;
+    float min_ms = 0;
+    float max_ms = 0;
+  };
+
+  struct Stats {
+    Histogram histogram;
+    /// Notes that started while the output was sounding
+    std::uint64_t masked = 0;
+    /// Notes that were not heard within @ref Detector::timeout
+    std::uint64_t unheard = 0;
+  };
+
+  static_assert(std::is_trivially_copyable_v<Stats>);
+
+  /// Finds the first sound after each note on. Only used by one thread, and
+  /// never allocates.
+  struct Detector {
+    /// Samples at or below this are silent. -60 dBFS.
+    static constexpr float threshold = 0.001f;
+    /// Seconds of silence after which a note is counted as unheard
+    static constexpr double timeout = 1;
+    /// Notes that can wait at once. More are ignored.
+    static constexpr int capacity = 32;
+
+    /// A note on takes effect at `frame` of the next block
+    void note(int frame, std::int64_t stamp) noexcept;
+
+    /// Look for the sound of the waiting notes in a processed block
+    ///
+    /// \param output_ns when the first frame of the block reaches the output
+    void block(const float* left,
+               const float* right,
+               int nframes,
+               std::int64_t output_ns,
+               int samplerate) noexcept;
+
+    const Stats& stats() const noexcept
+    {
+      return _stats;
+    }
+
+  private:
+    struct Waiting {
+      /// The frame to look from, in the next block
+      int frame;
+      std::int64_t stamp;
+      /// Frames of silence so far
+      std::int64_t waited;
+      /// Whether it has been checked for masking
+      bool checked;
+    };
+
+    std::array<Waiting, capacity> _waiting = {};
+    int _count = 0;
+    /// Whether the last frame of the previous block was sounding
+    bool _sounding = false;
+    Stats _stats;
+  };
+
+  // MEASURING //
+
+  /// A note on with `stamp` takes effect at `frame` of the next block. Audio
+  /// thread.
+  void note(int frame, std::int64_t stamp) noexcept;
+
+  /// Look for the sound of the waiting notes in a processed block. Audio
+  /// thread.
+  ///
+  /// \param output_ns when the first frame of the block reaches the output
+  void block(const float* left,
+             const float* right,
+             int nframes,
+             std::int64_t output_ns,
+             int samplerate) noexcept;
+
+  /// The measurements so far. Any thread.
+  Stats stats() noexcept;
+
+} // namespace otto::services::latency
@@ -25,9 +25,16 @@ namespace otto::services {
                                    std::string(message.prefix) + message.message);
     });
 
+    rt_log::logger().start();
+
     LOGI("LOGGING NOW");
   }
 
+  LogManager::~LogManager()
+  {
+    rt_log::logger().stop();
+  }
+
   void LogManager::set_thread_name(const std::string& name)
   {
     loguru::set_thread_name(name.c_str());
@@ -7,6 +7,7 @@
 #define LOGURU_USE_FMTLIB 1
 #include <loguru.hpp>
 #include "services/application.hpp"
+#include "services/rt_log.hpp"
 
 namespace otto::services {
 
@@ -14,6 +15,9 @@ namespace otto::services {
     /// Initialize the logger
     LogManager(int argc, char** argv, bool enable_console = true, const char* logFilePath = nullptr);
 
+    /// Stop the realtime log thread, flushing any pending messages
+    ~LogManager();
+
     /// Set how the current thread appears in the log
     void set_thread_name(const std::string& name);
   };
@@ -0,0 +1,200 @@
+#include "memory.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <fmt/format.h>
+
+#include "services/log_manager.hpp"
+
+namespace otto::services::memory {
+
+  namespace {
+    constexpr std::size_t max_accounts = 64;
+
+    // Constant initialized, so accounts can be charged during the static
+    // initialization of other files
+    Account registry[max_accounts];
+    std::atomic<std::size_t> account_count = 0;
+    std::mutex registry_mutex;
+
+    /// Bytes charged to all accounts
+    std::atomic<std::size_t> charged = 0;
+
+    /// Bytes allocated from the heap and not freed, by the whole process
+    std::size_t heap_in_use() noexcept
+    {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+      auto info = mallinfo2();
+      return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+      // The fields are `int`, and wrap around past 2 GiB
+      auto info = mallinfo();
+      return unsigned(info.uordblks) + unsigned(info.hblkhd);
+#else
+      return 0;
+#endif
+    }
+
+    /// Heap in use that has not been charged to an account
+    std::ptrdiff_t uncharged() noexcept
+    {
+      return std::ptrdiff_t(heap_in_use()) - std::ptrdiff_t(charged.load(std::memory_order_relaxed));
+    }
+  } // namespace
+
+  std::string_view name(Kind kind) noexcept
+  {
+    switch (kind) {
+      case Kind::heap: return "heap";
+      case Kind::buffers: return "buffers";
+      case Kind::assets: return "assets";
+    }
+    return "";
+  }
+
+  // ACCOUNT //
+
+  std::string_view Account::name() const noexcept
+  {
+    return _name.data();
+  }
+
+  std::size_t Account::total() const noexcept
+  {
+    std::size_t res = 0;
+    for (auto& b : _bytes) res += b.load(std::memory_order_relaxed);
+    return res;
+  }
+
+  void Account::add(Kind kind, std::size_t bytes) noexcept
+  {
+    _bytes[std::size_t(kind)].fetch_add(bytes, std::memory_order_relaxed);
+    _charges.fetch_add(1, std::memory_order_relaxed);
+    charged.fetch_add(bytes, std::memory_order_relaxed);
+    auto now = total();
+    auto peak = _peak.load(std::memory_order_relaxed);
+    while (now > peak && !_peak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+  }
+
+  void Account::remove(Kind kind, std::size_t bytes) noexcept
+  {
+    _bytes[std::size_t(kind)].fetch_sub(bytes, std::memory_order_relaxed);
+    _charges.fetch_sub(1, std::memory_order_relaxed);
+    charged.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  Account& account(std::string_view name)
+  {
+    std::lock_guard lock(registry_mutex);
+    const auto count = account_count.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < count; i++) {
+      if (registry[i].name() == name) return registry[i];
+    }
+    if (count == max_accounts) return registry[max_accounts - 1];
+    auto& res = registry[count];
+    auto length = std::min(name.size(), res._name.size() - 1);
+    std::copy_n(name.data(), length, res._name.data());
+    account_count.store(count + 1, std::memory_order_release);
+    return res;
+  }
+
+  std::vector<const Account*> accounts()
+  {
+    std::vector<const Account*> res;
+    const auto count = account_count.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < count; i++) res.push_back(&registry[i]);
+    return res;
+  }
+
+  // CHARGE //
+
+  Charge::Charge(Account& account, Kind kind, std::size_t bytes) noexcept
+  {
+    if constexpr (!enabled) return;
+    _account = &account;
+    _kind = kind;
+    _bytes = bytes;
+    _account->add(kind, bytes);
+  }
+
+  Charge::Charge(std::string_view account, Kind kind, std::size_t bytes)
+    : Charge(memory::account(account), kind, bytes)
+  {}
+
+  Charge::~Charge() noexcept
+  {
+    release();
+  }
+
+  Charge::Charge(Charge&& rhs) noexcept
+    : _account(std::exchange(rhs._account, nullptr)), _kind(rhs._kind), _bytes(rhs._bytes)
+  {}
+
+  Charge& Charge::operator=(Charge&& rhs) noexcept
+  {
+    if (this == &rhs) return *this;
+    release();
+    _account = std::exchange(rhs._account, nullptr);
+    _kind = rhs._kind;
+    _bytes = rhs._bytes;
+    return *this;
+  }
+
+  void Charge::release() noexcept
+  {
+    if (_account == nullptr) return;
+    _account->remove(_kind, _bytes);
+    _account = nullptr;
+  }
+
+  // MEASURE //
+
+  Measure::Measure() noexcept : _start(enabled ? uncharged() : 0) {}
+
+  std::size_t Measure::bytes() const noexcept
+  {
+    if constexpr (!enabled) return 0;
+    auto grown = uncharged() - _start;
+    return grown > 0 ? std::size_t(grown) : 0;
+  }
+
+  // REPORT //
+
+  std::string format_bytes(std::size_t bytes)
+  {
+    if (bytes < 1024) return fmt::format("{} B", bytes);
+    if (bytes < 1024 * 1024) return fmt::format("{:.1f} KiB", bytes / 1024.0);
+    return fmt::format("{:.1f} MiB", bytes / (1024.0 * 1024.0));
+  }
+
+  std::string report()
+  {
+    std::string res = fmt::format("{:<16} {:>10} {:>10} {:>10} {:>10} {:>10}\n", "Account", "Heap",
+                                  "Buffers", "Assets", "Total", "Peak");
+    for (auto* a : accounts()) {
+      res += fmt::format("{:<16} {:>10} {:>10} {:>10} {:>10} {:>10}\n", a->name(),
+                         format_bytes(a->bytes(Kind::heap)), format_bytes(a->bytes(Kind::buffers)),
+                         format_bytes(a->bytes(Kind::assets)), format_bytes(a->total()),
+                         format_bytes(a->peak()));
+    }
+    return res;
+  }
+
+  void log_report()
+  {
+    if constexpr (!enabled) return;
+    auto table = report();
+    std::size_t begin = 0;
+    for (auto end = table.find('\n'); end != std::string::npos; end = table.find('\n', begin)) {
+      LOGI("{}", std::string_view(table).substr(begin, end - begin));
+      begin = end + 1;
+    }
+  }
+
+} // namespace otto::services::memory
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// Memory accounting per engine and service
+///
+/// Memory is counted against an @ref Account, as one of the @ref Kind
+/// "kinds" of memory, by a @ref Charge that is kept for as long as the memory
+/// is in use. Nothing is counted when memory is allocated, so the audio
+/// thread and the thread pool are not slowed down.
+///
+///  - Engines and services are charged how much the heap grew while they were
+///    constructed, as measured by @ref Measure. @ref Accounted does this for
+///    members.
+///  - Assets, like samples and wavetables, are charged their size by the
+///    code that loads them, and the charge is kept with the asset.
+///  - The audio buffers are charged by the @ref AudioManager.
+///
+/// What an engine allocates later, other than assets, is not counted.
+///
+/// The counting is enabled with the CMake option
+/// `OTTO_ENABLE_MEMORY_ACCOUNTING`. Without it, the accounts stay empty.
+namespace otto::services::memory {
+
+#if defined(OTTO_ENABLE_MEMORY_ACCOUNTING) && OTTO_ENABLE_MEMORY_ACCOUNTING
+  constexpr bool enabled = true;
+#else
+  constexpr bool enabled = false;
+#endif
+
+  enum struct Kind : std::uint8_t {
+    /// Objects and their members
+    heap,
+    /// Audio buffers
+    buffers,
+    /// Samples, wavetables and other files loaded into memory
+    assets,
+  };
+
+  constexpr std::size_t kind_count = 3;
+
+  std::string_view name(Kind) noexcept;
+
+  struct Account {
+    constexpr Account() noexcept = default;
+
+    std::string_view name() const noexcept;
+
+    /// Bytes of `kind` in use
+    std::size_t bytes(Kind kind) const noexcept
+    {
+      return _bytes[std::size_t(kind)].load(std::memory_order_relaxed);
+    }
+
+    /// Bytes of all kinds in use
+    std::size_t total() const noexcept;
+
+    /// The most bytes of all kinds that have been in use at once
+    std::size_t peak() const noexcept
+    {
+      return _peak.load(std::memory_order_relaxed);
+    }
+
+    /// Charges that have not been released
+    std::size_t charges() const noexcept
+    {
+      return _charges.load(std::memory_order_relaxed);
+    }
+
+    /// Count one more charge of `bytes`
+    void add(Kind kind, std::size_t bytes) noexcept;
+    /// Release a charge of `bytes`
+    void remove(Kind kind, std::size_t bytes) noexcept;
+
+  private:
+    friend Account& account(std::string_view name);
+
+    std::array<std::atomic<std::size_t>, kind_count> _bytes = {};
+    std::atomic<std::size_t> _peak = 0;
+    std::atomic<std::size_t> _charges = 0;
+    std::array<char, 32> _name = {};
+  };
+
+  /// The account named `name`, which is created if it does not exist
+  ///
+  /// There is room for a fixed number of accounts. Past that, the last one
+  /// is shared.
+  Account& account(std::string_view name);
+
+  /// All accounts, in the order they were created
+  std::vector<const Account*> accounts();
+
+  /// Counts `bytes` of `kind` against an account until it is destroyed or
+  /// released
+  struct Charge {
+    Charge() noexcept = default;
+    Charge(Account& account, Kind kind, std::size_t bytes) noexcept;
+    Charge(std::string_view account, Kind kind, std::size_t bytes);
+    ~Charge() noexcept;
+
+    Charge(Charge&& rhs) noexcept;
+    Charge& operator=(Charge&& rhs) noexcept;
+
+    /// Release the charge before it is destroyed
+    void release() noexcept;
+
+    std::size_t bytes() const noexcept
+    {
+      return _bytes;
+    }
+
+  private:
+    Account* _account = nullptr;
+    Kind _kind = Kind::heap;
+    std::size_t _bytes = 0;
+  };
+
+  /// Measures how much the heap has grown since it was constructed
+  ///
+  /// Memory charged to any account in the meantime is left out, so an asset
+  /// loaded by an engine or an @ref Accounted member of a service is not
+  /// counted twice.
+  ///
+  /// Reads the statistics of the C library allocator, so it costs nothing in
+  /// between, but it also counts what other threads allocate and free in the
+  /// meantime. Use it around work that allocates a lot, like constructing an
+  /// engine. Without allocator statistics, it always measures 0.
+  struct Measure {
+    Measure() noexcept;
+
+    /// Bytes the heap has grown by, or 0 if it has shrunk
+    std::size_t bytes() const noexcept;
+
+  private:
+    std::ptrdiff_t _start;
+  };
+
+  namespace detail {
+    /// Starts measuring before the bases after it are constructed
+    struct Measured {
+      Measure _measure;
+    };
+  } // namespace detail
+
+  /// `T`, charged to the account `name` for what it allocates while it is
+  /// constructed
+  ///
+  /// For objects that are not made by a factory, like members. The object
+  /// itself is not counted, it is part of its owner.
+  template<typename T>
+  struct Accounted : private detail::Measured, T {
+    template<typename... Args>
+    Accounted(std::string_view name, Args&&... args)
+      : T(std::forward<Args>(args)...), _memory_charge(name, Kind::heap, _measure.bytes())
+    {}
+
+  private:
+    Charge _memory_charge;
+  };
+
+  /// The bytes used by the elements of `v`
+  template<typename T>
+  std::size_t bytes_of(const std::vector<T>& v) noexcept
+  {
+    return v.capacity() * sizeof(T);
+  }
+
+  /// `bytes` in B, KiB or MiB
+  std::string format_bytes(std::size_t bytes);
+
+  /// A table of all accounts, one per line
+  std::string report();
+
+  /// Log @ref report
+  void log_report();
+
+} // namespace otto::services::memory
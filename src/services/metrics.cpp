@@ -0,0 +1,251 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#if OTTO_ENABLE_METRICS
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "services/application.hpp"
+#include "services/engine_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/memory.hpp"
+
+namespace otto::services::metrics {
+
+  namespace {
+    using namespace std::chrono;
+
+    /// The shortest time between two snapshots
+    constexpr auto publish_interval = milliseconds(100);
+
+    void store_max(std::atomic<std::uint64_t>& max, std::uint64_t value) noexcept
+    {
+      auto cur = max.load(std::memory_order_relaxed);
+      while (value > cur && !max.compare_exchange_weak(cur, value, std::memory_order_relaxed)) {
+      }
+    }
+
+    struct Counters {
+      std::atomic<std::uint64_t> callbacks = 0;
+      std::atomic<std::uint64_t> xruns = 0;
+      std::atomic<std::uint64_t> callback_ns = 0;
+      std::atomic<std::uint64_t> callback_max_ns = 0;
+      std::atomic<std::uint64_t> frames = 0;
+      std::atomic<std::uint32_t> samplerate = 0;
+      std::atomic<std::uint32_t> buffer_size = 0;
+      std::array<std::atomic<std::uint64_t>, stage_count> stage_ns = {};
+      std::atomic<std::uint32_t> voices = 0;
+      std::atomic<std::uint64_t> ui_frames = 0;
+      std::atomic<std::uint64_t> ui_frame_ns = 0;
+      std::atomic<std::uint64_t> ui_frame_max_ns = 0;
+    } counters;
+
+    /// The counters at the previous snapshot, to take the intervals from
+    struct Previous {
+      clock::time_point time = clock::now();
+      std::uint64_t callbacks = 0;
+      std::uint64_t callback_ns = 0;
+      std::uint64_t frames = 0;
+      std::array<std::uint64_t, stage_count> stage_ns = {};
+      std::uint64_t ui_frames = 0;
+      std::uint64_t ui_frame_ns = 0;
+    } previous;
+
+    template<std::size_t N>
+    void copy_name(char (&dst)[N], std::string_view src) noexcept
+    {
+      auto length = std::min(src.size(), N - 1);
+      std::copy_n(src.data(), length, dst);
+      dst[length] = '\0';
+    }
+
+#if OTTO_ENABLE_METRICS
+    /// Owns the shared memory object, and removes it at exit
+    struct Exporter {
+      Exporter()
+      {
+        int fd = shm_open(segment_name, O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+          LOGW("Could not create {}, metrics are not published: {}", segment_name,
+               std::strerror(errno));
+          return;
+        }
+        if (ftruncate(fd, sizeof(Segment)) == 0) {
+          void* ptr = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+          if (ptr != MAP_FAILED) _segment = static_cast<Segment*>(ptr);
+        }
+        close(fd);
+        if (_segment == nullptr) {
+          LOGW("Could not map {}, metrics are not published: {}", segment_name,
+               std::strerror(errno));
+          shm_unlink(segment_name);
+          return;
+        }
+        // A reader that opens the object now sees an incompatible version
+        // until the header is complete
+        _segment->magic = 0;
+        _segment->version = version;
+        _segment->size = sizeof(Segment);
+        _segment->sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _segment->magic = magic;
+        LOGI("Publishing metrics in {}", segment_name);
+      }
+
+      ~Exporter()
+      {
+        if (_segment == nullptr) return;
+        munmap(_segment, sizeof(Segment));
+        shm_unlink(segment_name);
+      }
+
+      Segment* _segment = nullptr;
+    };
+#endif
+  } // namespace
+
+  std::string_view name(Stage stage) noexcept
+  {
+    switch (stage) {
+      case Stage::arpeggiator: return "Arpeggiator";
+      case Stage::synth: return "Synth";
+      case Stage::drums: return "Drums";
+      case Stage::looper: return "Looper";
+      case Stage::effect1: return "Effect1";
+      case Stage::effect2: return "Effect2";
+      case Stage::master: return "Master";
+    }
+    return "";
+  }
+
+  // RECORDING //
+
+  void audio_callback(clock::duration time, int nframes, int samplerate) noexcept
+  {
+    const auto ns = std::uint64_t(duration_cast<nanoseconds>(time).count());
+    counters.callbacks.fetch_add(1, std::memory_order_relaxed);
+    counters.callback_ns.fetch_add(ns, std::memory_order_relaxed);
+    counters.frames.fetch_add(nframes, std::memory_order_relaxed);
+    counters.samplerate.store(samplerate, std::memory_order_relaxed);
+    counters.buffer_size.store(nframes, std::memory_order_relaxed);
+    store_max(counters.callback_max_ns, ns);
+  }
+
+  void xrun() noexcept
+  {
+    counters.xruns.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  clock::time_point stage_done(Stage stage, clock::time_point start) noexcept
+  {
+    const auto now = clock::now();
+    const auto ns = std::uint64_t(duration_cast<nanoseconds>(now - start).count());
+    counters.stage_ns[std::size_t(stage)].fetch_add(ns, std::memory_order_relaxed);
+    return now;
+  }
+
+  void voices(int count) noexcept
+  {
+    counters.voices.store(count, std::memory_order_relaxed);
+  }
+
+  void ui_frame(clock::duration time) noexcept
+  {
+    const auto ns = std::uint64_t(duration_cast<nanoseconds>(time).count());
+    counters.ui_frames.fetch_add(1, std::memory_order_relaxed);
+    counters.ui_frame_ns.fetch_add(ns, std::memory_order_relaxed);
+    store_max(counters.ui_frame_max_ns, ns);
+  }
+
+  // PUBLISHING //
+
+  Snapshot take_snapshot()
+  {
+    Snapshot res = {};
+    const auto now = clock::now();
+    res.time_ns = duration_cast<nanoseconds>(now.time_since_epoch()).count();
+    res.interval_ns = duration_cast<nanoseconds>(now - previous.time).count();
+    previous.time = now;
+
+    res.samplerate = counters.samplerate.load(std::memory_order_relaxed);
+    res.buffer_size = counters.buffer_size.load(std::memory_order_relaxed);
+    res.callbacks = counters.callbacks.load(std::memory_order_relaxed);
+    res.xruns = counters.xruns.load(std::memory_order_relaxed);
+    const auto callback_ns = counters.callback_ns.load(std::memory_order_relaxed);
+    const auto frames = counters.frames.load(std::memory_order_relaxed);
+    const auto callbacks = res.callbacks - previous.callbacks;
+    // The audio time that passed in the interval, which all loads are
+    // relative to
+    const double audio_ns =
+      res.samplerate == 0 ? 0 : (frames - previous.frames) * 1e9 / res.samplerate;
+    auto load = [&](std::uint64_t ns) { return audio_ns > 0 ? float(ns / audio_ns) : 0.f; };
+
+    res.cpu_load = load(callback_ns - previous.callback_ns);
+    if (callbacks > 0) res.callback_avg_us = (callback_ns - previous.callback_ns) / 1e3 / callbacks;
+    res.callback_max_us = counters.callback_max_ns.exchange(0, std::memory_order_relaxed) / 1e3f;
+    if (res.samplerate > 0) res.callback_budget_us = res.buffer_size * 1e6f / res.samplerate;
+    previous.callbacks = res.callbacks;
+    previous.callback_ns = callback_ns;
+    previous.frames = frames;
+
+    res.voices = counters.voices.load(std::memory_order_relaxed);
+
+    auto* engines = Application::current().engine_manager._storage.get();
+    for (std::size_t i = 0; i < stage_count; i++) {
+      auto& e = res.engines[i];
+      const auto stage = name(Stage(i));
+      copy_name(e.stage, stage);
+      auto* engine = engines ? engines->by_name(std::string(stage)) : nullptr;
+      copy_name(e.engine, engine ? std::string_view(engine->name()) : stage);
+      const auto ns = counters.stage_ns[i].load(std::memory_order_relaxed);
+      e.load = load(ns - previous.stage_ns[i]);
+      previous.stage_ns[i] = ns;
+    }
+    res.engine_count = stage_count;
+
+    auto accounts = memory::accounts();
+    std::sort(accounts.begin(), accounts.end(),
+              [](auto* a, auto* b) { return a->total() > b->total(); });
+    res.account_count = std::min(accounts.size(), std::size(res.accounts));
+    for (std::size_t i = 0; i < res.account_count; i++) {
+      copy_name(res.accounts[i].name, accounts[i]->name());
+      res.accounts[i].bytes = accounts[i]->total();
+      res.accounts[i].peak = accounts[i]->peak();
+    }
+
+    res.ui_frames = counters.ui_frames.load(std::memory_order_relaxed);
+    const auto ui_frame_ns = counters.ui_frame_ns.load(std::memory_order_relaxed);
+    if (res.ui_frames > previous.ui_frames) {
+      const auto ui_frames = res.ui_frames - previous.ui_frames;
+      res.ui_frame_avg_ms = (ui_frame_ns - previous.ui_frame_ns) / 1e6 / ui_frames;
+    }
+    res.ui_frame_max_ms = counters.ui_frame_max_ns.exchange(0, std::memory_order_relaxed) / 1e6f;
+    previous.ui_frames = res.ui_frames;
+    previous.ui_frame_ns = ui_frame_ns;
+
+    res.latency = latency::stats();
+
+    return res;
+  }
+
+  void publish()
+  {
+#if OTTO_ENABLE_METRICS
+    static clock::time_point last;
+    const auto now = clock::now();
+    if (now - last < publish_interval) return;
+    last = now;
+    static Exporter exporter;
+    if (exporter._segment == nullptr) return;
+    write(*exporter._segment, take_snapshot());
+#endif
+  }
+
+} // namespace otto::services::metrics
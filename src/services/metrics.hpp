@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+#include "services/latency.hpp"
+
+/// Runtime metrics, published in shared memory for external monitoring
+///
+/// The audio and UI threads count into lock-free counters. About ten times a
+/// second, the UI thread gathers them into a @ref Snapshot, and writes it to
+/// the POSIX shared memory object @ref segment_name. Tools like
+/// `otto_metrics` map the object read-only and read it at any time, without
+/// any synchronization with OTTO.
+///
+/// The @ref Segment is protected by a sequence lock: the writer makes the
+/// sequence odd while it writes, so a reader retries when it read during a
+/// write. Readers never block the writer.
+///
+/// This header only depends on the standard library, so readers do not have
+/// to link OTTO. The layout of @ref Segment is versioned. Change
+/// @ref version on any change to it.
+///
+/// Publishing can be turned off with the CMake option `OTTO_ENABLE_METRICS`.
+/// The counters are still kept.
+namespace otto::services::metrics {
+
+  constexpr std::uint32_t magic = 0x4f54544d; // "OTTM"
+  constexpr std::uint32_t version = 2;
+  constexpr const char* segment_name = "/otto-metrics";
+
+  /// The parts of the audio chain that are timed
+  enum struct Stage : std::uint8_t {
+    arpeggiator,
+    synth,
+    drums,
+    looper,
+    effect1,
+    effect2,
+    master,
+  };
+
+  constexpr std::size_t stage_count = 7;
+
+  /// The name of `stage`, as used by `EngineManager::by_name`
+  std::string_view name(Stage stage) noexcept;
+
+  // LAYOUT //
+
+  struct EngineMetrics {
+    /// The slot in the audio chain
+    char stage[16];
+    /// The selected engine
+    char engine[24];
+    /// Share of the time available per block, over the last interval
+    float load;
+  };
+
+  struct AccountMetrics {
+    char name[24];
+    std::uint64_t bytes;
+    std::uint64_t peak;
+  };
+
+  /// Everything that is published. Loads and averages are over the interval
+  /// since the previous snapshot, counts are since startup.
+  struct Snapshot {
+    /// Writer's monotonic clock, when the snapshot was taken
+    std::uint64_t time_ns;
+    std::uint64_t interval_ns;
+
+    std::uint32_t samplerate;
+    std::uint32_t buffer_size;
+    std::uint64_t callbacks;
+    std::uint64_t xruns;
+    /// Share of the time available per block spent in the callback
+    float cpu_load;
+    float callback_avg_us;
+    float callback_max_us;
+    /// The time available per block
+    float callback_budget_us;
+
+    /// Voices of the synth that are playing a note
+    std::uint32_t voices;
+
+    std::uint32_t engine_count;
+    EngineMetrics engines[stage_count];
+
+    std::uint32_t account_count;
+    AccountMetrics accounts[16];
+
+    std::uint64_t ui_frames;
+    float ui_frame_avg_ms;
+    float ui_frame_max_ms;
+
+    /// Note-on to sound, since startup
+    latency::Stats latency;
+  };
+
+  static_assert(std::is_trivially_copyable_v<Snapshot>);
+  static_assert(std::atomic<std::uint32_t>::is_always_lock_free,
+                "The sequence must work across processes");
+
+  /// The contents of the shared memory object
+  struct Segment {
+    std::uint32_t magic;
+    std::uint32_t version;
+    /// `sizeof(Segment)`, as a check on the layout
+    std::uint32_t size;
+    /// Odd while the snapshot is written
+    std::atomic<std::uint32_t> sequence;
+    Snapshot snapshot;
+  };
+
+  /// Write `snapshot` to `segment`. There may only be one writer.
+  inline void write(Segment& segment, const Snapshot& snapshot) noexcept
+  {
+    const auto seq = segment.sequence.load(std::memory_order_relaxed);
+    segment.sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&segment.snapshot, &snapshot, sizeof(Snapshot));
+    segment.sequence.store(seq + 2, std::memory_order_release);
+  }
+
+  /// Read a consistent snapshot from `segment`
+  ///
+  /// \returns `false` if there was a write during each of `tries` attempts
+  inline bool read(const Segment& segment, Snapshot& out, int tries = 100) noexcept
+  {
+    for (int i = 0; i < tries; i++) {
+      const auto before = segment.sequence.load(std::memory_order_acquire);
+      if (before % 2 != 0) continue;
+      std::memcpy(&out, &segment.snapshot, sizeof(Snapshot));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (segment.sequence.load(std::memory_order_relaxed) == before) return true;
+    }
+    return false;
+  }
+
+  /// Whether `segment` was written by a compatible version of OTTO
+  inline bool compatible(const Segment& segment) noexcept
+  {
+    return segment.magic == magic && segment.version == version &&
+           segment.size == sizeof(Segment);
+  }
+
+  // RECORDING //
+
+  using clock = std::chrono::steady_clock;
+
+  /// Count an audio callback that took `time` for `nframes`. Audio thread.
+  void audio_callback(clock::duration time, int nframes, int samplerate) noexcept;
+
+  /// Count a buffer over- or underrun. Audio thread.
+  void xrun() noexcept;
+
+  /// Count the time from `start` to now against `stage`. Audio thread.
+  ///
+  /// \returns now, to start the next stage with
+  clock::time_point stage_done(Stage stage, clock::time_point start) noexcept;
+
+  /// Set the number of playing voices. Audio thread.
+  void voices(int count) noexcept;
+
+  /// Count a UI frame that took `time` to draw. UI thread.
+  void ui_frame(clock::duration time) noexcept;
+
+  /// Gather the counters into a snapshot, and reset the ones that are per
+  /// interval
+  ///
+  /// Reads the engine names and the memory accounts, so it must be called
+  /// from the thread that selects engines.
+  Snapshot take_snapshot();
+
+  /// Publish a snapshot, if the last one was published long enough ago. UI
+  /// thread.
+  void publish();
+
+} // namespace otto::services::metrics
@@ -1,6 +1,7 @@
 #include "preset_manager.hpp"
 
 #include "services/debug_ui.hpp"
+#include "services/session.hpp"
 
 namespace otto::services {
 
@@ -11,8 +12,17 @@ namespace otto::services {
     load_preset_files();
   }
 
+  PresetManager::~PresetManager()
+  {
+    if (_reloading.valid()) {
+      _reloading.cancel();
+      _reloading.wait();
+    }
+  }
+
   const std::vector<std::string>& PresetManager::preset_names(const std::string& engine_name)
   {
+    poll_reload();
     auto eg_found = _preset_data.find(engine_name);
     if (eg_found == _preset_data.end()) {
       throw exception(ErrorCode::no_such_engine, "No presets for engine: {}", engine_name);
@@ -56,6 +66,7 @@ namespace otto::services {
     engine.props().as<core::props::serializable>().from_json(pd.data[idx]);
     engine.current_preset(idx);
     if (!no_enable_callback) engine.on_enable();
+    session::record(session::Preset{engine.name(), pd.names[idx]});
   }
 
   void PresetManager::apply_preset(core::engine::AnyEngine& engine,
@@ -71,6 +82,7 @@ namespace otto::services {
     engine.props().as<core::props::serializable>().from_json(pd.data[idx]);
     engine.current_preset(idx);
     if (!no_enable_callback) engine.on_enable();
+    session::record(session::Preset{engine.name(), pd.names[idx]});
   }
 
   void PresetManager::load_preset_files()
@@ -81,28 +93,107 @@ namespace otto::services {
       fs::create_directories(presets_dir);
     }
     DLOGI("Loading presets");
-    for (auto&& de : fs::recursive_directory_iterator(presets_dir)) {
-      if (de.is_directory()) continue;
-      auto filename = de.path().filename().string();
-      if (filename.size() == 0 || filename.c_str()[0] == '.') continue;
-      LOGI_SCOPE("Loading preset file {}", de.path());
-      if (de.is_regular_file() || de.is_symlink()) {
-        util::JsonFile jf{de.path()};
+    // A reload in progress would be older than this one
+    if (_reloading.valid()) {
+      _reloading.cancel();
+      _reloading.wait();
+    }
+    {
+      std::unique_lock lock(_reload_mutex);
+      _reloaded = nullptr;
+    }
+    _library.wait_ready();
+    _loaded_generation = _library.generation();
+    install(parse(presets_dir, _library.entries(), _files));
+  }
+
+  void PresetManager::poll_reload()
+  {
+    std::shared_ptr<const PresetFiles> reloaded;
+    {
+      std::unique_lock lock(_reload_mutex);
+      reloaded = std::move(_reloaded);
+    }
+    if (reloaded) install(std::move(reloaded));
+
+    const auto generation = _library.generation();
+    if (generation == _loaded_generation) return;
+    _loaded_generation = generation;
+    if (_reloading.valid()) _reloading.cancel();
+    _reloading = Application::current().thread_pool->submit(
+      [this, entries = _library.entries(), previous = _files] {
+        auto files = parse(presets_dir, entries, previous);
+        if (services::ThreadPool::cancelled()) return;
+        std::unique_lock lock(_reload_mutex);
+        _reloaded = std::move(files);
+      },
+      services::ThreadPool::Priority::low);
+  }
+
+  auto PresetManager::parse(const fs::path& dir,
+                            const util::LibraryIndex::Snapshot& entries,
+                            std::shared_ptr<const PresetFiles> previous)
+    -> std::shared_ptr<const PresetFiles>
+  {
+    auto res = std::make_shared<PresetFiles>();
+    for (auto&& entry : *entries) {
+      if (services::ThreadPool::cancelled()) break;
+      auto key = entry.path.string();
+      // Reuse the parsed file if it is unchanged
+      auto found = previous->find(key);
+      if (found != previous->end() && found->second.size == entry.size &&
+          found->second.mtime == entry.mtime) {
+        res->insert(*found);
+        continue;
+      }
+      auto path = dir / entry.path;
+      if (!fs::is_regular_file(path)) continue;
+      LOGI_SCOPE("Loading preset file {}", path);
+      try {
+        util::JsonFile jf{path};
         jf.read();
-        std::string engine = jf.data()["engine"];
-        std::string name = jf.data()["name"];
-        // map::operator[] creates the entry if it doesnt exist
-        auto& pd = _preset_data[engine];
-        if (auto found = util::find(pd.names, name); found != pd.names.end()) {
-          pd.data[found - pd.names.begin()] = std::move(jf.data()["props"]);
-          DLOGI("Reloaded preset '{}' for engine '{}", name, engine);
-        } else {
-          pd.names.push_back(name);
-          pd.data.emplace_back(std::move(jf.data()["props"]));
-          DLOGI("Loaded preset '{}' for engine '{}", name, engine);
-        }
+        PresetFile file;
+        file.size = entry.size;
+        file.mtime = entry.mtime;
+        file.engine = jf.data()["engine"];
+        file.name = jf.data()["name"];
+        file.props = std::move(jf.data()["props"]);
+        res->emplace(std::move(key), std::move(file));
+      } catch (std::exception& e) {
+        LOGE("Could not load preset file {}: {}", path, e.what());
       }
     }
+    return res;
+  }
+
+  void PresetManager::install(std::shared_ptr<const PresetFiles> files)
+  {
+    std::unordered_map<std::string, PresetNamesDataPair> presets;
+    for (auto& [path, file] : *files) {
+      auto& pd = presets[file.engine];
+      if (auto found = util::find(pd.names, file.name); found != pd.names.end()) {
+        pd.data[found - pd.names.begin()] = file.props;
+        DLOGI("Preset '{}' for engine '{}' is defined twice, using {}", file.name, file.engine,
+              path);
+      } else {
+        pd.names.push_back(file.name);
+        pd.data.push_back(file.props);
+      }
+    }
+    // Engines whose presets were all removed keep an empty entry, so the
+    // names vectors handed out stay valid
+    for (auto& [engine, pd] : _preset_data) {
+      if (presets.count(engine) == 0) {
+        pd.names.clear();
+        pd.data.clear();
+      }
+    }
+    for (auto& [engine, pd] : presets) {
+      auto& dst = _preset_data[engine];
+      dst.names = std::move(pd.names);
+      dst.data = std::move(pd.data);
+    }
+    _files = std::move(files);
   }
 
   void PresetManager::create_preset(const std::string& engine_name,
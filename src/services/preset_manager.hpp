@@ -1,10 +1,14 @@
 #pragma once
 
+#include <map>
+#include <mutex>
 #include <unordered_map>
 
 #include "core/engine/engine.hpp"
 #include "core/service.hpp"
 #include "services/application.hpp"
+#include "services/thread_pool.hpp"
+#include "util/library_index.hpp"
 
 namespace otto::services {
 
@@ -23,9 +27,17 @@ namespace otto::services {
     /// \effects `load_preset_files()`
     PresetManager();
 
+    /// Cancels a reload in progress
+    ~PresetManager();
+
     /// (Re)load preset files
     ///
-    /// Invoked by @ref init. Call to reload all preset files.
+    /// Invoked by @ref init. Call to reload all preset files. This blocks until
+    /// the library has been scanned, but only parses the files that changed
+    /// since the last load. Presets whose files were removed are dropped.
+    ///
+    /// Changes to the library that are found later are reloaded on the
+    /// thread pool, and picked up by @ref preset_names.
     ///
     /// \throws @ref filesystem::filesystem_error
     void load_preset_files();
@@ -86,12 +98,54 @@ namespace otto::services {
       std::vector<nlohmann::json> data;
     };
 
+    /// A parsed preset file
+    struct PresetFile {
+      std::uintmax_t size = 0;
+      std::int64_t mtime = 0;
+      std::string engine;
+      std::string name;
+      nlohmann::json props;
+    };
+
+    /// Parsed preset files, by their path in the library
+    using PresetFiles = std::map<std::string, PresetFile>;
+
+    /// Parse the files in `entries`, reusing the ones in `previous` that
+    /// are unchanged
+    ///
+    /// Does not touch the preset manager, so it can run on the thread pool
+    static std::shared_ptr<const PresetFiles> parse(const fs::path& dir,
+                                                    const util::LibraryIndex::Snapshot& entries,
+                                                    std::shared_ptr<const PresetFiles> previous);
+
+    /// Replace the presets with the ones in `files`
+    ///
+    /// The names vectors are updated in place, since widgets hold on to them
+    void install(std::shared_ptr<const PresetFiles> files);
+
+    /// Start a reload if the library has changed, and install a finished one
+    void poll_reload();
+
     // Key is engine name.
     // This design is chosen because we want to expose the names vector
     // separately.
     std::unordered_map<std::string, PresetNamesDataPair> _preset_data;
+    /// The files @ref _preset_data was built from
+    std::shared_ptr<const PresetFiles> _files = std::make_shared<const PresetFiles>();
 
     const fs::path presets_dir = Application::current().data_dir / "presets";
+
+    /// Keeps track of the preset files, including ones added at runtime
+    util::LibraryIndex _library = {presets_dir, {".json"}};
+    /// The @ref util::LibraryIndex::generation the presets were last loaded,
+    /// or are being reloaded at
+    unsigned _loaded_generation = 0;
+
+    services::ThreadPool::Task _reloading;
+    /// Guards @ref _reloaded
+    std::mutex _reload_mutex;
+    /// Files parsed by @ref _reloading, to be installed by @ref poll_reload
+    std::shared_ptr<const PresetFiles> _reloaded;
   };
 
 } // namespace otto::services
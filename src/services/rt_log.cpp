@@ -0,0 +1,100 @@
+#include "rt_log.hpp"
+
+namespace otto::services::rt_log {
+
+  Logger::Logger() noexcept
+  {
+    for (std::size_t i = 0; i < capacity; i++) {
+      _ring[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  Logger::~Logger()
+  {
+    stop();
+  }
+
+  // The ring is Dmitry Vyukov's bounded queue. Each record has a sequence
+  // number, which tells producers and the consumer whose turn it is.
+
+  Record* Logger::claim() noexcept
+  {
+    auto pos = _enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      auto& r = _ring[pos & (capacity - 1)];
+      auto seq = r.sequence.load(std::memory_order_acquire);
+      auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+      if (diff == 0) {
+        if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          return &r;
+        }
+      } else if (diff < 0) {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      } else {
+        pos = _enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void Logger::publish(Record& r) noexcept
+  {
+    auto seq = r.sequence.load(std::memory_order_relaxed);
+    r.sequence.store(seq + 1, std::memory_order_release);
+  }
+
+  Record* Logger::front() noexcept
+  {
+    auto& r = _ring[_dequeue_pos & (capacity - 1)];
+    if (r.sequence.load(std::memory_order_acquire) != _dequeue_pos + 1) return nullptr;
+    return &r;
+  }
+
+  void Logger::pop(Record& r) noexcept
+  {
+    r.sequence.store(_dequeue_pos + capacity, std::memory_order_release);
+    _dequeue_pos++;
+  }
+
+  std::size_t Logger::drain()
+  {
+    auto n = drain([](const Site& site, std::string message) {
+      loguru::log(site.verbosity, site.file, site.line, "{}", message);
+    });
+    auto dropped = this->dropped();
+    if (dropped != _reported_dropped) {
+      LOG_F(WARNING, "{} realtime log messages were dropped", dropped - _reported_dropped);
+      _reported_dropped = dropped;
+    }
+    return n;
+  }
+
+  void Logger::start(std::chrono::milliseconds interval)
+  {
+    if (_should_run.exchange(true)) return;
+    _thread = std::thread([this, interval] {
+      loguru::set_thread_name("rt_log");
+      while (_should_run) {
+        drain();
+        std::this_thread::sleep_for(interval);
+      }
+    });
+  }
+
+  void Logger::stop()
+  {
+    _should_run = false;
+    if (_thread.joinable()) _thread.join();
+    drain();
+  }
+
+  // Constructed during static initialization, so the first log call from the
+  // audio thread does not have to do it
+  static Logger global_logger;
+
+  Logger& logger() noexcept
+  {
+    return global_logger;
+  }
+
+} // namespace otto::services::rt_log
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#ifndef LOGURU_USE_FMTLIB
+#define LOGURU_USE_FMTLIB 1
+#endif
+#include <loguru.hpp>
+
+/// Realtime safe logging
+///
+/// Logging through loguru formats the message and writes it to every sink
+/// synchronously, under a lock. On the audio thread that means a log call can
+/// block on disk I/O.
+///
+/// The `RT_LOG*` macros instead copy the arguments into a fixed-size record in
+/// a lock-free ring buffer. A background thread, started by
+/// @ref services::LogManager, formats the records and hands them to loguru,
+/// with the file and line of the original call. If the ring is full, the
+/// message is dropped and counted. Nothing on the calling side allocates,
+/// locks or blocks.
+///
+/// Restrictions compared to the normal `LOG*` macros:
+///  - The format string must be a string literal
+///  - Arguments must be trivially copyable (numbers, enums, pointers to
+///    static strings etc.), and fit in @ref rt_log::Record::payload_size bytes
+namespace otto::services::rt_log {
+
+  /// Static information about a call site. One is created per use of the macros.
+  struct Site {
+    loguru::Verbosity verbosity;
+    const char* file;
+    unsigned line;
+    const char* format;
+  };
+
+  struct Record;
+
+  /// Formats a record. Instantiated per argument list, so this doubles as
+  /// the type information for the payload.
+  using FormatFunc = std::string (*)(const Record&);
+
+  /// A fixed size log record. One cache line.
+  struct alignas(64) Record {
+    static constexpr std::size_t payload_size = 40;
+
+    /// The arguments, as a `std::tuple`
+    alignas(std::max_align_t) std::byte payload[payload_size];
+    /// Used by the ring buffer
+    std::atomic<std::size_t> sequence = 0;
+    const Site* site = nullptr;
+    FormatFunc format = nullptr;
+  };
+
+  static_assert(sizeof(Record) == 64);
+
+  namespace detail {
+    template<typename... Args>
+    std::string format_record(const Record& r)
+    {
+      auto& args = *std::launder(reinterpret_cast<const std::tuple<Args...>*>(r.payload));
+      return std::apply([&](const auto&... a) { return fmt::format(r.site->format, a...); }, args);
+    }
+  } // namespace detail
+
+  /// A bounded, lock-free, multi producer single consumer queue of log records
+  struct Logger {
+    /// Number of records in the ring
+    static constexpr std::size_t capacity = 1024;
+    static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+
+    Logger() noexcept;
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    /// Push a record
+    ///
+    /// Lock-free, never allocates. Safe to call from any thread.
+    ///
+    /// \returns `false` if the ring was full and the message was dropped
+    template<typename... Args>
+    bool push(const Site& site, const char* /* format, already in site */, Args&&... args) noexcept
+    {
+      using Tuple = std::tuple<std::decay_t<Args>...>;
+      static_assert((std::is_trivially_copyable_v<std::decay_t<Args>> && ...),
+                    "Realtime log arguments must be trivially copyable");
+      static_assert(sizeof(Tuple) <= Record::payload_size, "Too many realtime log arguments");
+      static_assert(alignof(Tuple) <= alignof(std::max_align_t));
+
+      if (site.verbosity > loguru::current_verbosity_cutoff()) return true;
+      Record* r = claim();
+      if (r == nullptr) return false;
+      r->site = &site;
+      r->format = &detail::format_record<std::decay_t<Args>...>;
+      new (r->payload) Tuple(args...);
+      publish(*r);
+      return true;
+    }
+
+    /// Format and pass all pending records to `sink`
+    ///
+    /// Must only be called from one thread at a time.
+    ///
+    /// \param sink called as `sink(const Site&, std::string message)`
+    /// \returns the number of records consumed
+    template<typename Sink>
+    std::size_t drain(Sink&& sink)
+    {
+      std::size_t n = 0;
+      while (Record* r = front()) {
+        sink(*r->site, r->format(*r));
+        pop(*r);
+        n++;
+      }
+      return n;
+    }
+
+    /// Write all pending records to loguru
+    ///
+    /// Also logs a warning if messages were dropped since last time.
+    std::size_t drain();
+
+    /// Number of messages dropped because the ring was full
+    std::size_t dropped() const noexcept
+    {
+      return _dropped.load(std::memory_order_relaxed);
+    }
+
+    /// Start a background thread that calls @ref drain every `interval`
+    ///
+    /// The producers never wake the thread, since that would not be
+    /// realtime safe, so `interval` is the maximum latency of a message.
+    void start(std::chrono::milliseconds interval = std::chrono::milliseconds(10));
+
+    /// Stop the background thread, and drain any remaining records
+    void stop();
+
+  private:
+    Record* claim() noexcept;
+    void publish(Record&) noexcept;
+    Record* front() noexcept;
+    void pop(Record&) noexcept;
+
+    std::array<Record, capacity> _ring;
+    alignas(64) std::atomic<std::size_t> _enqueue_pos = 0;
+    alignas(64) std::size_t _dequeue_pos = 0;
+    std::atomic<std::size_t> _dropped = 0;
+    std::size_t _reported_dropped = 0;
+
+    std::atomic<bool> _should_run = false;
+    std::thread _thread;
+  };
+
+  /// The global realtime logger used by the `RT_LOG*` macros
+  Logger& logger() noexcept;
+
+} // namespace otto::services::rt_log
+
+/// \private
+#define OTTO_RT_LOG_FIRST(first, ...) first
+
+/// \private
+#define OTTO_RT_LOG(verbosity, ...)                                                                \
+  do {                                                                                             \
+    static constexpr ::otto::services::rt_log::Site otto_rt_log_site = {                           \
+      verbosity, __FILE__, __LINE__, OTTO_RT_LOG_FIRST(__VA_ARGS__, "")};                         \
+    ::otto::services::rt_log::logger().push(otto_rt_log_site, __VA_ARGS__);                        \
+  } while (false)
+
+/// Realtime safe version of LOGI
+#define RT_LOGI(...) OTTO_RT_LOG(loguru::Verbosity_INFO, __VA_ARGS__)
+
+/// Realtime safe version of LOGW
+#define RT_LOGW(...) OTTO_RT_LOG(loguru::Verbosity_WARNING, __VA_ARGS__)
+
+/// Realtime safe version of LOGE
+#define RT_LOGE(...) OTTO_RT_LOG(loguru::Verbosity_ERROR, __VA_ARGS__)
+
+#if LOGURU_DEBUG_LOGGING
+
+/// Realtime safe version of DLOGI
+#define RT_DLOGI(...) RT_LOGI(__VA_ARGS__)
+
+/// Realtime safe version of DLOGW
+#define RT_DLOGW(...) RT_LOGW(__VA_ARGS__)
+
+/// Realtime safe version of DLOGE
+#define RT_DLOGE(...) RT_LOGE(__VA_ARGS__)
+
+#else
+
+#define RT_DLOGI(...) ((void) 0)
+#define RT_DLOGW(...) ((void) 0)
+#define RT_DLOGE(...) ((void) 0)
+
+#endif
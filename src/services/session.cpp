@@ -0,0 +1,312 @@
+#include "session.hpp"
+
+#include <mutex>
+
+#include "services/application.hpp"
+#include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/state_manager.hpp"
+
+namespace otto::services::session {
+
+  namespace {
+    constexpr char magic[8] = {'O', 'T', 'T', 'O', 'S', 'E', 'S', 'S'};
+
+    enum struct Type : std::uint8_t {
+      key_press = 1,
+      key_release,
+      rotary,
+      midi,
+      preset,
+      end,
+    };
+
+    // ENCODING //
+
+    void put_u8(std::ostream& out, std::uint8_t v)
+    {
+      out.put(char(v));
+    }
+
+    void put_u32(std::ostream& out, std::uint32_t v)
+    {
+      for (int i = 0; i < 4; i++) put_u8(out, std::uint8_t(v >> (8 * i)));
+    }
+
+    void put_varint(std::ostream& out, std::uint64_t v)
+    {
+      while (v >= 0x80) {
+        put_u8(out, std::uint8_t(v | 0x80));
+        v >>= 7;
+      }
+      put_u8(out, std::uint8_t(v));
+    }
+
+    /// Zigzag, so small negative numbers stay small
+    void put_signed(std::ostream& out, std::int64_t v)
+    {
+      put_varint(out, (std::uint64_t(v) << 1) ^ std::uint64_t(v >> 63));
+    }
+
+    void put_bytes(std::ostream& out, const void* data, std::size_t size)
+    {
+      put_varint(out, size);
+      out.write(static_cast<const char*>(data), size);
+    }
+
+    void put_string(std::ostream& out, const std::string& s)
+    {
+      put_bytes(out, s.data(), s.size());
+    }
+
+    // DECODING //
+
+    std::uint8_t get_u8(std::istream& in)
+    {
+      auto c = in.get();
+      if (c == std::istream::traits_type::eof()) {
+        throw util::exception("Unexpected end of session log");
+      }
+      return std::uint8_t(c);
+    }
+
+    std::uint32_t get_u32(std::istream& in)
+    {
+      std::uint32_t res = 0;
+      for (int i = 0; i < 4; i++) res |= std::uint32_t(get_u8(in)) << (8 * i);
+      return res;
+    }
+
+    std::uint64_t get_varint(std::istream& in)
+    {
+      std::uint64_t res = 0;
+      for (int shift = 0; shift < 64; shift += 7) {
+        auto b = get_u8(in);
+        res |= std::uint64_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) return res;
+      }
+      throw util::exception("Malformed number in session log");
+    }
+
+    std::int64_t get_signed(std::istream& in)
+    {
+      auto v = get_varint(in);
+      return std::int64_t(v >> 1) ^ -std::int64_t(v & 1);
+    }
+
+    std::vector<std::uint8_t> get_bytes(std::istream& in)
+    {
+      auto size = get_varint(in);
+      // Larger than any input, so a corrupt length does not allocate
+      // everything
+      if (size > (1 << 24)) throw util::exception("Malformed length in session log");
+      std::vector<std::uint8_t> res(size);
+      in.read(reinterpret_cast<char*>(res.data()), size);
+      if (std::size_t(in.gcount()) != size) throw util::exception("Unexpected end of session log");
+      return res;
+    }
+
+    std::string get_string(std::istream& in)
+    {
+      auto bytes = get_bytes(in);
+      return {bytes.begin(), bytes.end()};
+    }
+
+    // RECORDER //
+
+    std::mutex recorder_mutex;
+    std::optional<Writer> recorder;
+    std::atomic<bool> is_recording = false;
+    /// The frame of the clock manager when the recording started
+    std::uint64_t start_frame = 0;
+    thread_local int unrecorded_depth = 0;
+
+    std::uint64_t current_frame()
+    {
+      auto& clock = Application::current().clock_manager;
+      return clock._storage ? clock->frames() : 0;
+    }
+  } // namespace
+
+  // MIDI //
+
+  Midi Midi::from(core::midi::AnyMidiEvent event)
+  {
+    Midi res;
+    util::match(event, [&](auto& e) {
+      auto bytes = e.to_bytes();
+      res.bytes.assign(bytes.begin(), bytes.end());
+    });
+    return res;
+  }
+
+  core::midi::AnyMidiEvent Midi::event() const
+  {
+    auto bytes = this->bytes;
+    if (bytes.empty()) throw util::exception("Empty midi event in session log");
+    // Events of other types only keep their status byte
+    if (bytes.size() == 1 && !core::midi::RealtimeEvent::is_realtime(bytes[0])) {
+      return core::midi::MidiEvent::from_bytes(bytes);
+    }
+    return core::midi::from_bytes(bytes);
+  }
+
+  // WRITER //
+
+  Writer::Writer(const fs::path& path, const Header& header)
+    : _file(path.c_str(), std::ios::binary | std::ios::trunc)
+  {
+    if (!_file) throw util::exception("Could not create session log {}", path.c_str());
+    _file.write(magic, sizeof(magic));
+    put_u32(_file, version);
+    put_u32(_file, header.samplerate);
+    put_u32(_file, header.buffer_size);
+    auto state = nlohmann::json::to_cbor(header.state);
+    put_bytes(_file, state.data(), state.size());
+    _file.flush();
+    _flushed = std::chrono::steady_clock::now();
+  }
+
+  void Writer::write(const Record& record)
+  {
+    put_varint(_file, record.frame - _frame);
+    _frame = record.frame;
+    util::match(record.input,
+                [&](const KeyPress& in) {
+                  put_u8(_file, std::uint8_t(Type::key_press));
+                  put_u8(_file, std::uint8_t(in.key));
+                },
+                [&](const KeyRelease& in) {
+                  put_u8(_file, std::uint8_t(Type::key_release));
+                  put_u8(_file, std::uint8_t(in.key));
+                },
+                [&](const core::ui::RotaryEvent& in) {
+                  put_u8(_file, std::uint8_t(Type::rotary));
+                  put_u8(_file, std::uint8_t(in.rotary));
+                  put_signed(_file, in.clicks);
+                },
+                [&](const Midi& in) {
+                  put_u8(_file, std::uint8_t(Type::midi));
+                  put_bytes(_file, in.bytes.data(), in.bytes.size());
+                },
+                [&](const Preset& in) {
+                  put_u8(_file, std::uint8_t(Type::preset));
+                  put_string(_file, in.engine);
+                  put_string(_file, in.name);
+                },
+                [&](const End&) { put_u8(_file, std::uint8_t(Type::end)); });
+    auto now = std::chrono::steady_clock::now();
+    if (mpark::holds_alternative<End>(record.input) || now - _flushed >= flush_interval) {
+      _file.flush();
+      _flushed = now;
+    }
+  }
+
+  // READER //
+
+  Reader::Reader(const fs::path& path) : _file(path.c_str(), std::ios::binary)
+  {
+    if (!_file) throw util::exception("Could not open session log {}", path.c_str());
+    char m[sizeof(magic)] = {};
+    _file.read(m, sizeof(m));
+    if (!std::equal(m, m + sizeof(m), magic)) {
+      throw util::exception("{} is not a session log", path.c_str());
+    }
+    if (auto v = get_u32(_file); v != version) {
+      throw util::exception("{} is a session log of version {}, expected {}", path.c_str(), v,
+                            version);
+    }
+    _header.samplerate = get_u32(_file);
+    _header.buffer_size = get_u32(_file);
+    _header.state = nlohmann::json::from_cbor(get_bytes(_file));
+  }
+
+  std::optional<Record> Reader::next()
+  {
+    if (_file.peek() == std::ifstream::traits_type::eof()) return std::nullopt;
+    _frame += get_varint(_file);
+    Record res{_frame, End{}};
+    switch (Type(get_u8(_file))) {
+    case Type::key_press: res.input = KeyPress{core::ui::Key(get_u8(_file))}; break;
+    case Type::key_release: res.input = KeyRelease{core::ui::Key(get_u8(_file))}; break;
+    case Type::rotary: {
+      auto rotary = core::ui::Rotary(get_u8(_file));
+      res.input = core::ui::RotaryEvent{rotary, int(get_signed(_file))};
+      break;
+    }
+    case Type::midi: res.input = Midi{get_bytes(_file)}; break;
+    case Type::preset: {
+      auto engine = get_string(_file);
+      res.input = Preset{std::move(engine), get_string(_file)};
+      break;
+    }
+    case Type::end: break;
+    default: throw util::exception("Unknown record in session log");
+    }
+    return res;
+  }
+
+  // RECORDING //
+
+  void start_recording(const fs::path& path)
+  {
+    auto& app = Application::current();
+    Header header{app.audio_manager->samplerate(),
+                  int(app.audio_manager->buffer_pool().buffer_frames()),
+                  app.state_manager->snapshot()};
+    std::unique_lock lock(recorder_mutex);
+    recorder.emplace(path, header);
+    start_frame = current_frame();
+    is_recording = true;
+    LOGI("Recording the session to {}", path.c_str());
+  }
+
+  void stop_recording()
+  {
+    if (!is_recording) return;
+    record(End{});
+    std::unique_lock lock(recorder_mutex);
+    is_recording = false;
+    recorder.reset();
+  }
+
+  bool recording() noexcept
+  {
+    return is_recording;
+  }
+
+  void record(Input input) noexcept
+  {
+    if (!is_recording || unrecorded_depth > 0) return;
+    try {
+      std::unique_lock lock(recorder_mutex);
+      if (!recorder) return;
+      // Read under the lock, so frames never decrease in the log
+      recorder->write({current_frame() - start_frame, std::move(input)});
+    } catch (std::exception& e) {
+      LOGE("Error recording the session: {}", e.what());
+    }
+  }
+
+  void record_midi(const core::midi::AnyMidiEvent& event) noexcept
+  {
+    if (!is_recording || unrecorded_depth > 0) return;
+    try {
+      record(Midi::from(event));
+    } catch (std::exception& e) {
+      LOGE("Error recording the session: {}", e.what());
+    }
+  }
+
+  Unrecorded::Unrecorded() noexcept
+  {
+    unrecorded_depth++;
+  }
+
+  Unrecorded::~Unrecorded() noexcept
+  {
+    unrecorded_depth--;
+  }
+
+} // namespace otto::services::session
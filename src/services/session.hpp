@@ -0,0 +1,161 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <json.hpp>
+
+#include "core/audio/midi.hpp"
+#include "core/ui/screen.hpp"
+#include "util/exception.hpp"
+#include "util/filesystem.hpp"
+
+/// Recording and replaying the input of a session
+///
+/// While recording, every input is written to a compact binary log, with
+/// the audio frame it arrived at: key presses and releases and rotary turns
+/// sent to the @ref UIManager, MIDI sent to the @ref AudioManager, and
+/// presets applied by anything other than those inputs. The log starts with
+/// the samplerate, the buffer size and the state of all services, so a
+/// replay starts from the same place.
+///
+/// `otto_replay` plays a log back headless, applying each input before the
+/// first block that starts at or after its frame. Every replay of a log
+/// renders the same audio, so a performance problem can be profiled and
+/// bisected off the device. It is not sample exact to the recorded session,
+/// where the UI handles input on its own thread, at its own frame rate.
+///
+/// The log is a header followed by records. All integers are little
+/// endian, and `varint` is unsigned LEB128.
+///
+///     header: "OTTOSESS" u32:version u32:samplerate u32:buffer_size
+///             varint:length state as CBOR
+///     record: varint:frames since the previous record u8:type payload
+namespace otto::services::session {
+
+  constexpr std::uint32_t version = 1;
+
+  struct KeyPress {
+    core::ui::Key key;
+  };
+
+  struct KeyRelease {
+    core::ui::Key key;
+  };
+
+  struct Midi {
+    std::vector<std::uint8_t> bytes;
+
+    static Midi from(core::midi::AnyMidiEvent event);
+    /// \throws `util::exception` if the bytes are not a known event
+    core::midi::AnyMidiEvent event() const;
+  };
+
+  struct Preset {
+    /// The name of the engine it was applied to
+    std::string engine;
+    std::string name;
+  };
+
+  /// The last record of a log, at the frame the recording stopped
+  struct End {};
+
+  using Input = mpark::variant<KeyPress, KeyRelease, core::ui::RotaryEvent, Midi, Preset, End>;
+
+  struct Record {
+    /// Frames processed since the recording started, when the input arrived
+    std::uint64_t frame;
+    Input input;
+  };
+
+  struct Header {
+    int samplerate;
+    int buffer_size;
+    /// As from `StateManager::snapshot`
+    nlohmann::json state;
+  };
+
+  /// Writes a log
+  struct Writer {
+    /// \throws `util::exception` if the file can not be created
+    Writer(const fs::path& path, const Header& header);
+
+    /// Write a record
+    ///
+    /// Writes are buffered. The log is flushed by an @ref End record, and by
+    /// the first write @ref flush_interval after the last flush, so a crash
+    /// loses little. Frames must not decrease.
+    void write(const Record& record);
+
+    static constexpr std::chrono::milliseconds flush_interval{500};
+
+  private:
+    std::ofstream _file;
+    std::uint64_t _frame = 0;
+    std::chrono::steady_clock::time_point _flushed;
+  };
+
+  /// Reads a log
+  struct Reader {
+    /// \throws `util::exception` if the file can not be opened, or is not a
+    /// log of this version
+    Reader(const fs::path& path);
+
+    const Header& header() const noexcept
+    {
+      return _header;
+    }
+
+    /// The next record, or `std::nullopt` at the end of the file
+    ///
+    /// \throws `util::exception` if the record is malformed
+    std::optional<Record> next();
+
+  private:
+    std::ifstream _file;
+    Header _header;
+    std::uint64_t _frame = 0;
+  };
+
+  // RECORDING //
+
+  /// Record every input to `path`, from now on
+  ///
+  /// Takes the state from the state manager, so call it once the state is
+  /// loaded.
+  ///
+  /// \throws `util::exception` if the file can not be created
+  void start_recording(const fs::path& path);
+
+  /// Write the end of the log, and close it
+  void stop_recording();
+
+  bool recording() noexcept;
+
+  /// Record `input`, at the current frame of the clock manager, if
+  /// recording. Never throws, errors are logged.
+  void record(Input input) noexcept;
+
+  /// Record a MIDI event, like @ref record
+  ///
+  /// Only converts it to a @ref Midi record when recording, so it is cheap
+  /// to call for every event.
+  void record_midi(const core::midi::AnyMidiEvent& event) noexcept;
+
+  /// While it exists, inputs on this thread are not recorded
+  ///
+  /// For inputs that are caused by other inputs, like a preset applied from
+  /// a key handler, which are recreated when those are replayed.
+  struct Unrecorded {
+    Unrecorded() noexcept;
+    ~Unrecorded() noexcept;
+
+    Unrecorded(const Unrecorded&) = delete;
+    Unrecorded& operator=(const Unrecorded&) = delete;
+  };
+
+} // namespace otto::services::session
@@ -21,6 +21,26 @@ namespace otto::services {
     void detach(std::string name) override;
   };
 
+  nlohmann::json StateManager::snapshot()
+  {
+    auto res = nlohmann::json::object();
+    for (const auto& [name, client] : _clients) {
+      res[name] = client.save();
+    }
+    return res;
+  }
+
+  void StateManager::restore(nlohmann::json& state)
+  {
+    for (const auto& [name, client] : _clients) {
+      try {
+        client.load(state[name]);
+      } catch (std::exception& e) {
+        LOGE("Exception while restoring state for {}: {}", name, e.what());
+      }
+    }
+  }
+
   std::unique_ptr<StateManager> StateManager::create_default()
   {
     return std::make_unique<DefaultStateManager>();
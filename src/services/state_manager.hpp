@@ -33,6 +33,13 @@ namespace otto::services {
     /// \throws [otto::util::exception]() If no such handler is attached
     virtual void detach(std::string name) = 0;
 
+    /// The current state of all attached handlers, without writing it
+    nlohmann::json snapshot();
+
+    /// Invoke the attached loaders with `state`, like @ref load does with
+    /// the file
+    void restore(nlohmann::json& state);
+
     static std::unique_ptr<StateManager> create_default();
 
   protected:
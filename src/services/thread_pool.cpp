@@ -0,0 +1,259 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "services/log_manager.hpp"
+
+namespace otto::services {
+
+  struct ThreadPool::TaskState {
+    TaskState(std::function<void()> func) : func(std::move(func)) {}
+
+    std::function<void()> func;
+    std::atomic<Task::State> state = Task::State::queued;
+    std::atomic<bool> cancel_requested = false;
+
+    clock::time_point submitted = clock::now();
+    std::atomic<clock::time_point> started = {};
+    std::atomic<clock::time_point> finished = {};
+
+    std::mutex mutex;
+    std::condition_variable done;
+
+    void finish(Task::State s)
+    {
+      finished = clock::now();
+      std::unique_lock lock(mutex);
+      state = s;
+      done.notify_all();
+    }
+  };
+
+  namespace {
+    /// The pool and worker the current thread belongs to
+    thread_local ThreadPool* current_pool = nullptr;
+    thread_local std::size_t current_worker = 0;
+    /// The task running on the current thread
+    thread_local ThreadPool::TaskState* current_task = nullptr;
+
+    void pin_to_cpus(std::thread& thread, const std::vector<int>& cpus)
+    {
+#if defined(__linux__)
+      if (cpus.empty()) return;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      for (int cpu : cpus) CPU_SET(cpu, &set);
+      if (int err = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set); err != 0) {
+        LOGW("Could not pin thread pool worker to its CPUs: error {}", err);
+      }
+#endif
+    }
+  } // namespace
+
+  // Task //////////////////////////////////////////////////////////////////////
+
+  bool ThreadPool::Task::valid() const noexcept
+  {
+    return _state != nullptr;
+  }
+
+  ThreadPool::Task::State ThreadPool::Task::state() const noexcept
+  {
+    return _state->state;
+  }
+
+  bool ThreadPool::Task::cancel() noexcept
+  {
+    _state->cancel_requested = true;
+    auto expected = State::queued;
+    if (_state->state.compare_exchange_strong(expected, State::cancelled)) {
+      _state->finish(State::cancelled);
+      return true;
+    }
+    return false;
+  }
+
+  bool ThreadPool::Task::cancel_requested() const noexcept
+  {
+    return _state->cancel_requested;
+  }
+
+  void ThreadPool::Task::wait() const
+  {
+    std::unique_lock lock(_state->mutex);
+    _state->done.wait(lock, [&] {
+      auto s = _state->state.load();
+      return s == State::done || s == State::cancelled;
+    });
+  }
+
+  ThreadPool::clock::duration ThreadPool::Task::wait_time() const noexcept
+  {
+    auto started = _state->started.load();
+    if (started == clock::time_point{}) {
+      if (state() == State::cancelled) return _state->finished.load() - _state->submitted;
+      return clock::now() - _state->submitted;
+    }
+    return started - _state->submitted;
+  }
+
+  ThreadPool::clock::duration ThreadPool::Task::run_time() const noexcept
+  {
+    auto started = _state->started.load();
+    if (started == clock::time_point{}) return {};
+    auto finished = _state->finished.load();
+    if (finished == clock::time_point{}) return clock::now() - started;
+    return finished - started;
+  }
+
+  // ThreadPool ////////////////////////////////////////////////////////////////
+
+  ThreadPool::ThreadPool() : ThreadPool(Options{}) {}
+
+  ThreadPool::ThreadPool(Options options)
+  {
+    std::size_t threads = options.threads;
+    if (threads == 0) threads = options.cpus.size();
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (std::size_t i = 0; i < threads; i++) {
+      _workers.push_back(std::make_unique<Worker>());
+    }
+    for (std::size_t i = 0; i < threads; i++) {
+      _workers[i]->thread = std::thread([this, i] { worker_main(i); });
+      pin_to_cpus(_workers[i]->thread, options.cpus);
+    }
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    {
+      std::unique_lock lock(_sleep_mutex);
+      _should_run = false;
+    }
+    _wake.notify_all();
+    for (auto& w : _workers) {
+      w->thread.join();
+    }
+    // Cancel whatever was not started, so nobody waits for it forever
+    for (auto& w : _workers) {
+      for (auto& queue : w->queues) {
+        for (auto& task : queue) Task(task).cancel();
+      }
+    }
+  }
+
+  std::unique_ptr<ThreadPool> ThreadPool::create_default()
+  {
+    Options options;
+    int cores = std::thread::hardware_concurrency();
+    for (int i = 0; i < cores - 1; i++) {
+      options.cpus.push_back(i);
+    }
+    return std::make_unique<ThreadPool>(std::move(options));
+  }
+
+  ThreadPool::Task ThreadPool::submit(std::function<void()> f, Priority priority)
+  {
+    auto state = std::make_shared<TaskState>(std::move(f));
+    _busy++;
+    std::size_t worker = current_pool == this ? current_worker
+                                               : _next_worker++ % _workers.size();
+    {
+      // Incremented under the lock, so a worker can't miss it between
+      // checking and going to sleep, and before the push, so it never
+      // underflows when the task is taken
+      std::unique_lock lock(_sleep_mutex);
+      _queued++;
+    }
+    {
+      auto& w = *_workers[worker];
+      std::unique_lock lock(w.mutex);
+      w.queues[static_cast<std::size_t>(priority)].push_back(state);
+    }
+    _wake.notify_one();
+    return Task(std::move(state));
+  }
+
+  bool ThreadPool::cancelled() noexcept
+  {
+    return current_task != nullptr && current_task->cancel_requested;
+  }
+
+  void ThreadPool::wait_idle()
+  {
+    std::unique_lock lock(_idle_mutex);
+    _idle.wait(lock, [&] { return _busy == 0; });
+  }
+
+  std::size_t ThreadPool::thread_count() const noexcept
+  {
+    return _workers.size();
+  }
+
+  void ThreadPool::worker_main(std::size_t index)
+  {
+    current_pool = this;
+    current_worker = index;
+    loguru::set_thread_name(fmt::format("pool {}", index).c_str());
+
+    while (_should_run) {
+      if (auto task = find_task(index)) {
+        _queued--;
+        run(*task);
+        if (--_busy == 0) {
+          std::unique_lock lock(_idle_mutex);
+          _idle.notify_all();
+        }
+        continue;
+      }
+      std::unique_lock lock(_sleep_mutex);
+      _wake.wait(lock, [&] { return _queued > 0 || !_should_run; });
+    }
+  }
+
+  std::shared_ptr<ThreadPool::TaskState> ThreadPool::find_task(std::size_t index)
+  {
+    for (std::size_t p = 0; p < priority_count; p++) {
+      // Our own queue first, then steal from the others
+      for (std::size_t i = 0; i < _workers.size(); i++) {
+        auto& w = *_workers[(index + i) % _workers.size()];
+        std::unique_lock lock(w.mutex);
+        if (!w.queues[p].empty()) {
+          auto res = std::move(w.queues[p].front());
+          w.queues[p].pop_front();
+          return res;
+        }
+      }
+    }
+    return nullptr;
+  }
+
+  void ThreadPool::run(TaskState& task)
+  {
+    auto expected = Task::State::queued;
+    if (!task.state.compare_exchange_strong(expected, Task::State::running)) {
+      // Cancelled while queued
+      return;
+    }
+    task.started = clock::now();
+    current_task = &task;
+    try {
+      task.func();
+    } catch (std::exception& e) {
+      LOGE("Exception in thread pool task: {}", e.what());
+    } catch (...) {
+      LOGE("Unknown exception in thread pool task");
+    }
+    current_task = nullptr;
+    // Release any resources held by the task before it is reported as done
+    task.func = nullptr;
+    task.finish(Task::State::done);
+  }
+
+} // namespace otto::services
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/service.hpp"
+#include "services/application.hpp"
+
+namespace otto::services {
+
+  /// A shared pool of worker threads for background jobs
+  ///
+  /// Use it for anything that should not block the UI or audio threads, like
+  /// loading samples, parsing presets or analysing audio. Tasks are plain
+  /// callables, submitted with a @ref Priority, and return a @ref Task handle
+  /// that can be used to cancel, wait for, or time them.
+  ///
+  /// Each worker has its own queue per priority. Tasks submitted from a
+  /// worker are queued on that worker, and other tasks are spread over all
+  /// of them. Workers take tasks from their own queue first, and steal from
+  /// the others when it is empty. Within a priority and a queue, tasks are
+  /// started in the order they were submitted.
+  ///
+  /// The workers can be restricted to a set of CPUs, to keep them off the
+  /// core the audio thread runs on. This service is not realtime safe, and
+  /// should never be used from the audio thread.
+  struct ThreadPool : core::Service {
+    using clock = std::chrono::steady_clock;
+
+    /// Higher priority tasks are always started before lower priority ones
+    enum struct Priority { high, normal, low };
+
+    struct Options {
+      /// Number of workers. `0` means one per CPU in @ref cpus, or one per
+      /// core if that is empty too.
+      std::size_t threads = 0;
+      /// Indices of the CPUs the workers may run on. Empty means any.
+      std::vector<int> cpus = {};
+    };
+
+    /// \private
+    struct TaskState;
+
+    /// A handle to a submitted task
+    ///
+    /// Handles are cheap to copy. The task runs to completion even if all
+    /// handles are dropped.
+    struct Task {
+      enum struct State { queued, running, done, cancelled };
+
+      Task() = default;
+
+      /// Whether this refers to a task
+      bool valid() const noexcept;
+
+      State state() const noexcept;
+
+      /// Cancel the task
+      ///
+      /// A queued task is removed and will never run. A running task is asked
+      /// to stop, which it can check with @ref ThreadPool::cancelled.
+      ///
+      /// \returns `true` if the task was still queued, and will not run
+      bool cancel() noexcept;
+
+      /// Whether @ref cancel has been called
+      bool cancel_requested() const noexcept;
+
+      /// Block until the task is done or cancelled
+      void wait() const;
+
+      /// Time from submission until the task started, or until now if it
+      /// is still queued
+      clock::duration wait_time() const noexcept;
+
+      /// Time the task ran for, or has been running for so far
+      clock::duration run_time() const noexcept;
+
+    private:
+      friend struct ThreadPool;
+      Task(std::shared_ptr<TaskState> state) : _state(std::move(state)) {}
+      std::shared_ptr<TaskState> _state;
+    };
+
+    ThreadPool();
+    ThreadPool(Options options);
+
+    /// Cancels all queued tasks, and waits for the running ones to finish
+    ~ThreadPool();
+
+    /// A pool with one worker per core, leaving the last core to the audio
+    /// thread
+    static std::unique_ptr<ThreadPool> create_default();
+
+    /// Queue `f` to be run on a worker
+    ///
+    /// `f` is called with no arguments. Exceptions thrown by it are logged
+    /// and otherwise ignored.
+    Task submit(std::function<void()> f, Priority priority = Priority::normal);
+
+    /// Whether the task running on the current thread has been cancelled
+    ///
+    /// Long running tasks should check this regularly, and return early if
+    /// it is `true`. Always `false` outside of a task.
+    static bool cancelled() noexcept;
+
+    /// Block until no tasks are queued or running, including tasks they
+    /// submit
+    ///
+    /// For headless runs that need background work, like loading samples,
+    /// to be done at a known point. Must not be called from a worker.
+    void wait_idle();
+
+    std::size_t thread_count() const noexcept;
+
+  private:
+    static constexpr std::size_t priority_count = 3;
+    using Queue = std::deque<std::shared_ptr<TaskState>>;
+
+    struct Worker {
+      std::mutex mutex;
+      std::array<Queue, priority_count> queues;
+      std::thread thread;
+    };
+
+    void worker_main(std::size_t index);
+    std::shared_ptr<TaskState> find_task(std::size_t index);
+    void run(TaskState& task);
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::atomic<std::size_t> _next_worker = 0;
+
+    /// Number of tasks in the queues, including cancelled ones
+    std::atomic<std::size_t> _queued = 0;
+    std::atomic<bool> _should_run = true;
+    std::mutex _sleep_mutex;
+    std::condition_variable _wake;
+
+    /// Number of tasks that are queued or running
+    std::atomic<std::size_t> _busy = 0;
+    std::mutex _idle_mutex;
+    std::condition_variable _idle;
+  };
+
+} // namespace otto::services
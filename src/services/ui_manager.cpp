@@ -2,6 +2,8 @@
 
 #include "services/audio_manager.hpp"
 #include "services/engine_manager.hpp"
+#include "services/metrics.hpp"
+#include "services/session.hpp"
 #include "services/state_manager.hpp"
 
 #include "core/ui/vector_graphics.hpp"
@@ -91,6 +93,7 @@ namespace otto::services {
 
   void UIManager::draw_frame(vg::Canvas& ctx)
   {
+    const auto start = metrics::clock::now();
     ctx.lineWidth(6);
     ctx.lineCap(vg::Canvas::LineCap::ROUND);
     ctx.lineJoin(vg::Canvas::Canvas::LineJoin::ROUND);
@@ -107,25 +110,32 @@ namespace otto::services {
     });
 
     _frame_count++;
+    metrics::ui_frame(metrics::clock::now() - start);
+    metrics::publish();
   }
 
   void UIManager::keypress(Key key)
   {
+    session::record(session::KeyPress{key});
     key_events.outer().push_back(KeyPress{key});
   }
 
   void UIManager::rotary(RotaryEvent ev)
   {
+    session::record(ev);
     rotary_events.outer().push_back(ev);
   }
 
   void UIManager::keyrelease(Key key)
   {
+    session::record(session::KeyRelease{key});
     key_events.outer().push_back(KeyRelease{key});
   }
 
   void UIManager::flush_events()
   {
+    // Anything the handlers do is recreated by replaying the events
+    session::Unrecorded unrecorded;
     key_events.swap();
     for (auto& event : key_events.inner()) {
       util::match(event,
@@ -0,0 +1,569 @@
+#include "async_io.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Older kernel headers don't have io_uring. Without it, only the thread
+// backend is built.
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup)
+#define OTTO_ASYNC_IO_URING 1
+#endif
+#endif
+
+#include "services/log_manager.hpp"
+
+namespace otto::util {
+
+  /// A queued operation
+  ///
+  /// Owned by the backend from submission until it is completed.
+  struct AsyncIO::Batch::Op {
+    enum struct Type { read, write, fsync };
+
+    Type type;
+    int fd;
+    std::uint64_t offset = 0;
+    std::byte* data = nullptr;
+    std::size_t size = 0;
+    /// Bytes transferred so far
+    std::size_t transferred = 0;
+
+    std::promise<std::size_t> result;
+    std::promise<void> synced;
+
+    /// The remaining part of the buffer, for io_uring
+    iovec iov;
+
+    void succeed()
+    {
+      if (type == Type::fsync) {
+        synced.set_value();
+      } else {
+        result.set_value(transferred);
+      }
+    }
+
+    void fail(int err)
+    {
+      auto e = std::make_exception_ptr(std::system_error(err, std::system_category()));
+      if (type == Type::fsync) {
+        synced.set_exception(e);
+      } else {
+        result.set_exception(e);
+      }
+    }
+
+    /// Handle the result of a system call
+    ///
+    /// `res` is the number of bytes transferred, or a negated `errno`.
+    ///
+    /// \returns `false` if the transfer was short, and the rest should be
+    /// submitted again
+    bool complete(long res)
+    {
+      if (res == -EINTR || res == -EAGAIN) return false;
+      if (res < 0) {
+        fail(-res);
+        return true;
+      }
+      transferred += res;
+      // Zero bytes means the end of the file
+      if (type == Type::fsync || res == 0 || transferred >= size) {
+        succeed();
+        return true;
+      }
+      return false;
+    }
+
+    /// Run the operation to completion with blocking system calls
+    void run_blocking()
+    {
+      while (true) {
+        long res = 0;
+        switch (type) {
+          case Type::read:
+            res = ::pread(fd, data + transferred, size - transferred, offset + transferred);
+            break;
+          case Type::write:
+            res = ::pwrite(fd, data + transferred, size - transferred, offset + transferred);
+            break;
+          case Type::fsync: res = ::fsync(fd); break;
+        }
+        if (complete(res < 0 ? -errno : res)) return;
+      }
+    }
+  };
+
+  struct AsyncIO::Impl {
+    virtual ~Impl() = default;
+    virtual Backend backend() const noexcept = 0;
+    /// Take ownership of `ops`, and start them
+    virtual void submit(const std::vector<Op*>& ops) = 0;
+  };
+
+  // Threads ///////////////////////////////////////////////////////////////////
+
+  struct AsyncIO::ThreadImpl final : Impl {
+    ThreadImpl(const Options& options) : _capacity(std::max(1u, options.queue_depth))
+    {
+      for (unsigned i = 0; i < std::max(1u, options.threads); i++) {
+        _threads.emplace_back([this, i] {
+          loguru::set_thread_name(fmt::format("async io {}", i).c_str());
+          worker_main();
+        });
+      }
+    }
+
+    ~ThreadImpl()
+    {
+      {
+        std::unique_lock lock(_mutex);
+        _should_run = false;
+      }
+      _has_work.notify_all();
+      for (auto& t : _threads) t.join();
+    }
+
+    Backend backend() const noexcept override
+    {
+      return Backend::threads;
+    }
+
+    void submit(const std::vector<Op*>& ops) override
+    {
+      for (auto* op : ops) {
+        std::unique_lock lock(_mutex);
+        _has_room.wait(lock, [&] { return _in_flight < _capacity; });
+        _in_flight++;
+        _queue.push_back(op);
+        _has_work.notify_one();
+      }
+    }
+
+  private:
+    void worker_main()
+    {
+      std::unique_lock lock(_mutex);
+      while (true) {
+        // Drain the queue before stopping, so no future is left unfinished
+        _has_work.wait(lock, [&] { return !_queue.empty() || !_should_run; });
+        if (_queue.empty()) return;
+        auto* op = _queue.front();
+        _queue.pop_front();
+        lock.unlock();
+        op->run_blocking();
+        delete op;
+        lock.lock();
+        _in_flight--;
+        _has_room.notify_one();
+      }
+    }
+
+    const unsigned _capacity;
+    std::mutex _mutex;
+    std::condition_variable _has_work;
+    std::condition_variable _has_room;
+    std::deque<Op*> _queue;
+    unsigned _in_flight = 0;
+    bool _should_run = true;
+    std::vector<std::thread> _threads;
+  };
+
+  // io_uring //////////////////////////////////////////////////////////////////
+
+#if defined(OTTO_ASYNC_IO_URING)
+
+  /// Uses the raw system call interface, to avoid depending on liburing
+  struct AsyncIO::UringImpl final : Impl {
+    /// Set up the rings
+    ///
+    /// \throws `std::system_error` if io_uring is not available
+    UringImpl(const Options& options)
+    {
+      io_uring_params params = {};
+      _fd = syscall(__NR_io_uring_setup, std::max(1u, options.queue_depth), &params);
+      if (_fd < 0) throw std::system_error(errno, std::system_category(), "io_uring_setup");
+
+      _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+      _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single_mmap) _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+
+      _sq_ring = map(_sq_ring_size, IORING_OFF_SQ_RING);
+      _cq_ring = single_mmap ? _sq_ring : map(_cq_ring_size, IORING_OFF_CQ_RING);
+      _sqes = static_cast<io_uring_sqe*>(
+        map(params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES));
+      _sqe_count = params.sq_entries;
+
+      auto* sq = static_cast<char*>(_sq_ring);
+      _sq_tail = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+      _sq_mask = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+      _sq_array = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+
+      auto* cq = static_cast<char*>(_cq_ring);
+      _cq_head = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+      _cq_tail = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+      _cq_mask = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+      _cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+      // The completion ring is at least as large as the submission ring, so
+      // limiting the operations in flight to this means it never overflows
+      _capacity = std::min(std::max(1u, options.queue_depth), _sqe_count);
+
+      _reaper = std::thread([this] {
+        loguru::set_thread_name("async io");
+        reaper_main();
+      });
+    }
+
+    ~UringImpl()
+    {
+      {
+        std::unique_lock lock(_mutex);
+        _has_room.wait(lock, [&] { return _in_flight == 0; });
+        // A no-op with no user data stops the reaper
+        auto& sqe = push_sqe();
+        sqe.opcode = IORING_OP_NOP;
+        enter(1);
+      }
+      _reaper.join();
+      unmap();
+      ::close(_fd);
+    }
+
+    Backend backend() const noexcept override
+    {
+      return Backend::io_uring;
+    }
+
+    void submit(const std::vector<Op*>& ops) override
+    {
+      std::unique_lock lock(_mutex);
+      unsigned pending = 0;
+      for (auto* op : ops) {
+        if (_in_flight == _capacity) {
+          // Submit what we have so far, so the operations we wait for have
+          // actually been started
+          enter(pending);
+          pending = 0;
+          _has_room.wait(lock, [&] { return _in_flight < _capacity; });
+        }
+        _in_flight++;
+        prepare(*op);
+        pending++;
+      }
+      enter(pending);
+    }
+
+  private:
+    void* map(std::size_t size, off_t offset)
+    {
+      void* res = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, offset);
+      if (res == MAP_FAILED) {
+        int err = errno;
+        unmap();
+        ::close(_fd);
+        throw std::system_error(err, std::system_category(), "io_uring mmap");
+      }
+      return res;
+    }
+
+    void unmap()
+    {
+      if (_sqes != nullptr) munmap(_sqes, _sqe_count * sizeof(io_uring_sqe));
+      if (_cq_ring != nullptr && _cq_ring != _sq_ring) munmap(_cq_ring, _cq_ring_size);
+      if (_sq_ring != nullptr) munmap(_sq_ring, _sq_ring_size);
+    }
+
+    /// Get the next free submission queue entry, and publish it
+    ///
+    /// Must be called with `_mutex` held. The entry is submitted by the next
+    /// call to @ref enter
+    io_uring_sqe& push_sqe()
+    {
+      std::uint32_t tail = *_sq_tail;
+      std::uint32_t index = tail & _sq_mask;
+      auto& sqe = _sqes[index];
+      sqe = {};
+      _sq_array[index] = index;
+      __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+      return sqe;
+    }
+
+    /// Queue the remaining part of `op`
+    ///
+    /// Must be called with `_mutex` held
+    void prepare(Op& op)
+    {
+      auto& sqe = push_sqe();
+      sqe.fd = op.fd;
+      sqe.user_data = reinterpret_cast<std::uint64_t>(&op);
+      switch (op.type) {
+        case Op::Type::read: sqe.opcode = IORING_OP_READV; break;
+        case Op::Type::write: sqe.opcode = IORING_OP_WRITEV; break;
+        case Op::Type::fsync: sqe.opcode = IORING_OP_FSYNC; return;
+      }
+      op.iov.iov_base = op.data + op.transferred;
+      op.iov.iov_len = op.size - op.transferred;
+      sqe.addr = reinterpret_cast<std::uint64_t>(&op.iov);
+      sqe.len = 1;
+      sqe.off = op.offset + op.transferred;
+    }
+
+    /// Submit `count` queued entries
+    ///
+    /// Must be called with `_mutex` held
+    void enter(unsigned count)
+    {
+      while (count > 0) {
+        long res = syscall(__NR_io_uring_enter, _fd, count, 0, 0, nullptr, 0);
+        if (res < 0) {
+          if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+            std::this_thread::yield();
+            continue;
+          }
+          throw std::system_error(errno, std::system_category(), "io_uring_enter");
+        }
+        count -= res;
+      }
+    }
+
+    void reaper_main()
+    {
+      bool should_run = true;
+      while (should_run) {
+        long res = syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        if (res < 0 && errno != EINTR) {
+          LOGE("io_uring_enter failed while waiting for completions: {}", std::strerror(errno));
+        }
+        std::uint32_t head = *_cq_head;
+        std::uint32_t tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+          auto cqe = _cqes[head & _cq_mask];
+          auto* op = reinterpret_cast<Op*>(cqe.user_data);
+          if (op == nullptr) {
+            should_run = false;
+          } else if (op->complete(cqe.res)) {
+            delete op;
+            std::unique_lock lock(_mutex);
+            _in_flight--;
+            _has_room.notify_all();
+          } else {
+            // Short transfer, queue the rest. It is still counted as in
+            // flight, so there is room for it.
+            std::unique_lock lock(_mutex);
+            prepare(*op);
+            enter(1);
+          }
+        }
+        __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+      }
+    }
+
+    int _fd = -1;
+    void* _sq_ring = nullptr;
+    void* _cq_ring = nullptr;
+    std::size_t _sq_ring_size = 0;
+    std::size_t _cq_ring_size = 0;
+    io_uring_sqe* _sqes = nullptr;
+    unsigned _sqe_count = 0;
+
+    std::uint32_t* _sq_tail = nullptr;
+    std::uint32_t _sq_mask = 0;
+    std::uint32_t* _sq_array = nullptr;
+    std::uint32_t* _cq_head = nullptr;
+    std::uint32_t* _cq_tail = nullptr;
+    std::uint32_t _cq_mask = 0;
+    io_uring_cqe* _cqes = nullptr;
+
+    unsigned _capacity = 0;
+    std::mutex _mutex;
+    std::condition_variable _has_room;
+    unsigned _in_flight = 0;
+    std::thread _reaper;
+  };
+
+#endif
+
+  // AsyncIO ///////////////////////////////////////////////////////////////////
+
+  AsyncIO::AsyncIO() : AsyncIO(Options{}) {}
+
+  AsyncIO::AsyncIO(Options options)
+  {
+#if defined(OTTO_ASYNC_IO_URING)
+    if (options.use_io_uring) {
+      try {
+        _impl = std::make_unique<UringImpl>(options);
+        return;
+      } catch (std::system_error& e) {
+        LOGI("io_uring is not available ({}), using threads for async I/O", e.what());
+      }
+    }
+#endif
+    _impl = std::make_unique<ThreadImpl>(options);
+  }
+
+  AsyncIO::~AsyncIO() = default;
+
+  AsyncIO& AsyncIO::global()
+  {
+    static AsyncIO instance;
+    return instance;
+  }
+
+  AsyncIO::Backend AsyncIO::backend() const noexcept
+  {
+    return _impl->backend();
+  }
+
+  std::future<std::size_t> AsyncIO::read(int fd, std::uint64_t offset, gsl::span<std::byte> buffer)
+  {
+    auto b = batch();
+    return b.read(fd, offset, buffer);
+  }
+
+  std::future<std::size_t> AsyncIO::write(int fd,
+                                          std::uint64_t offset,
+                                          gsl::span<const std::byte> buffer)
+  {
+    auto b = batch();
+    return b.write(fd, offset, buffer);
+  }
+
+  std::future<void> AsyncIO::fsync(int fd)
+  {
+    auto b = batch();
+    return b.fsync(fd);
+  }
+
+  // Batch /////////////////////////////////////////////////////////////////////
+
+  AsyncIO::Batch::~Batch()
+  {
+    try {
+      submit();
+    } catch (std::exception& e) {
+      LOGE("Failed to submit async I/O batch: {}", e.what());
+    }
+  }
+
+  std::future<std::size_t> AsyncIO::Batch::read(int fd,
+                                                std::uint64_t offset,
+                                                gsl::span<std::byte> buffer)
+  {
+    auto* op = new Op{Op::Type::read, fd, offset, buffer.data(), std::size_t(buffer.size())};
+    _ops.push_back(op);
+    return op->result.get_future();
+  }
+
+  std::future<std::size_t> AsyncIO::Batch::write(int fd,
+                                                 std::uint64_t offset,
+                                                 gsl::span<const std::byte> buffer)
+  {
+    // Writes never modify the buffer, but share the struct with reads
+    auto* data = const_cast<std::byte*>(buffer.data());
+    auto* op = new Op{Op::Type::write, fd, offset, data, std::size_t(buffer.size())};
+    _ops.push_back(op);
+    return op->result.get_future();
+  }
+
+  std::future<void> AsyncIO::Batch::fsync(int fd)
+  {
+    auto* op = new Op{Op::Type::fsync, fd};
+    _ops.push_back(op);
+    return op->synced.get_future();
+  }
+
+  void AsyncIO::Batch::submit()
+  {
+    if (_ops.empty()) return;
+    _io._impl->submit(_ops);
+    _ops.clear();
+  }
+
+  // AlignedBuffer /////////////////////////////////////////////////////////////
+
+  AlignedBuffer::AlignedBuffer(std::size_t size)
+    : _size((size + alignment - 1) / alignment * alignment)
+  {
+    if (_size == 0) return;
+    _data.reset(static_cast<std::byte*>(std::aligned_alloc(alignment, _size)));
+    if (!_data) throw std::bad_alloc();
+  }
+
+  void AlignedBuffer::Free::operator()(std::byte* p) const noexcept
+  {
+    std::free(p);
+  }
+
+  // AsyncFile /////////////////////////////////////////////////////////////////
+
+  AsyncFile::AsyncFile(const filesystem::path& path, Mode mode, bool direct, AsyncIO& io) : _io(io)
+  {
+    int flags = O_CLOEXEC;
+    switch (mode) {
+      case Mode::read: flags |= O_RDONLY; break;
+      case Mode::write: flags |= O_WRONLY | O_CREAT | O_TRUNC; break;
+      case Mode::read_write: flags |= O_RDWR | O_CREAT; break;
+    }
+#if defined(O_DIRECT)
+    if (direct) {
+      _fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+      _direct = _fd >= 0;
+      // Not supported by the file system
+      if (_fd < 0 && errno != EINVAL) {
+        throw std::system_error(errno, std::system_category(), "Could not open " + path.string());
+      }
+    }
+#endif
+    if (_fd < 0) _fd = ::open(path.c_str(), flags, 0644);
+    if (_fd < 0) {
+      throw std::system_error(errno, std::system_category(), "Could not open " + path.string());
+    }
+  }
+
+  AsyncFile::~AsyncFile()
+  {
+    ::close(_fd);
+  }
+
+  std::uint64_t AsyncFile::size() const
+  {
+    struct stat st;
+    if (fstat(_fd, &st) != 0) throw std::system_error(errno, std::system_category(), "fstat");
+    return st.st_size;
+  }
+
+  std::future<std::size_t> AsyncFile::read(std::uint64_t offset, gsl::span<std::byte> buffer)
+  {
+    return _io.read(_fd, offset, buffer);
+  }
+
+  std::future<std::size_t> AsyncFile::write(std::uint64_t offset, gsl::span<const std::byte> buffer)
+  {
+    return _io.write(_fd, offset, buffer);
+  }
+
+  std::future<void> AsyncFile::fsync()
+  {
+    return _io.fsync(_fd);
+  }
+
+} // namespace otto::util
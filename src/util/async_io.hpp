@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/filesystem.hpp"
+
+namespace otto::util {
+
+  /// Asynchronous file I/O
+  ///
+  /// Reads, writes and fsyncs are queued, and return a `std::future` that
+  /// becomes ready when the operation completes. On Linux kernels that
+  /// support it, the operations are submitted through io_uring, and complete
+  /// without occupying any thread. Elsewhere, or if io_uring is not
+  /// available (it is often disabled in containers), a small pool of threads
+  /// does blocking `pread`/`pwrite` calls instead. The interface is the same
+  /// for both.
+  ///
+  /// Failed operations store a `std::system_error` in the future.
+  ///
+  /// Buffers must stay valid until the operation is complete. None of this is
+  /// realtime safe, so don't use it on the audio thread.
+  struct AsyncIO {
+    enum struct Backend { io_uring, threads };
+
+    struct Options {
+      /// Maximum number of operations in flight at a time. Further
+      /// submissions block until earlier ones complete.
+      unsigned queue_depth = 64;
+      /// Use io_uring if the kernel supports it
+      bool use_io_uring = true;
+      /// Number of threads for the fallback backend
+      unsigned threads = 2;
+    };
+
+    /// A set of operations to submit together
+    ///
+    /// With io_uring, all operations in a batch are submitted with a single
+    /// system call. Operations are submitted when @ref submit is called, or
+    /// when the batch is destroyed. Call @ref submit to handle errors, the
+    /// destructor only logs them.
+    struct Batch {
+      Batch(AsyncIO& io) : _io(io) {}
+      ~Batch();
+
+      Batch(const Batch&) = delete;
+      Batch& operator=(const Batch&) = delete;
+
+      std::future<std::size_t> read(int fd, std::uint64_t offset, gsl::span<std::byte> buffer);
+      std::future<std::size_t> write(int fd,
+                                     std::uint64_t offset,
+                                     gsl::span<const std::byte> buffer);
+      std::future<void> fsync(int fd);
+
+      /// Submit all queued operations
+      ///
+      /// \throws `std::system_error` if the kernel rejects the submission
+      void submit();
+
+    private:
+      friend struct AsyncIO;
+      struct Op;
+      AsyncIO& _io;
+      std::vector<Op*> _ops;
+    };
+
+    AsyncIO();
+    AsyncIO(Options options);
+
+    /// Waits for all operations in flight
+    ~AsyncIO();
+
+    AsyncIO(const AsyncIO&) = delete;
+    AsyncIO& operator=(const AsyncIO&) = delete;
+
+    /// The instance shared by the file classes
+    static AsyncIO& global();
+
+    Backend backend() const noexcept;
+
+    /// Read up to `buffer.size()` bytes at `offset`
+    ///
+    /// \returns the number of bytes read, which is less than requested only
+    /// at the end of the file
+    std::future<std::size_t> read(int fd, std::uint64_t offset, gsl::span<std::byte> buffer);
+
+    /// Write `buffer` at `offset`
+    ///
+    /// \returns the number of bytes written
+    std::future<std::size_t> write(int fd, std::uint64_t offset, gsl::span<const std::byte> buffer);
+
+    /// Flush the file to disk
+    std::future<void> fsync(int fd);
+
+    /// Start a @ref Batch of operations
+    Batch batch()
+    {
+      return Batch(*this);
+    }
+
+  private:
+    using Op = Batch::Op;
+    struct Impl;
+    struct UringImpl;
+    struct ThreadImpl;
+
+    std::unique_ptr<Impl> _impl;
+  };
+
+  /// A heap buffer aligned for direct I/O
+  struct AlignedBuffer {
+    /// Alignment of the data, and granularity of the size
+    static constexpr std::size_t alignment = 4096;
+
+    AlignedBuffer() = default;
+    /// Allocate at least `size` bytes, rounded up to @ref alignment
+    explicit AlignedBuffer(std::size_t size);
+
+    std::byte* data() noexcept
+    {
+      return _data.get();
+    }
+    const std::byte* data() const noexcept
+    {
+      return _data.get();
+    }
+    std::size_t size() const noexcept
+    {
+      return _size;
+    }
+
+    operator gsl::span<std::byte>() noexcept
+    {
+      return {data(), static_cast<std::ptrdiff_t>(_size)};
+    }
+
+  private:
+    struct Free {
+      void operator()(std::byte* p) const noexcept;
+    };
+    std::unique_ptr<std::byte[], Free> _data;
+    std::size_t _size = 0;
+  };
+
+  /// A file opened for @ref AsyncIO
+  struct AsyncFile {
+    enum struct Mode { read, write, read_write };
+
+    /// Open `path`
+    ///
+    /// With `direct`, reads and writes bypass the page cache where the file
+    /// system supports it. Offsets, sizes and buffers must then be aligned to
+    /// @ref AlignedBuffer::alignment. Files on file systems without direct
+    /// I/O, like tmpfs, are silently opened normally.
+    ///
+    /// \throws `std::system_error` if the file can not be opened
+    AsyncFile(const filesystem::path& path,
+              Mode mode = Mode::read,
+              bool direct = false,
+              AsyncIO& io = AsyncIO::global());
+    ~AsyncFile();
+
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+
+    int fd() const noexcept
+    {
+      return _fd;
+    }
+
+    /// Whether the file was opened for direct I/O
+    bool direct() const noexcept
+    {
+      return _direct;
+    }
+
+    std::uint64_t size() const;
+
+    std::future<std::size_t> read(std::uint64_t offset, gsl::span<std::byte> buffer);
+    std::future<std::size_t> write(std::uint64_t offset, gsl::span<const std::byte> buffer);
+    std::future<void> fsync();
+
+  private:
+    AsyncIO& _io;
+    int _fd = -1;
+    bool _direct = false;
+  };
+
+} // namespace otto::util
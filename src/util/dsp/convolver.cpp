@@ -0,0 +1,333 @@
+#include "convolver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "services/log_manager.hpp"
+#include "util/dsp/fft.hpp"
+#include "util/exception.hpp"
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  using simd::float4;
+
+  // Stage /////////////////////////////////////////////////////////////////////
+
+  struct Convolver::Stage {
+    /// \param ir the part of the impulse response this stage convolves with
+    Stage(gsl::span<const float> ir, std::size_t block)
+      : block(block),
+        fft(2 * block),
+        partitions(std::max<std::size_t>(1, (ir.size() + block - 1) / block)),
+        stride((fft.bins() + 3) / 4 * 4),
+        filter_re(partitions * stride),
+        filter_im(partitions * stride),
+        fdl_re(partitions * stride),
+        fdl_im(partitions * stride),
+        acc_re(stride),
+        acc_im(stride),
+        window(2 * block),
+        time(2 * block),
+        spectrum(fft.bins())
+    {
+      for (std::size_t p = 0; p < partitions; p++) {
+        std::fill(time.begin(), time.end(), 0.f);
+        auto first = std::min<std::size_t>(p * block, ir.size());
+        auto last = std::min<std::size_t>(first + block, ir.size());
+        std::copy(ir.begin() + first, ir.begin() + last, time.begin());
+        fft.forward(time, spectrum);
+        // The inverse FFT is scaled, so the filter does not need to be
+        for (std::size_t k = 0; k < spectrum.size(); k++) {
+          filter_re[p * stride + k] = spectrum[k].real();
+          filter_im[p * stride + k] = spectrum[k].imag();
+        }
+      }
+    }
+
+    /// Convolve the next `block` samples of `in` into `out`
+    ///
+    /// Overlap-save: the FFT of the last two input blocks goes into a
+    /// frequency domain delay line, and is multiplied with the partition of
+    /// the impulse response that matches its delay.
+    void process(const float* in, float* out) noexcept
+    {
+      std::copy(window.begin() + block, window.end(), window.begin());
+      std::copy(in, in + block, window.begin() + block);
+      fft.forward(window, spectrum);
+
+      fdl_pos = (fdl_pos + partitions - 1) % partitions;
+      float* xr = fdl_re.data() + fdl_pos * stride;
+      float* xi = fdl_im.data() + fdl_pos * stride;
+      for (std::size_t k = 0; k < spectrum.size(); k++) {
+        xr[k] = spectrum[k].real();
+        xi[k] = spectrum[k].imag();
+      }
+
+      std::fill(acc_re.begin(), acc_re.end(), 0.f);
+      std::fill(acc_im.begin(), acc_im.end(), 0.f);
+      for (std::size_t p = 0; p < partitions; p++) {
+        std::size_t d = (fdl_pos + p) % partitions;
+        const float* xr = fdl_re.data() + d * stride;
+        const float* xi = fdl_im.data() + d * stride;
+        const float* hr = filter_re.data() + p * stride;
+        const float* hi = filter_im.data() + p * stride;
+        for (std::size_t k = 0; k < stride; k += 4) {
+          auto ar = simd::load<float4>(xr + k);
+          auto ai = simd::load<float4>(xi + k);
+          auto br = simd::load<float4>(hr + k);
+          auto bi = simd::load<float4>(hi + k);
+          simd::store(acc_re.data() + k, simd::load<float4>(acc_re.data() + k) + ar * br - ai * bi);
+          simd::store(acc_im.data() + k, simd::load<float4>(acc_im.data() + k) + ar * bi + ai * br);
+        }
+      }
+
+      for (std::size_t k = 0; k < spectrum.size(); k++) {
+        spectrum[k] = {acc_re[k], acc_im[k]};
+      }
+      fft.inverse(spectrum, time);
+      // The first half has wrapped around, the second half is the output
+      std::copy(time.begin() + block, time.end(), out);
+    }
+
+    void reset() noexcept
+    {
+      std::fill(window.begin(), window.end(), 0.f);
+      std::fill(fdl_re.begin(), fdl_re.end(), 0.f);
+      std::fill(fdl_im.begin(), fdl_im.end(), 0.f);
+      fdl_pos = 0;
+    }
+
+    const std::size_t block;
+    FFT fft;
+    const std::size_t partitions;
+    /// Bins per spectrum, rounded up to a multiple of 4
+    const std::size_t stride;
+    std::vector<float> filter_re;
+    std::vector<float> filter_im;
+    /// The spectra of the last `partitions` input blocks, newest at `fdl_pos`
+    std::vector<float> fdl_re;
+    std::vector<float> fdl_im;
+    std::size_t fdl_pos = 0;
+    std::vector<float> acc_re;
+    std::vector<float> acc_im;
+    /// The last two blocks of input
+    std::vector<float> window;
+    std::vector<float> time;
+    std::vector<FFT::complex> spectrum;
+  };
+
+  // TailWorker ////////////////////////////////////////////////////////////////
+
+  /// Runs while any convolver with a background tail exists
+  ///
+  /// The thread holds `_mutex` while convolving, so a convolver is never
+  /// removed in the middle of a block.
+  struct Convolver::TailWorker {
+    static TailWorker& instance()
+    {
+      static TailWorker worker;
+      return worker;
+    }
+
+    void add(Convolver& conv)
+    {
+      std::unique_lock lifetime(_lifetime);
+      std::unique_lock lock(_mutex);
+      _convolvers.push_back(&conv);
+      if (_thread.joinable()) return;
+      _should_run = true;
+      _thread = std::thread([this] { main(); });
+    }
+
+    void remove(Convolver& conv)
+    {
+      std::unique_lock lifetime(_lifetime);
+      {
+        std::unique_lock lock(_mutex);
+        _convolvers.erase(std::find(_convolvers.begin(), _convolvers.end(), &conv));
+        if (!_convolvers.empty()) return;
+        _should_run = false;
+      }
+      _wake.notify_all();
+      _thread.join();
+    }
+
+    /// Called by the audio thread, after requesting a tail block
+    void wake() noexcept
+    {
+      _wake.notify_one();
+    }
+
+  private:
+    void main()
+    {
+      using namespace std::chrono_literals;
+      loguru::set_thread_name("convolver");
+      std::unique_lock lock(_mutex);
+      while (_should_run) {
+        bool worked = false;
+        for (auto* conv : _convolvers) worked |= conv->run_tails();
+        if (worked) continue;
+        // The audio thread notifies without the lock, so a wakeup can be
+        // missed. The timeout limits how late that makes a tail block.
+        _wake.wait_for(lock, 1ms);
+      }
+    }
+
+    /// Held by @ref add and @ref remove, so the thread is not started while
+    /// it is being stopped
+    std::mutex _lifetime;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::vector<Convolver*> _convolvers;
+    bool _should_run = false;
+    std::thread _thread;
+  };
+
+  // Convolver /////////////////////////////////////////////////////////////////
+
+  Convolver::Convolver(gsl::span<const float> impulse_response)
+    : Convolver(impulse_response, Options())
+  {}
+
+  Convolver::Convolver(gsl::span<const float> impulse_response, Options options)
+    : _options(options), _size(impulse_response.size())
+  {
+    auto is_pow2 = [](std::size_t n) { return n != 0 && (n & (n - 1)) == 0; };
+    if (!is_pow2(options.head_block) || !is_pow2(options.tail_block) ||
+        options.head_block < FFT::min_size / 2 || options.tail_block < options.head_block) {
+      throw util::exception("Unsupported convolution block sizes {} and {}", options.head_block,
+                            options.tail_block);
+    }
+
+    // A tail block is needed one tail block after its input is complete
+    const std::size_t head_size = std::min(_size, 2 * options.tail_block);
+    _head = std::make_unique<Stage>(impulse_response.subspan(0, head_size), options.head_block);
+    _head_in.resize(options.head_block);
+    _head_out.resize(options.head_block);
+
+    if (_size > head_size) {
+      _tail = std::make_unique<Stage>(impulse_response.subspan(head_size), options.tail_block);
+      _tail_ratio = options.tail_block / options.head_block;
+      _tail_collect.resize(options.tail_block);
+      _tail_in.resize(options.tail_block);
+      for (auto& out : _tail_out) out.resize(options.tail_block);
+      if (options.background) {
+        _worker = &TailWorker::instance();
+        _worker->add(*this);
+      }
+    }
+  }
+
+  Convolver::~Convolver() noexcept
+  {
+    if (_worker) _worker->remove(*this);
+  }
+
+  void Convolver::process(gsl::span<const float> in, gsl::span<float> out) noexcept
+  {
+    const std::size_t block = _options.head_block;
+    std::size_t done = 0;
+    while (done < std::size_t(in.size())) {
+      std::size_t n = std::min(block - _fill, in.size() - done);
+      // Input first, in case `in` and `out` are the same
+      std::copy_n(in.data() + done, n, _head_in.data() + _fill);
+      std::copy_n(_head_out.data() + _fill, n, out.data() + done);
+      _fill += n;
+      done += n;
+      if (_fill == block) {
+        process_block();
+        _fill = 0;
+      }
+    }
+  }
+
+  void Convolver::reset() noexcept
+  {
+    wait_idle();
+    _head->reset();
+    std::fill(_head_in.begin(), _head_in.end(), 0.f);
+    std::fill(_head_out.begin(), _head_out.end(), 0.f);
+    _fill = 0;
+    if (_tail) {
+      _tail->reset();
+      std::fill(_tail_out[0].begin(), _tail_out[0].end(), 0.f);
+      std::fill(_tail_out[1].begin(), _tail_out[1].end(), 0.f);
+      _tail_read = 2;
+      _tail_late = false;
+      _tail_fill = 0;
+    }
+  }
+
+  void Convolver::wait_idle() const noexcept
+  {
+    while (_tail_done.load(std::memory_order_acquire) < _tail_started) {
+      std::this_thread::yield();
+    }
+  }
+
+  void Convolver::process_block() noexcept
+  {
+    const std::size_t block = _options.head_block;
+    _head->process(_head_in.data(), _head_out.data());
+    if (!_tail) return;
+
+    // Tail block `n` covers the output from `n + 2` tail blocks on
+    const float* tail = _tail_out[_tail_read].data() + _tail_fill * block;
+    for (std::size_t i = 0; i < block; i++) _head_out[i] += tail[i];
+
+    std::copy(_head_in.begin(), _head_in.end(), _tail_collect.begin() + _tail_fill * block);
+    if (++_tail_fill == _tail_ratio) {
+      _tail_fill = 0;
+      start_tail();
+    }
+  }
+
+  void Convolver::start_tail() noexcept
+  {
+    if (_tail_done.load(std::memory_order_acquire) < _tail_started) {
+      // The background thread is still using `_tail_in`. Play silence, and
+      // drop this block from the tail, which is wrong until the gap has
+      // passed through it. A glitch, but the audio thread never waits.
+      _overruns.fetch_add(1, std::memory_order_relaxed);
+      _tail_read = 2;
+      _tail_late = true;
+      return;
+    }
+    // The last tail block started is read from now on, unless it was late,
+    // and the next one is written to the other buffer
+    _tail_read = (_tail_started == 0 || _tail_late) ? 2 : (_tail_started - 1) % 2;
+    _tail_late = false;
+    std::copy(_tail_collect.begin(), _tail_collect.end(), _tail_in.begin());
+    auto job = _tail_started++;
+    if (_worker) {
+      _tail_requested.store(_tail_started, std::memory_order_release);
+      _worker->wake();
+    } else {
+      run_tail(job);
+      _tail_done.store(_tail_started, std::memory_order_release);
+    }
+  }
+
+  bool Convolver::run_tails() noexcept
+  {
+    auto requested = _tail_requested.load(std::memory_order_acquire);
+    auto job = _tail_done.load(std::memory_order_relaxed);
+    if (job == requested) return false;
+    for (; job < requested; job++) {
+      run_tail(job);
+      _tail_done.store(job + 1, std::memory_order_release);
+    }
+    return true;
+  }
+
+  void Convolver::run_tail(std::size_t job) noexcept
+  {
+    _tail->process(_tail_in.data(), _tail_out[job % 2].data());
+  }
+
+} // namespace otto::util::dsp
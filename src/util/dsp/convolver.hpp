@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <gsl/span>
+
+namespace otto::util::dsp {
+
+  /// Low latency convolution with a long impulse response
+  ///
+  /// The impulse response is split in two. The head, the first
+  /// `2 * tail_block` samples, is convolved in blocks of `head_block`
+  /// samples, which sets the latency. The rest, the tail, is convolved in
+  /// blocks of `tail_block` samples, which is a lot cheaper per sample. Both
+  /// parts are uniformly partitioned, frequency domain convolutions, using
+  /// @ref FFT.
+  ///
+  /// Each tail block is only needed one tail block after its input is
+  /// complete, so it can be computed on a background thread, spreading its
+  /// cost over that time instead of spiking every `tail_block` samples. One
+  /// thread is shared by all convolvers. The audio thread never locks or
+  /// waits to hand over a block. If the background thread has not finished
+  /// one when it is needed, the tail is silent for that block, and the input
+  /// block is dropped from it. Those are counted in @ref overruns.
+  ///
+  /// Only the constructor allocates.
+  struct Convolver {
+    struct Options {
+      /// A power of two, at least 32
+      std::size_t head_block = 64;
+      /// A power of two, at least `head_block`
+      std::size_t tail_block = 1024;
+      /// Convolve the tail on a background thread. If `false`, it is
+      /// convolved in @ref process.
+      bool background = true;
+    };
+
+    /// \throws `util::exception` if the block sizes are not supported
+    Convolver(gsl::span<const float> impulse_response);
+    Convolver(gsl::span<const float> impulse_response, Options options);
+
+    /// Waits for the background thread to finish this convolver's block
+    ~Convolver() noexcept;
+
+    Convolver(const Convolver&) = delete;
+    Convolver& operator=(const Convolver&) = delete;
+
+    /// Convolve `in` into `out`, which must have the same size
+    ///
+    /// `in` and `out` may be the same buffer. Blocks can have any size.
+    void process(gsl::span<const float> in, gsl::span<float> out) noexcept;
+
+    /// Clear all buffered input, as if newly constructed
+    ///
+    /// Calls @ref wait_idle, so don't call it on the audio thread
+    void reset() noexcept;
+
+    /// Wait until the background thread has convolved all tail blocks
+    /// started by @ref process
+    ///
+    /// For tests and offline rendering. Call it from the thread that calls
+    /// @ref process.
+    void wait_idle() const noexcept;
+
+    /// The delay from input to output, in samples
+    std::size_t latency() const noexcept
+    {
+      return _options.head_block;
+    }
+
+    /// The length of the impulse response
+    std::size_t size() const noexcept
+    {
+      return _size;
+    }
+
+    /// The number of tail blocks the background thread did not finish in
+    /// time
+    std::size_t overruns() const noexcept
+    {
+      return _overruns.load(std::memory_order_relaxed);
+    }
+
+  private:
+    /// A uniformly partitioned convolution with part of the impulse response
+    struct Stage;
+    /// The background thread
+    struct TailWorker;
+
+    void process_block() noexcept;
+    /// Hand over a complete tail block, if the previous one is done
+    void start_tail() noexcept;
+    /// Convolve the requested tail blocks, on the background thread
+    ///
+    /// \returns `false` if there was nothing to do
+    bool run_tails() noexcept;
+    void run_tail(std::size_t job) noexcept;
+
+    Options _options;
+    std::size_t _size;
+
+    std::unique_ptr<Stage> _head;
+    std::vector<float> _head_in;
+    std::vector<float> _head_out;
+    std::size_t _fill = 0;
+
+    /// Empty if the impulse response fits in the head
+    std::unique_ptr<Stage> _tail;
+    /// Head blocks per tail block
+    std::size_t _tail_ratio = 0;
+    /// Head blocks in the tail block being collected
+    std::size_t _tail_fill = 0;
+    std::vector<float> _tail_collect;
+    /// Input of the tail block being convolved
+    std::vector<float> _tail_in;
+    /// Tail block `n` is written to `_tail_out[n % 2]`, while the other one is
+    /// read by the audio thread. `_tail_out[2]` is silence.
+    std::vector<float> _tail_out[3];
+    std::size_t _tail_read = 2;
+    /// Tail blocks started, only used by the audio thread
+    std::size_t _tail_started = 0;
+    /// The last tail block started finished late, so it is not played
+    bool _tail_late = false;
+
+    std::atomic<std::size_t> _tail_requested = 0;
+    std::atomic<std::size_t> _tail_done = 0;
+    std::atomic<std::size_t> _overruns = 0;
+    /// Null if the tail is convolved in @ref process
+    TailWorker* _worker = nullptr;
+  };
+
+} // namespace otto::util::dsp
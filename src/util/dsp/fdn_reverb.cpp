@@ -0,0 +1,331 @@
+#include "fdn_reverb.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace otto::util::dsp {
+
+  namespace {
+    using simd::float4;
+    using Lines = std::array<float4, FdnReverb::lines / 4>;
+
+    /// Line lengths in samples at 48 kHz. Primes, spread so each group has
+    /// both short and long lines.
+    constexpr float line_lengths[FdnReverb::lines] = {569,  1087, 1567, 2129, 653,  1201, 1693, 2287,
+                                                      757,  1327, 1831, 2459, 863,  1433, 1979, 967};
+    /// Allpass diffuser lengths in samples at 48 kHz
+    constexpr float diffuser_lengths[4] = {142, 107, 379, 277};
+    constexpr float diffuser_gain = 0.6f;
+    /// Modulation depth in samples at 48 kHz
+    constexpr float mod_depth = 8;
+    /// Octave up window in samples
+    constexpr std::size_t octave_window = 2048;
+
+    /// Signs of the input to, and the two outputs from, each line
+    const Lines input_signs = {float4{1, -1, 1, -1}, float4{-1, 1, -1, 1}, float4{1, 1, -1, -1},
+                               float4{-1, -1, 1, 1}};
+    const Lines out_a_signs = {float4{1, 1, -1, -1}, float4{1, 1, -1, -1}, float4{-1, -1, 1, 1},
+                               float4{-1, -1, 1, 1}};
+    const Lines out_b_signs = {float4{1, -1, 1, -1}, float4{-1, 1, -1, 1}, float4{1, -1, 1, -1},
+                               float4{-1, 1, -1, 1}};
+
+    float hsum(float4 v) noexcept
+    {
+      return (v[0] + v[1]) + (v[2] + v[3]);
+    }
+
+    /// Multiply by the 16x16 mixing matrix, the Kronecker product of a 4x4
+    /// Hadamard matrix and a 4x4 Householder reflection, both normalized
+    void mix(Lines& l) noexcept
+    {
+      // Householder within the groups: I - 2/4 * ones
+      for (auto& v : l) v -= 0.5f * hsum(v);
+      // Hadamard across them
+      auto a = l[0] + l[1];
+      auto b = l[0] - l[1];
+      auto c = l[2] + l[3];
+      auto d = l[2] - l[3];
+      l[0] = (a + c) * 0.5f;
+      l[1] = (b + d) * 0.5f;
+      l[2] = (a - c) * 0.5f;
+      l[3] = (b - d) * 0.5f;
+    }
+
+    /// Transpose the 4x4 matrix with rows `r`
+    void transpose(float4 (&r)[4]) noexcept
+    {
+      float4 t0 = {r[0][0], r[1][0], r[2][0], r[3][0]};
+      float4 t1 = {r[0][1], r[1][1], r[2][1], r[3][1]};
+      float4 t2 = {r[0][2], r[1][2], r[2][2], r[3][2]};
+      float4 t3 = {r[0][3], r[1][3], r[2][3], r[3][3]};
+      r[0] = t0;
+      r[1] = t1;
+      r[2] = t2;
+      r[3] = t3;
+    }
+
+    std::size_t next_pow2(std::size_t n) noexcept
+    {
+      std::size_t res = 1;
+      while (res < n) res *= 2;
+      return res;
+    }
+  } // namespace
+
+  // Allpass ///////////////////////////////////////////////////////////////////
+
+  float FdnReverb::Allpass::operator()(float x) noexcept
+  {
+    float d = buffer[pos];
+    float u = x + diffuser_gain * d;
+    buffer[pos] = u;
+    pos = pos + 1 == buffer.size() ? 0 : pos + 1;
+    return d - diffuser_gain * u;
+  }
+
+  // OctaveUp //////////////////////////////////////////////////////////////////
+
+  float FdnReverb::OctaveUp::operator()(float x) noexcept
+  {
+    // Both delays shrink by one sample per sample, so the heads read at
+    // twice the speed. Each jumps back when its weight is zero.
+    const std::size_t mask = buffer.size() - 1;
+    buffer[pos] = x;
+    std::size_t phase2 = (phase + octave_window / 2) % octave_window;
+    float w1 = 1 - std::abs(2.f * phase / octave_window - 1);
+    float y = w1 * buffer[(pos - (octave_window - phase)) & mask] +
+              (1 - w1) * buffer[(pos - (octave_window - phase2)) & mask];
+    pos = (pos + 1) & mask;
+    phase = (phase + 1) % octave_window;
+    return y;
+  }
+
+  // FdnReverb /////////////////////////////////////////////////////////////////
+
+  FdnReverb::FdnReverb(float samplerate) : _samplerate(samplerate)
+  {
+    const float scale = samplerate / 48000.f;
+    _mod_depth = mod_depth * scale;
+
+    float longest = *std::max_element(std::begin(line_lengths), std::end(line_lengths)) * scale;
+    std::size_t size = next_pow2(longest + _mod_depth + 2);
+    _delay_mask = size - 1;
+    // Padded, so the lines do not all start at the same offset in the cache
+    _delay_stride = size + (guard + 15) / 16 * 16 + 16;
+    _delay.resize(_delay_stride * lines);
+
+    for (std::size_t i = 0; i < lines; i++) {
+      auto g = i / 4;
+      auto j = i % 4;
+      _length[g][j] = line_lengths[i] * scale;
+      // Rates from 0.1 to 0.85 Hz, with spread out phases
+      double rate = 0.1 + 0.05 * i;
+      double phase = 2 * M_PI * i * 5 / lines;
+      _lfo_cos[g][j] = std::cos(phase);
+      _lfo_sin[g][j] = std::sin(phase);
+      _lfo_rot_cos[g][j] = std::cos(2 * M_PI * rate * block / samplerate);
+      _lfo_rot_sin[g][j] = std::sin(2 * M_PI * rate * block / samplerate);
+    }
+
+    for (std::size_t i = 0; i < _diffusers.size(); i++) {
+      _diffusers[i].buffer.resize(std::lround(diffuser_lengths[i] * scale));
+    }
+    _octave.buffer.resize(next_pow2(octave_window + 1));
+
+    _gate_release = std::exp(-1 / (0.01f * samplerate));
+    _gate_open = 1 - std::exp(-1 / (0.001f * samplerate));
+    _gate_close = 1 - std::exp(-1 / (0.04f * samplerate));
+
+    damping(10000);
+    update_gains();
+    reset();
+  }
+
+  void FdnReverb::decay(float seconds) noexcept
+  {
+    seconds = std::max(seconds, 0.01f);
+    if (seconds == _decay) return;
+    _decay = seconds;
+    update_gains();
+  }
+
+  void FdnReverb::update_gains() noexcept
+  {
+    // -60 dB after `_decay` seconds, whatever the length of the line
+    for (std::size_t g = 0; g < groups; g++) {
+      for (std::size_t j = 0; j < 4; j++) {
+        _gain[g][j] = std::pow(10.f, -3 * _length[g][j] / (_decay * _samplerate));
+      }
+    }
+  }
+
+  void FdnReverb::damping(float cutoff) noexcept
+  {
+    _lowpass_coef = 1 - std::exp(-2 * float(M_PI) * std::min(cutoff, _samplerate / 2) / _samplerate);
+  }
+
+  void FdnReverb::spread(float amount) noexcept
+  {
+    _spread = std::clamp(amount, 0.f, 1.f);
+  }
+
+  void FdnReverb::shimmer(float amount) noexcept
+  {
+    _shimmer = std::clamp(amount, 0.f, 1.f);
+  }
+
+  void FdnReverb::gate(float threshold) noexcept
+  {
+    _gate_threshold = threshold;
+  }
+
+  void FdnReverb::reset() noexcept
+  {
+    std::fill(_delay.begin(), _delay.end(), 0.f);
+    _lowpass = {};
+    for (auto& ap : _diffusers) std::fill(ap.buffer.begin(), ap.buffer.end(), 0.f);
+    std::fill(_octave.buffer.begin(), _octave.buffer.end(), 0.f);
+    _gate_env = 0;
+    _gate_gain = 1;
+  }
+
+  void FdnReverb::process(gsl::span<const float> in,
+                          gsl::span<float> left,
+                          gsl::span<float> right) noexcept
+  {
+    for (std::size_t n = 0; n < std::size_t(in.size());) {
+      if (_mod_countdown == 0) update_modulation();
+      // A call can end in the middle of a block. The next one reads the rest
+      // of it again, with the same modulation.
+      std::size_t len = std::min(_mod_countdown, in.size() - n);
+      read_taps();
+      process_block(in.data() + n, left.data() + n, right.data() + n, len);
+      write_feedback(len);
+      _pos = (_pos + len) & _delay_mask;
+      _mod_countdown -= len;
+      n += len;
+    }
+  }
+
+  void FdnReverb::update_modulation() noexcept
+  {
+    _mod_countdown = block;
+    for (std::size_t g = 0; g < groups; g++) {
+      float4 delay = _length[g] + _lfo_sin[g] * _mod_depth;
+      float4 whole = simd::floor(delay);
+      _frac[g] = delay - whole;
+      auto offset = simd::to_int(whole);
+      for (std::size_t j = 0; j < 4; j++) _offset[g * 4 + j] = offset[j];
+
+      float4 c = _lfo_cos[g] * _lfo_rot_cos[g] - _lfo_sin[g] * _lfo_rot_sin[g];
+      float4 s = _lfo_sin[g] * _lfo_rot_cos[g] + _lfo_cos[g] * _lfo_rot_sin[g];
+      // Keep the oscillators from drifting off the unit circle
+      float4 norm = 1.5f - 0.5f * (c * c + s * s);
+      _lfo_cos[g] = c * norm;
+      _lfo_sin[g] = s * norm;
+    }
+  }
+
+  void FdnReverb::read_taps() noexcept
+  {
+    // Each line is read in one piece, between two samples
+    for (std::size_t i = 0; i < lines; i++) {
+      const float* line = _delay.data() + i * _delay_stride;
+      // src[k + 1] is the sample `offset` before `_pos + k`, src[k] the one
+      // before that
+      const float* src = line + ((_pos - _offset[i] - 1) & _delay_mask);
+      const float frac = _frac[i / 4][i % 4];
+      for (std::size_t k = 0; k < block; k += 4) {
+        auto a = simd::load<float4>(src + k + 1);
+        auto b = simd::load<float4>(src + k);
+        simd::store(_taps[i].data() + k, a + (b - a) * frac);
+      }
+    }
+  }
+
+  void FdnReverb::write_feedback(std::size_t n) noexcept
+  {
+    const std::size_t size = _delay_mask + 1;
+    for (std::size_t i = 0; i < lines; i++) {
+      float* line = _delay.data() + i * _delay_stride;
+      for (std::size_t k = 0; k < n; k++) {
+        std::size_t idx = (_pos + k) & _delay_mask;
+        line[idx] = _feedback[i][k];
+        if (idx < guard) line[idx + size] = _feedback[i][k];
+      }
+    }
+  }
+
+  void FdnReverb::process_block(const float* in, float* left, float* right, std::size_t n) noexcept
+  {
+    // The state is copied to locals, so it can stay in registers instead of
+    // being reloaded after every store
+    const Lines gain = _gain;
+    Lines lowpass = _lowpass;
+    const float lowpass_coef = _lowpass_coef;
+
+    // From one row per line to one row per sample, four by four
+    std::array<Lines, block> taps;
+    for (std::size_t g = 0; g < groups; g++) {
+      for (std::size_t k = 0; k < block; k += 4) {
+        float4 tile[4];
+        for (std::size_t j = 0; j < 4; j++) tile[j] = simd::load<float4>(_taps[g * 4 + j].data() + k);
+        transpose(tile);
+        for (std::size_t j = 0; j < 4; j++) taps[k + j][g] = tile[j];
+      }
+    }
+    std::array<Lines, block> feedback;
+
+    for (std::size_t k = 0; k < n; k++) {
+      float x = in[k];
+      for (auto& ap : _diffusers) x = ap(x);
+
+      float4 out_a = {};
+      float4 out_b = {};
+      auto& fb = feedback[k];
+      for (std::size_t g = 0; g < groups; g++) {
+        out_a += taps[k][g] * out_a_signs[g];
+        out_b += taps[k][g] * out_b_signs[g];
+        lowpass[g] += lowpass_coef * (taps[k][g] - lowpass[g]);
+        fb[g] = lowpass[g] * gain[g];
+      }
+
+      if (_shimmer > 0) {
+        float s = fb[0][0];
+        fb[0][0] = s + _shimmer * (_octave(s) - s);
+      }
+
+      mix(fb);
+      for (std::size_t g = 0; g < groups; g++) fb[g] += input_signs[g] * (x * 0.25f);
+
+      // Two decorrelated outputs, blended towards mono as spread goes down
+      float a = hsum(out_a) * 0.25f;
+      float b = hsum(out_b) * 0.25f;
+      float mid = (a + b) * 0.5f;
+      float side = (a - b) * 0.5f * _spread;
+      float l = mid + side;
+      float r = mid - side;
+
+      if (_gate_threshold > 0) {
+        _gate_env = std::max(std::max(std::abs(l), std::abs(r)), _gate_env * _gate_release);
+        float target = _gate_env >= _gate_threshold ? 1.f : 0.f;
+        _gate_gain += (target - _gate_gain) * (target > _gate_gain ? _gate_open : _gate_close);
+        l *= _gate_gain;
+        r *= _gate_gain;
+      }
+      left[k] = l;
+      right[k] = r;
+    }
+    _lowpass = lowpass;
+
+    for (std::size_t g = 0; g < groups; g++) {
+      for (std::size_t k = 0; k < block; k += 4) {
+        float4 tile[4];
+        for (std::size_t j = 0; j < 4; j++) tile[j] = feedback[k + j][g];
+        transpose(tile);
+        for (std::size_t j = 0; j < 4; j++) simd::store(_feedback[g * 4 + j].data() + k, tile[j]);
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  /// A feedback delay network reverb
+  ///
+  /// Sixteen modulated delay lines feed back into each other through an
+  /// orthogonal mixing matrix, so the echoes multiply quickly while the
+  /// energy is preserved. The matrix is a 4x4 Hadamard matrix across groups
+  /// of four lines, combined with a 4x4 Householder reflection within each
+  /// group. The lines are kept in four @ref simd::float4, so both halves,
+  /// the damping and the modulation, are done four lines at a time.
+  ///
+  /// Each line has a lowpass and a gain in its feedback path, with the gain
+  /// set from its length so all lines decay at the same rate. The input goes
+  /// through a few allpass diffusers first, to smear transients.
+  ///
+  /// Optionally, one line is pitch shifted up an octave in the feedback
+  /// path, which gives a shimmer that keeps rising as the reverb decays.
+  ///
+  /// Only the constructor allocates.
+  struct FdnReverb {
+    static constexpr std::size_t lines = 16;
+
+    FdnReverb(float samplerate);
+
+    /// Time for the reverb to decay by 60 dB, in seconds
+    void decay(float seconds) noexcept;
+    /// Cutoff of the lowpass in the feedback path, in Hz
+    void damping(float cutoff) noexcept;
+    /// Decorrelation between the left and right outputs, from 0 (mono) to 1
+    void spread(float amount) noexcept;
+    /// Amount of the octave up pitch shift in the feedback path, from 0 to 1
+    void shimmer(float amount) noexcept;
+    /// Mute the output while it is below `threshold`, as a linear level
+    ///
+    /// `0` turns the gate off
+    void gate(float threshold) noexcept;
+
+    /// Process the mono `in` into `left` and `right`
+    ///
+    /// All three must have the same size. `in` may be the same buffer as
+    /// `left` or `right`.
+    void process(gsl::span<const float> in, gsl::span<float> left, gsl::span<float> right) noexcept;
+
+    /// Silence the reverb
+    void reset() noexcept;
+
+  private:
+    using float4 = simd::float4;
+    static constexpr std::size_t groups = lines / 4;
+    using Lines = std::array<float4, groups>;
+
+    /// Schroeder allpass, for diffusing the input
+    struct Allpass {
+      std::vector<float> buffer;
+      std::size_t pos = 0;
+      float operator()(float x) noexcept;
+    };
+
+    /// Octave up pitch shifter, crossfading between two read heads that
+    /// sweep through a window
+    struct OctaveUp {
+      std::vector<float> buffer;
+      std::size_t pos = 0;
+      std::size_t phase = 0;
+      float operator()(float x) noexcept;
+    };
+
+    /// Samples between updates of the modulation. The lengths change by
+    /// less than a hundredth of a sample in that time.
+    ///
+    /// This is also the block size. All lines are longer than this, so the
+    /// taps for a whole block can be read before any of it is written.
+    static constexpr std::size_t block = 16;
+    /// Samples copied from the start of each line to its end
+    static constexpr std::size_t guard = block + 1;
+
+    void update_gains() noexcept;
+    /// Step the oscillators, and set the read positions from them
+    void update_modulation() noexcept;
+    /// Read the next @ref block samples of each line into @ref _taps
+    void read_taps() noexcept;
+    /// Run the network for `n` samples, reading @ref _taps and writing
+    /// @ref _feedback
+    void process_block(const float* in, float* left, float* right, std::size_t n) noexcept;
+    /// Write the first `n` samples of @ref _feedback to the lines
+    void write_feedback(std::size_t n) noexcept;
+
+    float _samplerate;
+    float _decay = 2;
+
+    /// The delay lines, one after the other. Each is a ring buffer of
+    /// `_delay_mask + 1` samples followed by a copy of its first @ref guard
+    /// samples, so a block can be read without wrapping around.
+    std::vector<float> _delay;
+    std::size_t _delay_mask;
+    std::size_t _delay_stride;
+    std::size_t _pos = 0;
+
+    /// One row of @ref block samples per line
+    using Block = std::array<std::array<float, block>, lines>;
+    Block _taps;
+    Block _feedback;
+
+    Lines _length;
+    Lines _gain;
+    /// Lowpass state and coefficient
+    Lines _lowpass;
+    float _lowpass_coef = 1;
+
+    /// Quadrature oscillators for the modulation, and their rotation per
+    /// update
+    Lines _lfo_cos;
+    Lines _lfo_sin;
+    Lines _lfo_rot_cos;
+    Lines _lfo_rot_sin;
+    float _mod_depth;
+    /// Samples until the next update
+    std::size_t _mod_countdown = 0;
+    /// The modulated lengths, split in whole samples and a fraction
+    std::array<std::size_t, lines> _offset;
+    Lines _frac;
+
+    std::array<Allpass, 4> _diffusers;
+    OctaveUp _octave;
+    float _shimmer = 0;
+    float _spread = 1;
+
+    float _gate_threshold = 0;
+    float _gate_env = 0;
+    float _gate_gain = 1;
+    float _gate_release;
+    float _gate_open;
+    float _gate_close;
+  };
+
+} // namespace otto::util::dsp
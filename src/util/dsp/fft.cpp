@@ -0,0 +1,229 @@
+#include "fft.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "util/exception.hpp"
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  using simd::float4;
+
+  // FFT ///////////////////////////////////////////////////////////////////////
+
+  FFT::FFT(std::size_t size) : _size(size)
+  {
+    if (size < min_size || size > max_size || (size & (size - 1)) != 0) {
+      throw util::exception("FFT size must be a power of two from {} to {}, not {}", min_size,
+                            max_size, size);
+    }
+    std::size_t m = size / 2;
+    _re.resize(m);
+    _im.resize(m);
+    _work_re.resize(m);
+    _work_im.resize(m);
+
+    // Stage `n` uses exp(-2 pi i p / n) for p < n / 2
+    for (std::size_t n = m; n > 1; n /= 2) {
+      for (std::size_t p = 0; p < n / 2; p++) {
+        double phase = -2 * M_PI * p / n;
+        _twiddle_re.push_back(std::cos(phase));
+        _twiddle_im.push_back(std::sin(phase));
+      }
+    }
+
+    _split.resize(m);
+    for (std::size_t k = 0; k < m; k++) {
+      double phase = -2 * M_PI * k / size;
+      _split[k] = {float(std::cos(phase)), float(std::sin(phase))};
+    }
+  }
+
+  void FFT::transform() noexcept
+  {
+    // Stockham autosort, decimation in frequency. Each stage reads from one
+    // pair of buffers and writes to the other, in an order that leaves the
+    // result in natural order. In all but the first two stages, `s` is at
+    // least 4, and the inner loop is vectorized.
+    float* xr = _re.data();
+    float* xi = _im.data();
+    float* yr = _work_re.data();
+    float* yi = _work_im.data();
+    const float* twr = _twiddle_re.data();
+    const float* twi = _twiddle_im.data();
+
+    for (std::size_t n = _size / 2, s = 1; n > 1; n /= 2, s *= 2) {
+      std::size_t m = n / 2;
+      for (std::size_t p = 0; p < m; p++) {
+        const std::size_t a = s * p;
+        const std::size_t b = s * (p + m);
+        const std::size_t c = s * 2 * p;
+        const std::size_t d = s * (2 * p + 1);
+        if (s >= 4) {
+          auto wr = simd::broadcast<float4>(twr[p]);
+          auto wi = simd::broadcast<float4>(twi[p]);
+          for (std::size_t q = 0; q < s; q += 4) {
+            auto ar = simd::load<float4>(xr + q + a);
+            auto ai = simd::load<float4>(xi + q + a);
+            auto br = simd::load<float4>(xr + q + b);
+            auto bi = simd::load<float4>(xi + q + b);
+            simd::store(yr + q + c, ar + br);
+            simd::store(yi + q + c, ai + bi);
+            auto dr = ar - br;
+            auto di = ai - bi;
+            simd::store(yr + q + d, dr * wr - di * wi);
+            simd::store(yi + q + d, dr * wi + di * wr);
+          }
+        } else {
+          float wr = twr[p];
+          float wi = twi[p];
+          for (std::size_t q = 0; q < s; q++) {
+            float ar = xr[q + a], ai = xi[q + a];
+            float br = xr[q + b], bi = xi[q + b];
+            yr[q + c] = ar + br;
+            yi[q + c] = ai + bi;
+            float dr = ar - br, di = ai - bi;
+            yr[q + d] = dr * wr - di * wi;
+            yi[q + d] = dr * wi + di * wr;
+          }
+        }
+      }
+      twr += m;
+      twi += m;
+      std::swap(xr, yr);
+      std::swap(xi, yi);
+    }
+
+    // After an odd number of stages, the result is in the work buffers
+    if (xr != _re.data()) {
+      std::copy_n(xr, _size / 2, _re.data());
+      std::copy_n(xi, _size / 2, _im.data());
+    }
+  }
+
+  void FFT::forward(gsl::span<const float> in, gsl::span<complex> out) noexcept
+  {
+    const std::size_t m = _size / 2;
+    // Pack the even samples as real parts and the odd ones as imaginary
+    for (std::size_t k = 0; k < m; k++) {
+      _re[k] = in[2 * k];
+      _im[k] = in[2 * k + 1];
+    }
+    transform();
+
+    // Separate the transforms of the even and odd samples, and combine them
+    out[0] = {_re[0] + _im[0], 0};
+    out[m] = {_re[0] - _im[0], 0};
+    for (std::size_t k = 1; k < m; k++) {
+      complex z = {_re[k], _im[k]};
+      complex zc = {_re[m - k], -_im[m - k]};
+      complex even = (z + zc) * 0.5f;
+      complex odd = (z - zc) * complex(0, -0.5f);
+      out[k] = even + _split[k] * odd;
+    }
+  }
+
+  void FFT::inverse(gsl::span<const complex> in, gsl::span<float> out) noexcept
+  {
+    const std::size_t m = _size / 2;
+    // The reverse of the split in `forward`, conjugated, so the forward
+    // complex transform can be used
+    for (std::size_t k = 0; k < m; k++) {
+      complex x = in[k];
+      complex xc = std::conj(in[m - k]);
+      if (k == 0) {
+        x = {x.real(), 0};
+        xc = {in[m].real(), 0};
+      }
+      complex even = (x + xc) * 0.5f;
+      complex odd = (x - xc) * std::conj(_split[k]) * 0.5f;
+      complex z = even + complex(0, 1) * odd;
+      _re[k] = z.real();
+      _im[k] = -z.imag();
+    }
+    transform();
+
+    const float scale = 1.f / m;
+    for (std::size_t k = 0; k < m; k++) {
+      out[2 * k] = _re[k] * scale;
+      out[2 * k + 1] = -_im[k] * scale;
+    }
+  }
+
+  // STFT //////////////////////////////////////////////////////////////////////
+
+  STFT::STFT(std::size_t size, std::size_t hop, Window::WindowType window)
+    : _fft(size),
+      _hop(hop),
+      _window(size),
+      _gain(hop),
+      _input(size),
+      _output(size),
+      _frame(size),
+      _spectrum(_fft.bins())
+  {
+    if (hop == 0 || size % hop != 0) {
+      throw util::exception("STFT hop must divide the size {}, but is {}", size, hop);
+    }
+    std::vector<double> w(size);
+    Window::compute(gsl::span<double>(w.data(), size), window, true);
+    std::copy(w.begin(), w.end(), _window.begin());
+
+    // Each output sample is the sum of `size / hop` windowed frames, which
+    // are windowed again after synthesis
+    for (std::size_t i = 0; i < hop; i++) {
+      double sum = 0;
+      for (std::size_t j = i; j < size; j += hop) sum += w[j] * w[j];
+      _gain[i] = sum > 0 ? 1 / sum : 0;
+    }
+  }
+
+  void STFT::reset() noexcept
+  {
+    std::fill(_input.begin(), _input.end(), 0.f);
+    std::fill(_output.begin(), _output.end(), 0.f);
+    _input_pos = 0;
+    _output_pos = 0;
+    _since_frame = 0;
+  }
+
+  bool STFT::push(float x) noexcept
+  {
+    _input[_input_pos] = x;
+    _input_pos = (_input_pos + 1) % _input.size();
+    if (++_since_frame < _hop) return false;
+    _since_frame = 0;
+    return true;
+  }
+
+  float STFT::pop() noexcept
+  {
+    float res = _output[_output_pos];
+    _output[_output_pos] = 0;
+    _output_pos = (_output_pos + 1) % _output.size();
+    return res;
+  }
+
+  void STFT::analyze_frame() noexcept
+  {
+    // The oldest sample is the one about to be overwritten
+    const std::size_t n = size();
+    for (std::size_t j = 0; j < n; j++) {
+      _frame[j] = _input[(_input_pos + j) % n] * _window[j];
+    }
+    _fft.forward(_frame, _spectrum);
+  }
+
+  void STFT::synthesize_frame() noexcept
+  {
+    // The frame ends with the newest input sample, so it starts at the next
+    // output sample
+    const std::size_t n = size();
+    _fft.inverse(_spectrum, _frame);
+    for (std::size_t j = 0; j < n; j++) {
+      _output[(_output_pos + j) % n] += _frame[j] * _window[j] * _gain[j % _hop];
+    }
+  }
+
+} // namespace otto::util::dsp
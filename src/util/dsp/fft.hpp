@@ -0,0 +1,170 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/dsp/window.hpp"
+
+namespace otto::util::dsp {
+
+  /// A planned real FFT
+  ///
+  /// Transforms `size` real samples to `size / 2 + 1` complex bins, and
+  /// back. The sizes supported are the powers of two from @ref min_size to
+  /// @ref max_size.
+  ///
+  /// The real transform is computed as a complex transform of half the size,
+  /// using the Stockham autosort algorithm, which needs no bit reversal. The
+  /// butterflies work on separate real and imaginary arrays, four at a time.
+  ///
+  /// All memory, including the twiddle factors, is allocated by the
+  /// constructor, so the transforms are realtime safe. They use buffers in the
+  /// plan, so one plan can not be used by two threads at once.
+  struct FFT {
+    using complex = std::complex<float>;
+
+    static constexpr std::size_t min_size = 64;
+    static constexpr std::size_t max_size = 65536;
+
+    /// \throws `util::exception` if `size` is not supported
+    FFT(std::size_t size);
+
+    std::size_t size() const noexcept
+    {
+      return _size;
+    }
+
+    /// The number of bins in the spectrum, `size() / 2 + 1`
+    std::size_t bins() const noexcept
+    {
+      return _size / 2 + 1;
+    }
+
+    /// Transform `size()` samples to `bins()` bins
+    ///
+    /// The spectrum is not scaled.
+    void forward(gsl::span<const float> in, gsl::span<complex> out) noexcept;
+
+    /// Transform `bins()` bins back to `size()` samples
+    ///
+    /// Scaled by `1 / size()`, so it is the exact inverse of @ref forward.
+    /// The imaginary parts of the first and last bin are ignored.
+    void inverse(gsl::span<const complex> in, gsl::span<float> out) noexcept;
+
+  private:
+    /// In-place complex FFT of `_re` and `_im`, of size `_size / 2`
+    void transform() noexcept;
+
+    std::size_t _size;
+    /// Twiddles for each stage of the complex transform, one stage after
+    /// the other
+    std::vector<float> _twiddle_re;
+    std::vector<float> _twiddle_im;
+    /// Twiddles for splitting the complex spectrum into the real one
+    std::vector<complex> _split;
+    std::vector<float> _re;
+    std::vector<float> _im;
+    std::vector<float> _work_re;
+    std::vector<float> _work_im;
+  };
+
+  /// Short-time fourier transform with overlap-add resynthesis
+  ///
+  /// Input is collected into overlapping frames of `size` samples, `hop`
+  /// samples apart, windowed and transformed. Each spectrum can then be
+  /// inspected or changed, and transformed back. The results are windowed
+  /// again and overlapped, and the gain of the overlapping windows is
+  /// compensated for, so an unchanged spectrum gives back the input.
+  ///
+  /// Like @ref FFT, only the constructor allocates.
+  struct STFT {
+    using complex = FFT::complex;
+
+    /// \param hop must divide `size`
+    /// \throws `util::exception` if the sizes are not supported
+    STFT(std::size_t size, std::size_t hop, Window::WindowType window = Window::hann);
+
+    std::size_t size() const noexcept
+    {
+      return _fft.size();
+    }
+
+    std::size_t hop() const noexcept
+    {
+      return _hop;
+    }
+
+    /// The delay from input to output of @ref process, in samples
+    std::size_t latency() const noexcept
+    {
+      return size();
+    }
+
+    /// Analyse `in`, calling `f(spectrum)` for each complete frame
+    ///
+    /// `spectrum` is a `gsl::span<const complex>` of `size() / 2 + 1` bins.
+    template<typename F>
+    void analyze(gsl::span<const float> in, F&& f)
+    {
+      for (float x : in) {
+        if (push(x)) {
+          analyze_frame();
+          f(gsl::span<const complex>(_spectrum));
+        }
+      }
+    }
+
+    /// Analyse `in`, let `f(spectrum)` change each frame, and write the
+    /// resynthesized signal to `out`
+    ///
+    /// `spectrum` is a `gsl::span<complex>`. `in` and `out` must have the same
+    /// size, and may be the same buffer.
+    template<typename F>
+    void process(gsl::span<const float> in, gsl::span<float> out, F&& f)
+    {
+      for (std::ptrdiff_t i = 0; i < in.size(); i++) {
+        float x = in[i];
+        out[i] = pop();
+        if (push(x)) {
+          analyze_frame();
+          f(gsl::span<complex>(_spectrum));
+          synthesize_frame();
+        }
+      }
+    }
+
+    /// Clear all buffered input and output
+    void reset() noexcept;
+
+  private:
+    /// Add a sample to the input. Returns true when a frame is complete.
+    bool push(float x) noexcept;
+    /// The next output sample
+    float pop() noexcept;
+
+    void analyze_frame() noexcept;
+    void synthesize_frame() noexcept;
+
+    FFT _fft;
+    std::size_t _hop;
+    std::vector<float> _window;
+    /// One over the overlapped squared windows, for each position in a hop
+    std::vector<float> _gain;
+
+    /// The last `size()` input samples, as a ring buffer
+    std::vector<float> _input;
+    std::size_t _input_pos = 0;
+    std::size_t _since_frame = 0;
+
+    /// Overlap-add accumulator, as a ring buffer
+    std::vector<float> _output;
+    std::size_t _output_pos = 0;
+
+    std::vector<float> _frame;
+    std::vector<complex> _spectrum;
+  };
+
+} // namespace otto::util::dsp
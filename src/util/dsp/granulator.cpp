@@ -0,0 +1,243 @@
+#include "granulator.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace otto::util::dsp {
+
+  namespace {
+    using simd::float4;
+    using simd::int4;
+
+    float hsum(float4 v) noexcept
+    {
+      return (v[0] + v[1]) + (v[2] + v[3]);
+    }
+  } // namespace
+
+  Granulator::Granulator(float samplerate) : _samplerate(samplerate)
+  {
+    std::vector<double> points(window_size + 1);
+    for (int type = 0; type < int(_windows.size()); type++) {
+      Window::compute(points, Window::WindowType(type), false);
+      auto& table = _windows[type];
+      table.assign(points.begin(), points.end());
+      // So the point after the last one can always be read
+      table.push_back(0);
+    }
+    _window = _windows[Window::hann].data();
+    density(20);
+    size(0.1);
+    reset();
+  }
+
+  void Granulator::source(gsl::span<const float> sample) noexcept
+  {
+    _source = sample;
+    reset();
+  }
+
+  void Granulator::gate(bool open) noexcept
+  {
+    if (open && !_gate) _countdown = 0;
+    _gate = open;
+  }
+
+  void Granulator::position(float fraction) noexcept
+  {
+    _position = std::clamp(fraction, 0.f, 1.f);
+  }
+
+  void Granulator::spray(float seconds) noexcept
+  {
+    _spray = seconds * _samplerate;
+  }
+
+  void Granulator::density(float grains_per_second) noexcept
+  {
+    _interval = _samplerate / std::max(grains_per_second, 0.01f);
+  }
+
+  void Granulator::size(float seconds) noexcept
+  {
+    _size = std::max(seconds * _samplerate, 1.f);
+  }
+
+  void Granulator::pitch(float ratio) noexcept
+  {
+    _pitch = ratio;
+  }
+
+  void Granulator::window(Window::WindowType type) noexcept
+  {
+    _window = _windows[type].data();
+  }
+
+  void Granulator::spread(float amount) noexcept
+  {
+    _spread = std::clamp(amount, 0.f, 1.f);
+  }
+
+  void Granulator::reset() noexcept
+  {
+    _count = 0;
+    _countdown = 0;
+    // Unused lanes of the last batch must read inside the source, and be
+    // silent
+    _pos.fill(0);
+    _step.fill(0);
+    _phase.fill(1);
+    _phase_step.fill(0);
+    _gain_left.fill(0);
+    _gain_right.fill(0);
+  }
+
+  float Granulator::random() noexcept
+  {
+    // xorshift32
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+    return float(std::int32_t(_random)) * (1.f / 2147483648.f);
+  }
+
+  void Granulator::start_grain() noexcept
+  {
+    if (_count == max_grains || _source.size() < 2) return;
+    const float last = _source.size() - 1;
+    const std::size_t g = _count++;
+    _pos[g] = std::clamp(_position * last + _spray * random(), 0.f, last);
+    _step[g] = _pitch;
+    _phase[g] = 0;
+    _phase_step[g] = 1 / _size;
+    // Keep the level when grains overlap, assuming they are uncorrelated
+    float gain = 1 / std::sqrt(std::max(_size / _interval, 1.f));
+    // Equal power panning, centered at 0
+    float angle = (1 + _spread * random()) * float(M_PI) / 4;
+    _gain_left[g] = gain * std::cos(angle);
+    _gain_right[g] = gain * std::sin(angle);
+  }
+
+  void Granulator::remove_finished() noexcept
+  {
+    for (std::size_t g = 0; g < _count;) {
+      if (_phase[g] < 1) {
+        g++;
+        continue;
+      }
+      // Move the last grain here, and silence its old slot
+      std::size_t last = --_count;
+      _pos[g] = _pos[last];
+      _step[g] = _step[last];
+      _phase[g] = _phase[last];
+      _phase_step[g] = _phase_step[last];
+      _gain_left[g] = _gain_left[last];
+      _gain_right[g] = _gain_right[last];
+      _pos[last] = 0;
+      _step[last] = 0;
+      _phase[last] = 1;
+      _phase_step[last] = 0;
+      _gain_left[last] = 0;
+      _gain_right[last] = 0;
+    }
+  }
+
+  template<bool Stereo>
+  void Granulator::render(float* left, float* right, std::size_t n) noexcept
+  {
+    const float* src = _source.data();
+    const float last = _source.size() - 1;
+    const int4 last_index = int4{} + std::int32_t(_source.size() - 1);
+    const float* win = _window;
+
+    // Sum the batches lane by lane, and the lanes once per sample at the end
+    constexpr std::size_t chunk = 64;
+    float4 sum_left[chunk];
+    float4 sum_right[chunk];
+
+    for (std::size_t done = 0; done < n; done += chunk) {
+      const std::size_t m = std::min(chunk, n - done);
+      std::fill_n(sum_left, m, float4{});
+      if constexpr (Stereo) std::fill_n(sum_right, m, float4{});
+
+      for (std::size_t b = 0; b < _count; b += 4) {
+        float4 pos = simd::load<float4>(&_pos[b]);
+        float4 step = simd::load<float4>(&_step[b]);
+        float4 phase = simd::load<float4>(&_phase[b]);
+        float4 phase_step = simd::load<float4>(&_phase_step[b]);
+        float4 gain_left = simd::load<float4>(&_gain_left[b]);
+        float4 gain_right = simd::load<float4>(&_gain_right[b]);
+        if constexpr (!Stereo) gain_left = (gain_left + gain_right) * float(M_SQRT1_2);
+
+        for (std::size_t k = 0; k < m; k++) {
+          // Read the source, between samples
+          float4 p = simd::clamp(pos, 0.f, last);
+          int4 i0 = simd::to_int(p);
+          // Comparisons are -1 where true
+          int4 i1 = i0 - (i0 < last_index);
+          float4 frac = p - simd::to_float(i0);
+          float4 a = {src[i0[0]], src[i0[1]], src[i0[2]], src[i0[3]]};
+          float4 c = {src[i1[0]], src[i1[1]], src[i1[2]], src[i1[3]]};
+          float4 s = a + frac * (c - a);
+
+          // Read the window, silent once it has ended
+          float4 t = simd::min(phase, simd::broadcast<float4>(1)) * float(window_size);
+          int4 w0 = simd::to_int(t);
+          float4 wfrac = t - simd::to_float(w0);
+          float4 wa = {win[w0[0]], win[w0[1]], win[w0[2]], win[w0[3]]};
+          float4 wc = {win[w0[0] + 1], win[w0[1] + 1], win[w0[2] + 1], win[w0[3] + 1]};
+          float4 w = simd::select<float4>(phase < 1.f, wa + wfrac * (wc - wa), float4{});
+          s *= w;
+
+          sum_left[k] += s * gain_left;
+          if constexpr (Stereo) sum_right[k] += s * gain_right;
+          pos += step;
+          phase += phase_step;
+        }
+
+        simd::store(&_pos[b], pos);
+        simd::store(&_phase[b], phase);
+      }
+      for (std::size_t k = 0; k < m; k++) left[done + k] += hsum(sum_left[k]);
+      if constexpr (Stereo) {
+        for (std::size_t k = 0; k < m; k++) right[done + k] += hsum(sum_right[k]);
+      }
+    }
+  }
+
+  template<bool Stereo>
+  void Granulator::process(float* left, float* right, std::size_t n) noexcept
+  {
+    std::fill_n(left, n, 0.f);
+    if constexpr (Stereo) std::fill_n(right, n, 0.f);
+    if (_source.size() < 2) return;
+
+    // Render up to each grain start, so grains start on the right sample
+    std::size_t done = 0;
+    while (done < n) {
+      std::size_t segment = n - done;
+      if (_gate) {
+        if (_countdown <= 0) {
+          start_grain();
+          _countdown += _interval;
+        }
+        segment = std::min<std::size_t>(segment, std::ceil(_countdown));
+      }
+      render<Stereo>(left + done, Stereo ? right + done : nullptr, segment);
+      _countdown -= segment;
+      done += segment;
+      remove_finished();
+    }
+  }
+
+  void Granulator::process(gsl::span<float> left, gsl::span<float> right) noexcept
+  {
+    process<true>(left.data(), right.data(), left.size());
+  }
+
+  void Granulator::process(gsl::span<float> out) noexcept
+  {
+    process<false>(out.data(), nullptr, out.size());
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <gsl/span>
+
+#include "util/dsp/window.hpp"
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  /// Granular synthesis over a sample
+  ///
+  /// While the gate is open, new grains are started at a steady rate. Each
+  /// grain plays a short, windowed piece of the source, starting near the
+  /// set position, at the set pitch, panned somewhere in the stereo field.
+  ///
+  /// Grains live in a fixed pool, stored one field per array, and are
+  /// rendered four at a time with @ref simd::float4. The windows are tables
+  /// computed once by @ref Window.
+  ///
+  /// Only the constructor allocates. The source is not copied.
+  struct Granulator {
+    /// Size of the grain pool. When it is full, new grains are skipped.
+    static constexpr std::size_t max_grains = 256;
+
+    Granulator(float samplerate);
+
+    /// Play grains from `sample`, which must outlive its use here
+    ///
+    /// Stops all grains
+    void source(gsl::span<const float> sample) noexcept;
+
+    /// Start new grains. Grains that are playing always finish.
+    void gate(bool open) noexcept;
+    /// Where grains start, as a fraction of the source
+    void position(float fraction) noexcept;
+    /// Random offset of the start of each grain, up to `seconds` either way
+    void spray(float seconds) noexcept;
+    /// Grains started per second
+    void density(float grains_per_second) noexcept;
+    /// Length of each grain, in seconds
+    void size(float seconds) noexcept;
+    /// Playback speed of each grain, `1` for the original pitch
+    void pitch(float ratio) noexcept;
+    void window(Window::WindowType type) noexcept;
+    /// Random panning of each grain, from 0 (all centered) to 1
+    void spread(float amount) noexcept;
+
+    /// Render into `left` and `right`, which must have the same size
+    void process(gsl::span<float> left, gsl::span<float> right) noexcept;
+    /// Render the sum of both channels into `out`
+    void process(gsl::span<float> out) noexcept;
+
+    /// Stop all grains
+    void reset() noexcept;
+
+    /// Number of grains playing
+    std::size_t active() const noexcept
+    {
+      return _count;
+    }
+
+  private:
+    using float4 = simd::float4;
+
+    /// Points in each window table
+    static constexpr std::size_t window_size = 1024;
+
+    template<bool Stereo>
+    void process(float* left, float* right, std::size_t n) noexcept;
+    /// Render `n` samples of the active grains, adding to the output
+    template<bool Stereo>
+    void render(float* left, float* right, std::size_t n) noexcept;
+    void start_grain() noexcept;
+    /// Remove the grains whose windows have ended
+    void remove_finished() noexcept;
+    /// Uniform in `[-1, 1)`
+    float random() noexcept;
+
+    float _samplerate;
+    gsl::span<const float> _source;
+
+    /// Window tables for each @ref Window::WindowType, with a guard point
+    std::array<std::vector<float>, 6> _windows;
+    const float* _window;
+
+    bool _gate = false;
+    float _position = 0;
+    float _spray = 0;
+    float _interval;
+    float _size;
+    float _pitch = 1;
+    float _spread = 0;
+    /// Samples until the next grain starts
+    float _countdown = 0;
+    std::uint32_t _random = 0x9E3779B9;
+
+    /// The grain pool. The first @ref _count grains are playing.
+    std::size_t _count = 0;
+    /// Read position in the source, and its step per sample
+    alignas(16) std::array<float, max_grains> _pos;
+    alignas(16) std::array<float, max_grains> _step;
+    /// Position in the window, from 0 to 1, and its step per sample
+    alignas(16) std::array<float, max_grains> _phase;
+    alignas(16) std::array<float, max_grains> _phase_step;
+    alignas(16) std::array<float, max_grains> _gain_left;
+    alignas(16) std::array<float, max_grains> _gain_right;
+  };
+
+} // namespace otto::util::dsp
@@ -0,0 +1,321 @@
+#include "kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#include "util/simd.hpp"
+
+#if defined(__arm__) && defined(__linux__)
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#endif
+
+// Function attributes that enable each instruction set. Kernels are only
+// compiled for the sets the compiler can target on this architecture.
+// The generic implementations below are inlined into these functions, so
+// they are compiled with the extra instructions too, while the rest of the
+// program still only uses the baseline.
+#if defined(__x86_64__) || defined(__i386__)
+#define OTTO_KERNELS_X86 1
+#define OTTO_TARGET_SSE2 __attribute__((target("sse2")))
+// Neither AVX2 nor AVX-512 implies FMA, so it is enabled with them, to fuse
+// the multiplies and adds of the kernels
+#define OTTO_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define OTTO_TARGET_AVX512 __attribute__((target("avx512f,fma")))
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define OTTO_KERNELS_NEON 1
+#define OTTO_TARGET_NEON
+#elif defined(__arm__) && defined(__ARM_PCS_VFP) && defined(__GNUC__) && !defined(__clang__)
+// 32-bit ARM, where NEON is optional. The rpi-proto-1 config only passes
+// `-mfpu=neon-vfpv4` to the linker, so the rest of the code does not use it.
+#define OTTO_KERNELS_NEON 1
+#define OTTO_TARGET_NEON __attribute__((target("fpu=neon-vfpv4")))
+#endif
+
+namespace otto::util::dsp::kernels {
+
+  namespace {
+
+    // Generic implementations ///////////////////////////////////////////////
+
+    template<typename V>
+    [[gnu::always_inline]] inline void scale_impl(const float* in,
+                                                  float* out,
+                                                  std::size_t n,
+                                                  float gain) noexcept
+    {
+      simd::transform<V>(in, out, n, [gain](auto x) { return x * gain; });
+    }
+
+    template<typename V>
+    [[gnu::always_inline]] inline void mix_impl(const float* in,
+                                                float* out,
+                                                std::size_t n,
+                                                float gain) noexcept
+    {
+      constexpr std::size_t lanes = simd::lanes<V>;
+      std::size_t tail = n - n % lanes;
+      for (std::size_t i = 0; i < tail; i += lanes) {
+        simd::store<V>(out + i, simd::load<V>(out + i) + simd::load<V>(in + i) * gain);
+      }
+      for (std::size_t i = tail; i < n; i++) {
+        out[i] += in[i] * gain;
+      }
+    }
+
+    template<typename V>
+    [[gnu::always_inline]] inline void mix4_impl(const float* const* in,
+                                                 float* out,
+                                                 std::size_t n,
+                                                 const float* gains) noexcept
+    {
+      constexpr std::size_t lanes = simd::lanes<V>;
+      const float *a = in[0], *b = in[1], *c = in[2], *d = in[3];
+      const float ga = gains[0], gb = gains[1], gc = gains[2], gd = gains[3];
+      std::size_t tail = n - n % lanes;
+      for (std::size_t i = 0; i < tail; i += lanes) {
+        V x = simd::load<V>(out + i) + simd::load<V>(a + i) * ga + simd::load<V>(b + i) * gb +
+              simd::load<V>(c + i) * gc + simd::load<V>(d + i) * gd;
+        simd::store<V>(out + i, x);
+      }
+      for (std::size_t i = tail; i < n; i++) {
+        out[i] += a[i] * ga + b[i] * gb + c[i] * gc + d[i] * gd;
+      }
+    }
+
+    template<typename V>
+    [[gnu::always_inline]] inline Level ramp_impl(const float* in,
+                                                  float* out,
+                                                  std::size_t n,
+                                                  float from,
+                                                  float to) noexcept
+    {
+      constexpr std::size_t lanes = simd::lanes<V>;
+      const float step = n > 0 ? (to - from) / n : 0.f;
+      // The gain of each lane is `from + (i + lane + 1) * step`
+      float lane_index[lanes];
+      for (std::size_t l = 0; l < lanes; l++) lane_index[l] = l + 1;
+      const V offsets = simd::load<V>(lane_index);
+      V peak = simd::broadcast<V>(0.f);
+      V sum = simd::broadcast<V>(0.f);
+      std::size_t tail = n - n % lanes;
+      for (std::size_t i = 0; i < tail; i += lanes) {
+        V gain = from + (simd::broadcast<V>(float(i)) + offsets) * step;
+        V x = simd::load<V>(in + i) * gain;
+        simd::store<V>(out + i, x);
+        peak = simd::max<V>(peak, simd::abs(x));
+        sum += x * x;
+      }
+      Level res = {simd::reduce_max(peak), simd::reduce_add(sum)};
+      for (std::size_t i = tail; i < n; i++) {
+        float x = in[i] * (from + (float(i) + 1.f) * step);
+        out[i] = x;
+        res.peak = std::max(res.peak, std::abs(x));
+        res.sum_squares += x * x;
+      }
+      return res;
+    }
+
+    /// The sum of the lanes of `v`
+    ///
+    /// Adds the halves of wide vectors first, which is a shorter chain of
+    /// additions than @ref simd::reduce_add
+    template<typename V>
+    [[gnu::always_inline]] inline float sum_lanes(V v) noexcept
+    {
+      if constexpr (simd::lanes<V> <= 4) {
+        return simd::reduce_add(v);
+      } else {
+        using Half = std::conditional_t<simd::lanes<V> == 16, simd::float8, simd::float4>;
+        constexpr std::size_t half = simd::lanes<V> / 2;
+        Half sum;
+        for (std::size_t i = 0; i < half; i++) sum[i] = v[i] + v[i + half];
+        return sum_lanes<Half>(sum);
+      }
+    }
+
+    template<typename V>
+    [[gnu::always_inline]] inline float dot_impl(const float* a,
+                                                 const float* b,
+                                                 std::size_t n) noexcept
+    {
+      constexpr std::size_t lanes = simd::lanes<V>;
+      // Two accumulators, so consecutive multiply-adds do not wait for
+      // each other
+      V acc0 = simd::broadcast<V>(0.f);
+      V acc1 = simd::broadcast<V>(0.f);
+      std::size_t i = 0;
+      for (; i + 2 * lanes <= n; i += 2 * lanes) {
+        acc0 += simd::load<V>(a + i) * simd::load<V>(b + i);
+        acc1 += simd::load<V>(a + i + lanes) * simd::load<V>(b + i + lanes);
+      }
+      for (; i + lanes <= n; i += lanes) {
+        acc0 += simd::load<V>(a + i) * simd::load<V>(b + i);
+      }
+      float res = sum_lanes<V>(acc0 + acc1);
+      for (; i < n; i++) res += a[i] * b[i];
+      return res;
+    }
+
+/// Define the kernels for one instruction set, in `namespace ISA`
+#define OTTO_DEFINE_KERNELS(ISA, V, TARGET)                                                        \
+  namespace ISA {                                                                                  \
+    TARGET void scale(const float* in, float* out, std::size_t n, float gain) noexcept             \
+    {                                                                                              \
+      scale_impl<V>(in, out, n, gain);                                                             \
+    }                                                                                              \
+    TARGET void mix(const float* in, float* out, std::size_t n, float gain) noexcept               \
+    {                                                                                              \
+      mix_impl<V>(in, out, n, gain);                                                               \
+    }                                                                                              \
+    TARGET void mix4(const float* const* in, float* out, std::size_t n, const float* gains)        \
+      noexcept                                                                                     \
+    {                                                                                              \
+      mix4_impl<V>(in, out, n, gains);                                                             \
+    }                                                                                              \
+    TARGET Level ramp(const float* in, float* out, std::size_t n, float from, float to) noexcept   \
+    {                                                                                              \
+      return ramp_impl<V>(in, out, n, from, to);                                                   \
+    }                                                                                              \
+    TARGET float dot(const float* a, const float* b, std::size_t n) noexcept                       \
+    {                                                                                              \
+      return dot_impl<V>(a, b, n);                                                                 \
+    }                                                                                              \
+    constexpr KernelTable table = {Isa::ISA, &scale, &mix, &mix4, &ramp, &dot};                    \
+  }
+
+    OTTO_DEFINE_KERNELS(scalar, float, )
+#if OTTO_KERNELS_X86
+    OTTO_DEFINE_KERNELS(sse2, simd::float4, OTTO_TARGET_SSE2)
+    OTTO_DEFINE_KERNELS(avx2, simd::float8, OTTO_TARGET_AVX2)
+    OTTO_DEFINE_KERNELS(avx512, simd::float16, OTTO_TARGET_AVX512)
+#endif
+#if OTTO_KERNELS_NEON
+    OTTO_DEFINE_KERNELS(neon, simd::float4, OTTO_TARGET_NEON)
+#endif
+
+#undef OTTO_DEFINE_KERNELS
+
+    /// The table for `isa`, or `nullptr` if it is not compiled in
+    const KernelTable* find_table(Isa isa) noexcept
+    {
+      switch (isa) {
+        case Isa::scalar: return &scalar::table;
+#if OTTO_KERNELS_X86
+        case Isa::sse2: return &sse2::table;
+        case Isa::avx2: return &avx2::table;
+        case Isa::avx512: return &avx512::table;
+#endif
+#if OTTO_KERNELS_NEON
+        case Isa::neon: return &neon::table;
+#endif
+        default: return nullptr;
+      }
+    }
+
+    bool cpu_supports(Isa isa) noexcept
+    {
+#if OTTO_KERNELS_X86
+      // May run before the constructor that normally initializes this
+      __builtin_cpu_init();
+      switch (isa) {
+        case Isa::sse2: return __builtin_cpu_supports("sse2");
+        case Isa::avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case Isa::avx512:
+          return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("fma");
+        default: break;
+      }
+#endif
+#if OTTO_KERNELS_NEON
+      if (isa == Isa::neon) {
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+        return true;
+#elif defined(__linux__)
+        return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+        return false;
+#endif
+      }
+#endif
+      return isa == Isa::scalar;
+    }
+
+    const KernelTable& best_table() noexcept
+    {
+      for (Isa isa : all_isas) {
+        if (supported(isa)) return *find_table(isa);
+      }
+      return scalar::table;
+    }
+
+    /// Selects the best table on first use, in case a kernel is called
+    /// before the static initializer below has run.
+    namespace resolve {
+      void scale(const float* in, float* out, std::size_t n, float gain) noexcept
+      {
+        detail::active = &best_table();
+        table().scale(in, out, n, gain);
+      }
+      void mix(const float* in, float* out, std::size_t n, float gain) noexcept
+      {
+        detail::active = &best_table();
+        table().mix(in, out, n, gain);
+      }
+      void mix4(const float* const* in, float* out, std::size_t n, const float* gains) noexcept
+      {
+        detail::active = &best_table();
+        table().mix4(in, out, n, gains);
+      }
+      Level ramp(const float* in, float* out, std::size_t n, float from, float to) noexcept
+      {
+        detail::active = &best_table();
+        return table().ramp(in, out, n, from, to);
+      }
+      float dot(const float* a, const float* b, std::size_t n) noexcept
+      {
+        detail::active = &best_table();
+        return table().dot(a, b, n);
+      }
+      constexpr KernelTable table = {Isa::scalar, &scale, &mix, &mix4, &ramp, &dot};
+    } // namespace resolve
+
+  } // namespace
+
+  std::atomic<const KernelTable*> detail::active = &resolve::table;
+
+  namespace {
+    /// Select the kernels at startup
+    [[maybe_unused]] const bool selected = [] {
+      detail::active = &best_table();
+      return true;
+    }();
+  } // namespace
+
+  std::string_view name(Isa isa) noexcept
+  {
+    switch (isa) {
+      case Isa::scalar: return "scalar";
+      case Isa::sse2: return "SSE2";
+      case Isa::avx2: return "AVX2";
+      case Isa::avx512: return "AVX-512";
+      case Isa::neon: return "NEON";
+    }
+    return "unknown";
+  }
+
+  bool supported(Isa isa) noexcept
+  {
+    return find_table(isa) != nullptr && cpu_supports(isa);
+  }
+
+  bool select(Isa isa) noexcept
+  {
+    if (!supported(isa)) return false;
+    detail::active = find_table(isa);
+    return true;
+  }
+
+} // namespace otto::util::dsp::kernels
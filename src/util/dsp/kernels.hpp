@@ -0,0 +1,130 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string_view>
+
+/// Buffer level DSP kernels, with runtime selection of the instruction set
+///
+/// The release builds target a baseline CPU, so they run on any machine of
+/// the architecture. The kernels in this file are additionally compiled for
+/// newer instruction sets, and the best one the CPU supports is selected at
+/// startup. Calls go through a table of function pointers, @ref KernelTable,
+/// so the cost of the dispatch is one indirect call per buffer.
+///
+/// To add a kernel, add a pointer to @ref KernelTable, a generic
+/// implementation in `kernels.cpp`, and an inline wrapper here.
+namespace otto::util::dsp::kernels {
+
+  /// The instruction sets kernels are compiled for
+  enum struct Isa {
+    /// Plain C++, one float at a time
+    scalar,
+    /// x86-64 baseline, 4 floats at a time
+    sse2,
+    /// 8 floats at a time, with FMA
+    avx2,
+    /// 16 floats at a time, with FMA
+    avx512,
+    /// ARM, 4 floats at a time
+    neon,
+  };
+
+  /// All values of @ref Isa, in order of preference
+  constexpr Isa all_isas[] = {Isa::avx512, Isa::avx2, Isa::sse2, Isa::neon, Isa::scalar};
+
+  std::string_view name(Isa) noexcept;
+
+  /// The level of a buffer
+  struct Level {
+    /// The highest absolute value
+    float peak = 0;
+    float sum_squares = 0;
+  };
+
+  /// The kernels compiled for one instruction set
+  ///
+  /// `in` and `out` may be the same buffer, but may not otherwise overlap.
+  struct KernelTable {
+    Isa isa;
+    /// `out[i] = in[i] * gain`
+    void (*scale)(const float* in, float* out, std::size_t n, float gain) noexcept;
+    /// `out[i] += in[i] * gain`
+    void (*mix)(const float* in, float* out, std::size_t n, float gain) noexcept;
+    /// `out[i] += in[0][i] * gains[0] + ... + in[3][i] * gains[3]`
+    void (*mix4)(const float* const* in, float* out, std::size_t n, const float* gains) noexcept;
+    /// `out[i] = in[i] * (from + (to - from) * (i + 1) / n)`, returning the
+    /// level of `out`
+    Level (*ramp)(const float* in, float* out, std::size_t n, float from, float to) noexcept;
+    /// The sum of `a[i] * b[i]`
+    float (*dot)(const float* a, const float* b, std::size_t n) noexcept;
+  };
+
+  /// Whether the kernels for `isa` are compiled in, and the CPU supports them
+  bool supported(Isa isa) noexcept;
+
+  /// Use the kernels for `isa`
+  ///
+  /// Mainly for testing and benchmarking, since the best supported set is
+  /// selected automatically at startup.
+  ///
+  /// \returns `false`, and keeps the current selection, if `isa` is not
+  /// @ref supported
+  bool select(Isa isa) noexcept;
+
+  namespace detail {
+    extern std::atomic<const KernelTable*> active;
+  }
+
+  /// The kernels currently in use
+  inline const KernelTable& table() noexcept
+  {
+    return *detail::active.load(std::memory_order_relaxed);
+  }
+
+  /// `out[i] = in[i] * gain`
+  inline void scale(const float* in, float* out, std::size_t n, float gain) noexcept
+  {
+    table().scale(in, out, n, gain);
+  }
+
+  /// `buf[i] *= gain`
+  inline void scale(float* buf, std::size_t n, float gain) noexcept
+  {
+    table().scale(buf, buf, n, gain);
+  }
+
+  /// `out[i] += in[i] * gain`
+  inline void mix(const float* in, float* out, std::size_t n, float gain) noexcept
+  {
+    table().mix(in, out, n, gain);
+  }
+
+  /// Mix four buffers into `out`, each with its own gain
+  ///
+  /// Reads and writes `out` once, instead of once per buffer like @ref mix.
+  /// None of the buffers in `in` may overlap `out`.
+  inline void mix4(const float* const* in, float* out, std::size_t n, const float* gains) noexcept
+  {
+    table().mix4(in, out, n, gains);
+  }
+
+  /// Scale `in` into `out` by a gain going linearly from `from` to `to`,
+  /// reaching `to` at the last sample
+  ///
+  /// \returns the level of `out`
+  inline Level ramp(const float* in, float* out, std::size_t n, float from, float to) noexcept
+  {
+    return table().ramp(in, out, n, from, to);
+  }
+
+  /// The sum of `a[i] * b[i]`, the inner loop of an FIR filter
+  ///
+  /// The order of the additions depends on the instruction set, so the
+  /// result can differ in the last bits between them.
+  inline float dot(const float* a, const float* b, std::size_t n) noexcept
+  {
+    return table().dot(a, b, n);
+  }
+
+} // namespace otto::util::dsp::kernels
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <utility>
+
+/// Lookup tables generated at compile time
+///
+/// All tables are `inline constexpr`, so they end up in read-only data, are
+/// shared by every voice and engine, and cost nothing at startup.
+///
+/// The standard math functions are not `constexpr` in C++17, so the tables are
+/// generated with the series implementations in @ref constexpr_math. Those are
+/// accurate to roughly double precision in the ranges used here, but are much
+/// too slow to use at runtime.
+namespace otto::util::dsp {
+
+  namespace constexpr_math {
+
+    constexpr double pi = 3.14159265358979323846;
+    constexpr double ln2 = 0.69314718055994530942;
+
+    constexpr double floor(double x)
+    {
+      auto i = static_cast<long long>(x);
+      return (x < 0 && x != i) ? i - 1 : i;
+    }
+
+    /// e^x for small x, as a taylor series
+    constexpr double exp_small(double x)
+    {
+      double sum = 1;
+      double term = 1;
+      for (int n = 1; n < 30; n++) {
+        term *= x / n;
+        sum += term;
+      }
+      return sum;
+    }
+
+    /// 2^x
+    constexpr double exp2(double x)
+    {
+      double i = floor(x);
+      double res = exp_small((x - i) * ln2);
+      for (; i > 0; i--) res *= 2;
+      for (; i < 0; i++) res /= 2;
+      return res;
+    }
+
+    /// e^x
+    constexpr double exp(double x)
+    {
+      return exp2(x / ln2);
+    }
+
+    /// sin(x), with x reduced to [-pi, pi]
+    constexpr double sin(double x)
+    {
+      x -= 2 * pi * floor(x / (2 * pi) + 0.5);
+      double sum = 0;
+      double term = x;
+      for (int n = 1; n < 26; n += 2) {
+        sum += term;
+        term *= -x * x / ((n + 1) * (n + 2));
+      }
+      return sum;
+    }
+
+    constexpr double cos(double x)
+    {
+      return sin(x + pi / 2);
+    }
+
+    constexpr double tanh(double x)
+    {
+      double e = exp(2 * x);
+      return (e - 1) / (e + 1);
+    }
+
+  } // namespace constexpr_math
+
+  /// A table sampled at `N` evenly spaced points over `[min, max]`, with
+  /// linear interpolation between them. Input outside the range is clamped.
+  template<std::size_t N>
+  struct LookupTable {
+    static_assert(N >= 2);
+
+    float min;
+    float max;
+    std::array<float, N> data;
+
+    /// Generate a table from a `constexpr` function
+    template<typename F>
+    static constexpr LookupTable generate(float min, float max, F&& f)
+    {
+      LookupTable res = {min, max, {}};
+      for (std::size_t i = 0; i < N; i++) {
+        res.data[i] = f(min + (max - min) * double(i) / double(N - 1));
+      }
+      return res;
+    }
+
+    constexpr float operator()(float x) const noexcept
+    {
+      float pos = (x - min) * ((N - 1) / (max - min));
+      if (!(pos > 0)) return data.front();
+      if (pos >= N - 1) return data.back();
+      auto i = static_cast<std::size_t>(pos);
+      float frac = pos - i;
+      return data[i] + frac * (data[i + 1] - data[i]);
+    }
+  };
+
+  /// A single cycle waveform of `N` points, plus a guard point so
+  /// interpolation never has to wrap.
+  template<std::size_t N>
+  struct WaveTable {
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+    std::array<float, N + 1> data;
+
+    /// A sine component for @ref additive
+    struct Partial {
+      /// Number of cycles over the table, i.e. the harmonic number
+      double harmonic;
+      double amplitude;
+      /// Phase offset, in cycles
+      double phase = 0;
+    };
+
+    /// Build a table as a sum of sines. Equivalent to Gamma's `addSine`
+    static constexpr WaveTable additive(std::initializer_list<Partial> partials)
+    {
+      WaveTable res = {};
+      for (std::size_t i = 0; i <= N; i++) {
+        double sum = 0;
+        for (auto& p : partials) {
+          sum += p.amplitude * constexpr_math::sin(2 * constexpr_math::pi *
+                                                   (p.harmonic * double(i) / N + p.phase));
+        }
+        res.data[i] = sum;
+      }
+      return res;
+    }
+
+    /// Read the table at `phase`, in cycles. Any value is wrapped to [0, 1).
+    constexpr float operator()(float phase) const noexcept
+    {
+      phase -= static_cast<int>(phase);
+      if (phase < 0) phase += 1;
+      // A tiny negative phase rounds up to exactly 1
+      if (phase >= 1) phase -= 1;
+      float pos = phase * N;
+      auto i = static_cast<std::size_t>(pos);
+      float frac = pos - i;
+      return data[i] + frac * (data[i + 1] - data[i]);
+    }
+  };
+
+  namespace tables {
+
+    /// Frequencies of MIDI notes, at A4 = 440Hz
+    inline constexpr auto midi_note_freq = [] {
+      std::array<float, 128> res = {};
+      for (int i = 0; i < 128; i++) {
+        res[i] = 440.0 * constexpr_math::exp2((i - 69) / 12.0);
+      }
+      return res;
+    }();
+
+    /// Frequency ratio of every cent in a semitone, `[0, 100]`
+    inline constexpr auto cent_ratio = [] {
+      std::array<float, 101> res = {};
+      for (int i = 0; i <= 100; i++) {
+        res[i] = constexpr_math::exp2(i / 1200.0);
+      }
+      return res;
+    }();
+
+    /// Frequency of a fractional MIDI note at A4 = 440Hz, with cent resolution
+    constexpr float midi_to_freq(float note) noexcept
+    {
+      if (!(note > 0)) return midi_note_freq.front();
+      if (note >= 127) return midi_note_freq.back();
+      int semitone = static_cast<int>(note);
+      int cents = static_cast<int>((note - semitone) * 100.f + 0.5f);
+      return midi_note_freq[semitone] * cent_ratio[cents];
+    }
+
+    /// sin(x * pi/2) for x in [0, 1]. The gain of the right channel for an
+    /// equal power pan, where 0 is hard left.
+    inline constexpr auto equal_power_pan_table = LookupTable<257>::generate(
+      0, 1, [](double x) { return constexpr_math::sin(x * constexpr_math::pi / 2); });
+
+    /// Equal power pan gains
+    ///
+    /// \param pos Position in [-1, 1], where -1 is hard left
+    /// \returns `{left, right}` gains, where `left^2 + right^2 == 1`
+    constexpr std::pair<float, float> equal_power_pan(float pos) noexcept
+    {
+      float x = (pos + 1.f) * 0.5f;
+      return {equal_power_pan_table(1.f - x), equal_power_pan_table(x)};
+    }
+
+    /// tanh(x) for x in [-5, 5]
+    inline constexpr auto tanh_table =
+      LookupTable<1025>::generate(-5, 5, [](double x) { return constexpr_math::tanh(x); });
+
+    /// Saturate `x` with a tanh curve
+    ///
+    /// Interpolated, with an absolute error below 2e-5. Beyond ±5 the result
+    /// is clamped to ±tanh(5), which is within 1e-4 of ±1.
+    constexpr float tanh(float x) noexcept
+    {
+      return tanh_table(x);
+    }
+
+    /// One cycle of a sine wave
+    inline constexpr auto sine = WaveTable<2048>::additive({{1, 1}});
+
+    /// The drawbar harmonics of the Goss organ
+    namespace goss {
+      /// Fundamental, plus the second and third harmonic
+      inline constexpr auto pipe1 = WaveTable<1024>::additive({{1, 1}, {3, 1}, {2, 1}});
+      inline constexpr auto pipe2 = WaveTable<1024>::additive({{4, 1}, {16, 0.5}});
+      inline constexpr auto pipe3 =
+        WaveTable<1024>::additive({{6, 0.5}, {8, 1}, {10, 0.5}, {12, 1}, {16, 0.5}});
+      inline constexpr auto percussion = WaveTable<1024>::additive({{4, 0.5}, {6, 1.0}});
+    } // namespace goss
+
+  } // namespace tables
+
+} // namespace otto::util::dsp
@@ -0,0 +1,175 @@
+#include "looper.hpp"
+
+#include <algorithm>
+
+namespace otto::util::dsp {
+
+  Looper::Looper(std::size_t max_length, std::size_t layers, std::size_t fade)
+    : _max_length(max_length),
+      _layers(std::max<std::size_t>(layers, 2)),
+      _fade(fade),
+      // Value initialized, so every page is touched here and not on the
+      // audio thread
+      _arena(_max_length * _layers),
+      _preroll(std::max<std::size_t>(fade, 1))
+  {}
+
+  void Looper::record(std::size_t length) noexcept
+  {
+    clear();
+    _state = State::recording;
+    _take_length = std::min(length, _max_length);
+  }
+
+  void Looper::play() noexcept
+  {
+    switch (_state) {
+    case State::recording: close_take(); break;
+    case State::overdubbing:
+      // A pass that has not started yet would only copy the loop
+      if (_in_pass && _pos == _pass_start) {
+        _in_pass = false;
+        _dub_gain = 0;
+      }
+      _state = State::playing;
+      break;
+    case State::stopped: _state = State::playing; break;
+    default: break;
+    }
+  }
+
+  void Looper::overdub() noexcept
+  {
+    if (_state == State::recording) close_take();
+    if (_state != State::playing) return;
+    _state = State::overdubbing;
+    if (!_in_pass) {
+      // The pass is written to the layer after the current one, which is
+      // where a redo would have come from
+      _in_pass = true;
+      _pass_start = _pos;
+      _redo = 0;
+    }
+  }
+
+  void Looper::stop() noexcept
+  {
+    if (_state == State::recording) close_take();
+    if (_state == State::playing || _state == State::overdubbing) _state = State::stopped;
+  }
+
+  void Looper::clear() noexcept
+  {
+    _state = State::empty;
+    _length = 0;
+    _take_length = 0;
+    _pos = 0;
+    _undo = 0;
+    _redo = 0;
+    _in_pass = false;
+    _dub_gain = 0;
+  }
+
+  bool Looper::undo() noexcept
+  {
+    if (_state == State::empty) return false;
+    if (_in_pass) {
+      _in_pass = false;
+      _dub_gain = 0;
+      if (_state == State::overdubbing) _state = State::playing;
+      return true;
+    }
+    if (_undo == 0) {
+      clear();
+      return true;
+    }
+    _current = (_current + _layers - 1) % _layers;
+    _undo--;
+    _redo++;
+    return true;
+  }
+
+  bool Looper::redo() noexcept
+  {
+    if (_redo == 0 || _in_pass) return false;
+    _current = (_current + 1) % _layers;
+    _redo--;
+    _undo++;
+    return true;
+  }
+
+  gsl::span<const float> Looper::loop() const noexcept
+  {
+    return {_arena.data() + _current * _max_length, std::ptrdiff_t(_length)};
+  }
+
+  void Looper::close_take() noexcept
+  {
+    if (_length == 0) {
+      clear();
+      return;
+    }
+    // The pre-roll is not written while recording, so its oldest sample is
+    // at the write position
+    const std::size_t fade = std::min(_fade, _length);
+    float* end = layer(_current) + _length - fade;
+    for (std::size_t i = 0; i < fade; i++) {
+      float pre = _preroll[(_preroll_pos + _fade - fade + i) % _fade];
+      float w = float(i + 1) / fade;
+      end[i] = end[i] * (1 - w) + pre * w;
+    }
+    _state = State::playing;
+    _pos = 0;
+  }
+
+  void Looper::commit_pass() noexcept
+  {
+    _current = (_current + 1) % _layers;
+    _undo = std::min(_undo + 1, _layers - 1);
+    _redo = 0;
+    _in_pass = _state == State::overdubbing;
+    _pass_start = _pos;
+  }
+
+  void Looper::process(gsl::span<const float> in, gsl::span<float> out) noexcept
+  {
+    const std::size_t n = out.size();
+    const float dub_step = _fade > 0 ? 1.f / _fade : 1.f;
+
+    for (std::size_t k = 0; k < n; k++) {
+      const float x = in[k];
+      switch (_state) {
+      case State::empty: [[fallthrough]];
+      case State::stopped: out[k] = 0; break;
+      case State::recording: {
+        layer(_current)[_length++] = x;
+        out[k] = 0;
+        if (_length == (_take_length > 0 ? _take_length : _max_length)) close_take();
+        // Keep the pre-roll from before the take
+        continue;
+      }
+      case State::playing: [[fallthrough]];
+      case State::overdubbing: {
+        const float* cur = layer(_current);
+        out[k] = cur[_pos];
+        if (_in_pass) {
+          if (_state == State::overdubbing) {
+            _dub_gain = std::min(_dub_gain + dub_step, 1.f);
+          } else {
+            _dub_gain = std::max(_dub_gain - dub_step, 0.f);
+          }
+          layer(_current + 1)[_pos] = cur[_pos] + x * _dub_gain;
+        }
+        if (++_pos == _length) _pos = 0;
+        if (_in_pass && _pos == _pass_start) commit_pass();
+        break;
+      }
+      }
+      if (_fade > 0) {
+        _preroll[_preroll_pos] = x;
+        _preroll_pos = (_preroll_pos + 1) % _fade;
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <gsl/span>
+
+namespace otto::util::dsp {
+
+  /// A loop recorder with overdubs and undo
+  ///
+  /// All memory is allocated by the constructor, as one arena of `layers`
+  /// buffers of `max_length` samples each. Every overdub pass writes the
+  /// loop plus the input to the next buffer, and makes it the current one
+  /// when the pass has gone once around the loop. Undo and redo just move
+  /// between those buffers, so they are free, and the arena holds
+  /// `layers - 1` steps of undo.
+  ///
+  /// When the first take is closed, its last `fade` samples are
+  /// crossfaded with the input from just before it started, so the loop
+  /// plays through the seam without a click. Overdubs are faded in and out
+  /// over the same length.
+  ///
+  /// Commands take effect at the next sample processed.
+  struct Looper {
+    enum struct State {
+      /// Nothing recorded
+      empty,
+      /// Recording the first take, which sets the length of the loop
+      recording,
+      playing,
+      overdubbing,
+      /// Recorded, but not playing
+      stopped,
+    };
+
+    Looper(std::size_t max_length, std::size_t layers = 8, std::size_t fade = 256);
+
+    /// Start recording the first take, discarding any loop
+    ///
+    /// If `length` is not `0`, the take closes by itself after `length`
+    /// samples, and the loop starts playing. Otherwise it is closed by
+    /// @ref play. Takes longer than `max_length` are cut there.
+    void record(std::size_t length = 0) noexcept;
+    /// Close the first take, stop overdubbing, or resume playing
+    void play() noexcept;
+    /// Start adding the input to the loop. Only while playing.
+    void overdub() noexcept;
+    /// Pause the loop. An overdub pass in progress continues when it is
+    /// resumed with @ref play.
+    void stop() noexcept;
+    /// Discard the loop and all its layers
+    void clear() noexcept;
+
+    /// Go back to the loop before the last overdub pass
+    ///
+    /// An unfinished pass is discarded, and undoing the first take clears
+    /// the loop.
+    ///
+    /// \returns `false` if there was nothing to undo
+    bool undo() noexcept;
+    /// Bring back the last pass that was undone
+    ///
+    /// \returns `false` if there was nothing to redo
+    bool redo() noexcept;
+
+    /// Record from `in`, and write the loop to `out`
+    ///
+    /// Both must have the same size. `out` is silent unless the loop is
+    /// playing or overdubbing. The input being recorded is not in `out`.
+    void process(gsl::span<const float> in, gsl::span<float> out) noexcept;
+
+    State state() const noexcept
+    {
+      return _state;
+    }
+
+    /// Length of the loop, or of the take so far while recording
+    std::size_t length() const noexcept
+    {
+      return _length;
+    }
+
+    /// Playback position in the loop
+    std::size_t position() const noexcept
+    {
+      return _pos;
+    }
+
+    /// Number of passes that can be undone
+    std::size_t undo_depth() const noexcept
+    {
+      return _undo;
+    }
+
+    /// The loop as it is playing now
+    gsl::span<const float> loop() const noexcept;
+
+  private:
+    float* layer(std::size_t idx) noexcept
+    {
+      return _arena.data() + (idx % _layers) * _max_length;
+    }
+
+    /// Crossfade the end of the take with the pre-roll, and start playing
+    void close_take() noexcept;
+    /// Make the pass in progress the current loop
+    void commit_pass() noexcept;
+
+    const std::size_t _max_length;
+    const std::size_t _layers;
+    const std::size_t _fade;
+
+    std::vector<float> _arena;
+    /// The last @ref _fade input samples, a ring buffer
+    std::vector<float> _preroll;
+    std::size_t _preroll_pos = 0;
+
+    State _state = State::empty;
+    std::size_t _length = 0;
+    /// Length the take closes at, or `0`
+    std::size_t _take_length = 0;
+    std::size_t _pos = 0;
+
+    /// The layer playing
+    std::size_t _current = 0;
+    std::size_t _undo = 0;
+    std::size_t _redo = 0;
+
+    /// Whether a pass is being written to the next layer, and where it
+    /// started
+    bool _in_pass = false;
+    std::size_t _pass_start = 0;
+    /// Gain of the input in the pass, ramped over @ref _fade samples
+    float _dub_gain = 0;
+  };
+
+} // namespace otto::util::dsp
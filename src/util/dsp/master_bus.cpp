@@ -0,0 +1,126 @@
+#include "master_bus.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace otto::util::dsp {
+
+  MasterBus::MasterBus(float samplerate)
+    : _gain_coeff(1 - std::exp(-float(chunk) / (0.002f * samplerate))),
+      // Back to unity in about 100 ms
+      _release(1 - std::exp(-float(chunk) / (0.02f * samplerate))),
+      // 5 Hz
+      _dc_pole(std::exp(-2 * float(M_PI) * 5 / samplerate))
+  {}
+
+  void MasterBus::gain(float gain) noexcept
+  {
+    _gain_target = gain;
+  }
+
+  void MasterBus::ceiling(float ceiling) noexcept
+  {
+    _ceiling = ceiling;
+  }
+
+  void MasterBus::process(gsl::span<float> left, gsl::span<float> right) noexcept
+  {
+    const std::size_t n = left.size();
+    float* bufs[2] = {left.data(), right.data()};
+    for (std::size_t i = 0; i < n;) {
+      const std::size_t frames = std::min(n - i, chunk - _fill);
+      // The DC blocker depends on the previous frame, so this part can not
+      // be vectorized. It is a few operations per frame. The state is kept
+      // in locals, since the buffers could alias the members.
+      float peak = _in_peak;
+      for (int c = 0; c < 2; c++) {
+        float* buf = bufs[c] + i;
+        float* in = _in[c].data() + _fill;
+        const float* out = _out[c].data() + _fill;
+        float x1 = _dc_in[c];
+        float y1 = _dc_out[c];
+        for (std::size_t j = 0; j < frames; j++) {
+          float x = buf[j];
+          float y = x - x1 + _dc_pole * y1;
+          x1 = x;
+          y1 = y;
+          in[j] = y;
+          peak = std::max(peak, std::abs(y));
+          buf[j] = out[j];
+        }
+        _dc_in[c] = x1;
+        _dc_out[c] = y1;
+      }
+      _in_peak = peak;
+      i += frames;
+      _fill += frames;
+      if (_fill == chunk) {
+        finish_chunk();
+        _fill = 0;
+      }
+    }
+  }
+
+  void MasterBus::finish_chunk() noexcept
+  {
+    // The gain of the chunk is the product of the volume and the limiter.
+    // Both ends of the ramp are at most what the chunk allows.
+    const float gain = _gain + (_gain_target - _gain) * _gain_coeff;
+    auto allowed = [&](float peak) {
+      return peak * gain > _ceiling ? _ceiling / (peak * gain) : 1.f;
+    };
+    const float limit =
+      std::min({allowed(_prev_peak), allowed(_in_peak), _limit + (1 - _limit) * _release});
+    for (int c = 0; c < 2; c++) {
+      auto level =
+        kernels::ramp(_prev[c].data(), _out[c].data(), chunk, _gain * _limit, gain * limit);
+      _peak[c] = std::max(_peak[c], level.peak);
+      _sum_squares[c] += level.sum_squares;
+    }
+    _metered += chunk;
+    _gain = gain;
+    _limit = limit;
+
+    std::swap(_prev, _in);
+    _prev_peak = _in_peak;
+    _in_peak = 0;
+
+    // The DC blocker decays into denormals in silence
+    for (auto& y : _dc_out) {
+      if (std::abs(y) < 1e-15f) y = 0;
+    }
+  }
+
+  MasterBus::Levels MasterBus::take_levels() noexcept
+  {
+    if (_metered > 0) {
+      for (int c = 0; c < 2; c++) {
+        _levels.peak[c] = _peak[c];
+        _levels.rms[c] = std::sqrt(_sum_squares[c] / _metered);
+      }
+      _peak = {};
+      _sum_squares = {};
+      _metered = 0;
+    }
+    return _levels;
+  }
+
+  void MasterBus::reset() noexcept
+  {
+    _gain = _gain_target;
+    _dc_in = {};
+    _dc_out = {};
+    _in = {};
+    _prev = {};
+    _out = {};
+    _in_peak = 0;
+    _prev_peak = 0;
+    _fill = 0;
+    _limit = 1;
+    _levels = {};
+    _peak = {};
+    _sum_squares = {};
+    _metered = 0;
+  }
+
+} // namespace otto::util::dsp
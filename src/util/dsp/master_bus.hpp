@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include <gsl/span>
+
+#include "util/dsp/kernels.hpp"
+
+namespace otto::util::dsp {
+
+  /// The last stage of the output: gain, DC blocker, limiter and meters
+  ///
+  /// All stages run in one pass, a @ref chunk of frames at a time, so the
+  /// audio stays in the cache between them. Going in, each frame goes
+  /// through the DC blocker, while the peak of the chunk is taken. When a
+  /// chunk is full, the limiter finds the gain for the chunk before it from
+  /// the peaks of both, and applies it together with the gain with
+  /// @ref kernels::ramp, which also meters the result.
+  ///
+  /// The limiter is a brickwall: the output never goes above the ceiling.
+  /// Its gain only changes linearly over a chunk, towards the lowest of
+  /// what the two chunks allow, so it starts to duck a full chunk before a
+  /// peak. Below the ceiling, the output is the input, scaled and delayed
+  /// by @ref latency.
+  ///
+  /// Does not allocate.
+  struct MasterBus {
+    /// Frames processed together
+    static constexpr std::size_t chunk = 32;
+    /// Frames from the input to the output. One chunk is collected while the
+    /// next is looked at by the limiter.
+    static constexpr std::size_t latency = 2 * chunk;
+
+    /// Levels of the output, per channel
+    struct Levels {
+      std::array<float, 2> peak = {};
+      std::array<float, 2> rms = {};
+    };
+
+    MasterBus(float samplerate);
+
+    /// The gain, which is reached in about 10 ms
+    void gain(float gain) noexcept;
+    /// The highest output level, as a linear level
+    void ceiling(float ceiling) noexcept;
+
+    /// Process `left` and `right` in place
+    ///
+    /// They must have the same size.
+    void process(gsl::span<float> left, gsl::span<float> right) noexcept;
+
+    /// The levels since the last call, or of the last chunk if none has
+    /// finished since
+    Levels take_levels() noexcept;
+
+    /// Silence the output, and go straight to the gain
+    void reset() noexcept;
+
+  private:
+    using Chunk = std::array<std::array<float, chunk>, 2>;
+
+    /// Limit and output the previous chunk
+    void finish_chunk() noexcept;
+
+    float _gain_target = 1;
+    /// The gain at the end of the last output chunk
+    float _gain = 1;
+    /// Per chunk
+    float _gain_coeff;
+    float _ceiling = 0.98f;
+    /// Per chunk
+    float _release;
+    /// Pole of the DC blocker
+    float _dc_pole;
+    std::array<float, 2> _dc_in = {};
+    std::array<float, 2> _dc_out = {};
+
+    /// The chunk being collected, the one before, and the output
+    Chunk _in = {};
+    Chunk _prev = {};
+    Chunk _out = {};
+    float _in_peak = 0;
+    float _prev_peak = 0;
+    /// Frames in @ref _in
+    std::size_t _fill = 0;
+    /// The limiter gain at the end of the last output chunk
+    float _limit = 1;
+
+    Levels _levels;
+    std::array<float, 2> _peak = {};
+    std::array<float, 2> _sum_squares = {};
+    std::size_t _metered = 0;
+  };
+
+} // namespace otto::util::dsp
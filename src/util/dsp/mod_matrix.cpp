@@ -0,0 +1,121 @@
+#include "mod_matrix.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "util/fast_math.hpp"
+
+namespace otto::util::dsp {
+
+  // EnvelopeFollower ///////////////////////////////////////////////////////
+
+  EnvelopeFollower::EnvelopeFollower(float samplerate, float attack, float release)
+    : _samplerate(samplerate), _attack(attack), _release(release)
+  {}
+
+  float EnvelopeFollower::process(gsl::span<const float> in) noexcept
+  {
+    const std::size_t n = in.size();
+    if (n == 0) return _level;
+    simd::float4 peak4 = {};
+    std::size_t tail = n - n % 4;
+    for (std::size_t i = 0; i < tail; i += 4) {
+      peak4 = simd::max(peak4, simd::abs(simd::load<simd::float4>(in.data() + i)));
+    }
+    float peak = std::max(std::max(peak4[0], peak4[1]), std::max(peak4[2], peak4[3]));
+    for (std::size_t i = tail; i < n; i++) peak = std::max(peak, std::abs(in[i]));
+
+    // A one pole filter, with the coefficient for the whole block
+    float time = peak > _level ? _attack : _release;
+    float coeff = std::exp(-float(n) / (time * _samplerate));
+    _level = peak + coeff * (_level - peak);
+    return _level;
+  }
+
+  // ModMatrix //////////////////////////////////////////////////////////////
+
+  ModMatrix::ModMatrix(float samplerate) : _samplerate(samplerate)
+  {
+    for (std::size_t i = 0; i < num_lfos; i++) _random[i] = 0x9E3779B9 + i * 0x632BE5AB;
+  }
+
+  void ModMatrix::lfo(std::size_t idx, float rate, Shape shape) noexcept
+  {
+    _rate[idx] = rate / _samplerate;
+    _shape[idx] = std::int32_t(shape);
+  }
+
+  void ModMatrix::reset() noexcept
+  {
+    _phase.fill(0);
+  }
+
+  void ModMatrix::set(std::size_t source, float value) noexcept
+  {
+    _sources[source] = value;
+  }
+
+  void ModMatrix::route(std::size_t idx, std::size_t source, std::size_t target, float depth) noexcept
+  {
+    unroute(idx);
+    _routes[idx] = {source, target, depth};
+    _depths[source][target] += depth;
+  }
+
+  void ModMatrix::unroute(std::size_t idx) noexcept
+  {
+    auto& r = _routes[idx];
+    _depths[r.source][r.target] -= r.depth;
+    r.depth = 0;
+  }
+
+  void ModMatrix::process(std::size_t nframes) noexcept
+  {
+    for (std::size_t b = 0; b < num_lfos; b += 4) {
+      float4 phase = simd::load<float4>(&_phase[b]);
+      int4 shape;
+      std::memcpy(&shape, &_shape[b], sizeof(shape));
+
+      float4 sine = math::fast_sin<float4>(phase * float(2 * M_PI));
+      float4 triangle = 1.f - 4.f * simd::abs(phase - 0.5f);
+      float4 saw = 2.f * phase - 1.f;
+      float4 square = simd::select<float4>(phase < 0.5f, simd::broadcast<float4>(1), simd::broadcast<float4>(-1));
+      float4 held = simd::load<float4>(&_held[b]);
+
+      float4 value = held;
+      value = simd::select<float4>(shape == int(Shape::square), square, value);
+      value = simd::select<float4>(shape == int(Shape::saw), saw, value);
+      value = simd::select<float4>(shape == int(Shape::triangle), triangle, value);
+      value = simd::select<float4>(shape == int(Shape::sine), sine, value);
+      simd::store(&_sources[b], value);
+
+      phase += simd::load<float4>(&_rate[b]) * float(nframes);
+      int4 wrapped = phase >= 1.f;
+      phase -= simd::floor(phase);
+      simd::store(&_phase[b], phase);
+
+      // New values for the random LFOs that wrapped, which is rare
+      for (std::size_t i = 0; i < 4; i++) {
+        if (!wrapped[i]) continue;
+        // xorshift32
+        auto r = std::uint32_t(_random[b + i]);
+        r ^= r << 13;
+        r ^= r >> 17;
+        r ^= r << 5;
+        _random[b + i] = std::int32_t(r);
+        _held[b + i] = float(std::int32_t(r)) * (1.f / 2147483648.f);
+      }
+    }
+
+    float4 offsets[max_targets / 4] = {};
+    for (std::size_t s = 0; s < num_sources; s++) {
+      const float4 v = simd::broadcast<float4>(_sources[s]);
+      for (std::size_t t = 0; t < max_targets / 4; t++) {
+        offsets[t] += simd::load<float4>(&_depths[s][t * 4]) * v;
+      }
+    }
+    for (std::size_t t = 0; t < max_targets / 4; t++) simd::store(&_offsets[t * 4], offsets[t]);
+  }
+
+} // namespace otto::util::dsp
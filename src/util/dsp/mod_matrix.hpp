@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <gsl/span>
+
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  /// Peak level of a signal, updated once per block
+  struct EnvelopeFollower {
+    /// `attack` and `release` are in seconds
+    EnvelopeFollower(float samplerate, float attack = 0.01, float release = 0.2);
+
+    /// Follow the peak of `in`
+    ///
+    /// \returns the new level
+    float process(gsl::span<const float> in) noexcept;
+
+    float level() const noexcept
+    {
+      return _level;
+    }
+
+  private:
+    float _samplerate;
+    float _attack;
+    float _release;
+    float _level = 0;
+  };
+
+  /// Routes a set of modulation sources to a set of targets
+  ///
+  /// The sources are @ref num_lfos LFOs, and values set from outside, like
+  /// envelope followers and MIDI controllers. Each route adds its source,
+  /// times its depth, to the offset of its target.
+  ///
+  /// Everything runs at block rate. The LFOs are all computed at once, four
+  /// at a time with @ref simd::float4, and the routes are kept as a matrix
+  /// of depths from each source to each target, so the offsets of all
+  /// targets are summed with one vector multiply-add per source.
+  ///
+  /// What the targets are is up to the user of this class, which reads the
+  /// offsets after each @ref process.
+  struct ModMatrix {
+    static constexpr std::size_t num_lfos = 8;
+    /// The LFOs are the first sources, the rest are set with @ref set
+    static constexpr std::size_t num_sources = 16;
+    static constexpr std::size_t max_routes = 32;
+    static constexpr std::size_t max_targets = 32;
+
+    enum struct Shape { sine, triangle, saw, square, random };
+
+    ModMatrix(float samplerate);
+
+    /// Set the rate, in Hz, and the shape of an LFO
+    void lfo(std::size_t idx, float rate, Shape shape) noexcept;
+    /// Restart all LFOs at phase 0
+    void reset() noexcept;
+
+    /// Set the value of a source that is not an LFO
+    void set(std::size_t source, float value) noexcept;
+
+    /// Add `source`, times `depth`, to the offset of `target`
+    ///
+    /// Replaces the route that was at `idx`
+    void route(std::size_t idx, std::size_t source, std::size_t target, float depth) noexcept;
+    /// Remove the route at `idx`
+    void unroute(std::size_t idx) noexcept;
+
+    /// Compute the sources and offsets for a block of `nframes`, and advance
+    /// the LFOs past it
+    void process(std::size_t nframes) noexcept;
+
+    /// Value of a source, between -1 and 1 for the LFOs
+    float source(std::size_t idx) const noexcept
+    {
+      return _sources[idx];
+    }
+
+    /// Sum of the routes to `target`
+    float offset(std::size_t target) const noexcept
+    {
+      return _offsets[target];
+    }
+
+  private:
+    using float4 = simd::float4;
+    using int4 = simd::int4;
+
+    struct Route {
+      std::size_t source = 0;
+      std::size_t target = 0;
+      float depth = 0;
+    };
+
+    float _samplerate;
+
+    /// LFO phases, from 0 to 1, and their steps per sample
+    alignas(16) std::array<float, num_lfos> _phase = {};
+    alignas(16) std::array<float, num_lfos> _rate = {};
+    alignas(16) std::array<std::int32_t, num_lfos> _shape = {};
+    /// The held values of the random LFOs, and their generators
+    alignas(16) std::array<float, num_lfos> _held = {};
+    alignas(16) std::array<std::int32_t, num_lfos> _random;
+
+    alignas(16) std::array<float, num_sources> _sources = {};
+    std::array<Route, max_routes> _routes = {};
+    /// Depth from each source to each target, the sum of the routes between
+    /// them
+    alignas(16) std::array<std::array<float, max_targets>, num_sources> _depths = {};
+    alignas(16) std::array<float, max_targets> _offsets = {};
+  };
+
+} // namespace otto::util::dsp
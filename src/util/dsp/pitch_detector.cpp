@@ -0,0 +1,119 @@
+#include "pitch_detector.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "util/simd.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    using simd::float4;
+
+    /// The decimated samplerate is about this, or the samplerate if lower
+    constexpr float target_rate = 11025;
+  } // namespace
+
+  PitchDetector::PitchDetector(float samplerate, float min_freq, float max_freq)
+    : _decimation(std::max<std::size_t>(samplerate / target_rate, 1)),
+      _rate(samplerate / _decimation),
+      _min_lag(std::max<std::size_t>(_rate / max_freq, 2)),
+      _max_lag(std::ceil(_rate / min_freq) + 1),
+      _window((_max_lag + 3) / 4 * 4),
+      _hop(_window / 2),
+      _ring(_window + _max_lag, 0.f),
+      _frame(_window + _max_lag, 0.f),
+      _diff(_max_lag + 1, 0.f),
+      _norm(_max_lag + 1, 0.f)
+  {}
+
+  bool PitchDetector::process(gsl::span<const float> in) noexcept
+  {
+    for (float x : in) {
+      _sum += x;
+      if (++_summed < _decimation) continue;
+      _ring[_ring_pos] = _sum / _decimation;
+      _ring_pos = (_ring_pos + 1) % _ring.size();
+      _sum = 0;
+      _summed = 0;
+      // Start an estimate, unless the last one is not done
+      if (++_since_estimate >= _hop && _lag == 0) {
+        _since_estimate = 0;
+        auto oldest = _ring.begin() + _ring_pos;
+        std::copy(oldest, _ring.end(), _frame.begin());
+        std::copy(_ring.begin(), oldest, _frame.begin() + (_ring.end() - oldest));
+        _lag = 1;
+      }
+    }
+
+    if (_lag == 0) return false;
+    compute_lags();
+    if (_lag <= _max_lag) return false;
+    estimate();
+    _lag = 0;
+    return true;
+  }
+
+  void PitchDetector::compute_lags() noexcept
+  {
+    const float* x = _frame.data();
+    const std::size_t end = std::min(_lag + lags_per_call, _max_lag + 1);
+    for (; _lag < end; _lag++) {
+      const float* y = x + _lag;
+      float4 sum = {};
+      for (std::size_t j = 0; j < _window; j += 4) {
+        float4 d = simd::load<float4>(x + j) - simd::load<float4>(y + j);
+        sum += d * d;
+      }
+      _diff[_lag] = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+  }
+
+  void PitchDetector::estimate() noexcept
+  {
+    // Silence has no pitch
+    double energy = 0;
+    for (std::size_t j = 0; j < _window; j++) energy += double(_frame[j]) * _frame[j];
+    if (energy < 1e-6 * _window) {
+      _frequency = 0;
+      _clarity = 0;
+      return;
+    }
+
+    // Cumulative mean normalized difference
+    _norm[0] = 1;
+    double running = 0;
+    for (std::size_t t = 1; t <= _max_lag; t++) {
+      running += _diff[t];
+      _norm[t] = running > 0 ? _diff[t] * t / running : 1;
+    }
+
+    // The first dip below the threshold, or else the lowest point
+    std::size_t lag = 0;
+    for (std::size_t t = _min_lag; t < _max_lag; t++) {
+      if (_norm[t] < threshold) {
+        while (t + 1 < _max_lag && _norm[t + 1] < _norm[t]) t++;
+        lag = t;
+        break;
+      }
+    }
+    if (lag == 0) {
+      lag = std::min_element(_norm.begin() + _min_lag, _norm.begin() + _max_lag) - _norm.begin();
+    }
+    _clarity = std::clamp(1 - _norm[lag], 0.f, 1.f);
+    if (_norm[lag] >= threshold) {
+      _frequency = 0;
+      return;
+    }
+
+    // Refine between lags with a parabola through the neighbours. The
+    // normalization skews the dip, so this uses the plain difference.
+    float a = _diff[lag - 1];
+    float b = _diff[lag];
+    float c = _diff[lag + 1];
+    float denom = a - 2 * b + c;
+    float shift = denom > 0 ? std::clamp(0.5f * (a - c) / denom, -0.5f, 0.5f) : 0.f;
+    _frequency = _rate / (lag + shift);
+  }
+
+} // namespace otto::util::dsp
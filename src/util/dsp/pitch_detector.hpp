@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <gsl/span>
+
+namespace otto::util::dsp {
+
+  /// Monophonic pitch detection with the YIN algorithm
+  ///
+  /// The input is averaged down to around 11 kHz, which is plenty for the
+  /// fundamentals of instruments, and cuts the cost of the difference
+  /// function sixteen times at 48 kHz. A new estimate is started every half
+  /// window.
+  ///
+  /// The difference function is computed four samples at a time with
+  /// @ref simd::float4, and spread over several calls to @ref process, at
+  /// most @ref lags_per_call lags each, so the cost of every call is bounded.
+  ///
+  /// Only the constructor allocates.
+  struct PitchDetector {
+    /// Most lags of the difference function computed by one call to
+    /// @ref process
+    static constexpr std::size_t lags_per_call = 64;
+
+    /// Frequencies between `min_freq` and `max_freq` are detected
+    PitchDetector(float samplerate, float min_freq = 40, float max_freq = 1000);
+
+    /// Analyse `in`
+    ///
+    /// \returns `true` if a new estimate is ready
+    bool process(gsl::span<const float> in) noexcept;
+
+    /// The last frequency detected, or `0` if there was no clear pitch
+    float frequency() const noexcept
+    {
+      return _frequency;
+    }
+
+    /// How periodic the signal was, from 0 for noise or silence to 1 for a
+    /// pure tone
+    float clarity() const noexcept
+    {
+      return _clarity;
+    }
+
+    /// Below this value of the normalized difference function, a dip is
+    /// taken as the period
+    static constexpr float threshold = 0.15;
+
+  private:
+    /// Compute the difference function for the next lags of @ref _frame
+    void compute_lags() noexcept;
+    /// Find the period in the difference function
+    void estimate() noexcept;
+
+    const std::size_t _decimation;
+    /// Samplerate after decimation
+    const float _rate;
+    const std::size_t _min_lag;
+    const std::size_t _max_lag;
+    /// Size of the integration window, a multiple of 4
+    const std::size_t _window;
+    /// Decimated samples between estimates
+    const std::size_t _hop;
+
+    /// Sum of the input samples being averaged, and how many there are
+    float _sum = 0;
+    std::size_t _summed = 0;
+    /// The last decimated samples, @ref _window + @ref _max_lag of them
+    std::vector<float> _ring;
+    std::size_t _ring_pos = 0;
+    std::size_t _since_estimate = 0;
+
+    /// The ring, in order, being analysed
+    std::vector<float> _frame;
+    /// Difference function, for lags up to @ref _max_lag
+    std::vector<float> _diff;
+    /// The cumulative mean normalized difference function
+    std::vector<float> _norm;
+    /// The next lag to compute, or `0` when not analysing
+    std::size_t _lag = 0;
+
+    float _frequency = 0;
+    float _clarity = 0;
+  };
+
+} // namespace otto::util::dsp
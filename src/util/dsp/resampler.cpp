@@ -0,0 +1,280 @@
+#include "resampler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#include "util/dsp/kernels.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    struct Params {
+      /// Length of the filter at a step of 1. A multiple of 4.
+      int taps;
+      /// Number of phases in the table, between two input samples
+      int phases;
+      /// Kaiser window shape
+      double beta;
+    };
+
+    constexpr Params params(ResamplerQuality q)
+    {
+      switch (q) {
+        case ResamplerQuality::low: return {16, 64, 5.0};
+        case ResamplerQuality::medium: return {32, 256, 7.9};
+        case ResamplerQuality::high: return {64, 512, 11.2};
+      }
+      return {};
+    }
+
+    constexpr int max_taps = 64;
+    /// The most input samples a single output sample can depend on
+    constexpr int max_window = int(max_taps * Interpolator::max_step) + 4;
+
+    /// Zeroth order modified Bessel function of the first kind
+    double bessel_i0(double x)
+    {
+      double sum = 1;
+      double term = 1;
+      for (int k = 1; k < 50; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-17) break;
+      }
+      return sum;
+    }
+
+    /// `std::floor` is a library call on targets without SSE4.1, and it is
+    /// needed for every sample
+    inline std::ptrdiff_t floor_int(double x) noexcept
+    {
+      auto i = static_cast<std::ptrdiff_t>(x);
+      return i - (x < i);
+    }
+  } // namespace
+
+  /// The windowed sinc, sampled at each phase
+  ///
+  /// Row `p` of @ref rows holds the coefficients for an output `p / phases`
+  /// of the way from input sample `i` to `i + 1`, applied to the samples from
+  /// `i - taps/2 + 1` to `i + taps/2`. There is an extra row at the end, so
+  /// the rows can be interpolated without wrapping around.
+  ///
+  /// @ref prototype holds the same filter in order, for evaluating it at
+  /// arbitrary points.
+  struct Interpolator::Table {
+    Table(Params p)
+      : taps(p.taps),
+        phases(p.phases),
+        rows((p.phases + 1) * p.taps),
+        prototype(p.taps * p.phases + 2)
+    {
+      double half = taps / 2;
+      double norm = bessel_i0(p.beta);
+      auto filter = [&](double t) {
+        double x = t / half;
+        double window = std::abs(x) >= 1 ? 0 : bessel_i0(p.beta * std::sqrt(1 - x * x)) / norm;
+        double sinc = t == 0 ? 1 : std::sin(M_PI * t) / (M_PI * t);
+        return sinc * window;
+      };
+
+      for (int phase = 0; phase <= phases; phase++) {
+        float* row = &rows[phase * taps];
+        double sum = 0;
+        for (int j = 0; j < taps; j++) {
+          row[j] = filter(j - (half - 1) - double(phase) / phases);
+          sum += row[j];
+        }
+        // Unity gain at every phase, so DC does not get modulated by the
+        // fractional position
+        for (int j = 0; j < taps; j++) row[j] /= sum;
+      }
+
+      for (std::size_t m = 0; m < prototype.size(); m++) {
+        prototype[m] = filter(double(m) / phases - half);
+      }
+    }
+
+    int taps;
+    int phases;
+    std::vector<float> rows;
+    std::vector<float> prototype;
+  };
+
+  // Interpolator //////////////////////////////////////////////////////////////
+
+  Interpolator::Interpolator(ResamplerQuality quality) : _quality(quality)
+  {
+    // Built on first use, and shared by all instances
+    static const Table low(params(ResamplerQuality::low));
+    static const Table medium(params(ResamplerQuality::medium));
+    static const Table high(params(ResamplerQuality::high));
+    switch (quality) {
+      case ResamplerQuality::low: _table = &low; break;
+      case ResamplerQuality::medium: _table = &medium; break;
+      case ResamplerQuality::high: _table = &high; break;
+    }
+  }
+
+  std::size_t Interpolator::reach(double step) const noexcept
+  {
+    step = std::clamp(std::abs(step), 1.0, max_step);
+    // Including the padding to whole vectors in `interpolate`
+    return std::size_t(-floor_int(-_table->taps / 2 * step)) + 4;
+  }
+
+  float Interpolator::operator()(gsl::span<const float> data,
+                                 double position,
+                                 double step) const noexcept
+  {
+    auto size = static_cast<std::ptrdiff_t>(data.size());
+    auto r = static_cast<std::ptrdiff_t>(reach(step));
+    auto i = floor_int(position);
+    if (i - r >= 0 && i + r < size) {
+      return interpolate(data.data(), position, step);
+    }
+    if (i + r < 0 || i - r >= size) return 0;
+    return interpolate_edge(data, position, step);
+  }
+
+  float Interpolator::interpolate_edge(gsl::span<const float> data,
+                                       double position,
+                                       double step) const noexcept
+  {
+    // Copy the surroundings, padded with zeros
+    auto size = static_cast<std::ptrdiff_t>(data.size());
+    auto r = static_cast<std::ptrdiff_t>(reach(step));
+    auto first = floor_int(position) - r;
+    std::array<float, 2 * max_window + 1> window;
+    for (std::ptrdiff_t k = 0; k <= 2 * r; k++) {
+      auto idx = first + k;
+      window[k] = (idx >= 0 && idx < size) ? data[idx] : 0.f;
+    }
+    return interpolate(window.data(), position - first, step);
+  }
+
+  float Interpolator::interpolate(const float* data, double position, double step) const noexcept
+  {
+    const auto& table = *_table;
+    auto i = floor_int(position);
+    double frac = position - i;
+    step = std::min(std::abs(step), max_step);
+
+    if (step <= 1) {
+      // The table is used as is, blending the two nearest phases
+      double p = frac * table.phases;
+      int phase = int(p);
+      float blend = p - phase;
+      const float* x = data + i - (table.taps / 2 - 1);
+      float a = kernels::dot(x, &table.rows[phase * table.taps], table.taps);
+      float b = kernels::dot(x, &table.rows[(phase + 1) * table.taps], table.taps);
+      return a + blend * (b - a);
+    }
+
+    // Lower the cutoff to the output nyquist frequency by stretching the
+    // filter by `step`. The coefficients no longer line up with the table,
+    // so they are computed for each sample.
+    double half = table.taps / 2 * step;
+    auto first = floor_int(position - half) + 1;
+    auto last = -floor_int(-(position + half)) - 1;
+    int n = last - first + 1;
+    alignas(16) std::array<float, max_window> coefs;
+    float sum = 0;
+    // Position in the prototype, which starts at -taps/2
+    double x = ((first - position) / step + table.taps / 2) * table.phases;
+    double dx = table.phases / step;
+    for (int k = 0; k < n; k++, x += dx) {
+      auto m = static_cast<std::size_t>(x);
+      float frac = x - m;
+      float a = table.prototype[m];
+      coefs[k] = a + frac * (table.prototype[m + 1] - a);
+      sum += coefs[k];
+    }
+    // Pad to whole vectors. The samples they are multiplied with are always
+    // within the reach.
+    int padded = (n + 3) & ~3;
+    for (int k = n; k < padded; k++) coefs[k] = 0;
+    return kernels::dot(data + first, coefs.data(), padded) / sum;
+  }
+
+  // Resampler /////////////////////////////////////////////////////////////////
+
+  Resampler::Resampler(double step, ResamplerQuality quality) : _interpolator(quality)
+  {
+    this->step(step);
+    // Room for the widest filter, and some more to make the compaction
+    // cheap
+    _buffer.resize(4 * _interpolator.reach(Interpolator::max_step) + 1024);
+  }
+
+  void Resampler::step(double step) noexcept
+  {
+    _step = std::clamp(step, 1e-6, Interpolator::max_step);
+  }
+
+  std::size_t Resampler::latency() const noexcept
+  {
+    return _interpolator.reach(_step);
+  }
+
+  void Resampler::reset() noexcept
+  {
+    _buffered = 0;
+    _position = 0;
+  }
+
+  void Resampler::compact() noexcept
+  {
+    auto keep_from = floor_int(_position) -
+                     static_cast<std::ptrdiff_t>(_interpolator.reach(Interpolator::max_step));
+    if (keep_from <= 0) return;
+    auto from = std::min<std::size_t>(keep_from, _buffered);
+    std::copy(_buffer.begin() + from, _buffer.begin() + _buffered, _buffer.begin());
+    _buffered -= from;
+    _position -= from;
+  }
+
+  Resampler::Result Resampler::process(gsl::span<const float> in, gsl::span<float> out) noexcept
+  {
+    Result res;
+    auto n_in = static_cast<std::size_t>(in.size());
+    auto n_out = static_cast<std::size_t>(out.size());
+    gsl::span<const float> buffered = {_buffer.data(), static_cast<std::ptrdiff_t>(_buffered)};
+    while (res.produced < n_out) {
+      auto needed = static_cast<std::size_t>(_position) + latency();
+      if (needed >= _buffered) {
+        if (res.consumed == n_in) break;
+        if (_buffered == _buffer.size()) compact();
+        auto n = std::min(n_in - res.consumed, _buffer.size() - _buffered);
+        std::copy_n(in.data() + res.consumed, n, _buffer.data() + _buffered);
+        res.consumed += n;
+        _buffered += n;
+        buffered = {_buffer.data(), static_cast<std::ptrdiff_t>(_buffered)};
+        continue;
+      }
+      out[res.produced++] = _interpolator(buffered, _position, _step);
+      _position += _step;
+    }
+    compact();
+    return res;
+  }
+
+  // Offline ///////////////////////////////////////////////////////////////////
+
+  std::vector<float> resample(gsl::span<const float> in,
+                              double in_rate,
+                              double out_rate,
+                              ResamplerQuality quality)
+  {
+    Interpolator interpolator(quality);
+    double step = in_rate / out_rate;
+    auto n = static_cast<std::size_t>(std::ceil(in.size() / step));
+    std::vector<float> res(n);
+    for (std::size_t i = 0; i < n; i++) {
+      res[i] = interpolator(in, i * step, step);
+    }
+    return res;
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <gsl/span>
+
+namespace otto::util::dsp {
+
+  /// Quality of a @ref Resampler. Higher quality costs more CPU.
+  ///
+  /// Measured worst case SNR for sines in the passband, which ends at the
+  /// given fraction of the lower nyquist frequency, and throughput in output
+  /// samples per second on one core of an x86-64 server:
+  ///
+  /// | Quality  | Taps | Passband | SNR    | 44.1 to 48 kHz | 48 to 44.1 kHz |
+  /// |----------|------|----------|--------|----------------|----------------|
+  /// | `low`    | 16   | 80%      | 52 dB  | 32 M/s         | 10 M/s         |
+  /// | `medium` | 32   | 84%      | 79 dB  | 29 M/s         | 6.8 M/s        |
+  /// | `high`   | 64   | 86%      | 110 dB | 20 M/s         | 3.7 M/s        |
+  ///
+  /// Reducing the rate is slower, because the filter has to be evaluated
+  /// for every output sample, see @ref Interpolator.
+  enum struct ResamplerQuality { low, medium, high };
+
+  /// Band limited interpolation of a buffer at fractional positions
+  ///
+  /// This is the stateless core of the resampler, for when the whole input is
+  /// available, as in a sampler. It is a windowed sinc filter, stored as a
+  /// polyphase table, with linear interpolation between the phases.
+  ///
+  /// When the input is read faster than one sample per output sample, the
+  /// filter is widened to remove everything above the output nyquist
+  /// frequency. That costs `step` times as much, up to @ref max_step.
+  struct Interpolator {
+    /// Steps above this alias, instead of getting even more expensive
+    static constexpr double max_step = 16;
+
+    Interpolator(ResamplerQuality quality = ResamplerQuality::medium);
+
+    /// The value of `data` at `position`
+    ///
+    /// `step` is the distance between consecutive output samples, in input
+    /// samples, and only its magnitude is used. Samples outside of `data`
+    /// are zero.
+    float operator()(gsl::span<const float> data, double position, double step = 1) const noexcept;
+
+    /// The number of input samples needed on each side of the position
+    std::size_t reach(double step = 1) const noexcept;
+
+    ResamplerQuality quality() const noexcept
+    {
+      return _quality;
+    }
+
+  private:
+    friend struct Resampler;
+
+    /// The interpolated value at `position`, where there is enough data on
+    /// both sides of it
+    float interpolate(const float* data, double position, double step) const noexcept;
+    /// The interpolated value at `position`, where the filter reaches past
+    /// the ends of `data`
+    [[gnu::noinline]] float interpolate_edge(gsl::span<const float> data,
+                                             double position,
+                                             double step) const noexcept;
+
+    struct Table;
+    ResamplerQuality _quality;
+    const Table* _table;
+  };
+
+  /// A streaming sample rate converter
+  ///
+  /// Converts a stream in blocks of any size, with a ratio that may change
+  /// at any time, for example to follow a pitch.
+  ///
+  /// Only the constructor allocates, so @ref process is realtime safe.
+  struct Resampler {
+    /// Input samples consumed and output samples produced by @ref process
+    struct Result {
+      std::size_t consumed = 0;
+      std::size_t produced = 0;
+    };
+
+    /// \param step input samples per output sample, i.e. the input sample
+    /// rate divided by the output sample rate
+    Resampler(double step = 1, ResamplerQuality quality = ResamplerQuality::medium);
+
+    /// Change the ratio, from the next output sample
+    ///
+    /// Clamped to `(0, Interpolator::max_step]`
+    void step(double step) noexcept;
+    double step() const noexcept
+    {
+      return _step;
+    }
+
+    /// Convert as much of `in` as possible into `out`
+    ///
+    /// Stops when either all input is consumed or `out` is full. Input that
+    /// is not consumed should be passed again in the next call.
+    ///
+    /// Output sample `n` is the input at position `n * step` (for a constant
+    /// step), but it is only produced once @ref latency more input samples
+    /// have been passed in.
+    Result process(gsl::span<const float> in, gsl::span<float> out) noexcept;
+
+    /// Forget all input, as if newly constructed
+    void reset() noexcept;
+
+    /// The number of input samples needed after the position of an output
+    /// sample before it can be produced
+    std::size_t latency() const noexcept;
+
+  private:
+    /// Drop samples that are no longer needed from the front of the buffer
+    void compact() noexcept;
+
+    Interpolator _interpolator;
+    double _step = 1;
+    std::vector<float> _buffer;
+    std::size_t _buffered = 0;
+    /// Position of the next output sample in the buffer
+    double _position = 0;
+  };
+
+  /// Convert all of `in` from `in_rate` to `out_rate`
+  std::vector<float> resample(gsl::span<const float> in,
+                              double in_rate,
+                              double out_rate,
+                              ResamplerQuality quality = ResamplerQuality::medium);
+
+} // namespace otto::util::dsp
@@ -0,0 +1,70 @@
+#include "sample_voices.hpp"
+
+#include <algorithm>
+
+#include "util/dsp/kernels.hpp"
+
+namespace otto::util::dsp {
+
+  void SampleVoices::trigger(gsl::span<const float> sample, float gain, std::size_t offset) noexcept
+  {
+    if (sample.empty()) return;
+    Voice voice = {sample.data(), std::size_t(sample.size()), 0, gain, offset};
+    if (_count < max_voices) {
+      _voices[_count++] = voice;
+      return;
+    }
+    auto oldest = std::max_element(_voices.begin(), _voices.end(),
+                                   [](const Voice& a, const Voice& b) { return a.pos < b.pos; });
+    *oldest = voice;
+  }
+
+  void SampleVoices::process(gsl::span<float> out) noexcept
+  {
+    const std::size_t n = out.size();
+    // Voices that play the whole block are collected, and mixed four at a time
+    std::array<const float*, max_voices> whole;
+    std::array<float, max_voices> whole_gains;
+    std::size_t whole_count = 0;
+    for (std::size_t v = 0; v < _count;) {
+      Voice& voice = _voices[v];
+      if (voice.delay >= n) {
+        voice.delay -= n;
+        v++;
+        continue;
+      }
+      const std::size_t len = std::min(n - voice.delay, voice.size - voice.pos);
+      if (len == n) {
+        whole[whole_count] = voice.data + voice.pos;
+        whole_gains[whole_count++] = voice.gain;
+      } else {
+        kernels::mix(voice.data + voice.pos, out.data() + voice.delay, len, voice.gain);
+      }
+      voice.pos += len;
+      voice.delay = 0;
+      if (voice.pos == voice.size) {
+        voice = _voices[--_count];
+      } else {
+        v++;
+      }
+    }
+
+    std::size_t v = 0;
+    for (; v + 4 <= whole_count; v += 4) {
+      kernels::mix4(whole.data() + v, out.data(), n, whole_gains.data() + v);
+    }
+    for (; v < whole_count; v++) kernels::mix(whole[v], out.data(), n, whole_gains[v]);
+  }
+
+  bool SampleVoices::playing(gsl::span<const float> sample) const noexcept
+  {
+    return std::any_of(_voices.begin(), _voices.begin() + _count,
+                       [&](const Voice& v) { return v.data == sample.data(); });
+  }
+
+  void SampleVoices::stop() noexcept
+  {
+    _count = 0;
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include <gsl/span>
+
+namespace otto::util::dsp {
+
+  /// A fixed pool of voices playing one shot samples
+  ///
+  /// Voices can be started at any sample of the next block. Voices that play
+  /// the whole block are mixed four at a time with @ref kernels::mix4, so the
+  /// output is read and written once per four voices. Voices that start or
+  /// end in the block are mixed one at a time with @ref kernels::mix. When
+  /// the pool is full, the voice that has played the longest is taken over.
+  ///
+  /// Nothing allocates. The samples are not copied, so they must outlive
+  /// the voices playing them. Use @ref playing to find out when a sample is
+  /// no longer used.
+  struct SampleVoices {
+    static constexpr std::size_t max_voices = 32;
+
+    /// Start playing `sample` at `gain`, `offset` samples into the next
+    /// block
+    void trigger(gsl::span<const float> sample, float gain, std::size_t offset = 0) noexcept;
+
+    /// Add the playing voices to `out`
+    void process(gsl::span<float> out) noexcept;
+
+    /// Stop all voices
+    void stop() noexcept;
+
+    /// Whether any voice is playing `sample`, or waiting to start it
+    bool playing(gsl::span<const float> sample) const noexcept;
+
+    /// Number of voices playing, or waiting to start
+    std::size_t active() const noexcept
+    {
+      return _count;
+    }
+
+  private:
+    struct Voice {
+      const float* data;
+      std::size_t size;
+      std::size_t pos;
+      float gain;
+      /// Samples until it starts
+      std::size_t delay;
+    };
+
+    /// The first @ref _count are in use
+    std::array<Voice, max_voices> _voices;
+    std::size_t _count = 0;
+  };
+
+} // namespace otto::util::dsp
@@ -0,0 +1,173 @@
+#include "transport.hpp"
+
+namespace otto::util::dsp {
+
+  Transport::Transport(int samplerate, float bpm)
+    : _samplerate(samplerate), _set_samples_per_beat(60.0 * samplerate / bpm)
+  {
+    _samples_per_beat = _set_samples_per_beat;
+  }
+
+  void Transport::bpm(float bpm) noexcept
+  {
+    double spb = 60.0 * _samplerate / bpm;
+    if (spb == _set_samples_per_beat) return;
+    _set_samples_per_beat = spb;
+    if (_follow) return;
+    _origin_beat = _position;
+    _origin_sample = _run_samples;
+    _samples_per_beat = spb;
+  }
+
+  float Transport::bpm() const noexcept
+  {
+    return 60.0 * _samplerate / _samples_per_beat;
+  }
+
+  void Transport::follow(bool follow) noexcept
+  {
+    if (follow == _follow) return;
+    _follow = follow;
+    if (!_follow) {
+      _origin_beat = _position;
+      _origin_sample = _run_samples;
+      _samples_per_beat = _set_samples_per_beat;
+    } else if (_interval_count > 0) {
+      _samples_per_beat = _interval_sum / _interval_count * ppqn;
+    }
+  }
+
+  void Transport::start(int offset) noexcept
+  {
+    push(Command::start, offset);
+  }
+
+  void Transport::resume(int offset) noexcept
+  {
+    push(Command::resume, offset);
+  }
+
+  void Transport::stop(int offset) noexcept
+  {
+    push(Command::stop, offset);
+  }
+
+  void Transport::tick(int offset) noexcept
+  {
+    push(Command::tick, offset);
+  }
+
+  void Transport::push(Command c, int offset) noexcept
+  {
+    if (_event_count == max_events) return;
+    // Keep the events sorted by offset, and in the order they were given
+    // within an offset
+    int i = _event_count++;
+    for (; i > 0 && _events[i - 1].offset > offset; i--) _events[i] = _events[i - 1];
+    _events[i] = {c, offset};
+  }
+
+  void Transport::measure(std::int64_t time) noexcept
+  {
+    if (_last_tick_time >= 0) {
+      auto interval = time - _last_tick_time;
+      // A tick more than a second after the last one is from a clock that
+      // was stopped, which says nothing about the tempo
+      if (interval > _samplerate) {
+        _interval_count = 0;
+        _interval_pos = 0;
+        _interval_sum = 0;
+      } else {
+        // Drivers without timestamps give several ticks at the same offset,
+        // which the average still evens out
+        if (_interval_count == ppqn) {
+          _interval_sum -= _intervals[_interval_pos];
+        } else {
+          _interval_count++;
+        }
+        _intervals[_interval_pos] = interval;
+        _interval_sum += interval;
+        _interval_pos = (_interval_pos + 1) % ppqn;
+      }
+    }
+    _last_tick_time = time;
+    if (_follow && _interval_count > 0 && _interval_sum > 0) {
+      _samples_per_beat = _interval_sum / _interval_count * ppqn;
+    }
+  }
+
+  double Transport::advance(double begin, int frames) noexcept
+  {
+    _run_samples += frames;
+    if (!_follow) {
+      return _origin_beat + (_run_samples - _origin_sample) / _samples_per_beat;
+    }
+    // Between the last tick and the next one
+    double end = begin + frames / _samples_per_beat;
+    end = std::min(end, double(_ticks + 1) / ppqn);
+    end = std::max(end, double(_ticks) / ppqn);
+    end = std::max(end, begin);
+    // Going back to the tempo that is set continues from here
+    _origin_beat = end;
+    _origin_sample = _run_samples;
+    return end;
+  }
+
+  auto Transport::process(int nframes) noexcept -> const Block&
+  {
+    _block = {};
+    _block.nframes = nframes;
+    int from = 0;
+    double begin = _position;
+
+    for (int e = 0; e < _event_count; e++) {
+      const int offset = std::clamp(_events[e].offset, 0, nframes);
+      switch (_events[e].command) {
+      case Command::start:
+        _running = true;
+        _position = 0;
+        _ticks = -1;
+        _origin_beat = 0;
+        _origin_sample = 0;
+        _run_samples = 0;
+        from = offset;
+        begin = 0;
+        break;
+      case Command::resume:
+        if (_running) break;
+        _running = true;
+        from = offset;
+        begin = _position;
+        break;
+      case Command::stop:
+        if (!_running) break;
+        _running = false;
+        _position = advance(begin, offset - from);
+        _block.from = from;
+        _block.to = offset;
+        _block.begin = begin;
+        _block.end = _position;
+        break;
+      case Command::tick:
+        measure(_now + offset);
+        if (_running && _follow) _ticks++;
+        break;
+      }
+    }
+    _event_count = 0;
+
+    if (_running) {
+      _position = advance(begin, nframes - from);
+      _block.from = from;
+      _block.to = nframes;
+      _block.begin = begin;
+      _block.end = _position;
+    } else if (!_block.running()) {
+      _block.begin = _block.end = _position;
+    }
+    _block.samples_per_beat = _samples_per_beat;
+    _now += nframes;
+    return _block;
+  }
+
+} // namespace otto::util::dsp
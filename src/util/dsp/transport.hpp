@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace otto::util::dsp {
+
+  /// Tempo, play state and song position, to sample accuracy
+  ///
+  /// The transport is advanced once per block by @ref process, which
+  /// describes where it was during that block as a @ref Block. Positions
+  /// are in beats from the start of the song, and never go backwards while
+  /// running.
+  ///
+  /// It runs from its own tempo, or follows MIDI clock ticks. When
+  /// following, the tempo is the average over the last beat of ticks, and
+  /// the position is kept between the last tick received and the next one,
+  /// so it can neither drift nor run ahead of the clock.
+  ///
+  /// Commands and ticks are given for the next block, with their offset
+  /// into it. If the transport stops and starts again within one block,
+  /// only the last run is in the @ref Block.
+  struct Transport {
+    /// MIDI clock ticks per beat
+    static constexpr int ppqn = 24;
+    /// Most commands and ticks per block
+    static constexpr int max_events = 64;
+
+    /// Where the transport is during one block
+    ///
+    /// It runs in the frames `[from, to)`, going from `begin` at `from` to
+    /// `end` at `to`. A beat is in the block if it is in `[begin, end)`, so
+    /// every beat is in exactly one block.
+    struct Block {
+      int nframes = 0;
+      int from = 0;
+      int to = 0;
+      double begin = 0;
+      double end = 0;
+      double samples_per_beat = 0;
+
+      bool running() const noexcept
+      {
+        return to > from;
+      }
+
+      /// The frame during which the transport reaches `beat`, which may be
+      /// after this block, or `-1` if it is stopped
+      int offset(double beat) const noexcept
+      {
+        if (!running()) return -1;
+        double frames = end > begin ? (beat - begin) * (to - from) / (end - begin)
+                                    : (beat - begin) * samples_per_beat;
+        // Rounding errors must not move a beat that falls on a frame
+        return from + std::max(0, int(std::floor(frames + 1e-6)));
+      }
+
+      /// Call `f(frame, index)` for every multiple `index * division` of
+      /// `division` beats in this block
+      template<typename F>
+      void for_each(double division, F&& f) const
+      {
+        if (!running() || end <= begin) return;
+        constexpr double eps = 1e-9;
+        for (auto i = std::int64_t(std::floor(begin / division)); i * division < end - eps; i++) {
+          if (i * division < begin - eps) continue;
+          f(std::min(offset(i * division), to - 1), i);
+        }
+      }
+    };
+
+    Transport(int samplerate, float bpm = 120);
+
+    /// Set the tempo used when not following
+    void bpm(float bpm) noexcept;
+    /// The tempo, as set or as followed
+    float bpm() const noexcept;
+
+    /// Follow clock ticks, instead of the tempo that is set
+    void follow(bool follow) noexcept;
+    bool following() const noexcept
+    {
+      return _follow;
+    }
+
+    /// Start from the beginning of the song
+    ///
+    /// When following, the first tick after this is the first beat.
+    void start(int offset = 0) noexcept;
+    /// Start from where the transport stopped
+    void resume(int offset = 0) noexcept;
+    void stop(int offset = 0) noexcept;
+    /// A clock tick, only used when following
+    void tick(int offset = 0) noexcept;
+
+    /// Advance by a block of `nframes`, carrying out the commands and ticks
+    /// given since the last call
+    const Block& process(int nframes) noexcept;
+
+    /// The last block processed
+    const Block& block() const noexcept
+    {
+      return _block;
+    }
+
+    bool running() const noexcept
+    {
+      return _running;
+    }
+
+    /// The position at the end of the last block
+    double position() const noexcept
+    {
+      return _position;
+    }
+
+  private:
+    enum struct Command { start, resume, stop, tick };
+    struct Event {
+      Command command;
+      int offset;
+    };
+
+    void push(Command c, int offset) noexcept;
+    /// Measure the tempo from a tick at `time`, in samples since the
+    /// transport was made
+    void measure(std::int64_t time) noexcept;
+    /// Move the position forward by `frames` from `begin`
+    double advance(double begin, int frames) noexcept;
+
+    const int _samplerate;
+    /// The tempo that is set, and the one in use
+    double _set_samples_per_beat;
+    double _samples_per_beat;
+    bool _follow = false;
+    bool _running = false;
+    double _position = 0;
+
+    /// Samples run since the start of the song
+    std::int64_t _run_samples = 0;
+    /// The position at `_origin_sample` run samples. When not following,
+    /// the position is computed from those, so rounding errors do not add
+    /// up.
+    double _origin_beat = 0;
+    std::int64_t _origin_sample = 0;
+
+    /// Samples processed, running or not
+    std::int64_t _now = 0;
+    /// The tick received last, counted from `0` at the first beat
+    std::int64_t _ticks = -1;
+    std::int64_t _last_tick_time = -1;
+    /// Intervals between the last @ref ppqn ticks, a ring buffer
+    std::array<double, ppqn> _intervals = {};
+    int _interval_count = 0;
+    int _interval_pos = 0;
+    double _interval_sum = 0;
+
+    std::array<Event, max_events> _events;
+    int _event_count = 0;
+
+    Block _block;
+  };
+
+} // namespace otto::util::dsp
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "util/simd.hpp"
+
+/// Fast approximations of transcendental functions for audio kernels
+///
+/// Every function is a template on the value type, and works for `float`,
+/// @ref simd::float4 and @ref simd::float8. The code has no branches or table
+/// lookups, so the compiler can keep whole kernels in vector registers.
+///
+/// The error bounds below are measured over the stated input range in
+/// `test/util/fast_math.t.cpp`. They are well below what is audible, but
+/// these are not drop in replacements for `<cmath>`: there is no handling of
+/// NaN, infinities or denormals, and inputs outside the stated ranges are
+/// clamped or give undefined results.
+namespace otto::util::math {
+
+  namespace detail {
+    /// (-1)^q * sin(x - k*pi), where |x - k*pi| <= pi/2
+    template<typename V>
+    inline V sin_reduced(V x, simd::int_t<V> q, V k) noexcept
+    {
+      // pi is split in three parts with few mantissa bits each, so the
+      // products with k are exact (Cody-Waite reduction).
+      constexpr float pi_a = 3.140625f;
+      constexpr float pi_b = 9.67502593994140625e-4f;
+      constexpr float pi_c = 1.509957990978376432e-7f;
+      V r = ((x - k * pi_a) - k * pi_b) - k * pi_c;
+
+      // Odd taylor polynomial
+      V r2 = r * r;
+      V p = simd::broadcast<V>(-2.5052108385441718775e-8f);
+      p = p * r2 + 2.7557319223985890653e-6f;
+      p = p * r2 - 1.9841269841269841270e-4f;
+      p = p * r2 + 8.3333333333333333333e-3f;
+      p = p * r2 - 1.6666666666666666667e-1f;
+      V res = r + r * r2 * p;
+
+      // Flip the sign bit for odd q
+      return simd::bit_cast<V>(simd::bit_cast<simd::int_t<V>>(res) ^ ((q & 1) << 31));
+    }
+
+    constexpr float inv_pi = 0.31830988618379067154f;
+  } // namespace detail
+
+  /// sin(x)
+  ///
+  /// Absolute error below 2e-7 for |x| <= 10^4. Requires `|x| < 2^31 / pi`.
+  template<typename V>
+  inline V fast_sin(V x) noexcept
+  {
+    // sin(x) = (-1)^q * sin(x - q*pi)
+    auto q = simd::round_to_int(x * detail::inv_pi);
+    return detail::sin_reduced<V>(x, q, simd::to_float(q));
+  }
+
+  /// cos(x)
+  ///
+  /// Same accuracy as @ref fast_sin
+  template<typename V>
+  inline V fast_cos(V x) noexcept
+  {
+    // cos(x) = sin(x + pi/2) = (-1)^q * sin(x - (q - 1/2)*pi)
+    auto q = simd::to_int(simd::floor(x * detail::inv_pi) + 1.f);
+    return detail::sin_reduced<V>(x, q, simd::to_float(q) - 0.5f);
+  }
+
+  /// 2^x
+  ///
+  /// Relative error below 3e-7. `x` is clamped to [-126, 126], so the
+  /// result is always a normal float.
+  template<typename V>
+  inline V fast_exp2(V x) noexcept
+  {
+    x = simd::clamp<V>(x, -126.f, 126.f);
+    auto i = simd::round_to_int(x);
+    V f = x - simd::to_float(i);
+
+    // 2^f = e^(f*ln2) for f in [-0.5, 0.5], taylor polynomial with the powers
+    // of ln2 folded into the coefficients
+    V p = simd::broadcast<V>(1.5403530393381608e-4f);
+    p = p * f + 1.3333558146428443e-3f;
+    p = p * f + 9.6181291076284772e-3f;
+    p = p * f + 5.5504108664821580e-2f;
+    p = p * f + 2.4022650695910071e-1f;
+    p = p * f + 6.9314718055994531e-1f;
+    p = p * f + 1.f;
+
+    // Multiply by 2^i by constructing the float directly
+    V scale = simd::bit_cast<V>((i + 127) << 23);
+    return p * scale;
+  }
+
+  /// log2(x)
+  ///
+  /// Absolute error below 2e-7 for x in [0.5, 2], and relative error below
+  /// 2e-7 outside that. `x` must be positive and normal.
+  template<typename V>
+  inline V fast_log2(V x) noexcept
+  {
+    using I = simd::int_t<V>;
+    auto bits = simd::bit_cast<I>(x);
+    I e = ((bits >> 23) & 0xFF) - 127;
+    V m = simd::bit_cast<V>((bits & 0x007FFFFF) | 0x3F800000);
+
+    // Move the mantissa to [sqrt(1/2), sqrt(2)) so it is centered around 1
+    auto big = m > 1.41421356237309504880f;
+    m = simd::select<V>(big, m * 0.5f, m);
+    V ef = simd::to_float(e) + simd::select<V>(big, simd::broadcast<V>(1.f), simd::broadcast<V>(0.f));
+
+    // ln(m) = 2 atanh(s), s = (m - 1) / (m + 1), |s| < 0.172
+    V s = (m - 1.f) / (m + 1.f);
+    V s2 = s * s;
+    V p = simd::broadcast<V>(1.f / 9.f);
+    p = p * s2 + 1.f / 7.f;
+    p = p * s2 + 1.f / 5.f;
+    p = p * s2 + 1.f / 3.f;
+    p = p * s2 + 1.f;
+    // 2 / ln(2)
+    return ef + s * p * 2.88539008177792681472f;
+  }
+
+  /// e^x
+  ///
+  /// Relative error below 1e-6 for |x| <= 10. The error grows with |x|, since
+  /// `x * log2(e)` is rounded to a float, and is below 5e-6 for |x| <= 87.
+  template<typename V>
+  inline V fast_exp(V x) noexcept
+  {
+    return fast_exp2<V>(x * 1.44269504088896340736f);
+  }
+
+  /// ln(x)
+  ///
+  /// Same accuracy as @ref fast_log2
+  template<typename V>
+  inline V fast_log(V x) noexcept
+  {
+    return fast_log2<V>(x) * 0.69314718055994530942f;
+  }
+
+  /// x^y
+  ///
+  /// `x` must be positive and normal. The relative error grows with
+  /// |y * log2(x)|, and is below 2e-6 while the result is within [2^-20, 2^20].
+  template<typename V>
+  inline V fast_pow(V x, V y) noexcept
+  {
+    return fast_exp2<V>(y * fast_log2<V>(x));
+  }
+
+  /// tanh(x)
+  ///
+  /// Absolute error below 2e-7 for any x
+  template<typename V>
+  inline V fast_tanh(V x) noexcept
+  {
+    // tanh(x) = 1 - 2 / (e^2x + 1). That loses precision close to 0, where
+    // a taylor polynomial is used instead.
+    V ax = simd::min<V>(simd::abs<V>(x), simd::broadcast<V>(9.f));
+    V e = fast_exp2<V>(ax * 2.88539008177792681472f);
+    V big = 1.f - 2.f / (e + 1.f);
+
+    V x2 = x * x;
+    V p = simd::broadcast<V>(-17.f / 315.f);
+    p = p * x2 + 2.f / 15.f;
+    p = p * x2 - 1.f / 3.f;
+    V small = x + x * x2 * p;
+
+    // Restore the sign of x
+    auto sign = simd::bit_cast<simd::int_t<V>>(x) & INT32_MIN;
+    big = simd::bit_cast<V>(simd::bit_cast<simd::int_t<V>>(big) | sign);
+    return simd::select<V>(ax < 0.1f, small, big);
+  }
+
+  /// Convert decibels to a linear gain factor
+  ///
+  /// Relative error below 1e-6 for dB in [-120, 24]
+  template<typename V>
+  inline V fast_db_to_gain(V db) noexcept
+  {
+    // log2(10) / 20
+    return fast_exp2<V>(db * 0.16609640474436811739f);
+  }
+
+  /// Convert a linear gain factor to decibels
+  ///
+  /// Absolute error below 5e-6 dB. `gain` must be positive and normal.
+  template<typename V>
+  inline V fast_gain_to_db(V gain) noexcept
+  {
+    // 20 / log2(10)
+    return fast_log2<V>(gain) * 6.02059991327962390427f;
+  }
+
+} // namespace otto::util::math
@@ -0,0 +1,502 @@
+#include "library_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "util/jsonfile.hpp"
+
+#include "services/log_manager.hpp"
+
+namespace otto::util {
+
+  /// Without inotify, the tree is rescanned this often
+  static constexpr auto rescan_interval = std::chrono::seconds(5);
+  /// How long the background thread waits for changes before checking if it
+  /// should stop. Also the debounce time for writing the cache.
+  static constexpr int poll_timeout_ms = 250;
+  /// Bump this when the format of the cache changes
+  static constexpr int cache_version = 1;
+
+  static bool is_sound_file(const fs::path& p)
+  {
+    auto ext = p.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == ".wav";
+  }
+
+  template<typename T>
+  static T read_le(std::istream& in)
+  {
+    T res = 0;
+    in.read(reinterpret_cast<char*>(&res), sizeof(T));
+    return res;
+  }
+
+  /// Read the audio metadata and overview of a wave file
+  ///
+  /// This does not use `SoundFile`, as that rewrites the header when the file
+  /// is closed, which would trigger a new change notification. Supports 32 bit
+  /// float, which is what `SoundFile` reads, and 16 bit integer PCM.
+  ///
+  /// \returns `false` if the file is not a supported wave file
+  static bool read_wave_info(const fs::path& path, LibraryIndex::Entry& res)
+  {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char id[4];
+    in.read(id, 4);
+    read_le<std::uint32_t>(in);
+    char format[4];
+    in.read(format, 4);
+    if (!in || std::memcmp(id, "RIFF", 4) != 0 || std::memcmp(format, "WAVE", 4) != 0) {
+      return false;
+    }
+
+    int audio_format = 0;
+    int bits = 0;
+    std::uint32_t data_size = 0;
+    while (in.read(id, 4)) {
+      auto size = read_le<std::uint32_t>(in);
+      auto next = in.tellg() + std::streamoff(size + (size & 1));
+      if (std::memcmp(id, "fmt ", 4) == 0) {
+        audio_format = read_le<std::uint16_t>(in);
+        res.channels = read_le<std::uint16_t>(in);
+        res.samplerate = read_le<std::uint32_t>(in);
+        read_le<std::uint32_t>(in); // byte rate
+        read_le<std::uint16_t>(in); // block align
+        bits = read_le<std::uint16_t>(in);
+      } else if (std::memcmp(id, "data", 4) == 0) {
+        data_size = size;
+        break;
+      }
+      in.seekg(next);
+    }
+    bool is_float = audio_format == 3 && bits == 32;
+    bool is_pcm16 = audio_format == 1 && bits == 16;
+    if (!in || res.channels <= 0 || res.samplerate <= 0 || !(is_float || is_pcm16)) return false;
+
+    res.length = data_size / (bits / 8) / res.channels;
+    res.overview.assign(LibraryIndex::overview_size, 0.f);
+    if (res.length == 0) return true;
+
+    // Read in chunks, to avoid loading the whole file into memory
+    constexpr int chunk_frames = 4096;
+    std::vector<char> buf(chunk_frames * res.channels * (bits / 8));
+    int frame = 0;
+    while (frame < res.length) {
+      int n = std::min(chunk_frames, res.length - frame);
+      in.read(buf.data(), std::streamsize(n) * res.channels * (bits / 8));
+      if (!in) break;
+      for (int i = 0; i < n; i++, frame++) {
+        auto& peak = res.overview[std::int64_t(frame) * LibraryIndex::overview_size / res.length];
+        for (int c = 0; c < res.channels; c++) {
+          int s = i * res.channels + c;
+          float val;
+          if (is_float) {
+            std::memcpy(&val, buf.data() + s * 4, 4);
+          } else {
+            std::int16_t i16;
+            std::memcpy(&i16, buf.data() + s * 2, 2);
+            val = i16 / 32768.f;
+          }
+          peak = std::max(peak, std::abs(val));
+        }
+      }
+    }
+    return true;
+  }
+
+  /// `path` relative to `base`, which it is below
+  static std::string relative_to(const fs::path& path, const fs::path& base)
+  {
+    auto res = path.string();
+    auto prefix = base.string();
+    if (res.compare(0, prefix.size(), prefix) == 0) {
+      res.erase(0, prefix.find_last_not_of('/') + 1);
+      res.erase(0, res.find_first_not_of('/'));
+    }
+    return res;
+  }
+
+  static std::int64_t mtime_of(const fs::path& p, std::error_code& ec)
+  {
+    auto t = fs::last_write_time(p, ec);
+    return std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+  }
+
+  static nlohmann::json to_json(const LibraryIndex::Entry& e)
+  {
+    return {{"path", e.path.string()},   {"size", e.size},
+            {"mtime", e.mtime},          {"length", e.length},
+            {"samplerate", e.samplerate}, {"channels", e.channels},
+            {"overview", e.overview}};
+  }
+
+  static LibraryIndex::Entry from_json(const nlohmann::json& j)
+  {
+    LibraryIndex::Entry e;
+    e.path = j.at("path").get<std::string>();
+    e.size = j.at("size");
+    e.mtime = j.at("mtime");
+    e.length = j.at("length");
+    e.samplerate = j.at("samplerate");
+    e.channels = j.at("channels");
+    e.overview = j.at("overview").get<std::vector<float>>();
+    return e;
+  }
+
+  LibraryIndex::LibraryIndex(fs::path root, std::vector<std::string> extensions, fs::path cache_file)
+    : _root(std::move(root)),
+      _extensions(std::move(extensions)),
+      _cache_file(std::move(cache_file)),
+      _snapshot(std::make_shared<const std::vector<Entry>>())
+  {
+    if (!fs::exists(_root)) {
+      fs::create_directories(_root);
+    }
+    _thread = std::thread([this] { run(); });
+  }
+
+  LibraryIndex::~LibraryIndex() noexcept
+  {
+    _should_run = false;
+    _cv.notify_all();
+    if (_thread.joinable()) _thread.join();
+  }
+
+  auto LibraryIndex::entries() const -> Snapshot
+  {
+    return std::atomic_load(&_snapshot);
+  }
+
+  auto LibraryIndex::find(const fs::path& path) const -> std::optional<Entry>
+  {
+    auto snapshot = entries();
+    auto key = path.string();
+    auto found = std::lower_bound(snapshot->begin(), snapshot->end(), key,
+                                  [](const Entry& e, const std::string& k) { return e.path.string() < k; });
+    if (found == snapshot->end() || found->path.string() != key) return std::nullopt;
+    return *found;
+  }
+
+  void LibraryIndex::wait_ready() const
+  {
+    std::unique_lock lock(_mutex);
+    _cv.wait(lock, [this] { return _ready; });
+  }
+
+  void LibraryIndex::rescan()
+  {
+    {
+      std::unique_lock lock(_mutex);
+      _rescan_requested = true;
+    }
+    _cv.notify_all();
+  }
+
+  // Background thread -------------------------------------------------------
+
+  void LibraryIndex::run()
+  {
+    load_cache();
+#if defined(__linux__)
+    _inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify_fd < 0) {
+      LOGW("inotify unavailable, falling back to rescanning {} periodically", _root);
+    }
+#endif
+    full_scan();
+    {
+      std::unique_lock lock(_mutex);
+      _ready = true;
+    }
+    _cv.notify_all();
+
+    auto last_scan = std::chrono::steady_clock::now();
+    while (_should_run) {
+      bool changed = poll_changes(poll_timeout_ms);
+      bool do_rescan = false;
+      {
+        std::unique_lock lock(_mutex);
+        std::swap(do_rescan, _rescan_requested);
+      }
+      if (_inotify_fd < 0 && std::chrono::steady_clock::now() - last_scan > rescan_interval) {
+        do_rescan = true;
+      }
+      if (do_rescan) {
+        full_scan();
+        last_scan = std::chrono::steady_clock::now();
+      } else if (changed) {
+        publish();
+      } else if (_dirty) {
+        save_cache();
+      }
+    }
+    if (_dirty) save_cache();
+#if defined(__linux__)
+    if (_inotify_fd >= 0) ::close(_inotify_fd);
+#endif
+  }
+
+  bool LibraryIndex::matches(const fs::path& path) const
+  {
+    auto name = path.filename().string();
+    if (name.empty() || name[0] == '.') return false;
+    if (_extensions.empty()) return true;
+    auto ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return std::find(_extensions.begin(), _extensions.end(), ext) != _extensions.end();
+  }
+
+  void LibraryIndex::full_scan()
+  {
+    DLOGI("Scanning library {}", _root);
+#if defined(__linux__)
+    // Watches are re-added during the scan. Their IN_IGNORED events are
+    // dropped, since the descriptors are no longer in the map.
+    for (auto& [wd, dir] : _watches) ::inotify_rm_watch(_inotify_fd, wd);
+#endif
+    _watches.clear();
+    EntryMap res;
+    scan_dir(_root, res, _entries);
+    _entries = std::move(res);
+    publish();
+  }
+
+  void LibraryIndex::scan_dir(const fs::path& dir, EntryMap& res, const EntryMap& old)
+  {
+    watch(dir);
+    std::error_code ec;
+    for (auto iter = fs::directory_iterator(dir, ec); !ec && iter != fs::directory_iterator();
+         iter.increment(ec)) {
+      auto& de = *iter;
+      auto name = de.path().filename().string();
+      if (name.empty() || name[0] == '.') continue;
+      if (de.is_directory(ec)) {
+        scan_dir(de.path(), res, old);
+        continue;
+      }
+      if (!matches(de.path())) continue;
+      auto rel = relative_to(de.path(), _root);
+      // Reuse the cached metadata if the file is unchanged
+      if (auto found = old.find(rel); found != old.end()) {
+        std::error_code fec;
+        if (found->second.size == de.file_size(fec) && found->second.mtime == mtime_of(de.path(), fec)) {
+          res.insert(*found);
+          continue;
+        }
+      }
+      if (auto entry = index_file(de.path()); entry) {
+        res.emplace(rel, std::move(*entry));
+      }
+    }
+    if (ec) LOGW("Error while scanning {}: {}", dir, ec.message());
+  }
+
+  auto LibraryIndex::index_file(const fs::path& path) const -> std::optional<Entry>
+  {
+    std::error_code ec;
+    // Skip sockets, fifos and broken links. Links to files are followed.
+    if (!fs::is_regular_file(path, ec)) return std::nullopt;
+    Entry res;
+    res.path = relative_to(path, _root);
+    res.size = fs::file_size(path, ec);
+    if (ec) return std::nullopt;
+    res.mtime = mtime_of(path, ec);
+    if (ec) return std::nullopt;
+
+    // Empty files are most likely still being written to. We get another
+    // event when they are closed.
+    if (!is_sound_file(path) || res.size == 0) return res;
+
+    if (!read_wave_info(path, res)) {
+      LOGW("Could not read sound file {}", path);
+      res.samplerate = res.channels = res.length = 0;
+      res.overview.clear();
+    }
+    return res;
+  }
+
+  void LibraryIndex::update_file(const fs::path& path)
+  {
+    if (!matches(path)) return;
+    auto rel = relative_to(path, _root);
+    if (auto entry = index_file(path); entry) {
+      DLOGI("Indexed {}", path);
+      _entries.insert_or_assign(rel, std::move(*entry));
+    } else {
+      _entries.erase(rel);
+    }
+  }
+
+  void LibraryIndex::remove_path(const fs::path& path)
+  {
+    auto rel = relative_to(path, _root);
+    // Removes `rel` itself, and everything below it if it is a directory
+    auto first = _entries.lower_bound(rel);
+    auto last = first;
+    while (last != _entries.end() &&
+           (last->first == rel || last->first.compare(0, rel.size() + 1, rel + "/") == 0)) {
+      ++last;
+    }
+    _entries.erase(first, last);
+  }
+
+  void LibraryIndex::publish()
+  {
+    auto res = std::make_shared<std::vector<Entry>>();
+    res->reserve(_entries.size());
+    for (auto& [k, e] : _entries) res->push_back(e);
+    std::atomic_store(&_snapshot, Snapshot(std::move(res)));
+    _generation.fetch_add(1, std::memory_order_acq_rel);
+    _dirty = true;
+  }
+
+  void LibraryIndex::load_cache()
+  {
+    if (_cache_file.empty() || !fs::exists(_cache_file)) return;
+    try {
+      JsonFile jf{_cache_file};
+      jf.read();
+      if (jf.data().value("version", 0) != cache_version) return;
+      for (auto& j : jf.data().at("entries")) {
+        auto e = from_json(j);
+        auto key = e.path.string();
+        _entries.emplace(std::move(key), std::move(e));
+      }
+      DLOGI("Loaded {} cached library entries for {}", _entries.size(), _root);
+    } catch (std::exception& e) {
+      LOGW("Ignoring invalid library cache {}: {}", _cache_file, e.what());
+      _entries.clear();
+    }
+  }
+
+  void LibraryIndex::save_cache()
+  {
+    _dirty = false;
+    if (_cache_file.empty()) return;
+    try {
+      JsonFile jf{_cache_file};
+      auto entries = nlohmann::json::array();
+      for (auto& [k, e] : _entries) entries.push_back(to_json(e));
+      jf.data() = {{"version", cache_version}, {"root", _root.string()}, {"entries", entries}};
+      jf.write(JsonFile::OpenOptions::create);
+    } catch (std::exception& e) {
+      LOGW("Could not write library cache {}: {}", _cache_file, e.what());
+    }
+  }
+
+  // Change notification -----------------------------------------------------
+
+#if defined(__linux__)
+
+  void LibraryIndex::watch(const fs::path& dir)
+  {
+    if (_inotify_fd < 0) return;
+    int wd = ::inotify_add_watch(_inotify_fd, dir.c_str(),
+                                 IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR);
+    if (wd < 0) {
+      LOGW("Could not watch {} for changes", dir);
+      return;
+    }
+    _watches[wd] = dir;
+  }
+
+  bool LibraryIndex::poll_changes(int timeout_ms)
+  {
+    if (_inotify_fd < 0) {
+      std::unique_lock lock(_mutex);
+      _cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                   [this] { return !_should_run || _rescan_requested; });
+      return false;
+    }
+
+    ::pollfd pfd = {_inotify_fd, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) return false;
+
+    bool changed = false;
+    alignas(::inotify_event) char buf[4096];
+    ::ssize_t len;
+    while ((len = ::read(_inotify_fd, buf, sizeof(buf))) > 0) {
+      for (char* ptr = buf; ptr < buf + len;) {
+        auto& ev = *reinterpret_cast<::inotify_event*>(ptr);
+        ptr += sizeof(::inotify_event) + ev.len;
+
+        if (ev.mask & IN_Q_OVERFLOW) {
+          // Events were lost
+          rescan();
+          continue;
+        }
+        auto found = _watches.find(ev.wd);
+        if (found == _watches.end()) continue;
+        if (ev.mask & IN_IGNORED) {
+          _watches.erase(found);
+          continue;
+        }
+        if (ev.mask & IN_DELETE_SELF) {
+          // The kernel drops the watch, and follows up with IN_IGNORED
+          auto dir = found->second;
+          _watches.erase(found);
+          if (dir == _root) {
+            LOGW("Library {} was removed", _root);
+            _entries.clear();
+            // Start over, like on construction
+            std::error_code ec;
+            fs::create_directories(_root, ec);
+            watch(_root);
+          } else {
+            remove_path(dir);
+          }
+          changed = true;
+          continue;
+        }
+        if (ev.len == 0) continue;
+
+        auto path = found->second / ev.name;
+        if (ev.mask & IN_ISDIR) {
+          if (ev.mask & (IN_CREATE | IN_MOVED_TO)) {
+            EntryMap added;
+            scan_dir(path, added, {});
+            _entries.merge(added);
+          } else if (ev.mask & IN_MOVED_FROM) {
+            // The watches below the moved directory now point to stale paths
+            rescan();
+          } else if (ev.mask & IN_DELETE) {
+            remove_path(path);
+          }
+        } else if (ev.mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+          update_file(path);
+        } else if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) {
+          remove_path(path);
+        } else {
+          continue;
+        }
+        changed = true;
+      }
+    }
+    return changed;
+  }
+
+#else
+
+  void LibraryIndex::watch(const fs::path&) {}
+
+  bool LibraryIndex::poll_changes(int timeout_ms)
+  {
+    std::unique_lock lock(_mutex);
+    _cv.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                 [this] { return !_should_run || _rescan_requested; });
+    return false;
+  }
+
+#endif
+
+} // namespace otto::util
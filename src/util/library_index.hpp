@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "util/filesystem.hpp"
+
+namespace otto::util {
+
+  /// A persistent, incrementally updated index of the files in a directory tree
+  ///
+  /// This backs the sample and preset libraries. On construction, a background
+  /// thread scans the tree, reusing the cached metadata of files whose size and
+  /// modification time have not changed since the last run. After that, the
+  /// index is kept up to date through inotify on linux, and by periodic rescans
+  /// on other platforms, so files copied in while OTTO is running show up
+  /// without a restart.
+  ///
+  /// Browsing is served from an immutable in-memory snapshot, and never
+  /// touches the disk.
+  struct LibraryIndex {
+    /// Metadata for one indexed file
+    struct Entry {
+      /// Path relative to @ref LibraryIndex::root
+      fs::path path;
+      /// File size in bytes
+      std::uintmax_t size = 0;
+      /// Last modification time, in seconds since the epoch
+      std::int64_t mtime = 0;
+
+      /// Length in frames. Only set for sound files
+      int length = 0;
+      /// Only set for sound files
+      int samplerate = 0;
+      /// Only set for sound files
+      int channels = 0;
+      /// Peak levels of @ref overview_size evenly spaced sections of the file.
+      ///
+      /// Empty for anything but sound files.
+      std::vector<float> overview;
+
+      bool is_audio() const noexcept
+      {
+        return samplerate > 0;
+      }
+    };
+
+    /// Shared, immutable list of entries, sorted by path
+    using Snapshot = std::shared_ptr<const std::vector<Entry>>;
+
+    /// Number of points in @ref Entry::overview
+    static constexpr int overview_size = 128;
+
+    /// Start indexing `root`
+    ///
+    /// \param extensions Lowercase file extensions to include, like `".wav"`.
+    ///        If empty, all files are included. Hidden files are always skipped.
+    /// \param cache_file Where to persist the index between runs. If empty, the
+    ///        tree is fully rescanned every time.
+    ///
+    /// \effects Creates `root` if it does not exist, and starts the background
+    /// thread. The index is empty until the initial scan is done, see
+    /// @ref wait_ready.
+    LibraryIndex(fs::path root, std::vector<std::string> extensions, fs::path cache_file = {});
+
+    /// Stop the background thread, and write the cache file
+    ~LibraryIndex() noexcept;
+
+    LibraryIndex(const LibraryIndex&) = delete;
+    LibraryIndex& operator=(const LibraryIndex&) = delete;
+
+    /// The indexed directory
+    const fs::path& root() const noexcept
+    {
+      return _root;
+    }
+
+    /// The current entries
+    ///
+    /// The snapshot stays valid for as long as it is held, even if the index
+    /// is updated in the meantime.
+    Snapshot entries() const;
+
+    /// Find an entry by its path relative to @ref root
+    std::optional<Entry> find(const fs::path& path) const;
+
+    /// Incremented every time a new snapshot is published
+    ///
+    /// Cheap to poll from the UI thread to know when to refresh a listing.
+    unsigned generation() const noexcept
+    {
+      return _generation.load(std::memory_order_acquire);
+    }
+
+    /// Block until the initial scan is done
+    void wait_ready() const;
+
+    /// Ask the background thread for a full rescan
+    void rescan();
+
+  private:
+    using EntryMap = std::map<std::string, Entry>;
+
+    void run();
+    void full_scan();
+    void scan_dir(const fs::path& dir, EntryMap& res, const EntryMap& old);
+    bool matches(const fs::path& path) const;
+    std::optional<Entry> index_file(const fs::path& path) const;
+    void update_file(const fs::path& path);
+    void remove_path(const fs::path& path);
+    void publish();
+    void load_cache();
+    void save_cache();
+
+    void watch(const fs::path& dir);
+    bool poll_changes(int timeout_ms);
+
+    const fs::path _root;
+    const std::vector<std::string> _extensions;
+    const fs::path _cache_file;
+
+    /// Owned by the background thread
+    EntryMap _entries;
+    bool _dirty = false;
+
+    Snapshot _snapshot;
+    std::atomic<unsigned> _generation{0};
+
+    mutable std::mutex _mutex;
+    mutable std::condition_variable _cv;
+    bool _ready = false;
+    bool _rescan_requested = false;
+    std::atomic<bool> _should_run{true};
+
+    /// inotify file descriptor, -1 if unavailable
+    int _inotify_fd = -1;
+    /// Watch descriptor to directory
+    std::unordered_map<int, fs::path> _watches;
+
+    std::thread _thread;
+  };
+
+} // namespace otto::util
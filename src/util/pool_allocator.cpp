@@ -0,0 +1,105 @@
+#include "pool_allocator.hpp"
+
+#include <algorithm>
+
+namespace otto::util {
+
+  static std::size_t round_up(std::size_t n, std::size_t multiple) noexcept
+  {
+    return ((n + multiple - 1) / multiple) * multiple;
+  }
+
+  memory_pool::memory_pool(std::size_t block_size, std::size_t block_count)
+    : _block_size(round_up(std::max<std::size_t>(block_size, 1), block_alignment)),
+      _capacity(block_count),
+      _next(std::make_unique<std::atomic<index_type>[]>(block_count)),
+      _head(pack(block_count > 0 ? 0 : null_index, 0))
+  {
+    if (block_count >= null_index) throw std::bad_alloc();
+    _storage = static_cast<std::byte*>(::operator new(_block_size * _capacity));
+    for (std::size_t i = 0; i < _capacity; i++) {
+      _next[i].store(i + 1 < _capacity ? index_type(i + 1) : null_index,
+                     std::memory_order_relaxed);
+    }
+  }
+
+  memory_pool::memory_pool(memory_pool&& rhs) noexcept
+    : _block_size(rhs._block_size),
+      _capacity(rhs._capacity),
+      _storage(rhs._storage),
+      _next(std::move(rhs._next)),
+      _head(rhs._head.load()),
+      _in_use(rhs._in_use.load()),
+      _high_water(rhs._high_water.load()),
+      _failed(rhs._failed.load())
+  {
+    rhs._storage = nullptr;
+    rhs._capacity = 0;
+    rhs._head = pack(null_index, 0);
+  }
+
+  memory_pool::~memory_pool() noexcept
+  {
+    ::operator delete(_storage);
+  }
+
+  void* memory_pool::allocate() noexcept
+  {
+    auto head = _head.load(std::memory_order_acquire);
+    while (true) {
+      auto idx = index_of(head);
+      if (idx == null_index) {
+        _failed.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      auto next = _next[idx].load(std::memory_order_relaxed);
+      if (_head.compare_exchange_weak(head, pack(next, tag_of(head) + 1),
+                                      std::memory_order_acq_rel, std::memory_order_acquire)) {
+        if constexpr (has_stats) {
+          auto in_use = _in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+          auto hw = _high_water.load(std::memory_order_relaxed);
+          while (in_use > hw &&
+                 !_high_water.compare_exchange_weak(hw, in_use, std::memory_order_relaxed))
+            ;
+        }
+        return block(idx);
+      }
+    }
+  }
+
+  void memory_pool::deallocate(void* ptr) noexcept
+  {
+    if (ptr == nullptr) return;
+    auto idx = index_type((static_cast<std::byte*>(ptr) - _storage) / _block_size);
+    auto head = _head.load(std::memory_order_relaxed);
+    do {
+      _next[idx].store(index_of(head), std::memory_order_relaxed);
+    } while (!_head.compare_exchange_weak(head, pack(idx, tag_of(head) + 1),
+                                          std::memory_order_release, std::memory_order_relaxed));
+    if constexpr (has_stats) _in_use.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  bool memory_pool::owns(const void* ptr) const noexcept
+  {
+    auto p = static_cast<const std::byte*>(ptr);
+    return p >= _storage && p < _storage + _block_size * _capacity;
+  }
+
+  auto memory_pool::stats() const noexcept -> Stats
+  {
+    Stats res;
+    res.block_size = _block_size;
+    res.capacity = _capacity;
+    res.in_use = _in_use.load(std::memory_order_relaxed);
+    res.high_water = _high_water.load(std::memory_order_relaxed);
+    res.failed_allocations = _failed.load(std::memory_order_relaxed);
+    return res;
+  }
+
+  void memory_pool::reset_stats() noexcept
+  {
+    _high_water = _in_use.load();
+    _failed = 0;
+  }
+
+} // namespace otto::util
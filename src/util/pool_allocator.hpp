@@ -1,121 +1,223 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <memory>
-
-#include "util/dyn-array.hpp"
+#include <new>
 
 namespace otto::util {
 
-  template<typename T>
+  /// A lock-free pool of fixed-size memory blocks
+  ///
+  /// All memory is allocated when the pool is constructed, after which
+  /// @ref allocate and @ref deallocate never touch the global heap, never lock
+  /// and never block. This makes the pool usable on the audio thread, while
+  /// blocks may still be freed from any other thread (e.g. the UI thread
+  /// releasing an object the audio thread is done with).
+  ///
+  /// The free list is a tagged-index Treiber stack. The tag is bumped on every
+  /// push/pop, which protects against the ABA problem without needing double
+  /// width CAS.
   struct memory_pool {
-    memory_pool(std::size_t size) noexcept
-    {
-      // Allocate uninitialized storage
-      auto [ptr, len] = std::get_temporary_buffer<T>(size);
-      _data = ptr;
-      _size = len;
+    /// Whether @ref Stats::in_use and @ref Stats::high_water are counted
+    ///
+    /// Counting them takes two more atomic operations on every allocation,
+    /// so it is turned on with the CMake option `OTTO_ENABLE_POOL_STATS`.
+#if defined(OTTO_ENABLE_POOL_STATS) && OTTO_ENABLE_POOL_STATS
+    static constexpr bool has_stats = true;
+#else
+    static constexpr bool has_stats = false;
+#endif
+
+    /// Usage statistics, as returned by @ref stats
+    struct Stats {
+      /// Size in bytes of each block
+      std::size_t block_size = 0;
+      /// Total number of blocks in the pool
+      std::size_t capacity = 0;
+      /// Number of blocks currently allocated. 0 without @ref has_stats
+      std::size_t in_use = 0;
+      /// Largest value @ref in_use has had since construction or @ref reset_stats.
+      /// 0 without @ref has_stats
+      std::size_t high_water = 0;
+      /// Number of calls to @ref allocate that failed because the pool was exhausted
+      std::size_t failed_allocations = 0;
     };
 
-    T* data() const noexcept
+    /// Alignment of every block handed out by the pool
+    static constexpr std::size_t block_alignment = alignof(std::max_align_t);
+
+    /// Construct a pool of `block_count` blocks, each at least `block_size` bytes
+    ///
+    /// `block_size` is rounded up to a multiple of @ref block_alignment
+    ///
+    /// \throws `std::bad_alloc` if the storage could not be allocated
+    memory_pool(std::size_t block_size, std::size_t block_count);
+
+    /// Construct a pool suitable for `block_count` objects of type `T`
+    template<typename T>
+    static memory_pool for_type(std::size_t block_count)
     {
-      return _data;
+      static_assert(alignof(T) <= block_alignment, "Over-aligned types are not supported");
+      return memory_pool(sizeof(T), block_count);
     }
 
-    std::size_t size() const noexcept
+    memory_pool(memory_pool&&) noexcept;
+    memory_pool(const memory_pool&) = delete;
+    memory_pool& operator=(const memory_pool&) = delete;
+    memory_pool& operator=(memory_pool&&) = delete;
+
+    ~memory_pool() noexcept;
+
+    /// Get a free block
+    ///
+    /// Lock-free and wait-free in the absence of contention.
+    ///
+    /// \returns `nullptr` if the pool is exhausted. This is deterministic,
+    /// the pool never grows.
+    void* allocate() noexcept;
+
+    /// Return a block to the pool
+    ///
+    /// May be called from any thread.
+    ///
+    /// \requires `ptr` was returned by @ref allocate on this pool, or is `nullptr`
+    void deallocate(void* ptr) noexcept;
+
+    /// Check if `ptr` points into this pool's storage
+    bool owns(const void* ptr) const noexcept;
+
+    /// Size in bytes of each block
+    std::size_t block_size() const noexcept
     {
-      return _size;
+      return _block_size;
     }
 
+    /// Total number of blocks
+    std::size_t capacity() const noexcept
+    {
+      return _capacity;
+    }
+
+    /// Snapshot of the current usage statistics
+    Stats stats() const noexcept;
+
+    /// Reset the high water mark to the current usage, and the failure count to 0
+    void reset_stats() noexcept;
+
   private:
-    T* _data;
-    std::size_t _size;
+    using index_type = std::uint32_t;
+    static constexpr index_type null_index = std::numeric_limits<index_type>::max();
+
+    /// Packed {tag, index} free list head
+    static constexpr std::uint64_t pack(index_type idx, std::uint32_t tag) noexcept
+    {
+      return (std::uint64_t(tag) << 32) | idx;
+    }
+
+    static constexpr index_type index_of(std::uint64_t head) noexcept
+    {
+      return index_type(head & 0xFFFFFFFF);
+    }
+
+    static constexpr std::uint32_t tag_of(std::uint64_t head) noexcept
+    {
+      return std::uint32_t(head >> 32);
+    }
+
+    std::byte* block(index_type idx) const noexcept
+    {
+      return _storage + std::size_t(idx) * _block_size;
+    }
+
+    std::size_t _block_size;
+    std::size_t _capacity;
+    std::byte* _storage = nullptr;
+    std::unique_ptr<std::atomic<index_type>[]> _next;
+    std::atomic<std::uint64_t> _head;
+
+    std::atomic<std::size_t> _in_use{0};
+    std::atomic<std::size_t> _high_water{0};
+    std::atomic<std::size_t> _failed{0};
   };
 
+  /// A `std::allocator` replacement backed by a @ref memory_pool
+  ///
+  /// Every call to `allocate` takes exactly one block from the pool, so this is
+  /// meant for node based containers (`std::list`, `std::map`, `std::set`),
+  /// `std::allocate_shared`, and vectors that are reserved once to a size
+  /// that fits in a single block.
+  ///
+  /// \throws `std::bad_alloc` from `allocate` if the request does not fit in a
+  /// block, or if the pool is exhausted. Both cases are deterministic, no
+  /// fallback to the global heap is ever made.
   template<typename T>
   struct pool_allocator {
-    typedef T value_type;
-    typedef T* pointer;
-    typedef const T* const_pointer;
-    typedef T& reference;
-    typedef const T& const_reference;
-    typedef std::size_t size_type;
-    typedef std::ptrdiff_t difference_type;
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
 
     template<typename U>
     struct rebind {
-      typedef pool_allocator<U> other;
+      using other = pool_allocator<U>;
     };
 
-    // return address of values
-    pointer address(reference value) const
-    {
-      return &value;
-    }
+    pool_allocator(memory_pool& pool) noexcept : _pool(&pool) {}
 
-    const_pointer address(const_reference value) const
-    {
-      return &value;
-    }
-
-    /* constructors and destructor
-     * - nothing to do because the allocator has no state
-     */
-    pool_allocator() noexcept = default;
     pool_allocator(const pool_allocator&) noexcept = default;
+    pool_allocator& operator=(const pool_allocator&) noexcept = default;
 
     template<typename U>
-    pool_allocator(const pool_allocator<U>&) noexcept {};
-
-    ~pool_allocator() noexcept = default;
+    pool_allocator(const pool_allocator<U>& rhs) noexcept : _pool(&rhs.pool())
+    {}
 
-    // return maximum number of elements that can be allocated
+    /// Maximum number of elements that can be allocated at once
     size_type max_size() const noexcept
     {
-      return std::numeric_limits<std::size_t>::max() / sizeof(T);
+      return _pool->block_size() / sizeof(T);
     }
 
-    // allocate but don't initialize num elements of type T
-    pointer allocate(size_type num, const void* = 0)
+    T* allocate(size_type n)
     {
-      pointer ret = (pointer)(::operator new(num * sizeof(T)));
-      return ret;
+      static_assert(alignof(T) <= memory_pool::block_alignment,
+                    "Over-aligned types are not supported");
+      if (n > max_size()) throw std::bad_alloc();
+      void* res = _pool->allocate();
+      if (res == nullptr) throw std::bad_alloc();
+      return static_cast<T*>(res);
     }
 
-    // initialize elements of allocated storage p with value value
-    void construct(pointer p, const T& value)
+    void deallocate(T* p, size_type) noexcept
     {
-      // initialize memory with placement new
-      new ((void*) p) T(value);
+      _pool->deallocate(p);
     }
 
-    // destroy elements of initialized storage p
-    void destroy(pointer p)
+    memory_pool& pool() const noexcept
     {
-      // destroy objects by calling their destructor
-      p->~T();
-    }
-
-    // deallocate storage p of deleted elements
-    void deallocate(pointer p, size_type num)
-    {
-      // print message and deallocate memory with global delete
-      ::operator delete((void*) p);
+      return *_pool;
     }
 
   private:
-    memory_pool<value_type>& _mem_pool;
+    memory_pool* _pool;
   };
 
-  // return that all specializations of this allocator are interchangeable
+  /// Allocators are equal if they share the same pool
   template<class T1, class T2>
-  bool operator==(const pool_allocator<T1>&, const pool_allocator<T2>&) noexcept
+  bool operator==(const pool_allocator<T1>& lhs, const pool_allocator<T2>& rhs) noexcept
   {
-    return true;
+    return &lhs.pool() == &rhs.pool();
   }
+
   template<class T1, class T2>
-  bool operator!=(const pool_allocator<T1>&, const pool_allocator<T2>&) noexcept
+  bool operator!=(const pool_allocator<T1>& lhs, const pool_allocator<T2>& rhs) noexcept
   {
-    return false;
+    return !(lhs == rhs);
   }
 } // namespace otto::util
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/// Portable SIMD vector types
+///
+/// These use the vector extensions supported by both GCC and Clang, so the
+/// same code compiles to SSE/AVX on x86, NEON on ARM, and plain scalar code
+/// where neither is available. Arithmetic and comparison operators work
+/// directly on the vector types, and scalars are broadcast in mixed
+/// expressions (`v * 2.f`).
+///
+/// Code that should work for any width is written as a template on the value
+/// type `V`, which can be `float`, @ref float4, @ref float8 or @ref float16.
+/// The helpers in this namespace work for all of them, so the scalar version
+/// doubles as the fallback for the tail of a buffer.
+///
+/// The wider types work on any target, the compiler splits them into
+/// several registers. Which instructions are used depends on the target
+/// flags, or the `target` attribute of the calling function, see
+/// `util/dsp/kernels.hpp`.
+namespace otto::util::simd {
+
+  /// 4 floats, one SSE or NEON register
+  using float4 = float __attribute__((vector_size(16)));
+  /// 4 ints, used for masks and bit manipulation of @ref float4
+  using int4 = std::int32_t __attribute__((vector_size(16)));
+  /// 8 floats, one AVX register. Two registers on SSE and NEON.
+  using float8 = float __attribute__((vector_size(32)));
+  /// 8 ints, used for masks and bit manipulation of @ref float8
+  using int8 = std::int32_t __attribute__((vector_size(32)));
+  /// 16 floats, one AVX-512 register
+  using float16 = float __attribute__((vector_size(64)));
+  /// 16 ints, used for masks and bit manipulation of @ref float16
+  using int16 = std::int32_t __attribute__((vector_size(64)));
+
+  template<typename V>
+  struct vector_traits;
+
+  template<>
+  struct vector_traits<float> {
+    using int_type = std::int32_t;
+    using mask_type = bool;
+    static constexpr std::size_t size = 1;
+  };
+
+  template<>
+  struct vector_traits<float4> {
+    using int_type = int4;
+    using mask_type = int4;
+    static constexpr std::size_t size = 4;
+  };
+
+  template<>
+  struct vector_traits<float8> {
+    using int_type = int8;
+    using mask_type = int8;
+    static constexpr std::size_t size = 8;
+  };
+
+  template<>
+  struct vector_traits<float16> {
+    using int_type = int16;
+    using mask_type = int16;
+    static constexpr std::size_t size = 16;
+  };
+
+  /// The integer vector with the same number of lanes as `V`
+  template<typename V>
+  using int_t = typename vector_traits<V>::int_type;
+
+  /// The result of comparing two `V`s
+  template<typename V>
+  using mask_t = typename vector_traits<V>::mask_type;
+
+  /// Number of floats in `V`
+  template<typename V>
+  constexpr std::size_t lanes = vector_traits<V>::size;
+
+  /// The widest vector type the target supports natively
+#if defined(__AVX512F__)
+  using native_float = float16;
+#elif defined(__AVX__)
+  using native_float = float8;
+#elif defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+  using native_float = float4;
+#else
+  using native_float = float;
+#endif
+
+  /// A `V` with all lanes set to `f`
+  template<typename V>
+  inline V broadcast(float f) noexcept
+  {
+    if constexpr (lanes<V> == 1) {
+      return f;
+    } else {
+      return V{} + f;
+    }
+  }
+
+  /// Load `lanes<V>` floats from unaligned memory
+  template<typename V>
+  inline V load(const float* ptr) noexcept
+  {
+    V res;
+    std::memcpy(&res, ptr, sizeof(V));
+    return res;
+  }
+
+  /// Store `lanes<V>` floats to unaligned memory
+  template<typename V>
+  inline void store(float* ptr, V v) noexcept
+  {
+    std::memcpy(ptr, &v, sizeof(V));
+  }
+
+  /// Reinterpret the bits of `v`
+  template<typename To, typename From>
+  inline To bit_cast(From v) noexcept
+  {
+    static_assert(sizeof(To) == sizeof(From));
+    To res;
+    std::memcpy(&res, &v, sizeof(To));
+    return res;
+  }
+
+  /// Convert to integers, truncating towards zero
+  template<typename V>
+  inline int_t<V> to_int(V v) noexcept
+  {
+    if constexpr (lanes<V> == 1) {
+      return static_cast<std::int32_t>(v);
+    } else {
+      return __builtin_convertvector(v, int_t<V>);
+    }
+  }
+
+  /// Convert integers to floats
+  inline float to_float(std::int32_t i) noexcept
+  {
+    return static_cast<float>(i);
+  }
+
+  inline float4 to_float(int4 i) noexcept
+  {
+    return __builtin_convertvector(i, float4);
+  }
+
+  inline float8 to_float(int8 i) noexcept
+  {
+    return __builtin_convertvector(i, float8);
+  }
+
+  inline float16 to_float(int16 i) noexcept
+  {
+    return __builtin_convertvector(i, float16);
+  }
+
+  /// Per lane `mask ? a : b`
+  template<typename V>
+  inline V select(mask_t<V> mask, V a, V b) noexcept
+  {
+    if constexpr (lanes<V> == 1) {
+      return mask ? a : b;
+    } else {
+      auto ia = bit_cast<int_t<V>>(a);
+      auto ib = bit_cast<int_t<V>>(b);
+      return bit_cast<V>((ia & mask) | (ib & ~mask));
+    }
+  }
+
+  template<typename V>
+  inline V min(V a, V b) noexcept
+  {
+    return select<V>(a < b, a, b);
+  }
+
+  template<typename V>
+  inline V max(V a, V b) noexcept
+  {
+    return select<V>(a > b, a, b);
+  }
+
+  template<typename V>
+  inline V clamp(V v, float lo, float hi) noexcept
+  {
+    return min<V>(max<V>(v, broadcast<V>(lo)), broadcast<V>(hi));
+  }
+
+  template<typename V>
+  inline V abs(V v) noexcept
+  {
+    return bit_cast<V>(bit_cast<int_t<V>>(v) & 0x7FFFFFFF);
+  }
+
+  /// The sum of the lanes of `v`
+  template<typename V>
+  inline float reduce_add(V v) noexcept
+  {
+    if constexpr (lanes<V> == 1) {
+      return v;
+    } else {
+      float res = 0;
+      for (std::size_t i = 0; i < lanes<V>; i++) res += v[i];
+      return res;
+    }
+  }
+
+  /// The largest lane of `v`
+  template<typename V>
+  inline float reduce_max(V v) noexcept
+  {
+    if constexpr (lanes<V> == 1) {
+      return v;
+    } else {
+      float res = v[0];
+      for (std::size_t i = 1; i < lanes<V>; i++) res = res < v[i] ? v[i] : res;
+      return res;
+    }
+  }
+
+  /// Round towards negative infinity
+  ///
+  /// \requires `|v| < 2^31`
+  template<typename V>
+  inline V floor(V v) noexcept
+  {
+    V t = to_float(to_int(v));
+    return select<V>(t > v, t - 1.f, t);
+  }
+
+  /// Round to the nearest integer, halfway cases up
+  ///
+  /// \requires `|v| < 2^31`
+  template<typename V>
+  inline int_t<V> round_to_int(V v) noexcept
+  {
+    return to_int(floor(v + 0.5f));
+  }
+
+  /// Apply `f` to `n` floats from `in`, writing the results to `out`
+  ///
+  /// Processes `lanes<V>` floats at a time, and the remainder one by one.
+  /// `f` must be callable with both `V` and `float`, like a generic lambda
+  /// calling the functions in @ref util::math. `in` and `out` may be the same.
+  template<typename V = native_float, typename F>
+  inline void transform(const float* in, float* out, std::size_t n, F&& f)
+  {
+    std::size_t tail = n - n % lanes<V>;
+    for (std::size_t i = 0; i < tail; i += lanes<V>) {
+      store<V>(out + i, f(load<V>(in + i)));
+    }
+    for (std::size_t i = tail; i < n; i++) {
+      out[i] = f(in[i]);
+    }
+  }
+
+} // namespace otto::util::simd
@@ -1,4 +1,8 @@
 #include "util/soundfile.hpp"
+
+#include <algorithm>
+#include <future>
+
 #include "services/log_manager.hpp"
 
 namespace otto::util {
@@ -192,4 +196,20 @@ namespace otto::util {
   Position SoundFile::length() {
     return (ByteFile::size() - audioOffset) / sample_size;
   }
+  std::future<std::size_t> SoundFile::read_samples_async(Position p,
+    gsl::span<Sample> out, AsyncIO& io) {
+    if (!async_file) {
+      async_file = std::make_unique<AsyncFile>(path, AsyncFile::Mode::read, false, io);
+    }
+    auto read = io.read(async_file->fd(), audioOffset + p * sample_size,
+      {reinterpret_cast<std::byte*>(out.data()), out.size() * std::ptrdiff_t(sample_size)});
+    return std::async(std::launch::deferred, [out, read = std::move(read)] () mutable {
+        std::size_t n = read.get() / sample_size;
+        auto* raw = reinterpret_cast<bytes<sample_size>*>(out.data());
+        std::transform(raw, raw + n, out.begin(),
+          [] (bytes<sample_size> b) { return b.cast<Sample>(); });
+        std::fill(out.begin() + n, out.end(), Sample{0});
+        return n;
+      });
+  }
 }
@@ -2,6 +2,7 @@
 
 #include <algorithm>
 
+#include "util/async_io.hpp"
 #include "util/bytefile.hpp"
 #include "util/algorithm.hpp"
 #include "util/exception.hpp"
@@ -68,6 +69,21 @@ namespace otto::util {
         is_iterator_v<InIter, Sample, std::input_iterator_tag>>>
       void write_samples(InIter&&, int);
 
+    /// Read `out.size()` samples, starting at sample `p`, without blocking
+    ///
+    /// The samples are read straight from the file on disk, through `io`, so
+    /// call <flush> first if it has been written to. The position used by
+    /// <read_samples> is not affected. `out` must stay valid until the
+    /// future is ready.
+    ///
+    /// Like <read_samples>, samples past the end of the file are set to 0.
+    /// The returned future is deferred: the conversion runs in `get` or
+    /// `wait`, which block until the read is done.
+    ///
+    /// \returns the number of samples read from the file
+    std::future<std::size_t> read_samples_async(Position p,
+      gsl::span<Sample> out, AsyncIO& io = AsyncIO::global());
+
     protected:
 
     /// When extending <SoundFile>, override this function.
@@ -89,6 +105,9 @@ namespace otto::util {
 
     ByteFile::Position audioOffset{0};
 
+    /// Opened on the first call to <read_samples_async>
+    std::unique_ptr<AsyncFile> async_file;
+
     Sample bytes_to_sample(bytes<sample_size> bytes) {
       return bytes.cast<Sample>();
     }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <Gamma/Domain.h>
+
+#include "services/application.hpp"
+#include "services/audio_manager.hpp"
+#include "services/clock_manager.hpp"
+#include "services/engine_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/preset_manager.hpp"
+#include "services/state_manager.hpp"
+#include "services/thread_pool.hpp"
+#include "services/ui_manager.hpp"
+
+namespace otto::test {
+
+  struct NullUIManager final : services::UIManager {
+    void main_ui_loop() override {}
+  };
+
+  struct MemoryStateManager final : services::StateManager {
+    void load() override {}
+    void save() override {}
+    void attach(std::string name, Loader load, Saver save) override
+    {
+      _clients[name] = {name, std::move(load), std::move(save)};
+    }
+    void detach(std::string name) override
+    {
+      _clients.erase(name);
+    }
+  };
+
+  /// Only the services the engines use while they are constructed and
+  /// processing
+  struct TestApplication : services::Application {
+    TestApplication()
+      : Application([] { return std::unique_ptr<services::LogManager>(); },
+                    services::ThreadPool::create_default,
+                    [] { return std::make_unique<MemoryStateManager>(); },
+                    [] { return std::unique_ptr<services::PresetManager>(); },
+                    std::make_unique<services::AudioManager>,
+                    [] { return std::make_unique<NullUIManager>(); },
+                    std::make_unique<services::ClockManager>,
+                    [] { return std::unique_ptr<services::EngineManager>(); })
+    {
+      gam::sampleRate(audio_manager->samplerate());
+    }
+  };
+
+} // namespace otto::test
@@ -0,0 +1,127 @@
+#include "../testing.t.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "engines/seq/euclid/euclid.hpp"
+#include "util/dsp/transport.hpp"
+
+namespace otto::engines {
+
+  namespace {
+    struct Note {
+      std::int64_t time;
+      bool on;
+      int key;
+    };
+
+    /// The notes Euclid plays in the first `frames` samples, processed in
+    /// blocks of `block`, with times from the start
+    std::vector<Note> render(Euclid& euclid, util::dsp::Transport& tr, int frames, int block)
+    {
+      std::vector<Note> res;
+      for (int done = 0; done < frames; done += block) {
+        auto out = euclid.process(audio::ProcessData<0>({}, block), tr.process(block));
+        for (auto& event : out.midi) {
+          util::match(event,
+                      [&](midi::NoteOnEvent& ev) {
+                        res.push_back({done + ev.time, true, ev.key});
+                      },
+                      [&](midi::NoteOffEvent& ev) {
+                        res.push_back({done + ev.time, false, ev.key});
+                      },
+                      [](auto&&) {});
+        }
+      }
+      res.erase(std::remove_if(res.begin(), res.end(), [&](auto& n) { return n.time >= frames; }),
+                res.end());
+      return res;
+    }
+
+    std::vector<std::int64_t> note_ons(const std::vector<Note>& notes, int key)
+    {
+      std::vector<std::int64_t> res;
+      for (auto& n : notes) {
+        if (n.on && n.key == key) res.push_back(n.time);
+      }
+      return res;
+    }
+
+    void set_channel(Euclid::Channel& chan, int length, int hits, int note)
+    {
+      chan.length = length;
+      chan.hits = hits;
+      chan.notes = std::array<int, 6>{{note, -1, -1, -1, -1, -1}};
+      chan.update_notes();
+    }
+  } // namespace
+
+  TEST_CASE("Euclid", "[engines] [euclid]")
+  {
+    SECTION("Steps are exactly spaced at any buffer size")
+    {
+      for (int samplerate : {44100, 48000}) {
+        for (float bpm : {120.f, 137.5f}) {
+          const double step = 60.0 * samplerate / bpm / 4;
+          for (int block : {1, 37, 64, 256, 1000}) {
+            CAPTURE(samplerate);
+            CAPTURE(bpm);
+            CAPTURE(block);
+            Euclid euclid;
+            // Every beat, and a polyrhythm of every third step
+            set_channel(euclid.props.channels[0], 16, 4, 60);
+            set_channel(euclid.props.channels[1], 3, 1, 64);
+            util::dsp::Transport tr(samplerate, bpm);
+            tr.start();
+            auto notes = render(euclid, tr, 4 * samplerate, block);
+
+            auto beats = note_ons(notes, 60);
+            REQUIRE(beats.size() == std::size_t(std::ceil(4 * samplerate / (4 * step))));
+            for (std::size_t i = 0; i < beats.size(); i++) {
+              REQUIRE(beats[i] == std::int64_t(std::floor(i * 4 * step + 1e-6)));
+            }
+            auto thirds = note_ons(notes, 64);
+            REQUIRE(thirds.size() == std::size_t(std::ceil(4 * samplerate / (3 * step))));
+            for (std::size_t i = 0; i < thirds.size(); i++) {
+              REQUIRE(thirds[i] == std::int64_t(std::floor(i * 3 * step + 1e-6)));
+            }
+          }
+        }
+      }
+    }
+
+    SECTION("A step ends the notes of the last one at the same frame")
+    {
+      Euclid euclid;
+      set_channel(euclid.props.channels[0], 4, 4, 60);
+      util::dsp::Transport tr(48000, 120);
+      tr.start(10);
+      auto notes = render(euclid, tr, 24000, 256);
+      // Each step is a NoteOff, then a NoteOn
+      REQUIRE(notes.size() == 8);
+      for (std::size_t i = 0; i < notes.size(); i += 2) {
+        REQUIRE(!notes[i].on);
+        REQUIRE(notes[i + 1].on);
+        REQUIRE(notes[i].time == notes[i + 1].time);
+        REQUIRE(notes[i].time == 10 + std::int64_t(i / 2) * 6000);
+      }
+    }
+
+    SECTION("Stopping ends the notes at the frame it stops on")
+    {
+      Euclid euclid;
+      set_channel(euclid.props.channels[0], 4, 4, 60);
+      util::dsp::Transport tr(48000, 120);
+      tr.start();
+      render(euclid, tr, 1000, 100);
+      tr.stop(42);
+      auto notes = render(euclid, tr, 1000, 100);
+      REQUIRE(notes.size() == 1);
+      REQUIRE(!notes[0].on);
+      REQUIRE(notes[0].time == 42);
+      REQUIRE(!euclid.running);
+    }
+  }
+
+} // namespace otto::engines
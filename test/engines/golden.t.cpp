@@ -0,0 +1,102 @@
+#include "golden.t.hpp"
+
+#include "application.t.hpp"
+
+#include "engines/fx/chorus/chorus.hpp"
+#include "engines/fx/nebula/nebula.hpp"
+#include "engines/fx/pingpong/pingpong.hpp"
+#include "engines/fx/wormhole/wormhole.hpp"
+#include "engines/misc/master/master.hpp"
+#include "engines/synths/OTTOFM/ottofm.hpp"
+#include "engines/synths/goss/goss.hpp"
+#include "engines/synths/hammond/hammond.hpp"
+#include "engines/synths/nuke/nuke.hpp"
+#include "engines/synths/rhodes/rhodes.hpp"
+
+#include "util/dsp/kernels.hpp"
+
+namespace otto::test::golden {
+
+  namespace {
+    struct Case {
+      /// Name of the references
+      std::string name;
+      std::function<Render(int block)> render;
+      Tolerance tolerance;
+    };
+
+    std::vector<Case> cases()
+    {
+      using namespace engines;
+      static const auto script = Script::standard();
+      static const auto input = standard_input();
+      // Loud enough for the limiter, with the right channel late
+      static const Render stereo = [] {
+        Render res = {std::vector<float>(frames), std::vector<float>(frames)};
+        for (int i = 0; i < frames; i++) {
+          res[0][i] = 3 * input[i];
+          res[1][i] = i >= 1000 ? 2 * input[i - 1000] : 0;
+        }
+        return res;
+      }();
+
+      // Engines that only use plain arithmetic and their own tables should
+      // not change at all. Where the order of operations is up to the
+      // compiler or the instruction set, allow for the rounding.
+      return {
+        {"goss", [](int b) { return render_synth<GossSynth>(script, b, {{"leslie", 0.6}}); },
+         Tolerance::exact()},
+        {"nuke",
+         [](int b) { return render_synth<NukeSynth>(script, b, preset("Nuke", "LadyGaga")); },
+         Tolerance::exact()},
+        {"hammond", [](int b) { return render_synth<HammondSynth>(script, b); },
+         Tolerance::exact()},
+        {"ottofm",
+         [](int b) {
+           return render_synth<OTTOFMSynth>(script, b, {{"algN", 5}, {"fmAmount", 0.7}});
+         },
+         Tolerance::db(-110)},
+        {"rhodes", [](int b) { return render_synth<RhodesSynth>(script, b); },
+         Tolerance::db(-110)},
+        {"chorus", [](int b) { return render_effect<Chorus>(input, b); }, Tolerance::db(-110)},
+        {"nebula", [](int b) { return render_effect<Nebula>(input, b); }, Tolerance::db(-110)},
+        {"pingpong", [](int b) { return render_effect<Pingpong>(input, b); }, Tolerance::db(-110)},
+        {"wormhole", [](int b) { return render_effect<Wormhole>(input, b); }, Tolerance::db(-110)},
+        {"master", [](int b) { return render_stereo<Master>(stereo, b); }, Tolerance::db(-120)},
+      };
+    }
+  } // namespace
+
+  TEST_CASE("Engines match their golden renders", "[engines] [golden]")
+  {
+    if (!enabled()) return;
+    TestApplication app;
+    for (auto& c : cases()) {
+      for (int block : block_sizes) {
+        CAPTURE(c.name);
+        CAPTURE(block);
+        check(c.name, block, c.render(block), c.tolerance);
+      }
+    }
+  }
+
+  TEST_CASE("Engines sound the same with the scalar kernels", "[engines] [golden]")
+  {
+    TestApplication app;
+    namespace kernels = util::dsp::kernels;
+    const auto isa = kernels::table().isa;
+    if (isa == kernels::Isa::scalar) return;
+    for (auto& c : cases()) {
+      CAPTURE(c.name);
+      CAPTURE(kernels::name(isa));
+      auto render = c.render(256);
+      kernels::select(kernels::Isa::scalar);
+      auto reference = c.render(256);
+      kernels::select(isa);
+      const float error = error_db(render, reference);
+      INFO("The renders differ by " << error << " dB");
+      REQUIRE(error <= c.tolerance.max_error_db);
+    }
+  }
+
+} // namespace otto::test::golden
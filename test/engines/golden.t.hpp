@@ -0,0 +1,322 @@
+#pragma once
+
+#include "../testing.t.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+#include <json.hpp>
+
+#include "core/engine/engine.hpp"
+#include "services/audio_manager.hpp"
+#include "util/jsonfile.hpp"
+#include "util/soundfile.hpp"
+#include "util/utility.hpp"
+
+/// Golden reference renders of the engines
+///
+/// A null test: an engine is rendered from a fixed MIDI script or input
+/// signal and a fixed preset, at a fixed block size, and the result is
+/// subtracted from a render of the same engine stored in `test/golden`.
+/// What is left must be below the tolerance of the engine, see
+/// @ref Tolerance. An optimization that changes the sound of an engine is
+/// caught this way, even when its own tests still pass.
+///
+/// References are only written when the tests are run with
+/// `OTTO_UPDATE_GOLDEN=1` set, to add a new engine, or to record all of
+/// them again after an intended change of sound. Listen to the new renders,
+/// and commit them. Once `test/golden` exists, a missing reference fails the
+/// test. Until the first references are recorded, the test is skipped with a
+/// warning.
+///
+/// The renders are two channel float WAV files, with mono engines in the
+/// first channel, so they can be opened in any audio editor. They are
+/// recorded on x86-64, where the tests are run. The math library of another
+/// target may round differently, beyond an exact tolerance.
+namespace otto::test::golden {
+
+  using namespace core;
+
+  constexpr int samplerate = 48000;
+  /// The block sizes engines are rendered at
+  constexpr int block_sizes[] = {16, 64, 256};
+  /// The length of every render, about three seconds. A multiple of all of
+  /// @ref block_sizes.
+  constexpr int frames = 576 * 256;
+
+  inline fs::path golden_dir = fs::path(OTTO_TEST_SOURCE_DIR) / "test" / "golden";
+
+  /// How far a render may be from its reference
+  struct Tolerance {
+    /// The highest level of the difference, in dB relative to the level of
+    /// the reference, or to full scale if the reference is silent.
+    float max_error_db;
+
+    /// Every sample must be the same
+    static Tolerance exact() noexcept
+    {
+      return {-std::numeric_limits<float>::infinity()};
+    }
+
+    /// The difference must be at most `max_error_db`
+    static Tolerance db(float max_error_db) noexcept
+    {
+      return {max_error_db};
+    }
+  };
+
+  /// Channels of audio
+  using Render = std::array<std::vector<float>, 2>;
+
+  inline float rms(const std::vector<float>& v)
+  {
+    double sum = 0;
+    for (float f : v) sum += double(f) * f;
+    return v.empty() ? 0 : std::sqrt(sum / v.size());
+  }
+
+  /// The level of `render - reference`, in dB relative to the level of
+  /// `reference`
+  ///
+  /// `-inf` if they are the same, `nan` if either contains a `nan`.
+  inline float error_db(const Render& render, const Render& reference)
+  {
+    float diff = 0;
+    float level = 0;
+    for (int c = 0; c < 2; c++) {
+      std::vector<float> d(render[c].size());
+      for (std::size_t i = 0; i < d.size(); i++) d[i] = render[c][i] - reference[c][i];
+      diff = std::max(diff, rms(d));
+      level = std::max(level, rms(reference[c]));
+    }
+    if (std::isnan(diff)) return diff;
+    return 20 * std::log10(diff / (level > 0 ? level : 1));
+  }
+
+  /// The MIDI to play to a synth, with times from the start
+  struct Script {
+    /// The length of the render
+    int frames;
+    std::vector<std::pair<int, midi::AnyMidiEvent>> events;
+
+    /// Single notes over the range of the keyboard, repeated and
+    /// overlapping notes, a chord, and a second of tails
+    static Script standard()
+    {
+      Script res{frames, {}};
+      auto note = [&](int key, float velocity, double on, double length) {
+        res.events.emplace_back(int(on * samplerate), midi::NoteOnEvent(key, velocity));
+        res.events.emplace_back(int((on + length) * samplerate), midi::NoteOffEvent(key));
+      };
+      int i = 0;
+      for (int key : {36, 48, 60, 72, 84, 96}) {
+        note(key, 0.3f + 0.1f * i, 0.15 * i, 0.1);
+        i++;
+      }
+      // Fast repeats of the same key
+      for (int r = 0; r < 6; r++) note(64, 1, 0.9 + 0.03 * r, 0.02);
+      // Overlapping
+      note(55, 0.8f, 1.1, 0.3);
+      note(57, 0.6f, 1.25, 0.3);
+      // A held chord
+      for (int key : {48, 52, 55, 59}) note(key, 0.7f, 1.5, 0.5);
+      std::stable_sort(res.events.begin(), res.events.end(),
+                       [](auto& a, auto& b) { return a.first < b.first; });
+      return res;
+    }
+  };
+
+  /// The input for effects: plucks of a few tones, and noise bursts, each
+  /// followed by silence for the tail
+  inline std::vector<float> standard_input()
+  {
+    std::vector<float> res(frames, 0.f);
+    // A fixed generator, so the input is the same on every run
+    std::uint32_t seed = 12345;
+    auto noise = [&] {
+      seed = seed * 1664525u + 1013904223u;
+      return float(seed >> 8) / float(1 << 24) * 2 - 1;
+    };
+    int i = 0;
+    for (float freq : {110.f, 440.f, 1760.f, 5000.f}) {
+      int start = i++ * samplerate / 4;
+      for (int j = 0; j < samplerate / 4; j++) {
+        res[start + j] = std::exp(-j / 2000.f) * std::sin(2 * float(M_PI) * freq * j / samplerate);
+      }
+    }
+    for (int j = samplerate; j < samplerate + samplerate / 2; j++) {
+      res[j] = ((j / 2400) % 2 ? 0.5f : 0.05f) * noise();
+    }
+    return res;
+  }
+
+  /// Set the props of `engine` from the props of a preset
+  inline void apply(engine::AnyEngine& engine, const nlohmann::json& props)
+  {
+    if (!props.is_null()) engine.props().as<props::serializable>().from_json(props);
+  }
+
+  /// The props of a preset in `data/presets`
+  inline nlohmann::json preset(const std::string& engine, const std::string& name)
+  {
+    util::JsonFile file{fs::path(OTTO_TEST_SOURCE_DIR) / "data" / "presets" / engine /
+                        (name + ".json")};
+    file.read();
+    return file.data()["props"];
+  }
+
+  /// Copy the channels of `data` to `out`, from frame `at`
+  template<int N>
+  void append(Render& out, int at, audio::ProcessData<N>& data)
+  {
+    auto bufs = data.raw_audio_buffers();
+    for (int c = 0; c < N; c++) {
+      std::copy_n(bufs[c], data.nframes, out[c].begin() + at);
+    }
+  }
+
+  /// Render a synth from `script`, in blocks of `block` frames
+  ///
+  /// The engine is constructed after the buffers are set to the block size,
+  /// so every render starts from the same state.
+  template<typename SynthT>
+  Render render_synth(const Script& script, int block, const nlohmann::json& props = {})
+  {
+    auto& pool = Application::current().audio_manager->buffer_pool();
+    pool.set_buffer_size(block);
+    SynthT engine;
+    apply(engine, props);
+    REQUIRE(script.frames % block == 0);
+    Render res = {std::vector<float>(script.frames), std::vector<float>(script.frames)};
+    auto event = script.events.begin();
+    for (int at = 0; at < script.frames; at += block) {
+      midi::shared_vector<midi::AnyMidiEvent> midi;
+      for (; event != script.events.end() && event->first < at + block; ++event) {
+        auto ev = event->second;
+        util::match(ev, [&](auto& e) { e.time = event->first - at; });
+        midi.push_back(ev);
+      }
+      auto in = pool.allocate_clear();
+      auto out = engine.process({in, std::move(midi), block});
+      append(res, at, out);
+    }
+    return res;
+  }
+
+  /// Render an effect from `input`, in blocks of `block` frames
+  template<typename EffectT>
+  Render render_effect(const std::vector<float>& input, int block, const nlohmann::json& props = {})
+  {
+    auto& pool = Application::current().audio_manager->buffer_pool();
+    pool.set_buffer_size(block);
+    EffectT engine;
+    apply(engine, props);
+    REQUIRE(input.size() % block == 0);
+    Render res = {std::vector<float>(input.size()), std::vector<float>(input.size())};
+    for (int at = 0; at < int(input.size()); at += block) {
+      auto in = pool.allocate();
+      std::copy_n(input.begin() + at, block, in.data());
+      auto out = engine.process(audio::ProcessData<1>(in));
+      append(res, at, out);
+    }
+    return res;
+  }
+
+  /// Render an engine that processes stereo in place, like the master,
+  /// from `input`, in blocks of `block` frames
+  template<typename EngineT>
+  Render render_stereo(const Render& input, int block, const nlohmann::json& props = {})
+  {
+    auto& pool = Application::current().audio_manager->buffer_pool();
+    pool.set_buffer_size(block);
+    EngineT engine;
+    apply(engine, props);
+    const int frames = input[0].size();
+    REQUIRE(frames % block == 0);
+    Render res = {std::vector<float>(frames), std::vector<float>(frames)};
+    for (int at = 0; at < frames; at += block) {
+      auto in = pool.allocate_multi<2>();
+      for (int c = 0; c < 2; c++) std::copy_n(input[c].begin() + at, block, in[c].data());
+      auto out = engine.process(audio::ProcessData<2>(in));
+      append(res, at, out);
+    }
+    return res;
+  }
+
+  /// Whether references are recorded or compared, rather than skipped
+  ///
+  /// Warns if there are no references at all.
+  inline bool enabled()
+  {
+    if (std::getenv("OTTO_UPDATE_GOLDEN") != nullptr || fs::exists(golden_dir)) return true;
+    WARN("Skipped: no golden references in " << golden_dir.string()
+                                             << ". Record them with OTTO_UPDATE_GOLDEN=1 set.");
+    return false;
+  }
+
+  inline fs::path path(const std::string& name, int block)
+  {
+    return golden_dir / fmt::format("{}.{}.wav", name, block);
+  }
+
+  inline void write(const fs::path& p, const Render& render)
+  {
+    fs::create_directories(p.parent_path());
+    if (fs::exists(p)) fs::remove(p);
+    util::SoundFile file;
+    file.open(p);
+    file.info.channels = 2;
+    file.info.samplerate = samplerate;
+    std::vector<float> interleaved(2 * render[0].size());
+    for (std::size_t i = 0; i < render[0].size(); i++) {
+      interleaved[2 * i] = render[0][i];
+      interleaved[2 * i + 1] = render[1][i];
+    }
+    file.write_samples(interleaved.data(), interleaved.size());
+    file.close();
+  }
+
+  inline Render read(const fs::path& p)
+  {
+    util::SoundFile file;
+    file.open(p);
+    std::vector<float> interleaved(file.length());
+    file.read_samples(interleaved.data(), interleaved.size());
+    file.close();
+    Render res = {std::vector<float>(interleaved.size() / 2),
+                  std::vector<float>(interleaved.size() / 2)};
+    for (std::size_t i = 0; i < res[0].size(); i++) {
+      res[0][i] = interleaved[2 * i];
+      res[1][i] = interleaved[2 * i + 1];
+    }
+    return res;
+  }
+
+  /// Compare `render` to the reference `name` at `block`
+  ///
+  /// Records the reference instead if `OTTO_UPDATE_GOLDEN` is set. Fails if
+  /// it does not exist.
+  inline void check(const std::string& name, int block, const Render& render, Tolerance tolerance)
+  {
+    auto p = path(name, block);
+    if (std::getenv("OTTO_UPDATE_GOLDEN") != nullptr) {
+      write(p, render);
+      WARN("Recorded the reference " << p.string());
+      return;
+    }
+    if (!fs::exists(p)) {
+      FAIL("The reference " << p.string()
+                            << " does not exist. Record it with OTTO_UPDATE_GOLDEN=1 set.");
+    }
+    auto reference = read(p);
+    REQUIRE(reference[0].size() == render[0].size());
+    const float error = error_db(render, reference);
+    INFO("The render differs from " << p.string() << " by " << error << " dB");
+    REQUIRE(error <= tolerance.max_error_db);
+  }
+
+} // namespace otto::test::golden
@@ -0,0 +1,71 @@
+#include "../testing.t.hpp"
+
+#include <functional>
+#include <memory>
+
+#include "application.t.hpp"
+
+#include "engines/fx/chorus/chorus.hpp"
+#include "engines/fx/nebula/nebula.hpp"
+#include "engines/fx/pingpong/pingpong.hpp"
+#include "engines/fx/wormhole/wormhole.hpp"
+#include "engines/misc/looper/looper.hpp"
+#include "engines/misc/master/master.hpp"
+#include "engines/misc/tuner/tuner.hpp"
+#include "engines/seq/euclid/euclid.hpp"
+#include "engines/synths/OTTOFM/ottofm.hpp"
+#include "engines/synths/goss/goss.hpp"
+#include "engines/synths/hammond/hammond.hpp"
+#include "engines/synths/nuke/nuke.hpp"
+#include "engines/synths/rhodes/rhodes.hpp"
+
+#include "services/memory.hpp"
+
+namespace otto::engines {
+
+  namespace {
+    namespace memory = services::memory;
+
+    struct Footprint {
+      std::string name;
+      std::size_t size;
+      std::function<std::shared_ptr<void>()> construct;
+    };
+
+    template<typename EngineT>
+    Footprint footprint(std::string name)
+    {
+      return {std::move(name), sizeof(EngineT), [] { return std::make_shared<EngineT>(); }};
+    }
+  } // namespace
+
+  TEST_CASE("The memory of each engine is measured", "[engines] [memory]")
+  {
+    test::TestApplication app;
+    Footprint engines[] = {
+      footprint<HammondSynth>("Woody"),
+      footprint<NukeSynth>("Nuke"),
+      footprint<GossSynth>("Goss"),
+      footprint<RhodesSynth>("Rhodes"),
+      footprint<OTTOFMSynth>("OTTO.FM"),
+      footprint<Chorus>("Chorus"),
+      footprint<Nebula>("Nebula"),
+      footprint<Pingpong>("PingPong"),
+      footprint<Wormhole>("Wormhole"),
+      footprint<Master>("Master"),
+      footprint<Looper>("Looper"),
+      footprint<Tuner>("Tuner"),
+      footprint<Euclid>("Euclid"),
+    };
+
+    if (!memory::enabled) return;
+    for (auto& e : engines) {
+      memory::Measure measure;
+      auto engine = e.construct();
+      CAPTURE(e.name);
+      // The engine itself is allocated while measuring
+      REQUIRE(measure.bytes() >= e.size);
+    }
+  }
+
+} // namespace otto::engines
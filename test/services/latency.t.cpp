@@ -0,0 +1,156 @@
+#include "../testing.t.hpp"
+
+#include <vector>
+
+#include "services/latency.hpp"
+
+namespace otto::services::latency {
+
+  namespace {
+    /// A driver and an engine with deterministic timing
+    ///
+    /// Notes arrive at given frames, and are handed to the engine at the
+    /// start of the next block, like a driver does. The engine sounds for
+    /// `length` frames, `delay` frames after each note. Each block reaches
+    /// the output `output_latency` frames after it is processed.
+    struct Loopback {
+      int samplerate = 48000;
+      int nframes = 64;
+      int delay = 10;
+      int length = 200;
+      std::int64_t output_latency = 128;
+
+      Detector detector;
+
+      std::int64_t ns(std::int64_t frames) const
+      {
+        return frames * 1'000'000'000 / samplerate;
+      }
+
+      /// The latency of a note arriving at `frame`, in ms
+      double expected(std::int64_t frame) const
+      {
+        const auto block_start = (frame + nframes - 1) / nframes * nframes;
+        return (ns(block_start + delay + output_latency) - ns(frame)) / 1e6;
+      }
+
+      void run(std::vector<std::int64_t> arrivals, int blocks)
+      {
+        std::vector<std::int64_t> onsets;
+        std::vector<float> out(nframes);
+        std::size_t next = 0;
+        for (int b = 0; b < blocks; b++) {
+          const std::int64_t start = std::int64_t(b) * nframes;
+          for (; next < arrivals.size() && arrivals[next] <= start; next++) {
+            detector.note(0, ns(arrivals[next]));
+            onsets.push_back(start + delay);
+          }
+          for (int i = 0; i < nframes; i++) {
+            const auto frame = start + i;
+            bool sound = false;
+            for (auto onset : onsets) sound |= frame >= onset && frame < onset + length;
+            out[i] = sound ? 0.5f : 0.f;
+          }
+          detector.block(out.data(), out.data(), nframes, ns(start + output_latency),
+                         samplerate);
+        }
+      }
+    };
+  } // namespace
+
+  TEST_CASE("Note to sound latency", "[services] [latency]")
+  {
+    Loopback loop;
+
+    SECTION("A note is heard its delay after the next block, plus the output latency")
+    {
+      loop.run({0, 1000, 2030}, 100);
+      auto& s = loop.detector.stats();
+      REQUIRE(s.histogram.count == 3);
+      REQUIRE(s.masked == 0);
+      REQUIRE(s.unheard == 0);
+      // The notes wait 0, 24 and 18 frames for their blocks
+      REQUIRE(s.histogram.min_ms == Approx(loop.expected(0)));
+      REQUIRE(s.histogram.max_ms == Approx(loop.expected(1000)));
+      const double mean = (loop.expected(0) + loop.expected(1000) + loop.expected(2030)) / 3;
+      REQUIRE(s.histogram.mean_ms() == Approx(mean));
+    }
+
+    SECTION("Sound that starts in a later block is found")
+    {
+      loop.delay = 300;
+      loop.run({0}, 20);
+      auto& s = loop.detector.stats();
+      REQUIRE(s.histogram.count == 1);
+      REQUIRE(s.histogram.min_ms == Approx(loop.expected(0)));
+    }
+
+    SECTION("Notes that start over sound are masked")
+    {
+      loop.run({0, 64}, 20);
+      auto& s = loop.detector.stats();
+      REQUIRE(s.histogram.count == 1);
+      REQUIRE(s.masked == 1);
+    }
+
+    SECTION("Notes that make no sound are unheard after the timeout")
+    {
+      loop.delay = 1'000'000;
+      const int blocks = int(Detector::timeout * loop.samplerate / loop.nframes) + 2;
+      loop.run({0}, blocks);
+      auto& s = loop.detector.stats();
+      REQUIRE(s.histogram.count == 0);
+      REQUIRE(s.unheard == 1);
+    }
+
+    SECTION("A note takes effect at its frame in the block")
+    {
+      // Sounding before the note, which is not masked by it
+      std::vector<float> out(64, 0.f);
+      for (int i = 0; i < 8; i++) out[i] = 1;
+      for (int i = 20; i < 64; i++) out[i] = 1;
+      loop.detector.note(16, 0);
+      loop.detector.block(out.data(), out.data(), 64, 0, 64000);
+      auto& s = loop.detector.stats();
+      REQUIRE(s.masked == 0);
+      REQUIRE(s.histogram.count == 1);
+      // 20 frames at 64 kHz
+      REQUIRE(s.histogram.min_ms == Approx(0.3125));
+    }
+  }
+
+  TEST_CASE("Latency histogram", "[services] [latency]")
+  {
+    Histogram h;
+    REQUIRE(h.quantile_ms(0.5) == 0);
+    for (int i = 0; i < 90; i++) h.add(4.5);
+    for (int i = 0; i < 10; i++) h.add(20.2);
+    h.add(1000);
+    REQUIRE(h.count == 101);
+    REQUIRE(h.buckets[4] == 90);
+    REQUIRE(h.buckets[20] == 10);
+    REQUIRE(h.buckets[Histogram::bucket_count - 1] == 1);
+    REQUIRE(h.quantile_ms(0.5) == 5);
+    REQUIRE(h.quantile_ms(0.95) == 21);
+    REQUIRE(h.quantile_ms(1) == 1000);
+    REQUIRE(h.min_ms == Approx(4.5));
+    REQUIRE(h.max_ms == 1000);
+  }
+
+  TEST_CASE("Arrival stamps", "[services] [latency]")
+  {
+    const auto before = now();
+    REQUIRE(stamp() >= before);
+    {
+      Arrival outer(10);
+      REQUIRE(stamp() == 10);
+      {
+        Arrival inner(20);
+        REQUIRE(stamp() == 20);
+      }
+      REQUIRE(stamp() == 10);
+    }
+    REQUIRE(stamp() >= before);
+  }
+
+} // namespace otto::services::latency
@@ -0,0 +1,105 @@
+#include "../testing.t.hpp"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "services/memory.hpp"
+
+namespace otto::services::memory {
+
+  TEST_CASE("Memory accounting", "[services] [memory]")
+  {
+    if (!enabled) return;
+    auto& acc = account("Test account");
+    const auto heap = acc.bytes(Kind::heap);
+    const auto assets = acc.bytes(Kind::assets);
+    const auto charges = acc.charges();
+
+    SECTION("A charge is counted until it is destroyed")
+    {
+      {
+        Charge charge(acc, Kind::assets, 1000);
+        REQUIRE(acc.bytes(Kind::assets) == assets + 1000);
+        REQUIRE(acc.bytes(Kind::heap) == heap);
+        REQUIRE(acc.charges() == charges + 1);
+        REQUIRE(acc.peak() >= acc.total());
+      }
+      REQUIRE(acc.bytes(Kind::assets) == assets);
+      REQUIRE(acc.charges() == charges);
+    }
+
+    SECTION("A charge of 0 bytes is added and removed")
+    {
+      {
+        Charge charge(acc, Kind::heap, 0);
+        REQUIRE(acc.charges() == charges + 1);
+      }
+      REQUIRE(acc.charges() == charges);
+      REQUIRE(acc.bytes(Kind::heap) == heap);
+    }
+
+    SECTION("Charges are found by the name of the account")
+    {
+      Charge charge("Test account", Kind::assets, 100);
+      REQUIRE(acc.bytes(Kind::assets) == assets + 100);
+    }
+
+    SECTION("Moved charges are only removed once")
+    {
+      Charge a(acc, Kind::assets, 100);
+      Charge b = std::move(a);
+      a = Charge();
+      REQUIRE(acc.bytes(Kind::assets) == assets + 100);
+      b = Charge(acc, Kind::assets, 50);
+      REQUIRE(acc.bytes(Kind::assets) == assets + 50);
+      b.release();
+      REQUIRE(acc.bytes(Kind::assets) == assets);
+      b.release();
+      REQUIRE(acc.bytes(Kind::assets) == assets);
+    }
+
+    SECTION("Charges can be released on another thread")
+    {
+      auto charge = std::make_unique<Charge>(acc, Kind::assets, 4096);
+      std::thread([c = std::move(charge)] {}).join();
+      REQUIRE(acc.bytes(Kind::assets) == assets);
+    }
+
+    SECTION("Measure counts how much the heap grows")
+    {
+      Measure measure;
+      auto v = std::vector<char>(100000);
+      REQUIRE(measure.bytes() >= 100000);
+      v = {};
+      v.shrink_to_fit();
+      REQUIRE(measure.bytes() < 100000);
+    }
+
+    SECTION("Measure leaves out what is charged in the meantime")
+    {
+      Measure measure;
+      auto v = std::vector<char>(100000);
+      Charge charge(acc, Kind::assets, v.size());
+      REQUIRE(measure.bytes() < 100000);
+    }
+
+    SECTION("Accounted charges what an object allocates while it is constructed")
+    {
+      struct Big {
+        std::vector<int> v = std::vector<int>(100000);
+      };
+      {
+        auto b = std::make_unique<Accounted<Big>>("Test account");
+        REQUIRE(acc.bytes(Kind::heap) >= heap + 100000 * sizeof(int));
+      }
+      REQUIRE(acc.bytes(Kind::heap) == heap);
+    }
+
+    SECTION("Accounts are listed in the report")
+    {
+      REQUIRE(report().find("Test account") != std::string::npos);
+    }
+  }
+
+} // namespace otto::services::memory
@@ -0,0 +1,78 @@
+#include "../testing.t.hpp"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "services/metrics.hpp"
+
+namespace otto::services::metrics {
+
+  TEST_CASE("Metrics segment", "[services] [metrics]")
+  {
+    auto segment = std::make_unique<Segment>();
+    segment->magic = magic;
+    segment->version = version;
+    segment->size = sizeof(Segment);
+
+    SECTION("A written snapshot is read back")
+    {
+      Snapshot in = {};
+      in.callbacks = 1234;
+      in.xruns = 2;
+      in.cpu_load = 0.25f;
+      in.engines[1].load = 0.125f;
+      in.accounts[3].bytes = 4096;
+      write(*segment, in);
+      Snapshot out;
+      REQUIRE(read(*segment, out));
+      REQUIRE(out.callbacks == 1234);
+      REQUIRE(out.xruns == 2);
+      REQUIRE(out.cpu_load == 0.25f);
+      REQUIRE(out.engines[1].load == 0.125f);
+      REQUIRE(out.accounts[3].bytes == 4096);
+      REQUIRE(segment->sequence.load() % 2 == 0);
+    }
+
+    SECTION("A read during a write is retried")
+    {
+      segment->sequence.store(1);
+      Snapshot out;
+      REQUIRE_FALSE(read(*segment, out, 10));
+    }
+
+    SECTION("Readers never see a torn snapshot")
+    {
+      std::atomic<bool> done = false;
+      std::thread writer([&] {
+        Snapshot s = {};
+        for (std::uint64_t i = 1; i <= 20000; i++) {
+          s.callbacks = s.xruns = s.ui_frames = i;
+          write(*segment, s);
+        }
+        done = true;
+      });
+      int reads = 0;
+      while (!done) {
+        Snapshot s;
+        if (!read(*segment, s)) continue;
+        REQUIRE(s.callbacks == s.xruns);
+        REQUIRE(s.callbacks == s.ui_frames);
+        reads++;
+      }
+      writer.join();
+      REQUIRE(reads > 0);
+    }
+
+    SECTION("Only segments with the same layout are compatible")
+    {
+      REQUIRE(compatible(*segment));
+      segment->version = version + 1;
+      REQUIRE_FALSE(compatible(*segment));
+      segment->version = version;
+      segment->size = 0;
+      REQUIRE_FALSE(compatible(*segment));
+    }
+  }
+
+} // namespace otto::services::metrics
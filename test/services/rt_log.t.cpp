@@ -0,0 +1,131 @@
+#include "../testing.t.hpp"
+
+#include <thread>
+#include <vector>
+
+#include "services/log_manager.hpp"
+
+using namespace otto;
+using namespace otto::services;
+
+namespace {
+  constexpr rt_log::Site site_a = {loguru::Verbosity_INFO, __FILE__, __LINE__, "a: {} {}"};
+  constexpr rt_log::Site site_b = {loguru::Verbosity_INFO, __FILE__, __LINE__, "b: {} {} {}"};
+  constexpr rt_log::Site site_c = {loguru::Verbosity_INFO, __FILE__, __LINE__, "{} {}"};
+
+  struct Message {
+    const rt_log::Site* site;
+    std::string text;
+  };
+} // namespace
+
+TEST_CASE("Realtime logger", "[services] [rt_log]")
+{
+  auto logger = std::make_unique<rt_log::Logger>();
+  std::vector<Message> messages;
+  auto sink = [&](const rt_log::Site& site, std::string text) {
+    messages.push_back({&site, std::move(text)});
+  };
+
+  SECTION("Records are formatted in order by the consumer")
+  {
+    REQUIRE(logger->push(site_a, site_a.format, 1, 2.5f));
+    REQUIRE(logger->push(site_b, site_b.format, "static", 'x', -3ll));
+    REQUIRE(logger->drain(sink) == 2);
+    REQUIRE(messages.size() == 2);
+    REQUIRE(messages[0].site == &site_a);
+    REQUIRE(messages[0].text == "a: 1 2.5");
+    REQUIRE(messages[1].site == &site_b);
+    REQUIRE(messages[1].text == "b: static x -3");
+    REQUIRE(logger->drain(sink) == 0);
+  }
+
+  SECTION("Messages are dropped and counted when the ring is full")
+  {
+    for (std::size_t i = 0; i < rt_log::Logger::capacity; i++) {
+      REQUIRE(logger->push(site_c, site_c.format, int(i), 0));
+    }
+    REQUIRE_FALSE(logger->push(site_c, site_c.format, -1, 0));
+    REQUIRE_FALSE(logger->push(site_c, site_c.format, -1, 0));
+    REQUIRE(logger->dropped() == 2);
+
+    REQUIRE(logger->drain(sink) == rt_log::Logger::capacity);
+    REQUIRE(messages.back().text == fmt::format("{} 0", rt_log::Logger::capacity - 1));
+
+    // Space is available again
+    REQUIRE(logger->push(site_c, site_c.format, 1, 2));
+  }
+
+  SECTION("The macros push to the global logger, with the call site")
+  {
+    rt_log::logger().drain(sink);
+    messages.clear();
+    int line = __LINE__ + 1;
+    RT_LOGI("From macro: {}", 42);
+    REQUIRE(rt_log::logger().drain(sink) == 1);
+    REQUIRE(messages[0].text == "From macro: 42");
+    REQUIRE(messages[0].site->line == unsigned(line));
+    REQUIRE(messages[0].site->verbosity == loguru::Verbosity_INFO);
+  }
+
+  SECTION("Multiple producers")
+  {
+    constexpr int threads = 4;
+    constexpr int per_thread = 10000;
+    std::vector<std::thread> producers;
+    std::atomic<bool> done = false;
+    std::vector<int> last_seen(threads, -1);
+    bool in_order = true;
+    std::size_t received = 0;
+
+    for (int t = 0; t < threads; t++) {
+      producers.emplace_back([&, t] {
+        for (int i = 0; i < per_thread; i++) {
+          while (!logger->push(site_c, site_c.format, t, i)) std::this_thread::yield();
+        }
+      });
+    }
+    std::thread consumer([&] {
+      auto check = [&](const rt_log::Site&, std::string text) {
+        int t, i;
+        std::sscanf(text.c_str(), "%d %d", &t, &i);
+        in_order = in_order && i > last_seen[t];
+        last_seen[t] = i;
+        received++;
+      };
+      while (!done) logger->drain(check);
+      logger->drain(check);
+    });
+    for (auto& p : producers) p.join();
+    done = true;
+    consumer.join();
+
+    REQUIRE(in_order);
+    REQUIRE(received == threads * per_thread);
+  }
+}
+
+TEST_CASE("Realtime logger benchmark", "[services] [rt_log] [benchmark]")
+{
+  auto logger = std::make_unique<rt_log::Logger>();
+  // Log to a file instead of the terminal, like on the device
+  auto stderr_verbosity = loguru::g_stderr_verbosity;
+  loguru::g_stderr_verbosity = loguru::Verbosity_OFF;
+  auto log_file = (test::dir / "rt_log_benchmark.txt").string();
+  loguru::add_file(log_file.c_str(), loguru::Truncate, loguru::Verbosity_MAX);
+
+  OBENCH_SECTION ("Call latency, rt_log vs loguru") {
+    OBENCH ("rt_log", 1000) {
+      logger->push(site_a, site_a.format, 42, 3.14f);
+      OBENCH_SKIP {
+        logger->drain([](auto&&...) {});
+      }
+    }
+    OBENCH ("loguru", 1000) {
+      LOGI("a: {} {}", 42, 3.14f);
+    }
+  }
+
+  loguru::remove_callback(log_file.c_str());
+  loguru::g_stderr_verbosity = stderr_verbosity;
+}
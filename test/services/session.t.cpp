@@ -0,0 +1,123 @@
+#include "../testing.t.hpp"
+
+#include <fstream>
+#include <iterator>
+
+#include "services/session.hpp"
+
+namespace otto::services::session {
+
+  using namespace core::midi;
+
+  TEST_CASE("Session log", "[services] [session]")
+  {
+    fs::path path = test::dir / "test.session";
+
+    Header header{44100, 256, {{"Engines", {{"Synth", "OTTO.FM"}}}}};
+
+    SECTION("Every input is read back at its frame")
+    {
+      {
+        Writer writer(path, header);
+        writer.write({0, KeyPress{core::ui::Key::synth}});
+        writer.write({0, KeyRelease{core::ui::Key::synth}});
+        writer.write({300, core::ui::RotaryEvent{core::ui::Rotary::red, -3}});
+        writer.write({300, Midi::from(NoteOnEvent(64, 0.5f))});
+        writer.write({1u << 20, Preset{"OTTO.FM", "Bell"}});
+        writer.write({(1u << 20) + 1, End{}});
+      }
+      Reader reader(path);
+      REQUIRE(reader.header().samplerate == 44100);
+      REQUIRE(reader.header().buffer_size == 256);
+      REQUIRE(reader.header().state == header.state);
+
+      auto r = reader.next();
+      REQUIRE(r);
+      REQUIRE(r->frame == 0);
+      REQUIRE(mpark::get<KeyPress>(r->input).key == core::ui::Key::synth);
+      r = reader.next();
+      REQUIRE(r);
+      REQUIRE(mpark::get<KeyRelease>(r->input).key == core::ui::Key::synth);
+      r = reader.next();
+      REQUIRE(r);
+      REQUIRE(r->frame == 300);
+      auto rotary = mpark::get<core::ui::RotaryEvent>(r->input);
+      REQUIRE(rotary.rotary == core::ui::Rotary::red);
+      REQUIRE(rotary.clicks == -3);
+      r = reader.next();
+      REQUIRE(r);
+      REQUIRE(r->frame == 300);
+      auto note = mpark::get<NoteOnEvent>(mpark::get<Midi>(r->input).event());
+      REQUIRE(note.key == 64);
+      REQUIRE(note.velocity == 63);
+      r = reader.next();
+      REQUIRE(r);
+      REQUIRE(r->frame == 1u << 20);
+      REQUIRE(mpark::get<Preset>(r->input).engine == "OTTO.FM");
+      REQUIRE(mpark::get<Preset>(r->input).name == "Bell");
+      r = reader.next();
+      REQUIRE(r);
+      REQUIRE(r->frame == (1u << 20) + 1);
+      REQUIRE(mpark::holds_alternative<End>(r->input));
+      REQUIRE_FALSE(reader.next());
+    }
+
+    SECTION("The log is complete after an End record, while it is still open")
+    {
+      Writer writer(path, header);
+      for (int i = 0; i < 100; i++) writer.write({std::uint64_t(i), Midi::from(NoteOnEvent(i))});
+      writer.write({100, End{}});
+      Reader reader(path);
+      int count = 0;
+      while (auto r = reader.next()) count++;
+      REQUIRE(count == 101);
+    }
+
+    SECTION("Midi events keep their type")
+    {
+      ControlChangeEvent in = MidiEvent{MidiEvent::Type::ControlChange, 2};
+      in.controler = 7;
+      in.value = 99;
+      auto cc = mpark::get<ControlChangeEvent>(Midi::from(in).event());
+      REQUIRE(cc.channel == 2);
+      REQUIRE(cc.controler == 7);
+      REQUIRE(cc.value == 99);
+      auto off = mpark::get<NoteOffEvent>(Midi::from(NoteOffEvent(60)).event());
+      REQUIRE(off.key == 60);
+      auto clock = Midi::from(RealtimeEvent{RealtimeEvent::Type::Clock});
+      auto rt = mpark::get<RealtimeEvent>(clock.event());
+      REQUIRE(rt.type == RealtimeEvent::Type::Clock);
+    }
+
+    SECTION("Other files are not read")
+    {
+      {
+        std::ofstream out(path.c_str());
+        out << "Not a session";
+      }
+      REQUIRE_THROWS_AS(Reader(path), util::exception);
+    }
+
+    SECTION("A truncated record is an error")
+    {
+      {
+        Writer writer(path, header);
+        writer.write({10, Preset{"OTTO.FM", "Bell"}});
+      }
+      std::string bytes;
+      {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+      }
+      {
+        std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size() - 2);
+      }
+      Reader reader(path);
+      REQUIRE_THROWS_AS(reader.next(), util::exception);
+    }
+
+    fs::remove(path);
+  }
+
+} // namespace otto::services::session
@@ -0,0 +1,191 @@
+#include "../testing.t.hpp"
+
+#include <mutex>
+#include <set>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+#include "services/thread_pool.hpp"
+
+using namespace otto;
+using namespace otto::services;
+using namespace std::chrono_literals;
+
+namespace {
+  /// Blocks the task it is run in until `open` is called
+  struct Gate {
+    void wait()
+    {
+      std::unique_lock lock(mutex);
+      cv.wait(lock, [&] { return is_open; });
+    }
+
+    void open()
+    {
+      std::unique_lock lock(mutex);
+      is_open = true;
+      cv.notify_all();
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool is_open = false;
+  };
+} // namespace
+
+TEST_CASE("Thread pool", "[services] [thread_pool]")
+{
+  SECTION("All tasks are run")
+  {
+    ThreadPool pool({4});
+    REQUIRE(pool.thread_count() == 4);
+    std::atomic<int> count = 0;
+    std::vector<ThreadPool::Task> tasks;
+    for (int i = 0; i < 1000; i++) {
+      tasks.push_back(pool.submit([&] { count++; }));
+    }
+    for (auto& t : tasks) t.wait();
+    REQUIRE(count == 1000);
+    REQUIRE(tasks.back().state() == ThreadPool::Task::State::done);
+  }
+
+  SECTION("Higher priority tasks are started first")
+  {
+    ThreadPool pool({1});
+    Gate gate;
+    std::vector<int> order;
+    pool.submit([&] { gate.wait(); });
+    pool.submit([&] { order.push_back(3); }, ThreadPool::Priority::low);
+    pool.submit([&] { order.push_back(2); }, ThreadPool::Priority::normal);
+    auto last = pool.submit([&] { order.push_back(1); }, ThreadPool::Priority::high);
+    auto low = pool.submit([&] { order.push_back(4); }, ThreadPool::Priority::low);
+    gate.open();
+    low.wait();
+    last.wait();
+    REQUIRE(order == std::vector{1, 2, 3, 4});
+  }
+
+  SECTION("Queued tasks can be cancelled")
+  {
+    ThreadPool pool({1});
+    Gate gate;
+    bool ran = false;
+    auto blocker = pool.submit([&] { gate.wait(); });
+    auto task = pool.submit([&] { ran = true; });
+    REQUIRE(task.cancel());
+    REQUIRE(task.state() == ThreadPool::Task::State::cancelled);
+    task.wait();
+    gate.open();
+    blocker.wait();
+    pool.submit([] {}).wait();
+    REQUIRE_FALSE(ran);
+  }
+
+  SECTION("Running tasks are asked to stop")
+  {
+    ThreadPool pool({1});
+    std::atomic<bool> started = false;
+    REQUIRE_FALSE(ThreadPool::cancelled());
+    auto task = pool.submit([&] {
+      started = true;
+      while (!ThreadPool::cancelled()) std::this_thread::sleep_for(1ms);
+    });
+    while (!started) std::this_thread::yield();
+    REQUIRE(task.state() == ThreadPool::Task::State::running);
+    REQUIRE_FALSE(task.cancel());
+    REQUIRE(task.cancel_requested());
+    task.wait();
+    REQUIRE(task.state() == ThreadPool::Task::State::done);
+  }
+
+  SECTION("Tasks are timed")
+  {
+    ThreadPool pool({1});
+    auto first = pool.submit([] { std::this_thread::sleep_for(20ms); });
+    auto second = pool.submit([] { std::this_thread::sleep_for(10ms); });
+    second.wait();
+    REQUIRE(first.run_time() >= 20ms);
+    REQUIRE(second.run_time() >= 10ms);
+    REQUIRE(second.run_time() < first.run_time());
+    REQUIRE(second.wait_time() >= first.run_time());
+  }
+
+  SECTION("Work spawned by a task is stolen by idle workers")
+  {
+    ThreadPool pool({4});
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    pool
+      .submit([&] {
+        std::vector<ThreadPool::Task> children;
+        for (int i = 0; i < 16; i++) {
+          children.push_back(pool.submit([&] {
+            std::this_thread::sleep_for(5ms);
+            std::unique_lock lock(mutex);
+            threads.insert(std::this_thread::get_id());
+          }));
+        }
+        for (auto& c : children) c.wait();
+      })
+      .wait();
+    REQUIRE(threads.size() > 1);
+  }
+
+  SECTION("Waiting for the pool to be idle includes spawned tasks")
+  {
+    ThreadPool pool({2});
+    std::atomic<int> count = 0;
+    for (int i = 0; i < 8; i++) {
+      pool.submit([&] {
+        std::this_thread::sleep_for(1ms);
+        pool.submit([&] {
+          std::this_thread::sleep_for(1ms);
+          count++;
+        });
+        count++;
+      });
+    }
+    pool.wait_idle();
+    REQUIRE(count == 16);
+    // Returns at once when there is nothing to do
+    pool.wait_idle();
+  }
+
+  SECTION("Exceptions in tasks are caught")
+  {
+    ThreadPool pool({1});
+    auto task = pool.submit([] { throw std::runtime_error("Expected exception"); });
+    task.wait();
+    REQUIRE(task.state() == ThreadPool::Task::State::done);
+    int res = 0;
+    pool.submit([&] { res = 1; }).wait();
+    REQUIRE(res == 1);
+  }
+
+#if defined(__linux__)
+  SECTION("Workers can be pinned to CPUs")
+  {
+    ThreadPool pool({2, {0}});
+    std::atomic<int> cpu = -1;
+    pool.submit([&] { cpu = sched_getcpu(); }).wait();
+    REQUIRE(cpu == 0);
+  }
+#endif
+
+  SECTION("Destroying the pool cancels queued tasks")
+  {
+    Gate gate;
+    ThreadPool::Task task;
+    {
+      ThreadPool pool({1});
+      pool.submit([&] { gate.wait(); });
+      task = pool.submit([] {});
+      gate.open();
+    }
+    task.wait();
+    REQUIRE(task.state() != ThreadPool::Task::State::queued);
+  }
+}
@@ -0,0 +1,208 @@
+#include "../testing.t.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "util/async_io.hpp"
+#include "util/soundfile.hpp"
+
+namespace otto::util {
+
+  namespace {
+    std::vector<std::byte> random_bytes(std::size_t n)
+    {
+      std::vector<std::byte> res(n);
+      for (auto& b : res) b = std::byte(Random::get(0, 255));
+      return res;
+    }
+
+    const char* name(AsyncIO::Backend b)
+    {
+      return b == AsyncIO::Backend::io_uring ? "io_uring" : "threads";
+    }
+
+    /// One instance of each backend that is available
+    std::vector<std::unique_ptr<AsyncIO>> backends()
+    {
+      std::vector<std::unique_ptr<AsyncIO>> res;
+      auto uring = std::make_unique<AsyncIO>(AsyncIO::Options{64, true});
+      if (uring->backend() == AsyncIO::Backend::io_uring) res.push_back(std::move(uring));
+      res.push_back(std::make_unique<AsyncIO>(AsyncIO::Options{64, false}));
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE("Asynchronous file I/O", "[util] [async_io]")
+  {
+    fs::create_directories(test::dir);
+    auto path = test::dir / "async_io.bin";
+
+    for (auto& io : backends()) {
+      SECTION(fmt::format("{}: Written data can be read back", name(io->backend())))
+      {
+        auto data = random_bytes(100000);
+        {
+          AsyncFile file(path, AsyncFile::Mode::write, false, *io);
+          auto written = file.write(0, data);
+          REQUIRE(written.get() == data.size());
+          file.fsync().get();
+          REQUIRE(file.size() == data.size());
+        }
+        AsyncFile file(path, AsyncFile::Mode::read, false, *io);
+        std::vector<std::byte> res(data.size());
+        REQUIRE(file.read(0, res).get() == data.size());
+        REQUIRE(res == data);
+
+        // Reads are short at the end of the file
+        REQUIRE(file.read(data.size() - 10, res).get() == 10);
+        REQUIRE(std::memcmp(res.data(), data.data() + data.size() - 10, 10) == 0);
+        REQUIRE(file.read(data.size(), res).get() == 0);
+      }
+
+      SECTION(fmt::format("{}: Batches complete all their operations", name(io->backend())))
+      {
+        auto data = random_bytes(256 * 1024);
+        {
+          AsyncFile file(path, AsyncFile::Mode::write, false, *io);
+          file.write(0, data).get();
+        }
+        AsyncFile file(path, AsyncFile::Mode::read, false, *io);
+        // More than the queue depth, so the batch has to wait for room
+        constexpr std::size_t chunk = 1024;
+        std::vector<std::byte> res(data.size());
+        std::vector<std::future<std::size_t>> futures;
+        {
+          auto batch = io->batch();
+          for (std::size_t i = 0; i < data.size(); i += chunk) {
+            futures.push_back(batch.read(file.fd(), i, {res.data() + i, chunk}));
+          }
+        }
+        for (auto& f : futures) REQUIRE(f.get() == chunk);
+        REQUIRE(res == data);
+      }
+
+      SECTION(fmt::format("{}: Errors are reported through the futures", name(io->backend())))
+      {
+        std::vector<std::byte> buf(16);
+        auto f = io->read(-1, 0, buf);
+        REQUIRE_THROWS_AS(f.get(), std::system_error);
+        auto s = io->fsync(-1);
+        REQUIRE_THROWS_AS(s.get(), std::system_error);
+      }
+
+      SECTION(fmt::format("{}: Aligned reads into preallocated buffers", name(io->backend())))
+      {
+        auto data = random_bytes(3 * AlignedBuffer::alignment);
+        {
+          AsyncFile file(path, AsyncFile::Mode::write, false, *io);
+          file.write(0, data).get();
+          file.fsync().get();
+        }
+        AsyncFile file(path, AsyncFile::Mode::read, true, *io);
+        AlignedBuffer buf(2 * AlignedBuffer::alignment);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(buf.data()) % AlignedBuffer::alignment == 0);
+        REQUIRE(file.read(AlignedBuffer::alignment, buf).get() == buf.size());
+        REQUIRE(std::memcmp(buf.data(), data.data() + AlignedBuffer::alignment, buf.size()) == 0);
+      }
+
+      SECTION(fmt::format("{}: Sound files can be read asynchronously", name(io->backend())))
+      {
+        auto wav = test::dir / "async_io.wav";
+        fs::remove(wav);
+        std::vector<float> audio(4096);
+        for (auto& s : audio) s = Random::get(-1.f, 1.f);
+        {
+          SoundFile file;
+          file.open(wav);
+          file.write_samples(audio.begin(), audio.end());
+          file.close();
+        }
+        SoundFile file;
+        file.open(wav);
+        std::vector<float> res(1000);
+        auto f = file.read_samples_async(1000, res, *io);
+        REQUIRE(f.get() == res.size());
+        REQUIRE(std::equal(res.begin(), res.end(), audio.begin() + 1000));
+        REQUIRE(file.position() == 0);
+
+        std::fill(res.begin(), res.end(), 1.f);
+        REQUIRE(file.read_samples_async(3596, res, *io).get() == 500);
+        REQUIRE(std::equal(res.begin(), res.begin() + 500, audio.begin() + 3596));
+        REQUIRE(std::all_of(res.begin() + 500, res.end(), [](float s) { return s == 0; }));
+      }
+    }
+
+    fs::remove(path);
+  }
+
+  TEST_CASE("Asynchronous file I/O benchmark", "[util] [async_io] [benchmark]")
+  {
+    using clock = std::chrono::steady_clock;
+    constexpr std::size_t file_size = 64 << 20;
+    constexpr std::size_t block = 4096;
+    constexpr std::size_t random_reads = 8192;
+    constexpr std::size_t depth = 32;
+
+    std::vector<fs::path> dirs = {test::dir};
+    if (fs::exists("/dev/shm")) dirs.push_back("/dev/shm");
+    fs::create_directories(test::dir);
+
+    auto data = random_bytes(1 << 20);
+    for (auto& dir : dirs) {
+      auto path = dir / "otto_async_io_bench.bin";
+      {
+        AsyncFile file(path, AsyncFile::Mode::write);
+        for (std::size_t i = 0; i < file_size; i += data.size()) file.write(i, data).get();
+        file.fsync().get();
+      }
+
+      for (auto& io : backends()) {
+        AsyncFile file(path, AsyncFile::Mode::read, true, *io);
+
+        // Sequential 1 MiB reads, `depth` at a time
+        AlignedBuffer buf(depth << 20);
+        auto start = clock::now();
+        for (std::size_t i = 0; i < file_size; i += depth << 20) {
+          std::vector<std::future<std::size_t>> futures;
+          {
+            auto batch = io->batch();
+            for (std::size_t j = 0; j < depth; j++) {
+              futures.push_back(batch.read(file.fd(), i + (j << 20), {buf.data() + (j << 20), 1 << 20}));
+            }
+          }
+          for (auto& f : futures) f.get();
+        }
+        std::chrono::duration<double> seq = clock::now() - start;
+
+        // Random 4 KiB reads, `depth` at a time, timed until each is done
+        std::vector<double> latencies;
+        start = clock::now();
+        for (std::size_t i = 0; i < random_reads; i += depth) {
+          std::vector<std::future<std::size_t>> futures;
+          auto submitted = clock::now();
+          {
+            auto batch = io->batch();
+            for (std::size_t j = 0; j < depth; j++) {
+              auto offset = Random::get<std::size_t>(0, file_size / block - 1) * block;
+              futures.push_back(batch.read(file.fd(), offset, {buf.data() + j * block, block}));
+            }
+          }
+          for (auto& f : futures) {
+            f.get();
+            latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - submitted).count());
+          }
+        }
+        std::chrono::duration<double> rnd = clock::now() - start;
+        std::sort(latencies.begin(), latencies.end());
+
+        fmt::print("{} ({}{}): sequential {:.0f} MB/s, random 4K {:.0f} MB/s, p50 {:.1f} us, p99 {:.1f} us\n",
+                   dir.string(), name(io->backend()), file.direct() ? ", direct" : "",
+                   file_size / seq.count() / 1e6, random_reads * block / rnd.count() / 1e6,
+                   latencies[latencies.size() / 2], latencies[latencies.size() * 99 / 100]);
+      }
+      fs::remove(path);
+    }
+  }
+
+} // namespace otto::util
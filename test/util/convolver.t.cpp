@@ -0,0 +1,162 @@
+#include "../testing.t.hpp"
+
+#include <vector>
+
+#include "util/dsp/convolver.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::vector<float> random_signal(std::size_t n)
+    {
+      std::vector<float> res(n);
+      for (auto& s : res) s = Random::get(-1.f, 1.f);
+      return res;
+    }
+
+    /// A decaying noise burst, like the impulse response of a room
+    std::vector<float> room(std::size_t n)
+    {
+      auto res = random_signal(n);
+      for (std::size_t i = 0; i < n; i++) res[i] *= std::exp(-5.f * i / n) * 0.05f;
+      return res;
+    }
+
+    std::vector<float> direct_convolution(const std::vector<float>& in, const std::vector<float>& ir)
+    {
+      std::vector<float> res(in.size());
+      for (std::size_t n = 0; n < in.size(); n++) {
+        double sum = 0;
+        for (std::size_t i = 0; i < ir.size() && i <= n; i++) sum += double(ir[i]) * in[n - i];
+        res[n] = sum;
+      }
+      return res;
+    }
+
+    /// Convolve in blocks of random sizes
+    ///
+    /// Much faster than real time, so it waits for the background thread after
+    /// each block
+    std::vector<float> convolve(Convolver& conv, const std::vector<float>& in)
+    {
+      std::vector<float> out(in.size());
+      for (std::size_t i = 0; i < in.size();) {
+        std::size_t n = std::min<std::size_t>(Random::get(1, 300), in.size() - i);
+        conv.process({in.data() + i, std::ptrdiff_t(n)}, {out.data() + i, std::ptrdiff_t(n)});
+        conv.wait_idle();
+        i += n;
+      }
+      return out;
+    }
+
+    void require_delayed_match(const std::vector<float>& out,
+                               const std::vector<float>& expected,
+                               std::size_t latency)
+    {
+      for (std::size_t i = 0; i < latency; i++) REQUIRE(out[i] == 0);
+      for (std::size_t i = latency; i < out.size(); i++) {
+        REQUIRE(out[i] == Approx(expected[i - latency]).margin(1e-4));
+      }
+    }
+  } // namespace
+
+  TEST_CASE("Convolver", "[util] [dsp] [convolver]")
+  {
+    SECTION("Unsupported block sizes are rejected")
+    {
+      std::vector<float> ir(100);
+      REQUIRE_THROWS(Convolver(ir, {16, 1024}));
+      REQUIRE_THROWS(Convolver(ir, {100, 1024}));
+      REQUIRE_THROWS(Convolver(ir, {256, 128}));
+    }
+
+    SECTION("A short impulse response only uses the head")
+    {
+      auto ir = room(300);
+      auto in = random_signal(5000);
+      Convolver conv(ir, {64, 256});
+      auto out = convolve(conv, in);
+      require_delayed_match(out, direct_convolution(in, ir), conv.latency());
+    }
+
+    SECTION("A long impulse response is split into head and tail")
+    {
+      auto ir = room(5000);
+      auto in = random_signal(20000);
+      auto expected = direct_convolution(in, ir);
+      for (bool background : {false, true}) {
+        Convolver conv(ir, {64, 512, background});
+        auto out = convolve(conv, in);
+        require_delayed_match(out, expected, conv.latency());
+      }
+    }
+
+    SECTION("The head and tail blocks can be the same size")
+    {
+      auto ir = room(1000);
+      auto in = random_signal(5000);
+      Convolver conv(ir, {128, 128, false});
+      auto out = convolve(conv, in);
+      require_delayed_match(out, direct_convolution(in, ir), conv.latency());
+    }
+
+    SECTION("Reset clears all state")
+    {
+      auto ir = room(3000);
+      auto in = random_signal(8000);
+      auto expected = direct_convolution(in, ir);
+      Convolver conv(ir, {32, 256});
+      convolve(conv, random_signal(777));
+      conv.reset();
+      auto out = convolve(conv, in);
+      require_delayed_match(out, expected, conv.latency());
+    }
+
+    SECTION("A late background thread is counted, not waited for")
+    {
+      // A long tail in small blocks, processed without waiting, is more
+      // than the background thread can keep up with
+      auto ir = room(48000);
+      auto in = random_signal(8000);
+      auto expected = direct_convolution(in, ir);
+      Convolver conv(ir, {32, 32});
+      auto run = [&](bool wait) {
+        std::vector<float> out(in.size());
+        for (std::size_t i = 0; i < in.size(); i += 32) {
+          conv.process({in.data() + i, 32}, {out.data() + i, 32});
+          if (wait) conv.wait_idle();
+        }
+        return out;
+      };
+      auto out = run(false);
+      REQUIRE(conv.overruns() > 0);
+      REQUIRE(std::all_of(out.begin(), out.end(), [](float s) { return std::isfinite(s); }));
+
+      conv.reset();
+      auto overruns = conv.overruns();
+      out = run(true);
+      REQUIRE(conv.overruns() == overruns);
+      require_delayed_match(out, expected, conv.latency());
+    }
+  }
+
+  TEST_CASE("Convolver benchmark", "[util] [dsp] [convolver] [benchmark]")
+  {
+    // One second of audio at 48 kHz, in blocks of 64, with the tail on the
+    // calling thread, so all the work is counted
+    auto in = random_signal(48000);
+    std::vector<float> out(in.size());
+    OBENCH_SECTION ("One second of audio, by impulse response length") {
+      for (double seconds : {0.25, 0.5, 1.0, 2.0, 4.0, 8.0}) {
+        auto ir = room(seconds * 48000);
+        Convolver conv(ir, {64, 1024, false});
+        OBENCH (fmt::format("{} s", seconds), 5) {
+          for (std::size_t i = 0; i < in.size(); i += 64) {
+            conv.process({in.data() + i, 64}, {out.data() + i, 64});
+          }
+        }
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
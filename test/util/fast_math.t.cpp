@@ -0,0 +1,147 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/fast_math.hpp"
+
+namespace otto::util::math {
+
+  namespace {
+    /// The largest error of `fast` compared to `ref` over `n` points in `[lo, hi]`,
+    /// evaluated `simd::lanes<V>` at a time.
+    template<typename V, typename Fast, typename Ref>
+    double max_error(Fast&& fast, Ref&& ref, double lo, double hi, bool relative, int n = 100001)
+    {
+      std::vector<float> in(n);
+      std::vector<float> out(n);
+      for (int i = 0; i < n; i++) {
+        in[i] = lo + (hi - lo) * i / (n - 1);
+      }
+      simd::transform<V>(in.data(), out.data(), n, fast);
+      double res = 0;
+      for (int i = 0; i < n; i++) {
+        double expected = ref(double(in[i]));
+        double err = std::abs(out[i] - expected);
+        if (relative) err /= std::abs(expected);
+        res = std::max(res, err);
+      }
+      return res;
+    }
+
+    /// Check the accuracy of all functions, evaluated `simd::lanes<V>` at a time
+    template<typename V>
+    void check_accuracy()
+    {
+      constexpr bool abs = false;
+      constexpr bool rel = true;
+
+      auto sin = [](auto x) { return fast_sin(x); };
+      auto cos = [](auto x) { return fast_cos(x); };
+      REQUIRE(max_error<V>(sin, [](double x) { return std::sin(x); }, -10, 10, abs) < 2e-7);
+      REQUIRE(max_error<V>(cos, [](double x) { return std::cos(x); }, -10, 10, abs) < 2e-7);
+      REQUIRE(max_error<V>(sin, [](double x) { return std::sin(x); }, -1e4, 1e4, abs) < 2e-7);
+      REQUIRE(max_error<V>(cos, [](double x) { return std::cos(x); }, -1e4, 1e4, abs) < 2e-7);
+      REQUIRE(fast_sin(0.f) == 0.f);
+
+      auto exp2 = [](auto x) { return fast_exp2(x); };
+      auto exp = [](auto x) { return fast_exp(x); };
+      REQUIRE(max_error<V>(exp2, [](double x) { return std::exp2(x); }, -126, 126, rel) < 3e-7);
+      REQUIRE(max_error<V>(exp, [](double x) { return std::exp(x); }, -10, 10, rel) < 1e-6);
+      REQUIRE(max_error<V>(exp, [](double x) { return std::exp(x); }, -87, 87, rel) < 5e-6);
+      REQUIRE(fast_exp2(0.f) == 1.f);
+      REQUIRE(fast_exp2(10.f) == 1024.f);
+      // Clamped instead of overflowing
+      REQUIRE(std::isfinite(fast_exp2(1000.f)));
+      REQUIRE(fast_exp2(-1000.f) > 0);
+
+      auto log2 = [](auto x) { return fast_log2(x); };
+      auto log = [](auto x) { return fast_log(x); };
+      REQUIRE(max_error<V>(log2, [](double x) { return std::log2(x); }, 0.5, 2, abs) < 2e-7);
+      REQUIRE(max_error<V>(log2, [](double x) { return std::log2(x); }, 1e-6, 0.5, rel) < 2e-7);
+      REQUIRE(max_error<V>(log2, [](double x) { return std::log2(x); }, 2, 1e6, rel) < 2e-7);
+      REQUIRE(max_error<V>(log, [](double x) { return std::log(x); }, 0.5, 2, abs) < 2e-7);
+      REQUIRE(max_error<V>(log, [](double x) { return std::log(x); }, 2, 1e3, rel) < 2e-7);
+      REQUIRE(fast_log2(1.f) == 0.f);
+      REQUIRE(fast_log2(1024.f) == 10.f);
+
+      // Results within [2^-20, 2^20]
+      for (float base : {0.5f, 2.f, 3.7f, 10.f}) {
+        auto pow = [base](auto y) { return fast_pow(simd::broadcast<decltype(y)>(base), y); };
+        double range = 20 / std::abs(std::log2(base));
+        REQUIRE(max_error<V>(pow, [&](double y) { return std::pow(base, y); }, -range, range, rel) <
+                2e-6);
+      }
+
+      auto tanh = [](auto x) { return fast_tanh(x); };
+      REQUIRE(max_error<V>(tanh, [](double x) { return std::tanh(x); }, -20, 20, abs) < 2e-7);
+      REQUIRE(max_error<V>(tanh, [](double x) { return std::tanh(x); }, -0.5, 0.5, abs) < 2e-7);
+      REQUIRE(fast_tanh(0.f) == 0.f);
+      REQUIRE(fast_tanh(100.f) == Approx(1));
+      REQUIRE(fast_tanh(-100.f) == Approx(-1));
+
+      auto to_gain = [](auto x) { return fast_db_to_gain(x); };
+      auto to_db = [](auto x) { return fast_gain_to_db(x); };
+      REQUIRE(max_error<V>(to_gain, [](double db) { return std::pow(10, db / 20); }, -120, 24, rel) <
+              1e-6);
+      REQUIRE(max_error<V>(to_db, [](double g) { return 20 * std::log10(g); }, 1e-5, 16, abs) <
+              5e-6);
+      REQUIRE(fast_db_to_gain(0.f) == 1.f);
+    }
+
+  } // namespace
+
+  TEST_CASE("Fast math approximations", "[util] [fast_math]")
+  {
+    SECTION("float")
+    {
+      check_accuracy<float>();
+    }
+    SECTION("float4")
+    {
+      check_accuracy<simd::float4>();
+    }
+    SECTION("float8")
+    {
+      check_accuracy<simd::float8>();
+    }
+  }
+
+  TEST_CASE("Fast math benchmark", "[util] [fast_math] [benchmark]")
+  {
+    constexpr int n = 4096;
+    std::vector<float> in(n);
+    std::vector<float> out(n);
+    for (int i = 0; i < n; i++) {
+      in[i] = -10 + 20.f * i / n;
+    }
+
+    OBENCH_SECTION ("sin, 4096 samples") {
+      OBENCH ("std::sin", 100) {
+        for (int i = 0; i < n; i++) out[i] = std::sin(in[i]);
+      }
+      OBENCH ("fast_sin", 100) {
+        simd::transform(in.data(), out.data(), n, [](auto x) { return fast_sin(x); });
+      }
+    }
+
+    OBENCH_SECTION ("exp2, 4096 samples") {
+      OBENCH ("std::exp2", 100) {
+        for (int i = 0; i < n; i++) out[i] = std::exp2(in[i]);
+      }
+      OBENCH ("fast_exp2", 100) {
+        simd::transform(in.data(), out.data(), n, [](auto x) { return fast_exp2(x); });
+      }
+    }
+
+    OBENCH_SECTION ("tanh, 4096 samples") {
+      OBENCH ("std::tanh", 100) {
+        for (int i = 0; i < n; i++) out[i] = std::tanh(in[i]);
+      }
+      OBENCH ("fast_tanh", 100) {
+        simd::transform(in.data(), out.data(), n, [](auto x) { return fast_tanh(x); });
+      }
+    }
+  }
+
+} // namespace otto::util::math
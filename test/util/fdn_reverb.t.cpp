@@ -0,0 +1,135 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/fdn_reverb.hpp"
+
+#include "engines/fx/wormhole/wormhole.faust.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    struct Output {
+      std::vector<float> left;
+      std::vector<float> right;
+    };
+
+    Output render(FdnReverb& reverb, const std::vector<float>& in)
+    {
+      Output res{std::vector<float>(in.size()), std::vector<float>(in.size())};
+      for (std::size_t i = 0; i < in.size(); i += 256) {
+        std::ptrdiff_t n = std::min<std::size_t>(256, in.size() - i);
+        reverb.process({in.data() + i, n}, {res.left.data() + i, n}, {res.right.data() + i, n});
+      }
+      return res;
+    }
+
+    /// Energy of `v` from `from` to `to` seconds, at 48 kHz
+    double energy(const std::vector<float>& v, double from, double to)
+    {
+      double sum = 0;
+      for (std::size_t i = from * 48000; i < to * 48000; i++) sum += double(v[i]) * v[i];
+      return sum;
+    }
+
+    std::vector<float> impulse(std::size_t n)
+    {
+      std::vector<float> res(n);
+      res[0] = 1;
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE("FdnReverb", "[util] [dsp] [reverb]")
+  {
+    SECTION("The impulse response decays at the set rate")
+    {
+      for (float decay : {0.5f, 2.f}) {
+        FdnReverb reverb(48000);
+        reverb.decay(decay);
+        reverb.damping(24000);
+        auto out = render(reverb, impulse(48000 * 3));
+        // Compare two windows a quarter of the decay time apart, once the
+        // echoes are dense: that should be 15 dB
+        double t = 0.2;
+        double drop = 10 * std::log10(energy(out.left, t, t + 0.05) /
+                                      energy(out.left, t + decay / 4, t + decay / 4 + 0.05));
+        REQUIRE(drop == Approx(15).margin(3));
+      }
+    }
+
+    SECTION("Long decays with shimmer stay bounded")
+    {
+      FdnReverb reverb(48000);
+      reverb.decay(30);
+      reverb.damping(24000);
+      reverb.shimmer(1);
+      std::vector<float> in(48000 * 10);
+      for (std::size_t i = 0; i < 48000; i++) in[i] = Random::get(-1.f, 1.f);
+      auto out = render(reverb, in);
+      float peak = 0;
+      for (float s : out.left) peak = std::max(peak, std::abs(s));
+      REQUIRE(std::isfinite(peak));
+      REQUIRE(peak < 4);
+    }
+
+    SECTION("Without spread, the output is mono")
+    {
+      FdnReverb reverb(48000);
+      reverb.spread(0);
+      auto out = render(reverb, impulse(10000));
+      REQUIRE(out.left == out.right);
+
+      reverb.spread(1);
+      reverb.reset();
+      out = render(reverb, impulse(10000));
+      REQUIRE(out.left != out.right);
+    }
+
+    SECTION("The gate closes when the tail gets quiet")
+    {
+      FdnReverb reverb(48000);
+      reverb.decay(5);
+      reverb.gate(0.01);
+      auto out = render(reverb, impulse(48000 * 2));
+      auto open = energy(out.left, 0, 0.1);
+      REQUIRE(open > 0);
+      REQUIRE(energy(out.left, 1.5, 2) < 1e-9 * open);
+    }
+  }
+
+  TEST_CASE("FdnReverb benchmark", "[util] [dsp] [reverb] [benchmark]")
+  {
+    // About one second of noise at 48 kHz, in blocks of 256
+    constexpr int block = 256;
+    std::vector<float> in(block * 188);
+    for (auto& s : in) s = Random::get(-1.f, 1.f);
+    std::vector<float> left(in.size());
+    std::vector<float> right(in.size());
+
+    OBENCH_SECTION ("One second of audio") {
+      faust_wormhole wormhole;
+      wormhole.init(48000);
+      OBENCH ("Wormhole", 10) {
+        for (std::size_t i = 0; i < in.size(); i += block) {
+          float* inputs[] = {in.data() + i};
+          float* outputs[] = {left.data() + i, right.data() + i};
+          wormhole.compute(block, inputs, outputs);
+        }
+      }
+
+      FdnReverb reverb(48000);
+      OBENCH ("FdnReverb", 10) {
+        reverb.process(in, left, right);
+      }
+
+      reverb.shimmer(0.5);
+      reverb.gate(0.001);
+      OBENCH ("FdnReverb with shimmer and gate", 10) {
+        reverb.process(in, left, right);
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,154 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "util/dsp/fft.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::vector<float> random_signal(std::size_t n)
+    {
+      std::vector<float> res(n);
+      for (auto& s : res) s = Random::get(-1.f, 1.f);
+      return res;
+    }
+
+    std::vector<std::complex<double>> naive_dft(const std::vector<float>& in)
+    {
+      auto n = in.size();
+      std::vector<std::complex<double>> res(n / 2 + 1);
+      for (std::size_t k = 0; k <= n / 2; k++) {
+        for (std::size_t j = 0; j < n; j++) {
+          res[k] += double(in[j]) * std::polar(1.0, -2 * M_PI * double(j * k % n) / n);
+        }
+      }
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE("FFT", "[util] [dsp] [fft]")
+  {
+    SECTION("Unsupported sizes are rejected")
+    {
+      REQUIRE_THROWS(FFT(32));
+      REQUIRE_THROWS(FFT(1000));
+      REQUIRE_THROWS(FFT(131072));
+      REQUIRE_NOTHROW(FFT(64));
+      REQUIRE_NOTHROW(FFT(65536));
+    }
+
+    for (std::size_t n : {64, 128, 256, 1024, 2048}) {
+      SECTION(fmt::format("Size {} matches a naive DFT", n))
+      {
+        FFT fft(n);
+        auto in = random_signal(n);
+        std::vector<std::complex<float>> out(fft.bins());
+        fft.forward(in, out);
+        auto expected = naive_dft(in);
+        // Errors grow with the size, relative to the magnitude of the bins
+        double tolerance = 1e-5 * std::sqrt(n) * std::log2(n);
+        for (std::size_t k = 0; k < out.size(); k++) {
+          REQUIRE(out[k].real() == Approx(expected[k].real()).margin(tolerance));
+          REQUIRE(out[k].imag() == Approx(expected[k].imag()).margin(tolerance));
+        }
+      }
+    }
+
+    for (std::size_t n = FFT::min_size; n <= FFT::max_size; n *= 2) {
+      SECTION(fmt::format("Size {} inverts exactly", n))
+      {
+        FFT fft(n);
+        auto in = random_signal(n);
+        std::vector<std::complex<float>> spectrum(fft.bins());
+        std::vector<float> out(n);
+        fft.forward(in, spectrum);
+        fft.inverse(spectrum, out);
+        float max_error = 0;
+        for (std::size_t i = 0; i < n; i++) max_error = std::max(max_error, std::abs(out[i] - in[i]));
+        REQUIRE(max_error < 1e-5f);
+      }
+    }
+
+    SECTION("A sine ends up in a single bin")
+    {
+      FFT fft(1024);
+      std::vector<float> in(1024);
+      for (std::size_t i = 0; i < in.size(); i++) in[i] = std::cos(2 * M_PI * 10 * i / 1024.0);
+      std::vector<std::complex<float>> out(fft.bins());
+      fft.forward(in, out);
+      for (std::size_t k = 0; k < out.size(); k++) {
+        REQUIRE(std::abs(out[k]) == Approx(k == 10 ? 512 : 0).margin(1e-3));
+      }
+    }
+  }
+
+  TEST_CASE("STFT", "[util] [dsp] [fft]")
+  {
+    SECTION("Unchanged spectra resynthesize the input")
+    {
+      for (auto window : {Window::hann, Window::rectangular, Window::blackman}) {
+        STFT stft(512, 128, window);
+        auto in = random_signal(8192);
+        std::vector<float> out(in.size());
+        // In odd sized blocks, to check that frames don't depend on them
+        for (std::size_t i = 0; i < in.size(); i += 100) {
+          auto n = std::min<std::size_t>(100, in.size() - i);
+          stft.process(gsl::span<const float>(in.data() + i, n), gsl::span<float>(out.data() + i, n),
+                       [](auto) {});
+        }
+        // Once the first frames have passed, the output is the delayed input
+        for (std::size_t i = 2 * stft.size(); i < in.size(); i++) {
+          REQUIRE(out[i] == Approx(in[i - stft.latency()]).margin(1e-5));
+        }
+      }
+    }
+
+    SECTION("Analysis finds the frequency of a sine")
+    {
+      STFT stft(1024, 256);
+      std::vector<float> in(4096);
+      // Bin 40 at a size of 1024
+      for (std::size_t i = 0; i < in.size(); i++) in[i] = std::sin(2 * M_PI * 40 * i / 1024.0);
+      int frames = 0;
+      stft.analyze(in, [&](gsl::span<const std::complex<float>> spectrum) {
+        frames++;
+        if (frames < 4) return;
+        auto peak = std::max_element(spectrum.begin(), spectrum.end(),
+                                      [](auto a, auto b) { return std::abs(a) < std::abs(b); });
+        REQUIRE(peak - spectrum.begin() == 40);
+      });
+      REQUIRE(frames == 16);
+    }
+
+    SECTION("Spectra can be changed")
+    {
+      STFT stft(256, 64);
+      std::vector<float> in(2048, 1.f);
+      std::vector<float> out(in.size());
+      stft.process(in, out, [](gsl::span<std::complex<float>> spectrum) {
+        for (auto& bin : spectrum) bin *= 0.5f;
+      });
+      REQUIRE(out.back() == Approx(0.5f).margin(1e-5));
+    }
+  }
+
+  TEST_CASE("FFT benchmark", "[util] [dsp] [fft] [benchmark]")
+  {
+    OBENCH_SECTION ("Forward and inverse real FFT") {
+      for (std::size_t n : {64, 256, 1024, 4096, 16384, 65536}) {
+        FFT fft(n);
+        auto in = random_signal(n);
+        std::vector<std::complex<float>> spectrum(fft.bins());
+        std::vector<float> out(n);
+        OBENCH (fmt::format("{} samples", n), 100) {
+          fft.forward(in, spectrum);
+          fft.inverse(spectrum, out);
+        }
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
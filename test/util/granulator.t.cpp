@@ -0,0 +1,165 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/granulator.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::vector<float> ramp(std::size_t n)
+    {
+      std::vector<float> res(n);
+      for (std::size_t i = 0; i < n; i++) res[i] = float(i) / n;
+      return res;
+    }
+
+    double energy(const std::vector<float>& v)
+    {
+      double sum = 0;
+      for (float s : v) sum += double(s) * s;
+      return sum;
+    }
+  } // namespace
+
+  TEST_CASE("Granulator", "[util] [dsp] [granular]")
+  {
+    Granulator gran(48000);
+
+    SECTION("Without a source, the output is silent")
+    {
+      gran.gate(true);
+      std::vector<float> out(256, 1.f);
+      gran.process(out);
+      REQUIRE(energy(out) == 0);
+    }
+
+    SECTION("A single grain plays the windowed source from the position")
+    {
+      auto source = ramp(48001);
+      gran.source(source);
+      gran.window(Window::rectangular);
+      gran.size(0.01);
+      gran.density(1);
+      gran.position(0.5);
+      gran.gate(true);
+      std::vector<float> out(1000);
+      gran.process(out);
+      // 480 samples of the source from the middle
+      for (std::size_t i = 0; i < 480; i++) REQUIRE(out[i] == Approx(source[24000 + i]));
+      for (std::size_t i = 480; i < 1000; i++) REQUIRE(out[i] == 0);
+      REQUIRE(gran.active() == 0);
+    }
+
+    SECTION("Pitch sets the playback speed of each grain")
+    {
+      auto source = ramp(48000);
+      gran.source(source);
+      gran.window(Window::rectangular);
+      gran.density(1);
+      gran.pitch(2);
+      gran.gate(true);
+      std::vector<float> out(100);
+      gran.process(out);
+      for (std::size_t i = 0; i < 100; i++) REQUIRE(out[i] == Approx(source[2 * i]));
+    }
+
+    SECTION("Overlapping grains sum to a steady level")
+    {
+      std::vector<float> source(48000, 1.f);
+      gran.source(source);
+      gran.size(0.05);
+      gran.density(100);
+      gran.gate(true);
+      std::vector<float> out(48000);
+      for (std::size_t i = 0; i < out.size(); i += 100) {
+        gran.process({out.data() + i, 100});
+      }
+      // Five hann windows overlap, summing to 2.5, and each grain has a gain
+      // of 1 / sqrt(5)
+      for (std::size_t i = 2400; i < out.size(); i++) {
+        REQUIRE(out[i] == Approx(2.5 / std::sqrt(5)).epsilon(0.01));
+      }
+    }
+
+    SECTION("Grains that are playing finish after the gate closes")
+    {
+      std::vector<float> source(48000, 1.f);
+      gran.source(source);
+      gran.size(0.1);
+      gran.density(50);
+      gran.gate(true);
+      std::vector<float> out(4800);
+      gran.process(out);
+      gran.gate(false);
+      REQUIRE(gran.active() > 0);
+      gran.process(out);
+      REQUIRE(energy(out) > 0);
+      REQUIRE(gran.active() == 0);
+      gran.process(out);
+      REQUIRE(energy(out) == 0);
+    }
+
+    SECTION("The pool limits the number of grains")
+    {
+      std::vector<float> source(48000, 1.f);
+      gran.source(source);
+      gran.size(1);
+      gran.density(1000);
+      gran.gate(true);
+      // Before the first grain ends
+      std::vector<float> out(24000);
+      gran.process(out);
+      REQUIRE(gran.active() == Granulator::max_grains);
+      for (float s : out) REQUIRE(std::isfinite(s));
+    }
+
+    SECTION("Spread pans the grains apart")
+    {
+      std::vector<float> source(48000);
+      for (auto& s : source) s = Random::get(-1.f, 1.f);
+      gran.source(source);
+      gran.spray(0.5);
+      gran.density(200);
+      gran.gate(true);
+      std::vector<float> left(48000), right(48000);
+
+      gran.spread(0);
+      gran.process(left, right);
+      REQUIRE(left == right);
+
+      gran.spread(1);
+      gran.process(left, right);
+      double diff = 0;
+      for (std::size_t i = 0; i < left.size(); i++) diff += std::pow(left[i] - right[i], 2);
+      REQUIRE(diff > 0.1 * energy(left));
+    }
+  }
+
+  TEST_CASE("Granulator benchmark", "[util] [dsp] [granular] [benchmark]")
+  {
+    std::vector<float> source(48000 * 10);
+    for (auto& s : source) s = Random::get(-1.f, 1.f);
+    std::vector<float> left(256);
+    std::vector<float> right(256);
+
+    OBENCH_SECTION ("One second of audio, by number of grains") {
+      for (int grains : {16, 64, 128, 256}) {
+        Granulator gran(48000);
+        gran.source(source);
+        gran.size(0.1);
+        gran.spray(2);
+        gran.spread(1);
+        // Slightly fewer than `grains` overlap, so the pool is never full
+        gran.density(grains * 9.5f);
+        gran.gate(true);
+        for (int i = 0; i < 48000; i += 256) gran.process(left, right);
+        OBENCH (fmt::format("{} grains", grains), 10) {
+          for (int i = 0; i < 48000; i += 256) gran.process(left, right);
+        }
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,201 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/kernels.hpp"
+
+namespace otto::util::dsp {
+
+  TEST_CASE("DSP kernel dispatch", "[util] [dsp] [kernels]")
+  {
+    auto initial = kernels::table().isa;
+    REQUIRE(kernels::supported(initial));
+    REQUIRE(kernels::supported(kernels::Isa::scalar));
+
+    // Every length up to a few vectors, to cover the scalar tails
+    std::vector<float> in(67);
+    std::vector<float> other(in.size());
+    for (std::size_t i = 0; i < in.size(); i++) {
+      in[i] = Random::get(-1.f, 1.f);
+      other[i] = Random::get(-1.f, 1.f);
+    }
+
+    auto run = [&](kernels::Isa isa) {
+      REQUIRE(kernels::select(isa));
+      REQUIRE(kernels::table().isa == isa);
+      std::vector<std::vector<float>> res;
+      for (std::size_t n = 0; n <= in.size(); n++) {
+        std::vector<float> scaled(in.size(), 0.f);
+        std::vector<float> mixed = other;
+        std::vector<float> in_place = in;
+        std::vector<float> ramped(in.size(), 0.f);
+        kernels::scale(in.data(), scaled.data(), n, 0.7f);
+        kernels::mix(in.data(), mixed.data(), n, -1.3f);
+        kernels::scale(in_place.data(), n, 2.f);
+        auto level = kernels::ramp(in.data(), ramped.data(), n, 1.5f, 0.5f);
+        // The level goes at the end, where the buffer was not written
+        ramped.push_back(level.peak);
+        ramped.push_back(level.sum_squares);
+        res.push_back(std::move(scaled));
+        res.push_back(std::move(mixed));
+        res.push_back(std::move(in_place));
+        res.push_back(std::move(ramped));
+      }
+      return res;
+    };
+
+    auto expected = run(kernels::Isa::scalar);
+    SECTION("The scalar kernels are correct")
+    {
+      std::size_t n = in.size();
+      for (std::size_t i = 0; i < n; i++) {
+        REQUIRE(expected[4 * n][i] == in[i] * 0.7f);
+        REQUIRE(expected[4 * n + 1][i] == other[i] + in[i] * -1.3f);
+        REQUIRE(expected[4 * n + 2][i] == in[i] * 2.f);
+        REQUIRE(expected[4 * n + 3][i] == Approx(in[i] * (1.5f - (i + 1.f) / n)));
+      }
+      float peak = 0;
+      float sum_squares = 0;
+      for (std::size_t i = 0; i < n; i++) {
+        peak = std::max(peak, std::abs(expected[4 * n + 3][i]));
+        sum_squares += expected[4 * n + 3][i] * expected[4 * n + 3][i];
+      }
+      REQUIRE(expected[4 * n + 3][n] == peak);
+      REQUIRE(expected[4 * n + 3][n + 1] == Approx(sum_squares));
+      // Nothing is written beyond n
+      REQUIRE(expected[4 * 5][5] == 0.f);
+      REQUIRE(expected[4 * 5 + 1][5] == other[5]);
+      REQUIRE(expected[4 * 5 + 2][5] == in[5]);
+      REQUIRE(expected[4 * 5 + 3][5] == 0.f);
+    }
+
+    for (auto isa : kernels::all_isas) {
+      if (!kernels::supported(isa)) continue;
+      SECTION(fmt::format("{} kernels match the scalar ones", kernels::name(isa)))
+      {
+        auto res = run(isa);
+        REQUIRE(res.size() == expected.size());
+        for (std::size_t j = 0; j < res.size(); j++) {
+          REQUIRE(res[j].size() == expected[j].size());
+          // The wider sets may fuse multiplies and adds, which rounds
+          // differently when `mix` cancels out
+          for (std::size_t i = 0; i < in.size(); i++) {
+            REQUIRE(res[j][i] == Approx(expected[j][i]).epsilon(1e-6).margin(1e-6));
+          }
+          // Levels are summed in a different order
+          for (std::size_t i = in.size(); i < res[j].size(); i++) {
+            REQUIRE(res[j][i] == Approx(expected[j][i]).epsilon(1e-5));
+          }
+        }
+      }
+    }
+
+    SECTION("dot matches a double precision sum for every instruction set")
+    {
+      for (auto isa : kernels::all_isas) {
+        if (!kernels::select(isa)) continue;
+        for (std::size_t n = 0; n <= in.size(); n++) {
+          double expected = 0;
+          for (std::size_t i = 0; i < n; i++) expected += double(in[i]) * other[i];
+          REQUIRE(kernels::dot(in.data(), other.data(), n) == Approx(expected).margin(1e-5));
+        }
+      }
+    }
+
+    SECTION("mix4 matches four mixes for every instruction set")
+    {
+      std::vector<std::vector<float>> ins(4, std::vector<float>(in.size()));
+      for (auto& v : ins) {
+        for (auto& s : v) s = Random::get(-1.f, 1.f);
+      }
+      const float* ptrs[] = {ins[0].data(), ins[1].data(), ins[2].data(), ins[3].data()};
+      const float gains[] = {0.5f, -1.f, 0.25f, 2.f};
+      for (auto isa : kernels::all_isas) {
+        if (!kernels::select(isa)) continue;
+        for (std::size_t n = 0; n <= in.size(); n++) {
+          std::vector<float> mixed = other;
+          kernels::mix4(ptrs, mixed.data(), n, gains);
+          for (std::size_t i = 0; i < in.size(); i++) {
+            float expected = other[i];
+            if (i < n) {
+              for (int j = 0; j < 4; j++) expected += ins[j][i] * gains[j];
+            }
+            REQUIRE(mixed[i] == Approx(expected).margin(1e-5));
+          }
+        }
+      }
+    }
+
+    SECTION("Selecting an unsupported instruction set keeps the current one")
+    {
+      REQUIRE(kernels::select(kernels::Isa::scalar));
+      for (auto isa : kernels::all_isas) {
+        if (kernels::supported(isa)) continue;
+        REQUIRE_FALSE(kernels::select(isa));
+        REQUIRE(kernels::table().isa == kernels::Isa::scalar);
+      }
+    }
+
+    kernels::select(initial);
+  }
+
+  TEST_CASE("DSP kernel benchmark", "[util] [dsp] [kernels] [benchmark]")
+  {
+    auto initial = kernels::table().isa;
+    std::vector<float> a(1024);
+    std::vector<float> b(a.size());
+    for (std::size_t i = 0; i < a.size(); i++) {
+      a[i] = Random::get(-1.f, 1.f);
+      b[i] = Random::get(-1.f, 1.f);
+    }
+    float sink = 0;
+
+    // The resampler runs a 32 tap dot product twice per output sample, and
+    // up to 1024 taps when it reduces the rate
+    OBENCH_SECTION ("dot, 48000 x 32 taps") {
+      for (auto isa : kernels::all_isas) {
+        if (!kernels::select(isa)) continue;
+        OBENCH (std::string(kernels::name(isa)), 20) {
+          for (int i = 0; i < 48000; i++) sink += kernels::dot(a.data() + (i & 63), b.data(), 32);
+        }
+      }
+    }
+    OBENCH_SECTION ("dot, 4800 x 1024 taps") {
+      for (auto isa : kernels::all_isas) {
+        if (!kernels::select(isa)) continue;
+        OBENCH (std::string(kernels::name(isa)), 20) {
+          for (int i = 0; i < 4800; i++) sink += kernels::dot(a.data(), b.data(), a.size());
+        }
+      }
+    }
+    OBENCH_SECTION ("mix, 48000 samples") {
+      for (auto isa : kernels::all_isas) {
+        if (!kernels::select(isa)) continue;
+        OBENCH (std::string(kernels::name(isa)), 20) {
+          for (int i = 0; i < 48000; i += 256) kernels::mix(a.data(), b.data(), 256, 0.5f);
+        }
+      }
+    }
+    OBENCH_SECTION ("16 buffers mixed, 48000 samples") {
+      std::vector<float> gains(16, 0.1f);
+      std::vector<const float*> ins(16, a.data());
+      for (auto isa : kernels::all_isas) {
+        if (!kernels::select(isa)) continue;
+        OBENCH (fmt::format("{}, mix", kernels::name(isa)), 20) {
+          for (int i = 0; i < 48000; i += 256) {
+            for (int j = 0; j < 16; j++) kernels::mix(ins[j], b.data(), 256, gains[j]);
+          }
+        }
+        OBENCH (fmt::format("{}, mix4", kernels::name(isa)), 20) {
+          for (int i = 0; i < 48000; i += 256) {
+            for (int j = 0; j < 16; j += 4) kernels::mix4(&ins[j], b.data(), 256, &gains[j]);
+          }
+        }
+      }
+    }
+    REQUIRE(std::isfinite(sink));
+    kernels::select(initial);
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,171 @@
+#include "../testing.t.hpp"
+
+#include <thread>
+
+#include "util/jsonfile.hpp"
+#include "util/library_index.hpp"
+
+namespace otto::util {
+
+  /// Write a minimal 32 bit float wave file
+  static void write_wave(const fs::path& p, int channels, int samplerate, const std::vector<float>& data)
+  {
+    std::ofstream out(p.c_str(), std::ios::binary | std::ios::trunc);
+    auto put = [&](auto v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    std::uint32_t data_size = data.size() * sizeof(float);
+    out.write("RIFF", 4);
+    put(std::uint32_t(4 + 8 + 16 + 8 + data_size));
+    out.write("WAVEfmt ", 8);
+    put(std::uint32_t(16));
+    put(std::uint16_t(3));
+    put(std::uint16_t(channels));
+    put(std::uint32_t(samplerate));
+    put(std::uint32_t(samplerate * channels * 4));
+    put(std::uint16_t(channels * 4));
+    put(std::uint16_t(32));
+    out.write("data", 4);
+    put(data_size);
+    out.write(reinterpret_cast<const char*>(data.data()), data_size);
+  }
+
+  /// Wait for the index to publish a new snapshot
+  static bool wait_for_change(const LibraryIndex& index, unsigned generation)
+  {
+    for (int i = 0; i < 500; i++) {
+      if (index.generation() != generation) return true;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+  }
+
+  TEST_CASE("LibraryIndex", "[util] [library_index]")
+  {
+    // Use a fresh directory, so changes from earlier runs are not picked up
+    auto id = Random::get(0, 1 << 30);
+    auto root = test::dir / fmt::format("library-{}", id);
+    auto cache = test::dir / fmt::format("library-{}.json", id);
+    fs::create_directories(root / "drums");
+
+    // A ramp from 0 to 1 on the left channel, silence on the right
+    std::vector<float> audio(2 * 1000, 0.f);
+    for (int i = 0; i < 1000; i++) audio[2 * i] = i / 999.f;
+    write_wave(root / "drums" / "ramp.wav", 2, 48000, audio);
+    write_wave(root / ".hidden.wav", 1, 44100, {0.f});
+    std::ofstream(root / "notes.txt") << "not a sample";
+
+    SECTION("Initial scan")
+    {
+      LibraryIndex index{root, {".wav"}, cache};
+      index.wait_ready();
+      auto entries = index.entries();
+      REQUIRE(entries->size() == 1);
+
+      auto& e = entries->front();
+      REQUIRE(e.path == fs::path("drums") / "ramp.wav");
+      REQUIRE(e.is_audio());
+      REQUIRE(e.channels == 2);
+      REQUIRE(e.samplerate == 48000);
+      REQUIRE(e.length == 1000);
+      REQUIRE(e.size == fs::file_size(root / "drums" / "ramp.wav"));
+      REQUIRE(e.overview.size() == LibraryIndex::overview_size);
+      REQUIRE(std::is_sorted(e.overview.begin(), e.overview.end()));
+      REQUIRE(e.overview.back() == Approx(1.f));
+
+      REQUIRE(index.find(fs::path("drums") / "ramp.wav"));
+      REQUIRE_FALSE(index.find("notes.txt"));
+    }
+
+    SECTION("Without an extension filter, all non-hidden files are indexed")
+    {
+      LibraryIndex index{root, {}};
+      index.wait_ready();
+      REQUIRE(index.entries()->size() == 2);
+      auto notes = index.find("notes.txt");
+      REQUIRE(notes);
+      REQUIRE_FALSE(notes->is_audio());
+    }
+
+#if defined(__linux__)
+    SECTION("Files added and removed at runtime are picked up")
+    {
+      LibraryIndex index{root, {".wav"}};
+      index.wait_ready();
+      auto old_snapshot = index.entries();
+
+      auto gen = index.generation();
+      fs::create_directories(root / "new");
+      write_wave(root / "new" / "added.wav", 1, 22050, std::vector<float>(500, 0.5f));
+      REQUIRE(wait_for_change(index, gen));
+      // The change might be published in more than one step
+      for (int i = 0; i < 100 && !index.find(fs::path("new") / "added.wav"); i++) {
+        wait_for_change(index, index.generation());
+      }
+      auto added = index.find(fs::path("new") / "added.wav");
+      REQUIRE(added);
+      REQUIRE(added->length == 500);
+      REQUIRE(added->overview.front() == Approx(0.5f));
+
+      // Old snapshots are not touched
+      REQUIRE(old_snapshot->size() == 1);
+
+      gen = index.generation();
+      fs::remove(root / "drums" / "ramp.wav");
+      REQUIRE(wait_for_change(index, gen));
+      REQUIRE_FALSE(index.find(fs::path("drums") / "ramp.wav"));
+    }
+
+    SECTION("Removed directories are dropped, including the root")
+    {
+      LibraryIndex index{root, {".wav"}};
+      index.wait_ready();
+
+      auto gen = index.generation();
+      fs::remove_all(root / "drums");
+      REQUIRE(wait_for_change(index, gen));
+      REQUIRE(index.entries()->empty());
+
+      write_wave(root / "kept.wav", 1, 22050, {0.f});
+      for (int i = 0; i < 100 && !index.find("kept.wav"); i++) {
+        wait_for_change(index, index.generation());
+      }
+      REQUIRE(index.find("kept.wav"));
+
+      gen = index.generation();
+      fs::remove_all(root);
+      REQUIRE(wait_for_change(index, gen));
+      REQUIRE(index.entries()->empty());
+
+      // The root is watched again once it has been recreated
+      write_wave(root / "after.wav", 1, 22050, {0.f});
+      for (int i = 0; i < 100 && !index.find("after.wav"); i++) {
+        wait_for_change(index, index.generation());
+      }
+      REQUIRE(index.find("after.wav"));
+    }
+#endif
+
+    SECTION("The index is persisted in the cache file")
+    {
+      {
+        LibraryIndex index{root, {".wav"}, cache};
+        index.wait_ready();
+      }
+      REQUIRE(fs::exists(cache));
+
+      JsonFile jf{cache};
+      jf.read();
+      auto& entries = jf.data()["entries"];
+      REQUIRE(entries.size() == 1);
+      REQUIRE(entries[0]["path"] == (fs::path("drums") / "ramp.wav").string());
+      REQUIRE(entries[0]["length"] == 1000);
+      REQUIRE(entries[0]["overview"].size() == LibraryIndex::overview_size);
+
+      LibraryIndex index{root, {".wav"}, cache};
+      index.wait_ready();
+      auto e = index.find(fs::path("drums") / "ramp.wav");
+      REQUIRE(e);
+      REQUIRE(e->overview.back() == Approx(1.f));
+    }
+  }
+
+} // namespace otto::util
@@ -0,0 +1,76 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+
+#include "util/dsp/lookup_tables.hpp"
+
+namespace otto::util::dsp {
+
+  // The tables must be usable in constant expressions
+  static_assert(tables::midi_note_freq[69] == 440.f);
+  static_assert(tables::equal_power_pan(-1).first == 1.f);
+  static_assert(tables::equal_power_pan(-1).second == 0.f);
+
+  TEST_CASE("Compile time lookup tables", "[util] [dsp] [lookup_tables]")
+  {
+    SECTION("constexpr_math matches <cmath>")
+    {
+      for (double x = -10; x < 10; x += 0.137) {
+        REQUIRE(constexpr_math::exp(x) == Approx(std::exp(x)).epsilon(1e-12));
+        REQUIRE(constexpr_math::exp2(x) == Approx(std::exp2(x)).epsilon(1e-12));
+        REQUIRE(constexpr_math::sin(x) == Approx(std::sin(x)).margin(1e-9));
+        REQUIRE(constexpr_math::cos(x) == Approx(std::cos(x)).margin(1e-9));
+        REQUIRE(constexpr_math::tanh(x) == Approx(std::tanh(x)).margin(1e-12));
+      }
+    }
+
+    SECTION("MIDI note frequencies")
+    {
+      for (int i = 0; i < 128; i++) {
+        REQUIRE(tables::midi_note_freq[i] == Approx(440 * std::pow(2, (i - 69) / 12.0)));
+      }
+      REQUIRE(tables::midi_to_freq(69) == 440.f);
+      REQUIRE(tables::midi_to_freq(69.5f) == Approx(440 * std::pow(2, 0.5 / 12)));
+      REQUIRE(tables::midi_to_freq(60.01f) == Approx(261.6256 * std::pow(2, 1 / 1200.0)));
+      REQUIRE(tables::midi_to_freq(-1) == tables::midi_note_freq.front());
+      REQUIRE(tables::midi_to_freq(200) == tables::midi_note_freq.back());
+    }
+
+    SECTION("Equal power pan")
+    {
+      for (float pos = -1; pos <= 1; pos += 0.01) {
+        auto [l, r] = tables::equal_power_pan(pos);
+        REQUIRE(l * l + r * r == Approx(1).epsilon(1e-4));
+      }
+      auto [l, r] = tables::equal_power_pan(0);
+      REQUIRE(l == Approx(r));
+    }
+
+    SECTION("tanh")
+    {
+      for (float x = -8; x <= 8; x += 0.0123) {
+        REQUIRE(tables::tanh(x) == Approx(std::tanh(x)).margin(1e-4));
+      }
+      for (float x = -5; x <= 5; x += 0.0123) {
+        REQUIRE(tables::tanh(x) == Approx(std::tanh(x)).margin(2e-5));
+      }
+    }
+
+    SECTION("Wave tables")
+    {
+      for (float ph = -2; ph < 2; ph += 0.0037) {
+        REQUIRE(tables::sine(ph) == Approx(std::sin(2 * M_PI * ph)).margin(2e-6));
+      }
+      // Wraps to exactly 1 in float, the end of the table
+      REQUIRE(tables::sine(-1e-9f) == Approx(0).margin(1e-6));
+      REQUIRE(tables::sine(-1 - 1e-9f) == Approx(0).margin(1e-6));
+      // pipe1 = sin(x) + sin(3x) + sin(2x)
+      for (float ph = 0; ph < 1; ph += 0.01) {
+        double x = 2 * M_PI * ph;
+        REQUIRE(tables::goss::pipe1(ph) ==
+                Approx(std::sin(x) + std::sin(3 * x) + std::sin(2 * x)).margin(1e-4));
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,164 @@
+#include "../testing.t.hpp"
+
+#include <vector>
+
+#include "util/dsp/looper.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    /// Distinct, deterministic samples
+    std::vector<float> signal(std::size_t n, float offset = 0)
+    {
+      std::vector<float> res(n);
+      for (std::size_t i = 0; i < n; i++) res[i] = offset + float(i % 1000) / 1000.f;
+      return res;
+    }
+
+    /// Process `in` in blocks of random sizes
+    std::vector<float> run(Looper& looper, const std::vector<float>& in)
+    {
+      std::vector<float> out(in.size());
+      for (std::size_t i = 0; i < in.size();) {
+        std::size_t n = std::min<std::size_t>(Random::get(1, 300), in.size() - i);
+        looper.process({in.data() + i, std::ptrdiff_t(n)}, {out.data() + i, std::ptrdiff_t(n)});
+        i += n;
+      }
+      return out;
+    }
+  } // namespace
+
+  TEST_CASE("Looper", "[util] [dsp] [looper]")
+  {
+    SECTION("The first take plays back sample exactly")
+    {
+      Looper looper(48000, 4, 0);
+      auto take = signal(10007);
+      looper.record();
+      run(looper, take);
+      looper.play();
+      REQUIRE(looper.length() == take.size());
+
+      auto out = run(looper, std::vector<float>(3 * take.size() + 5, 0.f));
+      for (std::size_t i = 0; i < out.size(); i++) {
+        REQUIRE(out[i] == take[i % take.size()]);
+      }
+    }
+
+    SECTION("A take with a set length closes by itself")
+    {
+      Looper looper(48000, 4, 0);
+      auto in = signal(3000);
+      looper.record(1000);
+      auto out = run(looper, in);
+      REQUIRE(looper.state() == Looper::State::playing);
+      REQUIRE(looper.length() == 1000);
+      // The loop starts right after the take
+      for (std::size_t i = 1000; i < 3000; i++) REQUIRE(out[i] == in[i % 1000]);
+    }
+
+    SECTION("The end of the take is crossfaded with the input before it")
+    {
+      constexpr std::size_t fade = 64;
+      Looper looper(48000, 4, fade);
+      auto pre = signal(500, 10);
+      auto take = signal(5000);
+      run(looper, pre);
+      looper.record();
+      run(looper, take);
+      looper.play();
+
+      auto loop = looper.loop();
+      for (std::size_t i = 0; i < take.size() - fade; i++) REQUIRE(loop[i] == take[i]);
+      for (std::size_t i = 0; i < fade; i++) {
+        float w = float(i + 1) / fade;
+        float expected = take[take.size() - fade + i] * (1 - w) + pre[pre.size() - fade + i] * w;
+        REQUIRE(loop[take.size() - fade + i] == Approx(expected));
+      }
+      // So the last sample leads into the first as the input did
+      REQUIRE(loop[take.size() - 1] == Approx(pre.back()));
+    }
+
+    SECTION("Overdubs are heard from the next pass, and can be undone and redone")
+    {
+      Looper looper(48000, 4, 0);
+      auto take = signal(2000);
+      auto dub = signal(2000, 5);
+      looper.record(2000);
+      run(looper, take);
+      looper.overdub();
+      auto out = run(looper, dub);
+      // The pass plays the loop as it was
+      REQUIRE(out == take);
+      looper.play();
+      REQUIRE(looper.undo_depth() == 1);
+
+      auto silence = std::vector<float>(2000, 0.f);
+      out = run(looper, silence);
+      for (std::size_t i = 0; i < out.size(); i++) REQUIRE(out[i] == Approx(take[i] + dub[i]));
+
+      REQUIRE(looper.undo());
+      out = run(looper, silence);
+      REQUIRE(out == take);
+
+      REQUIRE(looper.redo());
+      REQUIRE_FALSE(looper.redo());
+      out = run(looper, silence);
+      for (std::size_t i = 0; i < out.size(); i++) REQUIRE(out[i] == Approx(take[i] + dub[i]));
+    }
+
+    SECTION("An overdub started mid loop takes one whole pass")
+    {
+      Looper looper(48000, 4, 0);
+      auto take = signal(2000);
+      looper.record(2000);
+      run(looper, take);
+      run(looper, std::vector<float>(700, 0.f));
+      looper.overdub();
+      std::vector<float> dub(2000, 1.f);
+      run(looper, dub);
+      looper.play();
+      REQUIRE(looper.undo_depth() == 1);
+      // Back at sample 700
+      auto out = run(looper, std::vector<float>(2000, 0.f));
+      for (std::size_t i = 0; i < out.size(); i++) {
+        REQUIRE(out[i] == Approx(take[(i + 700) % 2000] + 1));
+      }
+    }
+
+    SECTION("Undo discards an unfinished pass")
+    {
+      Looper looper(48000, 4, 0);
+      auto take = signal(2000);
+      looper.record(2000);
+      run(looper, take);
+      looper.overdub();
+      run(looper, std::vector<float>(1000, 1.f));
+      REQUIRE(looper.undo());
+      REQUIRE(looper.state() == Looper::State::playing);
+      run(looper, std::vector<float>(1000, 0.f));
+      auto out = run(looper, std::vector<float>(2000, 0.f));
+      REQUIRE(out == take);
+    }
+
+    SECTION("Undo is limited by the number of layers, and the first take clears")
+    {
+      Looper looper(1000, 3, 0);
+      looper.record(100);
+      run(looper, signal(100));
+      looper.overdub();
+      run(looper, std::vector<float>(450, 1.f));
+      looper.play();
+      // Finish the last pass
+      run(looper, std::vector<float>(50, 0.f));
+      REQUIRE(looper.undo_depth() == 2);
+      REQUIRE(looper.undo());
+      REQUIRE(looper.undo());
+      REQUIRE(looper.state() != Looper::State::empty);
+      REQUIRE(looper.undo());
+      REQUIRE(looper.state() == Looper::State::empty);
+      REQUIRE_FALSE(looper.undo());
+    }
+  }
+
+} // namespace otto::util::dsp
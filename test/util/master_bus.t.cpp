@@ -0,0 +1,180 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/master_bus.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    struct Stereo {
+      std::vector<float> left;
+      std::vector<float> right;
+    };
+
+    Stereo sine(float freq, float amp, std::size_t frames, float offset = 0)
+    {
+      Stereo res{std::vector<float>(frames), std::vector<float>(frames)};
+      for (std::size_t i = 0; i < frames; i++) {
+        res.left[i] = offset + amp * std::sin(2 * float(M_PI) * freq * i / 48000);
+        res.right[i] = offset + amp * std::cos(2 * float(M_PI) * freq * i / 48000);
+      }
+      return res;
+    }
+
+    /// Run `in` through `bus` in blocks of `block`
+    Stereo render(MasterBus& bus, Stereo in, std::size_t block)
+    {
+      for (std::size_t i = 0; i < in.left.size(); i += block) {
+        std::ptrdiff_t n = std::min(block, in.left.size() - i);
+        bus.process({in.left.data() + i, n}, {in.right.data() + i, n});
+      }
+      return in;
+    }
+  } // namespace
+
+  TEST_CASE("MasterBus", "[util] [dsp] [master]")
+  {
+    MasterBus bus(48000);
+    bus.gain(1);
+    bus.reset();
+
+    SECTION("Below the ceiling, the output is the delayed input")
+    {
+      auto in = sine(440, 0.5, 48000);
+      auto out = render(bus, in, 256);
+      // After the DC blocker settles, it only shifts the phase slightly
+      for (std::size_t i = 4800; i < out.left.size(); i++) {
+        REQUIRE(out.left[i] == Approx(in.left[i - MasterBus::latency]).margin(0.01));
+        REQUIRE(out.right[i] == Approx(in.right[i - MasterBus::latency]).margin(0.01));
+      }
+    }
+
+    SECTION("The output never goes above the ceiling")
+    {
+      bus.ceiling(0.5);
+      Stereo in{std::vector<float>(48000), std::vector<float>(48000)};
+      for (std::size_t i = 0; i < in.left.size(); i++) {
+        // Bursts of loud noise, with single peaks in between
+        float amp = (i / 2000) % 2 ? 4.f : 0.1f;
+        if (i % 997 == 0) amp = 10;
+        in.left[i] = Random::get(-amp, amp);
+        in.right[i] = Random::get(-amp, amp);
+      }
+      for (std::size_t block : {1, 37, 256}) {
+        CAPTURE(block);
+        bus.reset();
+        auto out = render(bus, in, block);
+        for (std::size_t i = 0; i < out.left.size(); i++) {
+          REQUIRE(std::abs(out.left[i]) <= 0.5f + 1e-6f);
+          REQUIRE(std::abs(out.right[i]) <= 0.5f + 1e-6f);
+        }
+      }
+    }
+
+    SECTION("The output is the same at any block size")
+    {
+      auto in = sine(1000, 2, 20000, 0.2);
+      auto expected = render(bus, in, 20000);
+      for (std::size_t block : {1, 31, 32, 64, 1000}) {
+        CAPTURE(block);
+        bus.reset();
+        auto out = render(bus, in, block);
+        REQUIRE(out.left == expected.left);
+        REQUIRE(out.right == expected.right);
+      }
+    }
+
+    SECTION("DC is removed")
+    {
+      auto out = render(bus, sine(100, 0.1, 48000, 0.5), 256);
+      float mean = 0;
+      for (std::size_t i = 24000; i < out.left.size(); i++) mean += out.left[i];
+      mean /= 24000;
+      REQUIRE(mean == Approx(0).margin(0.005));
+    }
+
+    SECTION("The gain is smoothed")
+    {
+      render(bus, sine(50, 0.5, 4800), 256);
+      bus.gain(0);
+      auto out = render(bus, sine(50, 0.5, 4800), 256);
+      for (std::size_t i = 1; i < out.left.size(); i++) {
+        REQUIRE(std::abs(out.left[i] - out.left[i - 1]) < 0.01f);
+      }
+      REQUIRE(out.left.back() == Approx(0).margin(0.01));
+    }
+
+    SECTION("Levels are metered after the limiter")
+    {
+      bus.ceiling(1);
+      render(bus, sine(480, 0.5, 48000), 256);
+      auto levels = bus.take_levels();
+      for (int c = 0; c < 2; c++) {
+        REQUIRE(levels.peak[c] == Approx(0.5).margin(0.01));
+        REQUIRE(levels.rms[c] == Approx(0.5 / std::sqrt(2)).margin(0.01));
+      }
+      render(bus, sine(480, 4, 4800), 256);
+      levels = bus.take_levels();
+      REQUIRE(levels.peak[0] <= 1 + 1e-6f);
+      REQUIRE(levels.peak[0] > 0.9f);
+    }
+  }
+
+  TEST_CASE("MasterBus benchmark", "[util] [dsp] [master] [benchmark]")
+  {
+    auto in = sine(440, 1.5, 256);
+    auto buf = in;
+    OBENCH_SECTION ("One block of 256 frames") {
+      // The same stages, each a pass over the block
+      OBENCH ("separate passes", 10000) {
+        float gain = 0.8f;
+        float pole = 0.9993f;
+        float dc_in[2] = {};
+        float dc_out[2] = {};
+        float limit = 1;
+        float peak = 0;
+        float sum = 0;
+        buf = in;
+        for (auto* ch : {&buf.left, &buf.right}) {
+          kernels::scale(ch->data(), ch->size(), gain);
+        }
+        int c = 0;
+        for (auto* ch : {&buf.left, &buf.right}) {
+          for (auto& x : *ch) {
+            float y = x - dc_in[c] + pole * dc_out[c];
+            dc_in[c] = x;
+            dc_out[c] = y;
+            x = y;
+          }
+          c++;
+        }
+        for (std::size_t i = 0; i < buf.left.size(); i++) {
+          float level = std::max(std::abs(buf.left[i]), std::abs(buf.right[i]));
+          limit = std::min(level > 0.98f ? 0.98f / level : 1.f, limit + (1 - limit) * 0.001f);
+          buf.left[i] *= limit;
+          buf.right[i] *= limit;
+        }
+        for (auto* ch : {&buf.left, &buf.right}) {
+          for (auto x : *ch) {
+            peak = std::max(peak, std::abs(x));
+            sum += x * x;
+          }
+        }
+        OBENCH_SKIP
+        {
+          REQUIRE(peak <= 1.f);
+          REQUIRE(sum > 0);
+        }
+      }
+      MasterBus bus(48000);
+      bus.gain(0.8f);
+      OBENCH ("MasterBus", 10000) {
+        buf = in;
+        bus.process(buf.left, buf.right);
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,104 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/mod_matrix.hpp"
+
+namespace otto::util::dsp {
+
+  using Shape = ModMatrix::Shape;
+
+  TEST_CASE("ModMatrix", "[util] [dsp] [modulation]")
+  {
+    ModMatrix mm(48000);
+
+    SECTION("LFO shapes")
+    {
+      // One cycle per 480 samples, read every 60
+      mm.lfo(0, 100, Shape::sine);
+      mm.lfo(1, 100, Shape::triangle);
+      mm.lfo(2, 100, Shape::saw);
+      mm.lfo(3, 100, Shape::square);
+      mm.lfo(4, 100, Shape::sine);
+      for (int i = 0; i < 16; i++) {
+        mm.process(60);
+        float phase = (i % 8) / 8.f;
+        CAPTURE(phase);
+        REQUIRE(mm.source(0) == Approx(std::sin(2 * M_PI * phase)).margin(1e-5));
+        REQUIRE(mm.source(1) == Approx(1 - 4 * std::abs(phase - 0.5)).margin(1e-5));
+        REQUIRE(mm.source(2) == Approx(2 * phase - 1).margin(1e-5));
+        REQUIRE(mm.source(3) == (phase < 0.5 ? 1 : -1));
+        // The second group of four
+        REQUIRE(mm.source(4) == Approx(mm.source(0)).margin(1e-6));
+      }
+    }
+
+    SECTION("Random LFOs hold a new value each cycle")
+    {
+      mm.lfo(5, 100, Shape::random);
+      std::vector<float> values;
+      for (int i = 0; i < 480 * 20; i += 60) {
+        mm.process(60);
+        float v = mm.source(5);
+        REQUIRE(v >= -1);
+        REQUIRE(v <= 1);
+        if (i % 480 != 0) REQUIRE(v == values.back());
+        values.push_back(v);
+      }
+      std::sort(values.begin(), values.end());
+      REQUIRE(std::unique(values.begin(), values.end()) - values.begin() >= 19);
+    }
+
+    SECTION("Routes sum into the offsets of their targets")
+    {
+      mm.set(8, 0.5);
+      mm.set(9, -1);
+      mm.route(0, 8, 3, 0.2);
+      mm.route(1, 9, 3, 0.1);
+      mm.route(2, 9, 31, 1);
+      mm.process(64);
+      REQUIRE(mm.offset(3) == Approx(0.5 * 0.2 - 0.1));
+      REQUIRE(mm.offset(31) == Approx(-1));
+      REQUIRE(mm.offset(0) == 0);
+
+      // Replacing and removing routes
+      mm.route(2, 8, 31, 1);
+      mm.unroute(1);
+      mm.process(64);
+      REQUIRE(mm.offset(3) == Approx(0.1));
+      REQUIRE(mm.offset(31) == Approx(0.5));
+    }
+  }
+
+  TEST_CASE("EnvelopeFollower", "[util] [dsp] [modulation]")
+  {
+    EnvelopeFollower ef(48000, 0.01, 0.1);
+    std::vector<float> loud(256, 0.f);
+    loud[100] = -0.8;
+    std::vector<float> silent(256, 0.f);
+
+    // Rises to the peak within the attack time
+    for (int i = 0; i < 48000 * 0.05; i += 256) ef.process(loud);
+    REQUIRE(ef.level() == Approx(0.8).epsilon(0.01));
+    // And falls back in the release time
+    float level = 0;
+    for (int i = 0; i < 4800; i += 256) level = ef.process(silent);
+    REQUIRE(level < 0.8 * 0.5);
+    REQUIRE(level > 0.8 * 0.2);
+  }
+
+  TEST_CASE("ModMatrix benchmark", "[util] [dsp] [modulation] [benchmark]")
+  {
+    ModMatrix mm(48000);
+    for (std::size_t i = 0; i < ModMatrix::num_lfos; i++) mm.lfo(i, 0.5 + i, Shape(i % 5));
+    for (std::size_t r = 0; r < 32; r++) mm.route(r, r % ModMatrix::num_sources, r, 0.5);
+
+    OBENCH_SECTION ("One second of blocks of 64") {
+      OBENCH ("32 routes", 10) {
+        for (int i = 0; i < 48000; i += 64) mm.process(64);
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,104 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/pitch_detector.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::vector<float> sine(float freq, std::size_t n, float samplerate = 48000)
+    {
+      std::vector<float> res(n);
+      for (std::size_t i = 0; i < n; i++) res[i] = 0.5 * std::sin(2 * M_PI * freq * i / samplerate);
+      return res;
+    }
+
+    std::vector<float> saw(float freq, std::size_t n, float samplerate = 48000)
+    {
+      std::vector<float> res(n);
+      for (std::size_t i = 0; i < n; i++) {
+        float phase = freq * i / samplerate;
+        res[i] = 0.5 * (2 * (phase - std::floor(phase)) - 1);
+      }
+      return res;
+    }
+
+    /// Feed `in` in blocks of 256, and return the last estimate
+    float detect(PitchDetector& det, const std::vector<float>& in)
+    {
+      for (std::size_t i = 0; i + 256 <= in.size(); i += 256) det.process({in.data() + i, 256});
+      return det.frequency();
+    }
+
+    float cents(float freq, float expected)
+    {
+      return 1200 * std::log2(freq / expected);
+    }
+  } // namespace
+
+  TEST_CASE("PitchDetector", "[util] [dsp] [pitch]")
+  {
+    PitchDetector det(48000);
+
+    SECTION("Sines are detected within 2 cents")
+    {
+      for (float freq : {41.2f, 82.41f, 110.f, 196.f, 440.f, 659.3f, 987.8f}) {
+        CAPTURE(freq);
+        float found = detect(det, sine(freq, 24000));
+        REQUIRE(std::abs(cents(found, freq)) < 2);
+        REQUIRE(det.clarity() > 0.9);
+      }
+    }
+
+    SECTION("The fundamental of a saw is detected, not a harmonic")
+    {
+      for (float freq : {55.f, 110.f, 329.6f}) {
+        CAPTURE(freq);
+        float found = detect(det, saw(freq, 24000));
+        REQUIRE(std::abs(cents(found, freq)) < 5);
+      }
+    }
+
+    SECTION("Other samplerates")
+    {
+      PitchDetector det44(44100);
+      float found = detect(det44, sine(440, 22050, 44100));
+      REQUIRE(std::abs(cents(found, 440)) < 2);
+    }
+
+    SECTION("Silence and noise have no pitch")
+    {
+      REQUIRE(detect(det, std::vector<float>(24000, 0.f)) == 0);
+      REQUIRE(det.clarity() == 0);
+
+      std::vector<float> noise(24000);
+      for (auto& s : noise) s = Random::get(-0.5f, 0.5f);
+      REQUIRE(detect(det, noise) == 0);
+      REQUIRE(det.clarity() < 0.5);
+    }
+
+    SECTION("Estimates follow a change of pitch")
+    {
+      detect(det, sine(220, 24000));
+      float found = detect(det, sine(330, 12000));
+      REQUIRE(std::abs(cents(found, 330)) < 2);
+    }
+  }
+
+  TEST_CASE("PitchDetector benchmark", "[util] [dsp] [pitch] [benchmark]")
+  {
+    auto in = saw(110, 48000);
+    PitchDetector det(48000);
+
+    OBENCH_SECTION ("One second of audio") {
+      for (int block : {64, 256}) {
+        OBENCH (fmt::format("Blocks of {}", block), 10) {
+          for (std::size_t i = 0; i + block <= in.size(); i += block) det.process({in.data() + i, block});
+        }
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
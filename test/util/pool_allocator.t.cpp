@@ -0,0 +1,236 @@
+#include "../testing.t.hpp"
+
+#include <list>
+#include <map>
+#include <set>
+#include <thread>
+
+#include "util/pool_allocator.hpp"
+
+#include "core/audio/midi.hpp"
+
+namespace otto::util {
+
+  TEST_CASE("memory_pool", "[util] [pool_allocator]")
+  {
+    memory_pool pool{24, 16};
+
+    SECTION("Block size is rounded up to the block alignment")
+    {
+      REQUIRE(pool.block_size() % memory_pool::block_alignment == 0);
+      REQUIRE(pool.block_size() >= 24);
+      REQUIRE(pool.capacity() == 16);
+    }
+
+    SECTION("All blocks can be allocated, and are distinct")
+    {
+      std::set<void*> ptrs;
+      for (int i = 0; i < 16; i++) {
+        auto* p = pool.allocate();
+        REQUIRE(p != nullptr);
+        REQUIRE(pool.owns(p));
+        REQUIRE(reinterpret_cast<std::uintptr_t>(p) % memory_pool::block_alignment == 0);
+        ptrs.insert(p);
+      }
+      REQUIRE(ptrs.size() == 16);
+      if constexpr (memory_pool::has_stats) {
+        REQUIRE(pool.stats().in_use == 16);
+        REQUIRE(pool.stats().high_water == 16);
+      }
+
+      SECTION("An exhausted pool returns nullptr, and counts the failure")
+      {
+        REQUIRE(pool.allocate() == nullptr);
+        REQUIRE(pool.allocate() == nullptr);
+        REQUIRE(pool.stats().failed_allocations == 2);
+      }
+
+      SECTION("Freed blocks are reused")
+      {
+        void* p = *ptrs.begin();
+        pool.deallocate(p);
+        if constexpr (memory_pool::has_stats) REQUIRE(pool.stats().in_use == 15);
+        REQUIRE(pool.allocate() == p);
+      }
+
+      for (auto* p : ptrs) pool.deallocate(p);
+      if constexpr (memory_pool::has_stats) {
+        REQUIRE(pool.stats().in_use == 0);
+        REQUIRE(pool.stats().high_water == 16);
+        pool.reset_stats();
+        REQUIRE(pool.stats().high_water == 0);
+      }
+    }
+
+    SECTION("Foreign pointers are not owned")
+    {
+      int i = 0;
+      REQUIRE_FALSE(pool.owns(&i));
+    }
+  }
+
+  TEST_CASE("pool_allocator", "[util] [pool_allocator]")
+  {
+    SECTION("Works with std::list")
+    {
+      memory_pool pool{64, 8};
+      std::list<int, pool_allocator<int>> list{pool_allocator<int>(pool)};
+      for (int i = 0; i < 8; i++) list.push_back(i);
+      REQUIRE_THROWS_AS(list.push_back(8), std::bad_alloc);
+      REQUIRE(list.size() == 8);
+      list.clear();
+      for (int i = 0; i < 8; i++) list.push_back(i);
+      REQUIRE(list.size() == 8);
+    }
+
+    SECTION("Works with std::map")
+    {
+      memory_pool pool{64, 32};
+      using Alloc = pool_allocator<std::pair<const int, float>>;
+      std::map<int, float, std::less<int>, Alloc> map{Alloc(pool)};
+      for (int i = 0; i < 32; i++) map[i] = i * 0.5f;
+      REQUIRE(map.at(10) == 5.f);
+      REQUIRE_THROWS_AS(map[32], std::bad_alloc);
+    }
+
+    SECTION("Works with std::allocate_shared")
+    {
+      memory_pool pool{64, 2};
+      auto a = std::allocate_shared<int>(pool_allocator<int>(pool), 1);
+      auto b = std::allocate_shared<int>(pool_allocator<int>(pool), 2);
+      REQUIRE_THROWS_AS(std::allocate_shared<int>(pool_allocator<int>(pool), 3), std::bad_alloc);
+      a.reset();
+      auto c = std::allocate_shared<int>(pool_allocator<int>(pool), 3);
+      REQUIRE(*b + *c == 5);
+    }
+
+    SECTION("Requests larger than a block fail deterministically")
+    {
+      memory_pool pool{16 * sizeof(float), 4};
+      std::vector<float, pool_allocator<float>> vec{pool_allocator<float>(pool)};
+      REQUIRE_NOTHROW(vec.reserve(16));
+      REQUIRE(vec.get_allocator().max_size() == 16);
+      REQUIRE_THROWS(vec.reserve(17));
+    }
+  }
+
+  TEST_CASE("shared_vector allocates from its pool", "[util] [pool_allocator]")
+  {
+    using core::midi::shared_vector;
+    auto& pool = core::midi::shared_vector_pool();
+    shared_vector<int> a;
+    shared_vector<int> b = std::vector<int>{1, 2, 3};
+    REQUIRE(pool.owns(&*a));
+    REQUIRE(pool.owns(&*b));
+    REQUIRE(b.back() == 3);
+
+    SECTION("And from the heap when the pool is exhausted")
+    {
+      std::vector<void*> blocks;
+      while (void* p = pool.allocate()) blocks.push_back(p);
+      shared_vector<int> c;
+      REQUIRE_FALSE(pool.owns(&*c));
+      c.push_back(1);
+      REQUIRE(c.front() == 1);
+      for (auto* p : blocks) pool.deallocate(p);
+    }
+  }
+
+  TEST_CASE("memory_pool under contention", "[util] [pool_allocator]")
+  {
+    constexpr int count = 1024;
+    memory_pool pool{32, count};
+
+    // The "audio thread" allocates, the "UI thread" frees.
+    std::atomic<void*> handover[count] = {};
+    std::thread ui_thread([&] {
+      for (int i = 0; i < count * 16; i++) {
+        void* p = nullptr;
+        while ((p = handover[i % count].exchange(nullptr)) == nullptr) std::this_thread::yield();
+        pool.deallocate(p);
+      }
+    });
+    for (int i = 0; i < count * 16; i++) {
+      void* p = nullptr;
+      while ((p = pool.allocate()) == nullptr) std::this_thread::yield();
+      while (handover[i % count].load() != nullptr) std::this_thread::yield();
+      handover[i % count] = p;
+    }
+    ui_thread.join();
+    if constexpr (memory_pool::has_stats) {
+      REQUIRE(pool.stats().in_use == 0);
+      REQUIRE(pool.stats().high_water <= count);
+    }
+  }
+
+  TEST_CASE("memory_pool benchmark", "[util] [pool_allocator] [benchmark]")
+  {
+    constexpr int count = 256;
+    std::array<void*, count> ptrs;
+
+    OBENCH_SECTION ("pool vs malloc, single thread") {
+      memory_pool pool{64, count};
+      OBENCH ("malloc", 1000) {
+        for (auto& p : ptrs) p = std::malloc(64);
+        for (auto& p : ptrs) std::free(p);
+      }
+      OBENCH ("memory_pool", 1000) {
+        for (auto& p : ptrs) p = pool.allocate();
+        for (auto& p : ptrs) pool.deallocate(p);
+      }
+    }
+
+    OBENCH_SECTION ("pool vs malloc, with frees from the UI thread") {
+      memory_pool pool{64, count * 2};
+      std::array<std::atomic<void*>, count> handover = {};
+      // 1: free with std::free, 2: free to the pool, 0: quit
+      std::atomic<int> mode = 1;
+
+      std::thread ui_thread([&] {
+        while (mode != 0) {
+          for (auto& h : handover) {
+            if (void* p = h.exchange(nullptr); p != nullptr) {
+              if (mode == 1)
+                std::free(p);
+              else
+                pool.deallocate(p);
+            }
+          }
+        }
+      });
+
+      auto hand_over = [&] {
+        for (int i = 0; i < count; i++) {
+          while (handover[i].load() != nullptr) std::this_thread::yield();
+          handover[i] = ptrs[i];
+        }
+      };
+
+      auto drain = [&] {
+        for (auto& h : handover) {
+          while (h.load() != nullptr) std::this_thread::yield();
+        }
+      };
+
+      OBENCH ("malloc", 1000) {
+        for (auto& p : ptrs) p = std::malloc(64);
+        OBENCH_SKIP {
+          hand_over();
+        }
+      }
+      drain();
+      mode = 2;
+      OBENCH ("memory_pool", 1000) {
+        for (auto& p : ptrs) p = pool.allocate();
+        OBENCH_SKIP {
+          hand_over();
+        }
+      }
+      drain();
+      mode = 0;
+      ui_thread.join();
+      REQUIRE(pool.stats().failed_allocations == 0);
+    }
+  }
+
+} // namespace otto::util
@@ -0,0 +1,154 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/resampler.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::vector<float> sine(double freq, double rate, std::size_t n)
+    {
+      std::vector<float> res(n);
+      for (std::size_t i = 0; i < n; i++) res[i] = std::sin(2 * M_PI * freq * i / rate);
+      return res;
+    }
+
+    /// SNR in dB of `out`, compared to the sine it should be, ignoring the
+    /// edges
+    double snr(const std::vector<float>& out, double freq, double rate)
+    {
+      double signal = 0;
+      double noise = 0;
+      for (std::size_t i = 1000; i + 1000 < out.size(); i++) {
+        double ideal = std::sin(2 * M_PI * freq * i / rate);
+        signal += ideal * ideal;
+        noise += (out[i] - ideal) * (out[i] - ideal);
+      }
+      return 10 * std::log10(signal / noise);
+    }
+
+    /// The worst SNR for sines up to `passband` times the lower nyquist
+    double worst_snr(ResamplerQuality q, double in_rate, double out_rate, double passband)
+    {
+      double nyquist = std::min(in_rate, out_rate) / 2;
+      double res = 1000;
+      for (double f : {0.01, 0.2, 0.5, 0.8, 1.0}) {
+        double freq = f * passband * nyquist;
+        auto out = resample(sine(freq, in_rate, 8000), in_rate, out_rate, q);
+        res = std::min(res, snr(out, freq, out_rate));
+      }
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE("Resampler", "[util] [dsp] [resampler]")
+  {
+    SECTION("Integer positions at a step of 1 are the input samples")
+    {
+      std::vector<float> in(100);
+      for (auto& s : in) s = Random::get(-1.f, 1.f);
+      Interpolator interpolate;
+      for (int i = 0; i < 100; i++) {
+        REQUIRE(interpolate(in, i) == Approx(in[i]).margin(1e-6));
+      }
+      REQUIRE(interpolate(in, -1000) == 0);
+      REQUIRE(interpolate(in, 1000) == 0);
+    }
+
+    SECTION("Offline conversion has the expected length and quality")
+    {
+      REQUIRE(resample(std::vector<float>(44100), 44100, 48000).size() == 48000);
+      REQUIRE(resample(std::vector<float>(48000), 48000, 44100).size() == 44100);
+
+      REQUIRE(worst_snr(ResamplerQuality::low, 44100, 48000, 0.8) > 50);
+      REQUIRE(worst_snr(ResamplerQuality::low, 48000, 44100, 0.8) > 50);
+      REQUIRE(worst_snr(ResamplerQuality::medium, 44100, 48000, 0.84) > 78);
+      REQUIRE(worst_snr(ResamplerQuality::medium, 48000, 44100, 0.84) > 78);
+      REQUIRE(worst_snr(ResamplerQuality::high, 44100, 48000, 0.86) > 105);
+      REQUIRE(worst_snr(ResamplerQuality::high, 48000, 44100, 0.86) > 105);
+    }
+
+    SECTION("Downsampling removes everything above the output nyquist")
+    {
+      // 15 kHz folds down to 7.05 kHz at 22.05 kHz
+      auto out = resample(sine(15000, 44100, 8000), 44100, 22050, ResamplerQuality::medium);
+      double power = 0;
+      for (std::size_t i = 500; i + 500 < out.size(); i++) power += out[i] * out[i];
+      power /= out.size() - 1000;
+      REQUIRE(10 * std::log10(power / 0.5) < -70);
+    }
+
+    SECTION("Streaming in random blocks matches offline conversion")
+    {
+      auto in = sine(1000, 44100, 10000);
+      auto expected = resample(in, 44100, 48000);
+      Resampler resampler(44100.0 / 48000.0);
+      std::vector<float> out;
+      std::size_t consumed = 0;
+      while (true) {
+        std::size_t n_in = std::min<std::size_t>(Random::get(1, 300), in.size() - consumed);
+        std::vector<float> block(Random::get(1, 300));
+        auto res = resampler.process({in.data() + consumed, std::ptrdiff_t(n_in)}, block);
+        REQUIRE(res.produced <= block.size());
+        consumed += res.consumed;
+        out.insert(out.end(), block.begin(), block.begin() + res.produced);
+        if (consumed == in.size() && res.produced == 0) break;
+      }
+      // Everything except the last `latency` input samples is converted
+      REQUIRE(out.size() + 48000.0 / 44100.0 * (resampler.latency() + 1) >= expected.size());
+      for (std::size_t i = 0; i < out.size(); i++) {
+        REQUIRE(out[i] == Approx(expected[i]).margin(1e-5));
+      }
+    }
+
+    SECTION("The step can change while streaming")
+    {
+      auto in = sine(440, 44100, 20000);
+      Resampler resampler(1, ResamplerQuality::low);
+      std::vector<float> out(64);
+      std::size_t consumed = 0;
+      std::size_t produced = 0;
+      double step = 0.25;
+      while (consumed < in.size()) {
+        resampler.step(step);
+        REQUIRE(resampler.step() == step);
+        step = step >= 4 ? 0.25 : step * 1.5;
+        auto res = resampler.process({in.data() + consumed, std::ptrdiff_t(in.size() - consumed)}, out);
+        consumed += res.consumed;
+        produced += res.produced;
+        for (std::size_t i = 0; i < res.produced; i++) {
+          REQUIRE(std::abs(out[i]) < 1.01f);
+        }
+      }
+      REQUIRE(produced > 0);
+    }
+  }
+
+  TEST_CASE("Resampler benchmark", "[util] [dsp] [resampler] [benchmark]")
+  {
+    auto in = sine(1000, 44100, 1 << 16);
+    OBENCH_SECTION ("Offline, 65536 samples") {
+      OBENCH ("low, 44.1 to 48 kHz", 20) {
+        resample(in, 44100, 48000, ResamplerQuality::low);
+      }
+      OBENCH ("medium, 44.1 to 48 kHz", 20) {
+        resample(in, 44100, 48000, ResamplerQuality::medium);
+      }
+      OBENCH ("high, 44.1 to 48 kHz", 20) {
+        resample(in, 44100, 48000, ResamplerQuality::high);
+      }
+      OBENCH ("low, 48 to 44.1 kHz", 20) {
+        resample(in, 48000, 44100, ResamplerQuality::low);
+      }
+      OBENCH ("medium, 48 to 44.1 kHz", 20) {
+        resample(in, 48000, 44100, ResamplerQuality::medium);
+      }
+      OBENCH ("high, 48 to 44.1 kHz", 20) {
+        resample(in, 48000, 44100, ResamplerQuality::high);
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
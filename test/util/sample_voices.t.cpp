@@ -0,0 +1,123 @@
+#include "../testing.t.hpp"
+
+#include <vector>
+
+#include "util/dsp/sample_voices.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    std::vector<float> random_sample(std::size_t n)
+    {
+      std::vector<float> res(n);
+      for (auto& s : res) s = Random::get(-1.f, 1.f);
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE("SampleVoices", "[util] [dsp] [voices]")
+  {
+    SampleVoices voices;
+
+    SECTION("Voices start at their offset, and are summed")
+    {
+      auto a = random_sample(1000);
+      auto b = random_sample(300);
+      std::vector<float> expected(2048, 0.f);
+      for (std::size_t i = 0; i < a.size(); i++) expected[37 + i] += a[i] * 0.5f;
+      for (std::size_t i = 0; i < b.size(); i++) expected[300 + i] += b[i];
+
+      voices.trigger(a, 0.5, 37);
+      voices.trigger(b, 1, 300);
+      std::vector<float> out(2048, 0.f);
+      // Blocks of 128, so b starts two blocks in
+      for (std::size_t i = 0; i < out.size(); i += 128) voices.process({out.data() + i, 128});
+      for (std::size_t i = 0; i < out.size(); i++) REQUIRE(out[i] == Approx(expected[i]).margin(1e-6));
+      REQUIRE(voices.active() == 0);
+    }
+
+    SECTION("Many voices are summed, whether they play the whole block or not")
+    {
+      std::vector<float> expected(4096, 0.f);
+      std::vector<std::vector<float>> samples;
+      for (int v = 0; v < 11; v++) samples.push_back(random_sample(Random::get(1, 3000)));
+      for (int v = 0; v < 11; v++) {
+        std::size_t offset = Random::get(0, 200);
+        float gain = Random::get(0.f, 1.f);
+        for (std::size_t i = 0; i < samples[v].size(); i++) {
+          expected[offset + i] += samples[v][i] * gain;
+        }
+        voices.trigger(samples[v], gain, offset);
+      }
+      std::vector<float> out(expected.size(), 0.f);
+      for (std::size_t i = 0; i < out.size(); i += 64) voices.process({out.data() + i, 64});
+      for (std::size_t i = 0; i < out.size(); i++) REQUIRE(out[i] == Approx(expected[i]).margin(1e-5));
+      REQUIRE(voices.active() == 0);
+    }
+
+    SECTION("The oldest voice is taken over when the pool is full")
+    {
+      std::vector<float> ones(10000, 1.f);
+      std::vector<float> out(64);
+      voices.trigger(ones, 1);
+      voices.process(out);
+      for (std::size_t i = 1; i < SampleVoices::max_voices; i++) voices.trigger(ones, 1);
+      voices.process(out);
+      REQUIRE(voices.active() == SampleVoices::max_voices);
+
+      // Replaces the first one
+      voices.trigger(ones, 1);
+      REQUIRE(voices.active() == SampleVoices::max_voices);
+      std::fill(out.begin(), out.end(), 0.f);
+      voices.process(out);
+      REQUIRE(out[0] == SampleVoices::max_voices);
+    }
+
+    SECTION("A sample is playing until its last voice has finished")
+    {
+      auto a = random_sample(300);
+      auto b = random_sample(300);
+      std::vector<float> out(128, 0.f);
+      voices.trigger(a, 1, 100);
+      REQUIRE(voices.playing(a));
+      REQUIRE_FALSE(voices.playing(b));
+      voices.process(out);
+      voices.trigger(a, 1);
+      voices.process(out);
+      voices.process(out);
+      // The second voice has 44 samples left
+      REQUIRE(voices.playing(a));
+      voices.process(out);
+      REQUIRE_FALSE(voices.playing(a));
+    }
+
+    SECTION("Stop silences all voices")
+    {
+      auto a = random_sample(1000);
+      voices.trigger(a, 1);
+      voices.stop();
+      std::vector<float> out(256, 0.f);
+      voices.process(out);
+      for (float s : out) REQUIRE(s == 0);
+    }
+  }
+
+  TEST_CASE("SampleVoices benchmark", "[util] [dsp] [voices] [benchmark]")
+  {
+    auto sample = std::vector<float>(48000 * 2);
+    for (auto& s : sample) s = Random::get(-1.f, 1.f);
+    std::vector<float> out(256);
+
+    OBENCH_SECTION ("One second of audio, by number of voices") {
+      for (int n : {4, 16, 32}) {
+        SampleVoices voices;
+        OBENCH (fmt::format("{} voices", n), 10) {
+          voices.stop();
+          for (int v = 0; v < n; v++) voices.trigger(sample, 0.1, v);
+          for (int i = 0; i < 48000; i += 256) voices.process(out);
+        }
+      }
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,156 @@
+#include "../testing.t.hpp"
+
+#include <cmath>
+#include <vector>
+
+#include "util/dsp/transport.hpp"
+
+namespace otto::util::dsp {
+
+  namespace {
+    /// Frames, from the start, of every `division` of a beat in `frames`
+    /// samples, processed in blocks of `block`
+    std::vector<std::int64_t> render(Transport& tr, double division, int frames, int block)
+    {
+      std::vector<std::int64_t> res;
+      for (int done = 0; done < frames; done += block) {
+        auto& b = tr.process(block);
+        b.for_each(division, [&](int frame, std::int64_t) { res.push_back(done + frame); });
+      }
+      return res;
+    }
+  } // namespace
+
+  TEST_CASE("Transport", "[util] [dsp] [transport]")
+  {
+    SECTION("Steps fall on the same frames at any buffer size")
+    {
+      for (int samplerate : {44100, 48000}) {
+        for (float bpm : {120.f, 137.5f}) {
+          double step = 60.0 * samplerate / bpm / 4;
+          std::vector<std::int64_t> expected;
+          for (int i = 0; i * step < 10 * samplerate; i++) {
+            expected.push_back(std::int64_t(std::floor(i * step + 1e-6)));
+          }
+          for (int block : {1, 64, 256, 1000, 4096}) {
+            CAPTURE(samplerate);
+            CAPTURE(bpm);
+            CAPTURE(block);
+            Transport tr(samplerate, bpm);
+            tr.start();
+            auto frames = render(tr, 0.25, expected.back() + 1, block);
+            frames.resize(std::min(frames.size(), expected.size()));
+            REQUIRE(frames == expected);
+          }
+        }
+      }
+    }
+
+    SECTION("Start takes effect at its offset")
+    {
+      Transport tr(48000, 120);
+      tr.start(100);
+      auto& b = tr.process(256);
+      REQUIRE(b.running());
+      REQUIRE(b.from == 100);
+      REQUIRE(b.begin == 0);
+      REQUIRE(b.end == Approx(156 / 24000.0));
+      REQUIRE(b.offset(0) == 100);
+      int steps = 0;
+      b.for_each(0.25, [&](int frame, std::int64_t i) {
+        REQUIRE(frame == 100);
+        REQUIRE(i == 0);
+        steps++;
+      });
+      REQUIRE(steps == 1);
+    }
+
+    SECTION("Stop and resume continue from the same position")
+    {
+      Transport tr(48000, 120);
+      tr.start();
+      tr.process(1000);
+      tr.stop(10);
+      auto& stopped = tr.process(256);
+      REQUIRE(stopped.to == 10);
+      REQUIRE(tr.position() == Approx(1010 / 24000.0));
+      REQUIRE(!tr.process(256).running());
+      REQUIRE(tr.position() == Approx(1010 / 24000.0));
+      tr.resume(20);
+      auto& b = tr.process(256);
+      REQUIRE(b.from == 20);
+      REQUIRE(b.begin == Approx(1010 / 24000.0));
+      REQUIRE(b.end == Approx(1246 / 24000.0));
+    }
+
+    SECTION("Stopped blocks have no steps")
+    {
+      Transport tr(48000, 120);
+      REQUIRE(render(tr, 0.25, 48000, 256).empty());
+      REQUIRE(tr.process(256).offset(1) == -1);
+    }
+
+    SECTION("A tempo change keeps the position")
+    {
+      Transport tr(48000, 120);
+      tr.start();
+      render(tr, 1, 24000, 100);
+      REQUIRE(tr.position() == Approx(1));
+      tr.bpm(60);
+      auto beats = render(tr, 1, 48000, 100);
+      REQUIRE(tr.position() == Approx(2));
+      REQUIRE(beats == std::vector<std::int64_t>{0});
+    }
+
+    SECTION("Following sets the tempo from the ticks")
+    {
+      Transport tr(48000, 120);
+      tr.follow(true);
+      tr.start();
+      // 240 BPM, a tick every 500 samples
+      std::int64_t time = 0;
+      std::int64_t next_tick = 0;
+      int ticks = 0;
+      for (; time < 48000; time += 100) {
+        for (; next_tick < time + 100; next_tick += 500, ticks++) tr.tick(next_tick - time);
+        tr.process(100);
+        REQUIRE(tr.position() >= (ticks - 1) / 24.0 - 1e-9);
+        REQUIRE(tr.position() <= ticks / 24.0 + 1e-9);
+      }
+      REQUIRE(tr.bpm() == Approx(240));
+
+      // Without ticks, it stops at the next one
+      for (int i = 0; i < 100; i++) tr.process(100);
+      REQUIRE(tr.position() == Approx(ticks / 24.0));
+    }
+
+    SECTION("Following waits for the first tick after start")
+    {
+      Transport tr(48000, 120);
+      tr.follow(true);
+      tr.start();
+      for (int i = 0; i < 10; i++) tr.process(256);
+      REQUIRE(tr.position() == 0);
+      tr.tick(0);
+      auto& b = tr.process(256);
+      REQUIRE(b.offset(0) == 0);
+      REQUIRE(tr.position() > 0);
+    }
+
+    SECTION("Ticks without timestamps still give the tempo")
+    {
+      Transport tr(48000, 120);
+      tr.follow(true);
+      tr.start();
+      // 130 BPM, but every tick at the start of its block
+      double tick = 60.0 * 48000 / 130 / 24;
+      double next_tick = 0;
+      for (std::int64_t time = 0; time < 5 * 48000; time += 256) {
+        for (; next_tick < time + 256; next_tick += tick) tr.tick(0);
+        tr.process(256);
+      }
+      REQUIRE(tr.bpm() == Approx(130).epsilon(0.02));
+    }
+  }
+
+} // namespace otto::util::dsp
@@ -0,0 +1,153 @@
+/// Prints the metrics OTTO publishes, see services/metrics.hpp
+///
+/// Maps the shared memory object read-only, so it never blocks or slows down
+/// OTTO. Can be run over ssh on a headless unit.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "services/metrics.hpp"
+
+using namespace otto::services::metrics;
+
+namespace {
+
+  constexpr const char* usage =
+    "Usage: otto_metrics [options]\n"
+    "\n"
+    "Print the runtime metrics of a running OTTO.\n"
+    "\n"
+    "Options:\n"
+    "  --once           Print the metrics once, and exit\n"
+    "  --interval MS    Time between updates, default 500\n"
+    "  --help           Show this message\n";
+
+  std::string format_bytes(std::uint64_t bytes)
+  {
+    if (bytes < 1024) return fmt::format("{} B", bytes);
+    if (bytes < 1024 * 1024) return fmt::format("{:.1f} KiB", bytes / 1024.0);
+    return fmt::format("{:.1f} MiB", bytes / (1024.0 * 1024.0));
+  }
+
+  std::string format(const otto::services::latency::Stats& l)
+  {
+    auto& h = l.histogram;
+    std::string res = fmt::format("\nLatency  notes {}   masked {}   unheard {}\n", h.count,
+                                  l.masked, l.unheard);
+    if (h.count == 0) return res;
+    res += fmt::format("         min {:.1f} ms   mean {:.1f} ms   p95 {:.0f} ms   max {:.1f} ms\n",
+                       h.min_ms, h.mean_ms(), h.quantile_ms(0.95), h.max_ms);
+    const auto* first = std::find_if(std::begin(h.buckets), std::end(h.buckets),
+                                     [](auto n) { return n > 0; });
+    const auto* last = std::find_if(std::rbegin(h.buckets), std::rend(h.buckets),
+                                    [](auto n) { return n > 0; })
+                         .base();
+    const auto most = *std::max_element(first, last);
+    for (const auto* b = first; b != last; b++) {
+      const int i = b - std::begin(h.buckets);
+      const auto edge = i * h.bucket_ms;
+      res += fmt::format("  {:>3}{} ms {:<40} {}\n", edge, i + 1 == h.bucket_count ? "+" : " ",
+                         std::string(std::size_t(40.0 * *b / most), '#'), *b);
+    }
+    return res;
+  }
+
+  std::string format(const Snapshot& s)
+  {
+    std::string res;
+    const auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       clock::now().time_since_epoch())
+                       .count();
+    const double age = (now - std::int64_t(s.time_ns)) / 1e9;
+    res += fmt::format("OTTO metrics, {} Hz, {} frames{}\n\n", s.samplerate, s.buffer_size,
+                       age > 1 ? fmt::format(" (not updated for {:.0f} s)", age) : "");
+    res += fmt::format("Audio    load {:5.1f}%   avg {:7.1f} us   max {:7.1f} us",
+                       100 * s.cpu_load, s.callback_avg_us, s.callback_max_us);
+    res += fmt::format("   budget {:.1f} us\n", s.callback_budget_us);
+    res += fmt::format("         callbacks {}   xruns {}\n", s.callbacks, s.xruns);
+    res += fmt::format("Voices   {}\n\n", s.voices);
+
+    res += "Engines\n";
+    for (std::uint32_t i = 0; i < s.engine_count && i < stage_count; i++) {
+      auto& e = s.engines[i];
+      res += fmt::format("  {:<12} {:<14} {:5.1f}%\n", e.stage, e.engine, 100 * e.load);
+    }
+
+    res += "\nMemory\n";
+    for (std::uint32_t i = 0; i < s.account_count && i < std::size(s.accounts); i++) {
+      auto& a = s.accounts[i];
+      res += fmt::format("  {:<16} {:>10}   peak {:>10}\n", a.name, format_bytes(a.bytes),
+                         format_bytes(a.peak));
+    }
+
+    res += fmt::format("\nUI       frames {}   avg {:.2f} ms   max {:.2f} ms\n", s.ui_frames,
+                       s.ui_frame_avg_ms, s.ui_frame_max_ms);
+    res += format(s.latency);
+    return res;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  bool once = false;
+  int interval = 500;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help") {
+      std::cout << usage;
+      return 0;
+    } else if (arg == "--once") {
+      once = true;
+    } else if (arg == "--interval" && i + 1 < argc) {
+      interval = std::stoi(argv[++i]);
+    } else {
+      std::cerr << "Unknown option " << arg << "\n\n" << usage;
+      return 1;
+    }
+  }
+
+  int fd = shm_open(segment_name, O_RDONLY, 0);
+  if (fd < 0) {
+    std::cerr << "Could not open " << segment_name << ": " << std::strerror(errno)
+              << "\nIs OTTO running, with OTTO_ENABLE_METRICS?\n";
+    return 1;
+  }
+  void* ptr = mmap(nullptr, sizeof(Segment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    std::cerr << "Could not map " << segment_name << ": " << std::strerror(errno) << "\n";
+    return 1;
+  }
+  const auto& segment = *static_cast<const Segment*>(ptr);
+  if (!compatible(segment)) {
+    std::cerr << "The metrics of this OTTO have version " << segment.version << ", expected "
+              << version << "\n";
+    return 1;
+  }
+
+  while (true) {
+    Snapshot snapshot;
+    if (read(segment, snapshot)) {
+      // Clear the terminal, unless printing once
+      if (!once) std::cout << "\033[H\033[2J";
+      std::cout << format(snapshot) << std::flush;
+      if (once) break;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+  }
+  munmap(ptr, sizeof(Segment));
+  return 0;
+}
@@ -0,0 +1,294 @@
+/// Replays a session log recorded with `--record`, see services/session.hpp
+///
+/// Runs the engines headless, like `otto_soak`, from the state at the start
+/// of the recording, and applies each input before the first block that
+/// starts at or after its frame. Every replay of a log renders the same
+/// audio, so it can be profiled, bisected, and compared by its checksum.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include "services/clock_manager.hpp"
+#include "services/engine_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/preset_manager.hpp"
+#include "services/session.hpp"
+#include "services/state_manager.hpp"
+#include "services/thread_pool.hpp"
+#include "services/ui_manager.hpp"
+#include "util/soundfile.hpp"
+
+using namespace otto;
+using namespace otto::services;
+
+namespace {
+
+  using clock = std::chrono::steady_clock;
+
+  constexpr const char* usage =
+    "Usage: otto_replay [options] LOG\n"
+    "\n"
+    "Replay a session recorded with `otto --record LOG`.\n"
+    "\n"
+    "Options:\n"
+    "  --realtime       Wait for each block's deadline, like an audio driver.\n"
+    "                   Otherwise, run as fast as possible\n"
+    "  --output FILE    Write the output to a wave file\n"
+    "  --tail SECONDS   Audio to render after the end of the log, default 1\n"
+    "  --help           Show this message\n";
+
+  struct Options {
+    fs::path log;
+    bool realtime = false;
+    std::optional<fs::path> output;
+    double tail = 1;
+
+    /// \throws `util::exception` for unknown or malformed arguments
+    static Options parse(int argc, char* argv[])
+    {
+      Options res;
+      bool has_log = false;
+      for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        auto value = [&] {
+          if (i + 1 >= argc) throw util::exception("Missing value for {}", arg);
+          return std::string(argv[++i]);
+        };
+        if (arg == "--realtime") res.realtime = true;
+        else if (arg == "--output") res.output = fs::path(value());
+        else if (arg == "--tail") res.tail = std::stod(value());
+        // Verbosity, handled by the logger
+        else if (arg.rfind("-v", 0) == 0) continue;
+        else if (arg.rfind("-", 0) == 0) throw util::exception("Unknown argument '{}'", arg);
+        else {
+          res.log = arg;
+          has_log = true;
+        }
+      }
+      if (!has_log) throw util::exception("No session log given");
+      return res;
+    }
+  };
+
+  /// Runs blocks through the engine manager, like an audio driver would
+  struct ReplayAudioManager final : AudioManager {
+    ReplayAudioManager(int samplerate, int buffer_size) : _input(buffer_size, 0.f)
+    {
+      _samplerate = samplerate;
+      buffer_pool().set_buffer_size(buffer_size);
+    }
+
+    /// Process one block of `nframes`, and write the interleaved output to
+    /// `out`
+    ///
+    /// \returns the time spent in the engines
+    clock::duration process(int nframes, std::vector<float>& out)
+    {
+      out.clear();
+      midi_bufs.swap();
+      int ref_count = 0;
+      auto in_buf = core::audio::AudioBufferHandle(_input.data(), nframes, ref_count);
+      auto t0 = clock::now();
+      auto res = Application::current().engine_manager->process(
+        {in_buf, {std::move(midi_bufs.inner())}, nframes});
+      auto time = clock::now() - t0;
+      for (int i = 0; i < nframes; i++) {
+        out.push_back(res.audio[0][i]);
+        out.push_back(res.audio[1][i]);
+      }
+      midi_bufs.inner() = res.midi.move_vector_out();
+      return time;
+    }
+
+  private:
+    std::vector<float> _input;
+  };
+
+  /// Has no UI, the inputs are applied from the log
+  struct ReplayUIManager final : UIManager {
+    void main_ui_loop() override {}
+
+    using UIManager::flush_events;
+    using UIManager::keypress;
+    using UIManager::keyrelease;
+    using UIManager::rotary;
+  };
+
+  /// Keeps the state in memory, so the state of the device is left alone
+  struct ReplayStateManager final : StateManager {
+    void load() override {}
+    void save() override {}
+
+    void attach(std::string name, Loader load, Saver save) override
+    {
+      if (_clients.count(name) != 0) {
+        throw util::exception("State handler '{}' is already attached", name);
+      }
+      _clients[name] = {name, std::move(load), std::move(save)};
+    }
+
+    void detach(std::string name) override
+    {
+      if (_clients.erase(name) == 0) {
+        throw util::exception("No state handler '{}' is attached", name);
+      }
+    }
+  };
+
+  /// The slots presets can be applied to, by their engine manager names
+  constexpr const char* preset_slots[] = {"Arpeggiator", "Synth", "Drums", "Effect1", "Effect2"};
+
+  void apply_preset(const session::Preset& preset)
+  {
+    auto& app = Application::current();
+    for (auto* slot : preset_slots) {
+      auto* engine = app.engine_manager->by_name(slot);
+      if (engine == nullptr || engine->name() != preset.engine) continue;
+      app.preset_manager->apply_preset(*engine, preset.name);
+      return;
+    }
+    LOGW("No engine {} to apply preset {} to", preset.engine, preset.name);
+  }
+
+  /// Apply an input from the log. Keys and rotaries are handled by the
+  /// caller flushing the UI events.
+  void apply(const session::Input& input)
+  {
+    auto& app = Application::current();
+    auto& ui = static_cast<ReplayUIManager&>(*app.ui_manager);
+    util::match(input, //
+                [&](const session::KeyPress& in) { ui.keypress(in.key); },
+                [&](const session::KeyRelease& in) { ui.keyrelease(in.key); },
+                [&](const core::ui::RotaryEvent& in) { ui.rotary(in); },
+                [&](const session::Midi& in) { app.audio_manager->send_midi_event(in.event()); },
+                [&](const session::Preset& in) { apply_preset(in); },
+                [&](const session::End&) {});
+  }
+
+  /// 64 bit FNV-1a of the bytes of the output, to compare replays by
+  struct Checksum {
+    void add(const std::vector<float>& samples) noexcept
+    {
+      auto* bytes = reinterpret_cast<const unsigned char*>(samples.data());
+      for (std::size_t i = 0; i < samples.size() * sizeof(float); i++) {
+        value = (value ^ bytes[i]) * 0x100000001b3;
+      }
+    }
+
+    std::uint64_t value = 0xcbf29ce484222325;
+  };
+
+  int replay(const Options& options, session::Reader& reader)
+  {
+    auto& app = Application::current();
+    auto& audio = static_cast<ReplayAudioManager&>(*app.audio_manager);
+    auto& ui = static_cast<ReplayUIManager&>(*app.ui_manager);
+    const auto& header = reader.header();
+    const int nframes = header.buffer_size;
+
+    std::optional<util::SoundFile> file;
+    if (options.output) {
+      if (fs::exists(*options.output)) fs::remove(*options.output);
+      file.emplace();
+      file->open(*options.output);
+      file->info.channels = 2;
+      file->info.samplerate = header.samplerate;
+    }
+
+    std::vector<float> output;
+    Checksum checksum;
+    std::uint64_t frame = 0;
+    std::optional<std::uint64_t> end;
+    std::uint64_t blocks = 0;
+    clock::duration processing = {};
+    auto deadline = clock::now();
+    const auto block_time = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(double(nframes) / header.samplerate));
+
+    auto next = reader.next();
+    while ((!end || frame < *end) && app.running()) {
+      for (; next && next->frame <= frame; next = reader.next()) {
+        if (mpark::holds_alternative<session::End>(next->input)) {
+          end = next->frame + std::uint64_t(options.tail * header.samplerate);
+        }
+        apply(next->input);
+      }
+      // A log without an end was cut off, play it to where it stops
+      if (!next && !end) end = frame + std::uint64_t(options.tail * header.samplerate);
+      ui.flush_events();
+      // Loads started by the inputs complete before the block, as they
+      // would have on a device that was not profiling
+      app.thread_pool->wait_idle();
+
+      if (options.realtime) {
+        deadline += block_time;
+        std::this_thread::sleep_until(deadline);
+      }
+      processing += audio.process(nframes, output);
+      checksum.add(output);
+      if (file) file->write_samples(output.begin(), output.end());
+      frame += nframes;
+      blocks++;
+    }
+
+    const double seconds = double(frame) / header.samplerate;
+    const double cpu = std::chrono::duration<double>(processing).count();
+    std::cout << fmt::format("Replayed {} blocks of {} frames, {:.2f} s of audio\n", blocks,
+                             nframes, seconds);
+    std::cout << fmt::format("Processing took {:.3f} s, {:.1f}% of the audio time\n", cpu,
+                             100 * cpu / seconds);
+    std::cout << fmt::format("Checksum {:016x}\n", checksum.value);
+    if (file) {
+      file->close();
+      std::cout << "Wrote " << options.output->c_str() << "\n";
+    }
+    return 0;
+  }
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--help") {
+      std::cout << usage;
+      return 0;
+    }
+  }
+
+  try {
+    auto options = Options::parse(argc, argv);
+    session::Reader reader(options.log);
+    const auto& header = reader.header();
+    Application app{[&] { return std::make_unique<LogManager>(argc, argv); },
+                    ThreadPool::create_default,
+                    [] { return std::make_unique<ReplayStateManager>(); },
+                    std::make_unique<PresetManager>,
+                    [&] {
+                      return std::make_unique<ReplayAudioManager>(header.samplerate,
+                                                                  header.buffer_size);
+                    },
+                    [] { return std::make_unique<ReplayUIManager>(); },
+                    std::make_unique<ClockManager>,
+                    EngineManager::create_default};
+
+    std::signal(SIGINT, Application::handle_signal);
+    std::signal(SIGTERM, Application::handle_signal);
+
+    auto state = header.state;
+    app.state_manager->restore(state);
+    app.thread_pool->wait_idle();
+    app.engine_manager->start();
+    app.audio_manager->start();
+
+    return replay(options, reader);
+  } catch (std::exception& e) {
+    std::cerr << e.what() << "\n\n" << usage;
+    return 1;
+  }
+}
@@ -0,0 +1,84 @@
+#include <csignal>
+#include <iostream>
+
+#include "services/clock_manager.hpp"
+#include "services/engine_manager.hpp"
+#include "services/log_manager.hpp"
+#include "services/preset_manager.hpp"
+#include "services/state_manager.hpp"
+#include "services/thread_pool.hpp"
+#include "services/ui_manager.hpp"
+
+#include "soak.hpp"
+
+using namespace otto;
+using namespace otto::services;
+
+/// Has no UI, the soak test drives everything
+struct SoakUIManager final : UIManager {
+  void main_ui_loop() override {}
+};
+
+/// Keeps the state in memory, so every run starts from the defaults, and
+/// the state of the device is left alone
+struct SoakStateManager final : StateManager {
+  void load() override {}
+  void save() override {}
+
+  void attach(std::string name, Loader load, Saver save) override
+  {
+    if (_clients.count(name) != 0) {
+      throw util::exception("State handler '{}' is already attached", name);
+    }
+    _clients[name] = {name, std::move(load), std::move(save)};
+  }
+
+  void detach(std::string name) override
+  {
+    if (_clients.erase(name) == 0) {
+      throw util::exception("No state handler '{}' is attached", name);
+    }
+  }
+};
+
+int main(int argc, char* argv[])
+{
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--help") {
+      std::cout << soak::Options::usage();
+      return 0;
+    }
+  }
+
+  try {
+    auto options = soak::Options::parse(argc, argv);
+    Application app{[&] { return std::make_unique<LogManager>(argc, argv); },
+                    ThreadPool::create_default,
+                    [] { return std::make_unique<SoakStateManager>(); },
+                    std::make_unique<PresetManager>,
+                    [&] {
+                      return std::make_unique<soak::SoakAudioManager>(options.samplerate,
+                                                                      options.buffer_size);
+                    },
+                    [] { return std::make_unique<SoakUIManager>(); },
+                    std::make_unique<ClockManager>,
+                    EngineManager::create_default};
+
+    std::signal(SIGINT, Application::handle_signal);
+    std::signal(SIGTERM, Application::handle_signal);
+
+    app.engine_manager->start();
+    app.audio_manager->start();
+    app.clock_manager->start();
+
+    if (!soak::run(options)) {
+      LOGE("Soak test failed");
+      return 1;
+    }
+    LOGI("Soak test passed");
+  } catch (std::exception& e) {
+    std::cerr << e.what() << "\n" << soak::Options::usage();
+    return 1;
+  }
+  return 0;
+}
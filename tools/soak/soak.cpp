@@ -0,0 +1,454 @@
+#include "soak.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+
+#include "core/engine/engine_dispatcher.hpp"
+#include "services/engine_manager.hpp"
+#include "services/latency.hpp"
+#include "services/log_manager.hpp"
+#include "services/preset_manager.hpp"
+#include "util/exception.hpp"
+#include "util/utility.hpp"
+
+namespace otto::soak {
+
+  using namespace core;
+  using clock = std::chrono::steady_clock;
+
+  // OPTIONS //
+
+  Options Options::parse(int argc, char* argv[])
+  {
+    Options res;
+    for (int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      auto value = [&] {
+        if (i + 1 >= argc) throw util::exception("Missing value for {}", arg);
+        return std::string(argv[++i]);
+      };
+      if (arg == "--duration") res.duration = std::stod(value());
+      else if (arg == "--seed") res.seed = std::stoul(value());
+      else if (arg == "--samplerate") res.samplerate = std::stoi(value());
+      else if (arg == "--buffer-size") res.buffer_size = std::stoi(value());
+      else if (arg == "--realtime") res.realtime = true;
+      else if (arg == "--window") res.window = std::stod(value());
+      else if (arg == "--switch-interval") res.switch_interval = std::stod(value());
+      else if (arg == "--max-p99") res.max_p99 = std::stod(value());
+      else if (arg == "--max-xruns") res.max_xruns = std::stoi(value());
+      else if (arg == "--max-buffers") res.max_buffers = std::stoul(value());
+      else if (arg == "--buffer-margin") res.buffer_margin = std::stoul(value());
+      else if (arg == "--max-rss-growth") res.max_rss_growth = std::stod(value());
+      else if (arg == "--max-silent-ratio") res.max_silent_ratio = std::stod(value());
+      // Verbosity, handled by the logger
+      else if (arg.rfind("-v", 0) == 0) continue;
+      else throw util::exception("Unknown argument '{}'", arg);
+    }
+    if (res.buffer_size <= 0 || res.samplerate <= 0 || res.window <= 0) {
+      throw util::exception("The buffer size, samplerate and window must be positive");
+    }
+    if (res.max_buffers >= core::audio::AudioBufferPool::number_of_buffers) {
+      throw util::exception("--max-buffers must be less than {}, running out of buffers terminates",
+                            core::audio::AudioBufferPool::number_of_buffers);
+    }
+    return res;
+  }
+
+  std::string Options::usage()
+  {
+    Options d;
+    return fmt::format(
+      "Usage: otto_soak [options]\n"
+      "  --duration SECONDS         audio time to run for ({})\n"
+      "  --seed N                   seed of the MIDI and the changes ({})\n"
+      "  --samplerate HZ            ({})\n"
+      "  --buffer-size FRAMES       ({})\n"
+      "  --realtime                 wait for each block's deadline\n"
+      "  --window SECONDS           audio time between reports ({})\n"
+      "  --switch-interval SECONDS  audio time between engine changes ({})\n"
+      "Fails when, in any window:\n"
+      "  --max-p99 FRACTION         the 99th percentile block time is over this part of the "
+      "block ({})\n"
+      "  --max-xruns N              more blocks than this take longer than they play ({})\n"
+      "  --max-buffers N            more audio buffers than this are in use. 0 for the first\n"
+      "                             window's use plus --buffer-margin, below {} ({})\n"
+      "  --buffer-margin N          buffers over the first window's use that are allowed ({})\n"
+      "  --max-rss-growth MIB       memory grows more than this after the first window ({})\n"
+      "  --max-silent-ratio RATIO   silent blocks take this much longer than others ({})\n",
+      d.duration, d.seed, d.samplerate, d.buffer_size, d.window, d.switch_interval, d.max_p99,
+      d.max_xruns, core::audio::AudioBufferPool::number_of_buffers, d.max_buffers,
+      d.buffer_margin, d.max_rss_growth, d.max_silent_ratio);
+  }
+
+  // MIDI GENERATOR //
+
+  MidiGenerator::MidiGenerator(std::uint32_t seed, int samplerate)
+    : _rng(seed), _samplerate(samplerate)
+  {}
+
+  void MidiGenerator::generate(int nframes, midi::shared_vector<midi::AnyMidiEvent>& out)
+  {
+    auto uniform = [this](double lo, double hi) {
+      return std::uniform_real_distribution<double>(lo, hi)(_rng);
+    };
+    auto frames = [this](double seconds) { return std::int64_t(seconds * _samplerate); };
+
+    // Note offs go first, so a key can be played again in the same block
+    std::vector<midi::AnyMidiEvent> offs;
+    std::vector<midi::AnyMidiEvent> ons;
+    for (auto& held : _held) {
+      if (held.left < nframes) {
+        offs.push_back(midi::NoteOffEvent(held.key, 0, 0, int(held.left)));
+      }
+      held.left -= nframes;
+    }
+    _held.erase(std::remove_if(_held.begin(), _held.end(), [](auto& h) { return h.left < 0; }),
+                _held.end());
+
+    if (_phase_left <= 0) {
+      _playing = !_playing;
+      _phase_left = _playing ? frames(uniform(4, 12)) : frames(uniform(2, 6));
+      _next_note = 0;
+    }
+    for (; _playing && _next_note < nframes; _next_note += frames(uniform(0.05, 0.5))) {
+      const int time = int(_next_note);
+      const int root = std::uniform_int_distribution<int>(36, 84)(_rng);
+      const int notes = std::uniform_int_distribution<int>(1, 3)(_rng);
+      for (int n = 0; n < notes; n++) {
+        const int key = root + 4 * n;
+        ons.push_back(midi::NoteOnEvent(key, uniform(0.2, 1), 0, time));
+        _held.push_back({key, time + frames(uniform(0.05, 1.5))});
+      }
+      if (uniform(0, 1) < 0.2) {
+        // Mod wheel
+        using byte = midi::MidiEvent::byte;
+        byte bytes[] = {0xB0, 1, byte(std::uniform_int_distribution<int>(0, 127)(_rng))};
+        ons.push_back(midi::ControlChangeEvent::from_bytes(bytes, time));
+      }
+    }
+    if (_playing) _next_note -= nframes;
+    _phase_left -= nframes;
+
+    auto time = [](const midi::AnyMidiEvent& ev) {
+      return util::match(ev, [](auto& e) { return e.time; });
+    };
+    offs.insert(offs.end(), ons.begin(), ons.end());
+    std::stable_sort(offs.begin(), offs.end(),
+                     [&](auto& a, auto& b) { return time(a) < time(b); });
+    for (auto& ev : offs) out.push_back(std::move(ev));
+  }
+
+  // AUDIO MANAGER //
+
+  SoakAudioManager::SoakAudioManager(int samplerate, int buffer_size) : _input(buffer_size, 0.f)
+  {
+    _samplerate = samplerate;
+    buffer_pool().set_buffer_size(buffer_size);
+  }
+
+  SoakAudioManager::Block SoakAudioManager::process(int nframes)
+  {
+    Block res;
+    midi_bufs.swap();
+
+    int ref_count = 0;
+    auto in_buf = audio::AudioBufferHandle(_input.data(), nframes, ref_count);
+    auto t0 = clock::now();
+    auto out = Application::current().engine_manager->process(
+      {in_buf, {std::move(midi_bufs.inner())}, nframes});
+    auto t1 = clock::now();
+
+    for (auto& buf : out.audio) {
+      for (int i = 0; i < nframes; i++) {
+        res.peak = std::max(res.peak, std::abs(buf[i]));
+        if (std::fpclassify(buf[i]) == FP_SUBNORMAL) res.subnormals++;
+      }
+    }
+    midi_bufs.inner() = out.midi.move_vector_out();
+    // Without a driver, a block is heard when it is processed
+    services::latency::block(out.audio[0].data(), out.audio[1].data(), nframes,
+                             services::latency::to_ns(t0), _samplerate);
+
+    res.seconds = std::chrono::duration<double>(t1 - t0).count();
+    _cpu_time.add(res.seconds * _samplerate / nframes);
+    return res;
+  }
+
+  // RUNNER //
+
+  namespace {
+
+    /// Resident memory, in MiB, or 0 where it can not be read
+    double rss()
+    {
+#if defined(__linux__)
+      std::ifstream statm("/proc/self/statm");
+      long pages = 0;
+      long resident = 0;
+      if (statm >> pages >> resident) return resident * double(sysconf(_SC_PAGESIZE)) / (1 << 20);
+#endif
+      return 0;
+    }
+
+    /// The `p` quantile of `values`, which are reordered
+    double quantile(std::vector<double>& values, double p)
+    {
+      if (values.empty()) return 0;
+      auto nth = values.begin() + std::min(values.size() - 1, std::size_t(p * values.size()));
+      std::nth_element(values.begin(), nth, values.end());
+      return *nth;
+    }
+
+    /// Moves one numeric property of an engine a little every block
+    struct Sweep {
+      props::property_base* prop = nullptr;
+      bool integer = false;
+      double value = 0;
+      double step = 0;
+      int blocks_left = 0;
+    };
+
+    /// Add the numeric leaves under `branch` to `out`
+    void find_numbers(props::branch_base& branch, std::vector<props::property_base*>& out)
+    {
+      for (props::property_base& child : branch.children()) {
+        if (auto* sub = dynamic_cast<props::branch_base*>(&child)) {
+          find_numbers(*sub, out);
+        } else if (child.is<props::serializable>()) {
+          auto json = child.as<props::serializable>().to_json();
+          if (json.is_number() && !json.is_boolean()) out.push_back(&child);
+        }
+      }
+    }
+
+    struct Runner {
+      Runner(const Options& options)
+        : options(options),
+          audio(static_cast<SoakAudioManager&>(*Application::current().audio_manager)),
+          engines(*Application::current().engine_manager),
+          midi(options.seed, options.samplerate),
+          rng(options.seed + 1)
+      {}
+
+      bool run();
+
+    private:
+      /// Switch an engine, or apply a preset
+      void change();
+      /// Start sweeping a new property
+      void start_sweep();
+      void step_sweep();
+      /// Report the window, and check the limits
+      ///
+      /// \returns `false` if a limit was exceeded
+      bool report(double seconds);
+
+      int random(int lo, int hi)
+      {
+        return std::uniform_int_distribution<int>(lo, hi)(rng);
+      }
+
+      const Options& options;
+      SoakAudioManager& audio;
+      services::EngineManager& engines;
+      MidiGenerator midi;
+      std::mt19937 rng;
+      Sweep sweep;
+
+      /// Block times in the window, as a fraction of the block length
+      std::vector<double> times;
+      std::vector<double> silent_times;
+      std::vector<double> sound_times;
+      int xruns = 0;
+      int subnormals = 0;
+      double first_rss = 0;
+      std::size_t max_buffers = 0;
+      int window_count = 0;
+    };
+
+    bool Runner::run()
+    {
+      const int n = options.buffer_size;
+      const double block_seconds = double(n) / options.samplerate;
+      const auto blocks = std::int64_t(options.duration / block_seconds);
+      const auto window_blocks = std::max<std::int64_t>(1, options.window / block_seconds);
+      const auto switch_blocks = std::max<std::int64_t>(1, options.switch_interval / block_seconds);
+      times.reserve(window_blocks);
+      silent_times.reserve(window_blocks);
+      sound_times.reserve(window_blocks);
+
+      LOGI("Soaking for {} s of audio, {} frames at {} Hz, seed {}", options.duration, n,
+           options.samplerate, options.seed);
+      start_sweep();
+      auto deadline = clock::now();
+      for (std::int64_t b = 0; b < blocks && Application::current().running(); b++) {
+        if (b > 0 && b % switch_blocks == 0) change();
+        step_sweep();
+
+        midi::shared_vector<midi::AnyMidiEvent> events;
+        midi.generate(n, events);
+        for (auto& ev : events) audio.send_midi_event(ev);
+
+        auto block = audio.process(n);
+        const double load = block.seconds / block_seconds;
+        times.push_back(load);
+        (block.peak < 1e-4f ? silent_times : sound_times).push_back(load);
+        if (load > 1) xruns++;
+        subnormals += block.subnormals;
+
+        if (options.realtime) {
+          deadline += std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(block_seconds));
+          std::this_thread::sleep_until(deadline);
+        }
+        if ((b + 1) % window_blocks == 0 || b + 1 == blocks) {
+          if (!report((b + 1) * block_seconds)) return false;
+        }
+      }
+      return true;
+    }
+
+    void Runner::change()
+    {
+      static const char* slots[] = {"Synth", "Effect1", "Effect2", "Arpeggiator"};
+      const int action = random(0, 4);
+      if (action < 4) {
+        auto* dispatcher = engines.dispatcher(slots[action]);
+        if (dispatcher == nullptr || dispatcher->engine_count() == 0) return;
+        auto& engine = dispatcher->select(random(0, int(dispatcher->engine_count()) - 1));
+        LOGI("{}: {}", slots[action], engine.name());
+      } else {
+        auto* synth = engines.by_name("Synth");
+        if (synth == nullptr) return;
+        auto& presets = *Application::current().preset_manager;
+        try {
+          auto& names = presets.preset_names(synth->name());
+          if (names.empty()) return;
+          int idx = random(0, int(names.size()) - 1);
+          presets.apply_preset(*synth, idx);
+          LOGI("{} preset: {}", synth->name(), names[idx]);
+        } catch (services::PresetManager::exception& e) {
+          // Engines without presets
+        }
+      }
+      // The swept property may have been destroyed with its engine
+      start_sweep();
+    }
+
+    void Runner::start_sweep()
+    {
+      sweep = {};
+      static const char* slots[] = {"Synth", "Effect1", "Effect2"};
+      auto* engine = engines.by_name(slots[random(0, 2)]);
+      if (engine == nullptr) return;
+      std::vector<props::property_base*> numbers;
+      find_numbers(engine->props(), numbers);
+      if (numbers.empty()) return;
+      sweep.prop = numbers[random(0, int(numbers.size()) - 1)];
+      auto json = sweep.prop->as<props::serializable>().to_json();
+      sweep.integer = json.is_number_integer();
+      sweep.value = json.get<double>();
+      // About a second, up or down by up to the value itself
+      const double block_seconds = double(options.buffer_size) / options.samplerate;
+      sweep.blocks_left = std::max(1, int(1 / block_seconds));
+      const double range = std::max(std::abs(sweep.value), 1.0);
+      sweep.step = std::uniform_real_distribution<double>(-range, range)(rng) / sweep.blocks_left;
+    }
+
+    void Runner::step_sweep()
+    {
+      if (sweep.prop == nullptr) return;
+      if (sweep.blocks_left-- <= 0) return start_sweep();
+      sweep.value += sweep.step;
+      auto& prop = sweep.prop->as<props::serializable>();
+      if (sweep.integer) {
+        prop.from_json(std::lround(sweep.value));
+      } else {
+        prop.from_json(sweep.value);
+      }
+    }
+
+    bool Runner::report(double seconds)
+    {
+      window_count++;
+      const double p50 = quantile(times, 0.5);
+      const double p99 = quantile(times, 0.99);
+      const double max = times.empty() ? 0 : *std::max_element(times.begin(), times.end());
+      const std::size_t buffers = audio.buffer_pool().high_water();
+      const double memory = rss();
+      if (window_count == 1) {
+        first_rss = memory;
+        max_buffers = options.max_buffers;
+        if (max_buffers == 0) {
+          max_buffers = std::min(buffers + options.buffer_margin,
+                                 std::size_t(core::audio::AudioBufferPool::number_of_buffers - 1));
+        }
+      }
+      // Needs enough of both to be meaningful
+      double silent_ratio = 0;
+      if (silent_times.size() >= 10 && sound_times.size() >= 10) {
+        silent_ratio = quantile(silent_times, 0.5) / std::max(quantile(sound_times, 0.5), 1e-9);
+      }
+
+      LOGI(
+        "{:7.0f} s | block time p50 {:5.1f}% p99 {:5.1f}% max {:5.1f}% | xruns {} | buffers {} | "
+        "rss {:.1f} MiB | silent/sound {:.2f} | denormal output samples {}",
+        seconds, p50 * 100, p99 * 100, max * 100, xruns, buffers, memory, silent_ratio,
+        subnormals);
+      const auto latency = services::latency::stats();
+      if (latency.histogram.count > 0) {
+        auto& h = latency.histogram;
+        LOGI("{:7.0f} s | note to sound p50 {:.0f} ms p99 {:.0f} ms max {:.1f} ms | {} notes, "
+             "{} masked, {} unheard",
+             seconds, h.quantile_ms(0.5), h.quantile_ms(0.99), h.max_ms, h.count, latency.masked,
+             latency.unheard);
+      }
+
+      std::vector<std::string> failures;
+      if (p99 > options.max_p99) {
+        failures.push_back(fmt::format("99th percentile block time {:.1f}% is over {:.1f}%",
+                                       p99 * 100, options.max_p99 * 100));
+      }
+      if (xruns > options.max_xruns) {
+        failures.push_back(fmt::format("{} blocks took longer than they play, more than {}", xruns,
+                                       options.max_xruns));
+      }
+      if (buffers > max_buffers) {
+        failures.push_back(
+          fmt::format("{} audio buffers in use, more than {}", buffers, max_buffers));
+      }
+      if (memory - first_rss > options.max_rss_growth) {
+        failures.push_back(fmt::format("Memory grew by {:.1f} MiB, more than {:.1f} MiB",
+                                       memory - first_rss, options.max_rss_growth));
+      }
+      if (silent_ratio > options.max_silent_ratio) {
+        failures.push_back(
+          fmt::format("Silent blocks take {:.2f} times as long as others, more than {:.2f}. "
+                      "Denormals in the decaying tails?",
+                      silent_ratio, options.max_silent_ratio));
+      }
+      for (auto& failure : failures) LOGE("{}", failure);
+
+      times.clear();
+      silent_times.clear();
+      sound_times.clear();
+      xruns = 0;
+      subnormals = 0;
+      return failures.empty();
+    }
+
+  } // namespace
+
+  bool run(const Options& options)
+  {
+    return Runner(options).run();
+  }
+
+} // namespace otto::soak
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "core/audio/midi.hpp"
+#include "core/audio/processor.hpp"
+#include "services/audio_manager.hpp"
+
+/// Headless soak and stress testing
+///
+/// `otto_soak` runs the engines through the default engine manager without
+/// a sound card, for as long as it is told to. It plays them from a
+/// seeded MIDI generator, and switches engines, applies presets and sweeps
+/// parameters at random, so every run with the same seed does the same
+/// thing. It measures every block, reports once per window, and fails
+/// when a measurement goes over its limit. See @ref Options.
+///
+/// It also reports the note-on to sound latency of the generated notes, as
+/// `services/latency.hpp` measures it, with each block heard as soon as it is
+/// processed. It has no limit, as the swept envelopes change it.
+namespace otto::soak {
+
+  struct Options {
+    /// Audio time to run for, in seconds
+    double duration = 60;
+    std::uint32_t seed = 1;
+    int samplerate = 48000;
+    int buffer_size = 256;
+    /// Wait for each block's deadline, like an audio driver. Otherwise, run
+    /// as fast as possible.
+    bool realtime = false;
+    /// Seconds of audio between reports
+    double window = 10;
+    /// Seconds of audio between engine and preset changes
+    double switch_interval = 5;
+
+    /// Most time a block may take at the 99th percentile, as a fraction of
+    /// the time it plays for
+    double max_p99 = 0.7;
+    /// Most blocks that may take longer than they play for
+    int max_xruns = 0;
+    /// Most audio buffers that may be in use at once
+    ///
+    /// Must be less than the pool has, since running out of buffers
+    /// terminates. 0 for the most used in the first window, plus
+    /// @ref buffer_margin.
+    std::size_t max_buffers = 0;
+    /// Buffers more than in the first window that later windows may use, when
+    /// @ref max_buffers is 0
+    std::size_t buffer_margin = 1;
+    /// Most the resident memory may grow after the first window, in MiB
+    double max_rss_growth = 32;
+    /// Most a silent block may take, relative to one with sound, at the
+    /// median. Silent blocks are usually cheaper, so slow ones mean the
+    /// decaying tails are in denormals.
+    double max_silent_ratio = 1.5;
+
+    /// Parse the arguments
+    ///
+    /// \throws `util::exception` for unknown or malformed arguments
+    static Options parse(int argc, char* argv[]);
+    static std::string usage();
+  };
+
+  /// Notes and controller changes from a seeded random generator
+  ///
+  /// Plays a few bars of notes and chords, then rests for a while so the
+  /// engines decay to silence, and repeats.
+  struct MidiGenerator {
+    MidiGenerator(std::uint32_t seed, int samplerate);
+
+    /// The events of the next block
+    void generate(int nframes, core::midi::shared_vector<core::midi::AnyMidiEvent>& out);
+
+    /// Whether notes are being played, rather than resting
+    bool playing() const noexcept
+    {
+      return _playing;
+    }
+
+  private:
+    struct Held {
+      int key;
+      /// Frames left until the note off
+      std::int64_t left;
+    };
+
+    std::mt19937 _rng;
+    const int _samplerate;
+    bool _playing = false;
+    /// Frames left of playing or resting
+    std::int64_t _phase_left = 0;
+    std::int64_t _next_note = 0;
+    std::vector<Held> _held;
+  };
+
+  /// Runs blocks through the engine manager, like an audio driver would
+  struct SoakAudioManager final : services::AudioManager {
+    SoakAudioManager(int samplerate, int buffer_size);
+
+    struct Block {
+      /// Time spent in the engines, in seconds
+      double seconds = 0;
+      /// The highest absolute value of the output
+      float peak = 0;
+      /// Denormal samples in the output
+      int subnormals = 0;
+    };
+
+    /// Process one block of `nframes`, with the MIDI sent since the last one
+    Block process(int nframes);
+
+  private:
+    std::vector<float> _input;
+  };
+
+  /// Run the soak test
+  ///
+  /// \returns `true` if no limit was exceeded
+  bool run(const Options& options);
+
+} // namespace otto::soak